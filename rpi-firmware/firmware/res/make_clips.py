@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+# Synthesizes the speaker's built in clips into clips/ as 16 bit mono 48 kHz WAVs. tools/adpcm_pack then packs
+# everything in clips/ (these and any recorded ones) into incbin/clips.adpcm for the firmware:
+#   adpcm_pack res/incbin/clips.adpcm res/clips/*.wav
+# Rerun after editing; the output is checked in.
+import math, os, struct, wave
+
+RATE = 48_000
+OUT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "clips")
+
+def note(hz, ms, decay_ms, amp, partials=((1, 1.0),)):
+    n = RATE * ms // 1000
+    return [amp * math.exp(-i / (RATE * decay_ms / 1000))
+            * sum(a * math.sin(2 * math.pi * hz * k * i / RATE) for k, a in partials) for i in range(n)]
+
+def silence(ms):
+    return [0.0] * (RATE * ms // 1000)
+
+def faded(x, ms=4):
+    # Short linear fades at both ends so nothing clicks when a clip starts or is cut off
+    n = min(RATE * ms // 1000, len(x) // 2)
+    for i in range(n):
+        x[i] *= i / n
+        x[-1 - i] *= i / n
+    return x
+
+def overlay(a, b, at_ms):
+    at = RATE * at_ms // 1000
+    out = a + [0.0] * max(0, at + len(b) - len(a))
+    for i, v in enumerate(b): out[at + i] += v
+    return out
+
+bell = ((1, 1.0), (2, 0.3), (3, 0.1))
+clips = {
+    # Two rising bell notes (E5, B5)
+    "chime": overlay(note(659.26, 320, 90, 0.35, bell), note(987.77, 220, 80, 0.35, bell), 100),
+    # Three soft blips, for while the host is working
+    "thinking": sum((note(523.25, 60, 40, 0.25) + silence(80) for _ in range(3)), []),
+    # Two falling square-ish tones
+    "error": note(392.0, 110, 400, 0.3, ((1, 1.0), (3, 0.33), (5, 0.2))) + silence(20)
+             + note(261.63, 120, 400, 0.3, ((1, 1.0), (3, 0.33), (5, 0.2))),
+}
+
+os.makedirs(OUT, exist_ok=True)
+for name, x in clips.items():
+    x = faded(x)
+    data = b"".join(struct.pack("<h", max(-32768, min(32767, round(v * 32767)))) for v in x)
+    with wave.open(os.path.join(OUT, name + ".wav"), "wb") as f:
+        f.setnchannels(1)
+        f.setsampwidth(2)
+        f.setframerate(RATE)
+        f.writeframes(data)
+    print(f"{name}.wav: {len(x)} samples, {len(x) * 1000 // RATE} ms")
@@ -0,0 +1,186 @@
+#pragma once
+#include "common.hpp"
+
+// IMA-ADPCM: 4 bits a sample, a quarter the flash of 16 bit PCM. Used for the speaker's clips (see mixer.hpp).
+// Clips are cut into blocks that each start from a stored sample and step index, like a WAV's IMA blocks, so a bit
+// error can't carry past its block. Decoding is a few adds and shifts per sample and a block header costs about
+// the same, so playing a clip costs the same every millisecond, wherever its block boundaries fall.
+// The encoder is here too, for tools/adpcm_pack.cpp and the tests.
+namespace adpcm{
+    constexpr array<u16, 89> cSteps = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+        107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+        876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+        5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+        27086, 29794, 32767,
+    };
+    constexpr array<s8, 8> cIndexSteps = {-1, -1, -1, -1, 2, 4, 6, 8}; // By the code's magnitude bits
+
+    constexpr u32 cBlockBytes = 256;
+    constexpr u32 cBlockHeader = 4; // The first sample (s16), the step index, a spare byte
+    constexpr u32 cBlockFrames = 1 + (cBlockBytes - cBlockHeader) * 2; // 505. The header's sample, then 2 per byte.
+
+    struct State{
+        s32 predictor = 0;
+        u32 index = 0;
+
+        constexpr s16 decode(SelfMut, u8 code){
+            s32 step = cSteps[self.index];
+            s32 diff = step >> 3;
+            if(code & 4){ diff += step; }
+            if(code & 2){ diff += step >> 1; }
+            if(code & 1){ diff += step >> 2; }
+            self.predictor = clamp<s32>(INT16_MIN, self.predictor + (code & 8 ? -diff : diff), INT16_MAX);
+            self.index = (u32)clamp<s32>(0, (s32)self.index + cIndexSteps[code & 7], cSteps.size() - 1);
+            return (s16)self.predictor;
+        }
+
+        // The code that gets closest to `sample`. Decodes it too, so the state follows the decoder's exactly.
+        constexpr u8 encode(SelfMut, s16 sample){
+            s32 step = cSteps[self.index];
+            s32 diff = sample - self.predictor;
+            u8 code = diff < 0 ? 8 : 0;
+            diff = std::abs(diff);
+            for(u8 bit = 4; bit; bit >>= 1){
+                if(diff >= step){
+                    code |= bit;
+                    diff -= step;
+                }
+                step >>= 1;
+            }
+            self.decode(code);
+            return code;
+        }
+    };
+
+    // Whole clips
+    // -------------------
+    constexpr size_t encoded_size(size_t frames){
+        size_t whole = frames / cBlockFrames, rest = frames % cBlockFrames;
+        return whole * cBlockBytes + (rest ? cBlockHeader + rest / 2 : 0);
+    }
+
+    // Encodes one block, starting from step `index`. Returns the squared error.
+    inline u64 encode_block(span<const s16> block, u32 index, vec<u8>& out){
+        State st = {.predictor = block[0], .index = index};
+        out.insert(out.end(), {(u8)block[0], (u8)((u16)block[0] >> 8), (u8)index, 0});
+        u64 err = 0;
+        auto code = [&](s16 x){
+            u8 c = st.encode(x);
+            err += (u64)((s64)x - st.predictor) * (u64)((s64)x - st.predictor);
+            return c;
+        };
+        for(size_t i = 1; i < block.size(); i += 2){
+            u8 lo = code(block[i]);
+            u8 hi = i + 1 < block.size() ? code(block[i + 1]) : 0;
+            out.push_back(lo | hi << 4);
+        }
+        return err;
+    }
+
+    // Encodes `pcm` into blocks, the last one cut short. Codes go low nibble first.
+    // Each block starts from whichever step size suits it best, so a loud start doesn't take a block to ramp up to.
+    inline vec<u8> encode(span<const s16> pcm){
+        vec<u8> out, trial;
+        out.reserve(encoded_size(pcm.size()));
+        for(size_t at = 0; at < pcm.size(); at += cBlockFrames){
+            auto block = pcm.subspan(at, std::min<size_t>(cBlockFrames, pcm.size() - at));
+            u32 best = 0;
+            u64 bestErr = UINT64_MAX;
+            for(u32 index = 0; index < cSteps.size(); index++){
+                trial.clear();
+                if(u64 err = encode_block(block, index, trial); err < bestErr){
+                    bestErr = err;
+                    best = index;
+                }
+            }
+            encode_block(block, best, out);
+        }
+        return out;
+    }
+
+    // Plays a clip's blocks a sample at a time, straight from where they are (flash, for the firmware's).
+    struct Reader{
+        u8 const* at = nullptr;
+        u32 inBlock = 0; // Samples to go in this block. 0: the next is a header.
+        State st;
+
+        static constexpr Reader make(u8 const* blocks){ return {.at = blocks}; }
+
+        constexpr s16 next(SelfMut){
+            if(self.inBlock == 0){
+                self.st.predictor = (s16)(self.at[0] | self.at[1] << 8);
+                self.st.index = std::min<u32>(self.at[2], cSteps.size() - 1);
+                self.at += cBlockHeader;
+                self.inBlock = cBlockFrames - 1;
+                return (s16)self.st.predictor;
+            }
+            bool high = self.inBlock % 2 == 1; // Low nibble first. The count starts even, so it's odd for the high one.
+            u8 code = high ? *self.at++ >> 4 : *self.at & 0xf;
+            self.inBlock -= 1;
+            return self.st.decode(code);
+        }
+    };
+
+    // Packs: many clips in one blob, found by name. Made by tools/adpcm_pack.cpp.
+    // A header, the index, then each clip's blocks. Little endian, as both the RP2040 and the PC are.
+    // -------------------
+    constexpr u32 cPackMagic = 0x4B50'4441; // "ADPK"
+    constexpr u32 cRate = 48'000; // Every clip in a pack
+    constexpr u16 cPackVersion = 1;
+    struct PackHeader{
+        u32 magic;
+        u16 version;
+        u16 count;
+    };
+    struct PackEntry{
+        array<char, 20> name; // Null padded
+        u32 offset;           // Of the blocks, from the start of the pack
+        u32 frames;
+
+        constexpr sv label(SelfRef){ return sv{self.name.data(), (size_t)(std::ranges::find(self.name, '\0') - self.name.begin())}; }
+    };
+    static_assert(sizeof(PackHeader) == 8 && sizeof(PackEntry) == 28);
+
+    struct Pack{
+        span<const u8> bytes; // 4 byte aligned
+
+        bool valid(SelfRef){
+            if(self.bytes.size() < sizeof(PackHeader)){ return false; }
+            auto& h = *(PackHeader const*)self.bytes.data();
+            if(h.magic != cPackMagic || h.version != cPackVersion){ return false; }
+            if(self.bytes.size() < sizeof(PackHeader) + h.count * sizeof(PackEntry)){ return false; }
+            return std::ranges::all_of(self.entries(), [&](PackEntry ref e){
+                return e.offset <= self.bytes.size() && encoded_size(e.frames) <= self.bytes.size() - e.offset;
+            });
+        }
+        u16 count(SelfRef){ return self.valid() ? ((PackHeader const*)self.bytes.data())->count : 0; }
+        span<const PackEntry> entries(SelfRef){
+            auto& h = *(PackHeader const*)self.bytes.data();
+            return {(PackEntry const*)(self.bytes.data() + sizeof(PackHeader)), h.count};
+        }
+        opt<u16> find(SelfRef, sv name){
+            auto all = self.entries().first(self.count());
+            auto it = std::ranges::find(all, name, &PackEntry::label);
+            return it == all.end() ? opt<u16>{} : (u16)(it - all.begin());
+        }
+        Reader reader(SelfRef, u16 i){ return Reader::make(self.bytes.data() + self.entries()[i].offset); }
+    };
+
+    // Builds a pack. `clips` are {name, samples at cRate}.
+    inline vec<u8> pack(span<const std::pair<string, vec<s16>>> clips){
+        vec<u8> out(sizeof(PackHeader) + clips.size() * sizeof(PackEntry));
+        PackHeader h = {.magic = cPackMagic, .version = cPackVersion, .count = (u16)clips.size()};
+        std::copy_n((u8 const*)&h, sizeof(h), out.begin());
+        for(size_t i = 0; i < clips.size(); i++){
+            auto& [name, pcm] = clips[i];
+            PackEntry e = {.name = {}, .offset = (u32)out.size(), .frames = (u32)pcm.size()};
+            std::copy_n(name.begin(), std::min(name.size(), e.name.size() - 1), e.name.begin());
+            std::copy_n((u8 const*)&e, sizeof(e), out.begin() + sizeof(PackHeader) + i * sizeof(PackEntry));
+            auto blocks = encode(pcm);
+            out.insert(out.end(), blocks.begin(), blocks.end());
+            out.resize((out.size() + 3) & ~3); // Keeps the next clip's headers aligned
+        }
+        return out;
+    }
+}
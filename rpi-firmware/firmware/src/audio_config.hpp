@@ -0,0 +1,45 @@
+#pragma once
+#include "common.hpp"
+#include <bit>
+
+// Build time audio buffering: latency vs. robustness.
+// Each can be overridden with a compile definition. CMake passes them through from cache variables of the
+// same name, e.g. `cmake -DAUDIO_BLOCK_US=2000`. The `stats` console command shows how a setting behaves.
+#ifndef AUDIO_BLOCK_US
+#define AUDIO_BLOCK_US 1000 // Length of each DMA block, speaker and mic
+#endif
+#ifndef AUDIO_SPK_RING_SAMPLES
+#define AUDIO_SPK_RING_SAMPLES 512 // USB -> DAC ring. Power of two.
+#endif
+#ifndef AUDIO_SPK_DMA_BLOCKS
+#define AUDIO_SPK_DMA_BLOCKS 4 // DAC DMA blocks queued ahead of the one playing, plus it. Power of two, 2-8.
+#endif
+#ifndef AUDIO_MIC_QUEUE_BLOCKS
+#define AUDIO_MIC_QUEUE_BLOCKS 8 // ADC -> USB block queue. Power of two.
+#endif
+#ifndef AUDIO_MIC_PREROLL_MS
+#define AUDIO_MIC_PREROLL_MS 500 // Mic history sent ahead of a push-to-talk press (2 bytes per sample at 48k)
+#endif
+#ifndef CLIP_CACHE_KB
+#define CLIP_CACHE_KB 1020 // Flash at the top of the chip for clips the host uploads (24 KB a second of audio)
+#endif
+
+namespace audio::cfg{
+    constexpr u32 cBlockUs = AUDIO_BLOCK_US;
+    constexpr u32 cSpeakerRingSamples = AUDIO_SPK_RING_SAMPLES;
+    constexpr u32 cSpeakerDMABlocks = AUDIO_SPK_DMA_BLOCKS;
+    constexpr u32 cMicQueueBlocks = AUDIO_MIC_QUEUE_BLOCKS;
+    constexpr u32 cMicPreRollMs = AUDIO_MIC_PREROLL_MS;
+    constexpr u32 cClipCacheBytes = CLIP_CACHE_KB * 1024;
+
+    // Frames in one DMA block at `rate`.
+    constexpr size_t block_frames(u32 rate){ return (u64)rate * cBlockUs / 1'000'000; }
+    // Microseconds it takes to play/record `frames` at `rate`.
+    constexpr u32 frames_to_us(u32 frames, u32 rate){ return (u64)frames * 1'000'000 / rate; }
+
+    static_assert((u64)48'000 * cBlockUs % 1'000'000 == 0, "Blocks must hold a whole number of frames");
+    static_assert(cSpeakerDMABlocks >= 2 && cSpeakerDMABlocks <= 8 && std::has_single_bit(cSpeakerDMABlocks), "The speaker DMA cycles through 2, 4 or 8 blocks");
+    static_assert(cMicPreRollMs * 1000 >= cBlockUs, "The pre-roll needs at least a block");
+    static_assert(cClipCacheBytes % 4096 == 0 && cClipCacheBytes / 4096 < 256, "The clip cache is whole flash sectors, under 1MB");
+    static_assert(cSpeakerRingSamples >= 4 * block_frames(48'000), "The speaker ring needs room for the host's jitter on top of a block either side of the target fill");
+}
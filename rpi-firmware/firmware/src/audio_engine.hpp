@@ -0,0 +1,48 @@
+#pragma once
+#include "common.hpp"
+#include "console.hpp"
+#include "dev/i2s_dac.hpp"
+#include "dev/mic_adc.hpp"
+#include "pico/multicore.h"
+#include "pico/flash.h"
+#include "hardware/sync.h"
+
+// The audio engine runs entirely on core1.
+// Core1 owns both DMA IRQs (0: speaker, 1: mic), so sample conversion, volume and the mic DC removal never queue
+// behind USB or console work on core0. Everything shared between the cores is lock-free:
+// - dev::dac::gAudioRecvBuffer: USB (core0) -> speaker (core1)
+// - dev::mic::gAudioSendBuffer: mic (core1) -> USB (core0)
+// - volumeFactor: one atomic word, written by the USB control handlers
+// - mixer::gMixer.commands: clips and tones asked for by the console (core0) -> speaker (core1)
+// The SIO FIFO is only used for the start-up handshake, and after that by flash_safe_execute to park core1 while
+// core0 writes flash (see dev/clip_cache.hpp).
+namespace audio{
+    enum class CoreMsg: u32{
+        Ready = 0xA0D1'0001,
+    };
+
+    // Brings up and starts the audio devices. Their IRQs get enabled on (and so serviced by) the calling core.
+    inline void init_on_this_core(){
+        profile::init_this_core();
+        dev::dac::init();
+        dev::mic::init();
+        dev::dac::start();
+        dev::mic::start();
+        flash_safe_execute_core_init(); // Lets core0 pause this core to write flash
+    }
+
+    inline void core1_main(){
+        init_on_this_core();
+        multicore_fifo_push_blocking((u32)CoreMsg::Ready);
+        while(true){ __wfi(); } // All the work happens in the DMA IRQs
+    }
+
+    // Starts the engine on core1 and waits for it to be running.
+    inline void launch(){
+        multicore_launch_core1(core1_main);
+        auto msg = multicore_fifo_pop_blocking();
+        if(msg != (u32)CoreMsg::Ready){
+            console::println(FMT("Audio core failed to start (%08x)"), (unsigned)msg);
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "common.hpp"
+#include <atomic>
+#include <pico/time.h>
+
+// Runtime audio telemetry, read out by the `stats` console command.
+// Written from one context (an audio IRQ or the USB task) and read/reset from the console. Everything is a
+// relaxed atomic: a reset racing an update may lose that one update, which is fine for telemetry.
+namespace audio::stats{
+    // Lowest/highest level (e.g. a ring's fill) seen since the last reset.
+    struct FillRange{
+        std::atomic<u32> min = UINT32_MAX;
+        std::atomic<u32> max = 0;
+
+        void note(SelfMut, u32 fill){ // Single writer, so no CAS needed
+            if(fill < self.min.load(std::memory_order_relaxed)){ self.min.store(fill, std::memory_order_relaxed); }
+            if(fill > self.max.load(std::memory_order_relaxed)){ self.max.store(fill, std::memory_order_relaxed); }
+        }
+        void reset(SelfMut){
+            self.min = UINT32_MAX;
+            self.max = 0;
+        }
+    };
+
+    // Histogram of how long an IRQ took to service, in 1us buckets. The last bucket collects everything longer.
+    struct ServiceTimes{
+        static constexpr u32 cBuckets = 64;
+        array<std::atomic<u32>, cBuckets> counts = {};
+        std::atomic<u32> worst = 0;
+
+        void note(SelfMut, u32 us){
+            auto& c = self.counts[std::min(us, cBuckets - 1)];
+            c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if(us > self.worst.load(std::memory_order_relaxed)){ self.worst.store(us, std::memory_order_relaxed); }
+        }
+        u32 total(SelfRef){
+            u32 n = 0;
+            for(auto& c: self.counts){ n += c.load(std::memory_order_relaxed); }
+            return n;
+        }
+        // The bucket (whole us) that the call at the `pct` percentile landed in.
+        u32 percentile(SelfRef, u32 pct){
+            u32 want = ((u64)self.total() * pct + 99) / 100;
+            u32 seen = 0;
+            for(u32 i = 0; i < cBuckets; i++){
+                seen += self.counts[i].load(std::memory_order_relaxed);
+                if(seen >= want && seen > 0){ return i; }
+            }
+            return 0;
+        }
+        void reset(SelfMut){
+            for(auto& c: self.counts){ c = 0; }
+            self.worst = 0;
+        }
+    };
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "common.hpp"
+
+// Consistent Overhead Byte Stuffing: re-codes a packet so it has no zero bytes, at a cost of one byte per 254, so a
+// zero can mark where one packet ends and the next begins. A corrupted or cut short packet costs only itself: the
+// reader picks up again at the next zero.
+// Plus the CRC-16 (CCITT-FALSE) that goes inside it. Shared with the host tools.
+namespace cobs{
+    // The most `encode` writes for `n` bytes.
+    constexpr size_t max_encoded(size_t n){ return n + n / 254 + 1; }
+
+    // Writes `in` to `out` with no zeros in it (and no terminator). Returns how many bytes that took.
+    constexpr size_t encode(span<const u8> in, span<u8> out){
+        size_t code = 0, w = 1; // Where the current run's length goes, and the next byte
+        u8 run = 1;
+        for(size_t i = 0; i < in.size(); i++){
+            u8 b = in[i];
+            if(b != 0){
+                out[w++] = b;
+                run += 1;
+            }
+            if(b == 0 || run == 0xff){
+                out[code] = run;
+                run = 1;
+                if(b != 0 && i + 1 == in.size()){ return w; } // A full run at the very end needs no empty one after
+                code = w++;
+            }
+        }
+        out[code] = run;
+        return w;
+    }
+
+    // Undoes `encode`. `out` may be `in`. Returns the decoded size, or nothing if `in` wasn't COBS.
+    constexpr opt<size_t> decode(span<const u8> in, span<u8> out){
+        size_t r = 0, w = 0;
+        while(r < in.size()){
+            u8 run = in[r++];
+            if(run == 0 || r + run - 1 > in.size()){ return {}; }
+            for(u8 i = 1; i < run; i++){ out[w++] = in[r++]; }
+            if(run != 0xff && r < in.size()){ out[w++] = 0; }
+        }
+        return w;
+    }
+
+    constexpr auto cCrcTable = []{
+        array<u16, 256> t;
+        for(u32 i = 0; i < t.size(); i++){
+            u16 c = (u16)(i << 8);
+            for(u32 b = 0; b < 8; b++){ c = (u16)(c & 0x8000 ? (c << 1) ^ 0x1021 : c << 1); }
+            t[i] = c;
+        }
+        return t;
+    }();
+    constexpr u16 crc16(span<const u8> bytes, u16 crc = 0xffff){
+        for(u8 b: bytes){ crc = (u16)(crc << 8) ^ cCrcTable[(crc >> 8) ^ b]; }
+        return crc;
+    }
+    static_assert(crc16(std::to_array<u8>({'1', '2', '3', '4', '5', '6', '7', '8', '9'})) == 0x29b1);
+}
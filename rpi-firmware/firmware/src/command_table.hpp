@@ -0,0 +1,149 @@
+#pragma once
+#include "common.hpp"
+#include <bit>
+#include <charconv>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <magic_enum/magic_enum.hpp>
+
+// Console commands as a table built at compile time. Each has a name (one word, or two like "stats reset"), how help
+// shows its arguments, its help line, and a handler whose parameters say what the arguments are. They're parsed
+// straight out of the line into those types, without allocating: numbers, words (sv), enums by name (via
+// magic_enum), and opt<T> for trailing ones that can be left off. A handler returning bool can reject what it got.
+// The names go in a perfect hash found at compile time, so a line finds its command in one probe, two for a line
+// that could start with a two word name.
+namespace cmd{
+    // The next space separated word of `in`, taken off it. Empty at the end.
+    constexpr sv word(sv& in){
+        size_t start = std::min(in.find_first_not_of(' '), in.size());
+        size_t end = std::min(in.find(' ', start), in.size());
+        sv w = in.substr(start, end - start);
+        in.remove_prefix(end);
+        return w;
+    }
+
+    template<typename T> constexpr bool cIsOpt = false;
+    template<typename T> constexpr bool cIsOpt<opt<T>> = true;
+
+    // One argument off the front of `in`. Nothing if it isn't a T (or isn't there).
+    template<typename T> constexpr opt<T> parse(sv& in){
+        if constexpr(cIsOpt<T>){
+            sv peek = in;
+            if(word(peek).empty()){ return T{}; } // Left off
+            auto v = parse<typename T::value_type>(in);
+            return v ? opt<T>{T{*v}} : opt<T>{};
+        }else{
+            sv w = word(in);
+            if(w.empty()){ return {}; }
+            if constexpr(std::is_same_v<T, sv>){
+                return w;
+            }else if constexpr(std::is_enum_v<T>){
+                return magic_enum::enum_cast<T>(w);
+            }else{
+                static_assert(std::is_arithmetic_v<T>, "Arguments are numbers, words, enums or opt of those");
+                T v;
+                auto res = std::from_chars(w.data(), w.data() + w.size(), v);
+                if(res.ec != std::errc() || res.ptr != w.data() + w.size()){ return {}; }
+                return v;
+            }
+        }
+    }
+
+    template<typename F> struct Params;
+    template<typename R, typename... P> struct Params<R (*)(P...)>{ using Values = std::tuple<std::remove_cvref_t<P>...>; };
+
+    // Runs a command on the rest of its line. False if the arguments were wrong.
+    using Handler = bool (*)(sv args);
+    template<auto cFn> bool invoke(sv args){
+        typename Params<decltype(cFn)>::Values values;
+        bool parsed = std::apply([&](auto&... v){
+            return (... && [&](auto& into){
+                auto p = parse<std::remove_cvref_t<decltype(into)>>(args);
+                if(p){ into = *p; }
+                return p.has_value();
+            }(v));
+        }, values);
+        if(!parsed || !word(args).empty()){ return false; } // Missing, wrong, or too many
+        if constexpr(std::is_same_v<decltype(std::apply(cFn, values)), bool>){
+            return std::apply(cFn, values);
+        }else{
+            std::apply(cFn, values);
+            return true;
+        }
+    }
+
+    struct Command{
+        sv name;
+        sv args; // As help shows them: "<hz> <ms>"
+        sv help;
+        Handler run;
+    };
+    template<auto cFn> constexpr Command command(sv name, sv args, sv help){
+        return {.name = name, .args = args, .help = help, .run = &invoke<cFn>};
+    }
+
+    // FNV-1a. `more` carries on from a hash of what comes before.
+    constexpr u32 more(u32 h, sv s){
+        for(char c: s){ h = (h ^ (u8)c) * 16777619u; }
+        return h;
+    }
+    constexpr u32 hash(sv s, u32 seed){ return more(2166136261u ^ seed, s); }
+
+    template<size_t N>
+    struct Table{
+        static_assert(N < 0xff);
+        static constexpr u32 cSlots = std::bit_ceil(2 * N);
+        static constexpr u32 cShift = 32 - std::countr_zero(cSlots); // The hash's top bits: its low ones only see the names' low bits
+        array<Command, N> commands; // In the order help lists them
+        u32 seed = 0;
+        array<u8, cSlots> slots = {}; // Index in `commands` + 1, 0 for none
+
+        // Tries seeds until every name gets a slot of its own. Fails to compile if two names are the same.
+        consteval Table(array<Command, N> const& c): commands(c){
+            for(; seed < 10'000; seed++){
+                slots = {};
+                bool clash = false;
+                for(u32 i = 0; i < N && !clash; i++){
+                    auto& slot = slots[hash(c[i].name, seed) >> cShift];
+                    clash = slot != 0;
+                    slot = (u8)(i + 1);
+                }
+                if(!clash){ return; }
+            }
+            throw "No perfect hash for the command names. Is one there twice?";
+        }
+
+        constexpr Command const* find(sv name) const{
+            u8 i = slots[hash(name, seed) >> cShift];
+            return i != 0 && commands[i - 1].name == name ? &commands[i - 1] : nullptr;
+        }
+        // The two word name "first second", however far apart the line had them.
+        constexpr Command const* find(sv first, sv second) const{
+            u8 i = slots[more(more(hash(first, seed), " "), second) >> cShift];
+            if(i == 0){ return nullptr; }
+            sv name = commands[i - 1].name;
+            bool same = name.size() == first.size() + 1 + second.size() && name.starts_with(first) &&
+                name[first.size()] == ' ' && name.ends_with(second);
+            return same ? &commands[i - 1] : nullptr;
+        }
+    };
+
+    enum class Result: u8{ Ok, Unknown, BadArgs };
+    struct Dispatched{
+        Result result;
+        Command const* command; // Unless Unknown
+    };
+
+    // Finds the line's command, two word names first, and runs it on the rest of the line.
+    template<size_t N> inline Dispatched dispatch(Table<N> ref table, sv line){
+        sv rest = line;
+        sv first = word(rest);
+        sv afterFirst = rest;
+        if(sv second = word(rest); !second.empty()){
+            if(auto c = table.find(first, second)){ return {c->run(rest) ? Result::Ok : Result::BadArgs, c}; }
+        }
+        if(auto c = table.find(first)){ return {c->run(afterFirst) ? Result::Ok : Result::BadArgs, c}; }
+        return {Result::Unknown, nullptr};
+    }
+}
@@ -66,7 +66,7 @@ struct DeferHandle{
     constexpr ~DeferHandle() noexcept { func(); }
 };
 struct DeferBuilder{
-    consteval auto operator->*(auto&& function){ return DeferHandle{std::move(function)}; }
+    constexpr auto operator->*(auto&& function){ return DeferHandle{std::move(function)}; } // Not consteval: the lambda captures runtime locals
 };
 #define defer_block DeferBuilder{} ->* [&]noexcept  // Syntax abuse to remove the user needing to write the capture notation
 #define defer auto ANONYMOUS_VARIABLE = defer_block
@@ -4,75 +4,288 @@
 #include <charconv>
 #include <system_error>
 #include "dev/servo_pwm.hpp"
+#include "dev/i2s_protocol.hpp"
+#include "dev/mic_adc.hpp"
+#include "profile.hpp"
+#include "mixer.hpp"
+#include "dev/clip_cache.hpp"
+#include "ctl.hpp"
+#include "log_ring.hpp"
+#include "command_table.hpp"
 
 namespace console{
     inline bool gPrintDebugInfo = false;
 
-    template<size_t N>
-    constexpr auto print(StringLitC<N> fmt, auto ref... params){
-        auto ptr = &fmt[0];
-        printf(fmt, params...);
+    // Output goes through the log ring (see log_ring.hpp): cheap enough for callbacks and IRQs, and sent from the
+    // main loop. So string arguments must outlive the call. Formats are given as FMT("..."), so they can be interned.
+    constexpr auto print(logring::Fmt fmt, auto ref... params){
+        logring::write<false>(fmt, params...);
     }
 
-    template<size_t N> constexpr auto println(StringLitC<N> fmt, auto ref... params){
-        printf(fmt, params...);
-        printf("\n");
+    constexpr auto println(logring::Fmt fmt, auto ref... params){
+        logring::write<true>(fmt, params...);
     }
 
+    // Not templates, so their FMTs are interned (see FMT)
+    inline logring::Fmt dbg_prefix(){ return FMT("DBG: "); }
+    inline logring::Fmt dbg_end(){ return FMT("\n"); }
+
     constexpr auto dbg(auto ref... params){
         if(gPrintDebugInfo){
-            print("DBG: ");
+            print(dbg_prefix());
             print(params...);
         }
     }
     constexpr auto dbgln(auto ref... params){
         if(gPrintDebugInfo){
             dbg(params...);
-            printf("\n");
+            print(dbg_end());
         }
     }
 
-    // Process a console command.
-    inline void processline(sv str){
-        constexpr sv cmdServo = "servo";
-        if(str.starts_with("help")){
-            println(
-R"(>>> ECE Competition Control Panel ver.R1
+    // Speaker buffer health: how full the ring is, the rate we're asking the host for, and any glitches so far.
+    inline void print_audio_stats(){
+        using namespace dev::dac;
+        u32 fb = gAudioRecvFeedback.value;
+        println(FMT("Speaker: fill %u/%u, feedback %u.%04u samples/ms, overruns %u, underruns %u"),
+            (unsigned)gAudioRecvBuffer.length(), (unsigned)gAudioRecvBuffer.capacity(),
+            (unsigned)(fb >> 16), (unsigned)(((fb & 0xffff) * 10000) >> 16),
+            (unsigned)gAudioRecvBuffer.overruns.load(), (unsigned)gAudioRecvBuffer.underruns.load());
+        auto& mic = dev::mic::gAudioSendBuffer;
+        auto ms = [](u32 blocks){ return (unsigned)(blocks * audio::cfg::cBlockUs / 1000); };
+        println(FMT("Mic: ADC at %u Hz, queued %u/%u ms, overruns %u"), (unsigned)dev::mic::gADCRate, ms(mic.length()), ms(mic.capacity()), (unsigned)mic.overruns.load());
+        auto& pre = dev::mic::gPreRoll;
+        u32 rate = usbSampleRate.load(std::memory_order_relaxed);
+        println(FMT("Pre-roll: %u ms kept, %u ms behind live"), (unsigned)(pre.filled * 1000ull / rate), (unsigned)(pre.lag * 1000ull / rate));
+    }
+
+    inline void print_service_times(char const* name, audio::stats::ServiceTimes ref t){
+        println(FMT("%s IRQ: %u calls, p50 %uus, p90 %uus, p99 %uus, worst %uus"), name, (unsigned)t.total(),
+            (unsigned)t.percentile(50), (unsigned)t.percentile(90), (unsigned)t.percentile(99), (unsigned)t.worst.load());
+    }
+
+    // Everything from `print_audio_stats`, plus the min/max fills, IRQ timing and latency since the last `stats reset`.
+    // Latency is estimated from the buffering on the device: the ring/queue plus the DMA blocks in flight,
+    // and the 1ms USB frame on the mic side. The host's own buffering comes on top.
+    inline void print_stats(){
+        using namespace audio::cfg;
+        print_audio_stats();
+        println(FMT("Config: %uus blocks, speaker ring %u samples, speaker DMA %u blocks, mic queue %u blocks"), (unsigned)cBlockUs,
+            (unsigned)cSpeakerRingSamples, (unsigned)cSpeakerDMABlocks, (unsigned)cMicQueueBlocks);
+
+        using namespace dev;
+        u32 spkBlock = dac::I2SOutBufHalf{}.size();
+        u32 spkMin = dac::gAudioRecvFill.min, spkMax = dac::gAudioRecvFill.max;
+        if(spkMin <= spkMax){
+            println(FMT("Speaker: fill %u..%u, latency %u..%uus"), (unsigned)spkMin, (unsigned)spkMax,
+                (unsigned)frames_to_us(spkMin + (cSpeakerDMABlocks - 1) * spkBlock, dac::cI2SSampleRate),
+                (unsigned)frames_to_us(spkMax + cSpeakerDMABlocks * spkBlock, dac::cI2SSampleRate));
+        }
+        u32 micMin = mic::gAudioSendFill.min, micMax = mic::gAudioSendFill.max;
+        if(micMin <= micMax){
+            println(FMT("Mic: queued %u..%u blocks, latency %u..%uus"), (unsigned)micMin, (unsigned)micMax,
+                (unsigned)(micMin * cBlockUs + 1000), (unsigned)((micMax + 1) * cBlockUs + 1000));
+        }
+        print_service_times("Speaker", dac::gDMAServiceTime);
+        print_service_times("Mic", mic::gDMAServiceTime);
+    }
+    inline void reset_stats(){
+        using namespace dev;
+        dac::gAudioRecvFill.reset();
+        dac::gDMAServiceTime.reset();
+        mic::gAudioSendFill.reset();
+        mic::gDMAServiceTime.reset();
+    }
+
+    // The cycle counts from profile.hpp: one line per site, then its histogram (bit width of the count: calls).
+    inline void print_profile(){
+#if PROFILE_ENABLED
+        constexpr u32 cCyclesPerUs = sys::cClockRate / 1'000'000;
+        println(FMT("%-16s %8s %8s %8s %8s %8s"), "site", "calls", "min", "avg", "max", "avg us");
+        for(size_t i = 0; i < profile::gTable.size(); i++){
+            auto& e = profile::gTable[i];
+            u32 n = e.count, avg = e.avg16 / 16;
+            if(n == 0){
+                println(FMT("%-16s %8u"), profile::cSiteNames[i], 0u);
+                continue;
+            }
+            println(FMT("%-16s %8u %8u %8u %8u %8u"), profile::cSiteNames[i], (unsigned)n, (unsigned)e.min.load(), (unsigned)avg,
+                (unsigned)e.max.load(), (unsigned)(avg / cCyclesPerUs));
+            print(FMT("  cycles <2^n:"));
+            for(u32 b = 0; b < e.histogram.size(); b++){
+                if(u32 c = e.histogram[b]; c){ print(FMT(" %u:%u"), (unsigned)b, (unsigned)c); }
+            }
+            println(FMT(""));
+        }
+#else
+        println(FMT("Profiling is compiled out. Build with -DFIRMWARE_PROFILE=ON"));
+#endif
+    }
+    // Times the speaker fill's inner loop on the interpolators and in plain code (see dev/interp.hpp), over a block
+    // of whatever is in the speaker ring, starting just before it wraps.
+    inline void print_kernel_profile(){
+#if PROFILE_ENABLED
+        using namespace dev;
+        constexpr u32 cReps = 16;
+        auto& ring = dac::gAudioRecvBuffer.ring;
+        dac::I2SOutBufHalf out;
+        u32 from = ring.size() - out.size() / 2;
+        auto time = [&](auto kernel){ // Hundredths of a cycle per sample
+            u32 start = profile::now();
+            for(u32 r = 0; r < cReps; r++){
+                gain::Ramp::Stepper volume = {.acc = (u32)gain::cUnity << 16, .step = 0};
+                kernel(volume);
+            }
+            return ((start - profile::now()) & profile::cCounterMask) * 100 / (cReps * out.size());
+        };
+        u32 scalar = time([&](auto& v){ interp::scaled_from_ring_scalar(ring, from, v, span{out}); });
+        u32 interp = time([&](auto& v){ interp::scaled_from_ring(ring, from, v, span{out}); });
+        println(FMT("speaker fill: scalar %u.%02u, interp %u.%02u cycles/sample"), (unsigned)(scalar / 100), (unsigned)(scalar % 100),
+            (unsigned)(interp / 100), (unsigned)(interp % 100));
+#else
+        println(FMT("Profiling is compiled out. Build with -DFIRMWARE_PROFILE=ON"));
+#endif
+    }
+    inline void reset_profile(){
+#if PROFILE_ENABLED
+        for(auto& e: profile::gTable){ e.reset(); }
+#endif
+    }
+
+    // The mic's voice detector: where the level sits against the noise floor, and whether silence is muted.
+    inline void print_voice(){
+        auto& v = dev::mic::gVoice;
+        auto db = [](s32 log2){ return (int)VoiceDetector::to_db(log2); };
+        println(FMT("VAD: %s, level %d dB, floor %d dB, crossings %u/ms, mute %s"), v.speaking ? "speech" : "silence",
+            db(v.level), db(v.noise_floor()), (unsigned)(v.crossings / 16), dev::mic::gMuteSilence ? "on" : "off");
+    }
+
+    // Prints a message when the mic's voice detector changes its mind, like the button's. Also an event for ctl.
+    inline void report_voice_changes(){
+        static bool reported = false;
+        bool speaking = dev::mic::gVoice.speaking;
+        if(speaking && !reported){
+            println(FMT("VAD: speech start"));
+            ctl::event_speech(true);
+        }else if(!speaking && reported){
+            println(FMT("VAD: speech end"));
+            ctl::event_speech(false);
+        }
+        reported = speaking;
+    }
+
+    // The clips built into the firmware, and how long each is.
+    inline void print_clips(){
+        auto pack = mixer::clips();
+        for(u16 i = 0; i < pack.count(); i++){
+            auto& e = pack.entries()[i];
+            println(FMT("%2u %-20.*s %5u ms"), (unsigned)i, (int)e.label().size(), e.label().data(), (unsigned)(e.frames / (mixer::cRate / 1000)));
+        }
+    }
+
+    // `play <clip>`: by name or by number (as `clips` lists them). `play stop` silences everything.
+    inline void play(sv arg){
+        if(arg == "stop"){
+            mixer::stop();
+            return;
+        }
+        auto pack = mixer::clips();
+        auto id = pack.find(arg);
+        if(u16 n; !id && std::from_chars(arg.begin(), arg.end(), n).ec == std::errc() && n < pack.count()){ id = n; }
+        if(!id){
+            println(FMT("Unknown clip. `clips` lists them"));
+        }else if(!mixer::play(*id)){
+            println(FMT("Mixer busy"));
+        }
+    }
+
+    // The clips the host has uploaded, oldest played first, and the room left.
+    inline void print_cache(){
+        using namespace dev;
+        if(!cache::gReady){
+            println(FMT("Clip cache off: the firmware overlaps its flash (lower CLIP_CACHE_KB)"));
+            return;
+        }
+        vec<cache::Entry> all{cache::entries().begin(), cache::entries().end()};
+        std::ranges::sort(all, {}, &cache::Entry::used);
+        for(auto& e: all){
+            println(FMT("%016llx %6u ms %3u sectors"), (unsigned long long)e.key, (unsigned)(e.frames / (mixer::cRate / 1000)), (unsigned)e.sectors);
+        }
+        u32 free = cache::cSectors - cache::used_sectors();
+        println(FMT("%u clips, %u of %u KB free"), (unsigned)all.size(), (unsigned)(free * cache::cSectorBytes / 1024), (unsigned)(cache::cSectors * cache::cSectorBytes / 1024));
+    }
+
+    // `tone <hz> <ms>`
+    inline bool tone(u32 hz, u32 ms){
+        if(hz == 0 || hz >= mixer::cRate / 2 || ms == 0 || ms > 10'000){ return false; }
+        if(!mixer::tone(hz, ms)){ println(FMT("Mixer busy")); }
+        return true;
+    }
+
+    inline void servo(f32 degrees){
+        auto x = clamp(-90.f, degrees, 90.f);
+        if(x != degrees){ println(FMT("Clamped range")); }
+        dev::servo::set_rotation_angle(x);
+    }
+
+    enum class OnOff: u8{ off, on };
+    inline void debug(OnOff v){ gPrintDebugInfo = v == OnOff::on; }
+    inline void vad_mute(OnOff v){ dev::mic::gMuteSilence = v == OnOff::on; }
+    inline void are_you_the_pico(){ println(FMT("yes")); }
+
+    // The console's commands, in the order `help` lists them (see command_table.hpp).
+    inline void print_help();
+    inline constexpr cmd::Table cCommands{std::to_array<cmd::Command>({
+        cmd::command<&print_help>("help", "", "Displays this"),
+        cmd::command<&debug>("debug", "<off/on>", "Controls printing debug info to the console"),
+        cmd::command<&servo>("servo", "<angle>", "Adjust the servo angle, -90..=90 degrees. E.g.: `servo -15.2`"),
+        cmd::command<&print_audio_stats>("audio", "", "Prints the speaker/mic buffer fill, USB rate feedback and over/underrun counts"),
+        cmd::command<&print_stats>("stats", "", "`audio`, plus min/max fill, IRQ service time percentiles and latency since the last reset"),
+        cmd::command<&reset_stats>("stats reset", "", "Starts those over"),
+        cmd::command<&print_profile>("profile", "", "Cycle counts of the audio IRQs and USB paths (needs a -DFIRMWARE_PROFILE=ON build)"),
+        cmd::command<&reset_profile>("profile reset", "", "Starts those over"),
+        cmd::command<&print_kernel_profile>("profile kernels", "", "Cycles per sample of the speaker fill loop, on the interpolators vs in plain code (same build)"),
+        cmd::command<&print_clips>("clips", "", "Lists the clips built into the firmware"),
+        cmd::command<&play>("play", "<clip>", "Plays one of them over the speaker, by name or number. `play stop` stops all clips and tones"),
+        cmd::command<&tone>("tone", "<hz> <ms>", "Plays a sine tone over the speaker, 1..23999 Hz for 1..10000 ms. E.g.: `tone 1000 500`"),
+        cmd::command<&print_cache>("cache", "", "Lists the clips the host has cached in flash, and the space left"),
+        cmd::command<&print_voice>("vad", "", "Voice detector state: speech or not, and the mic level against the noise floor"),
+        cmd::command<&vad_mute>("vad mute", "<off/on>", "Sends the host silence instead of the mic while nobody is talking"),
+        cmd::command<&are_you_the_pico>("areyouthepico?", "", "Replies `yes`"),
+    })};
+
+    inline void print_help(){
+        println(FMT(R"(>>> ECE Competition Control Panel ver.R1
 Credits:
 - Leon, Michelle: Hardware leads.
 - Jonathan Goldsmith: Firmware all.
 - Oshan, Dave, Ibrahim: Software developers.
 - Dave: Marketing material
 
-Commands (submit a command by sending a '\n' newline):
-    help            : Displays this
-    debug <off/on>  : Controls printing debug info to the console
-    servo <angle>   : Adjust the servo angle. `angle: decimal` ranged -90..=90
-                      E.g.: `servo -15.2`
-    areyouthepico?  : Replies `yes`
-Messages the device will send:
+Commands (submit a command by sending a '\n' newline):)"));
+        for(auto& c: cCommands.commands){
+            int pad = std::max<int>(0, 15 - (int)c.name.size());
+            println(FMT("    %.*s %-*.*s: %.*s"), (int)c.name.size(), c.name.data(), pad, (int)c.args.size(), c.args.data(),
+                (int)c.help.size(), c.help.data());
+        }
+        println(FMT(R"(Messages the device will send:
     "Button 0: pressed" (or released)
+    "VAD: speech start" (or end)
     "DBG: debug message log"
-)");
-        }else if(str.starts_with(cmdServo)){
-            f32 r;
-            std::from_chars_result res = std::from_chars(str.begin() + cmdServo.size() + 1, str.end(), r);
-            auto ok = (res.ec == std::errc());
-            if(ok){
-                auto x = clamp(-90.f, r, 90.f);
-                if(x != r){ println("Clamped range"); }
-                dev::servo::set_rotation_angle(x);
-            }else{
-                println("Invalid argument to `servo`");
-            }
-        }else if(str == "debug off"){
-            gPrintDebugInfo = false;
-        }else if(str == "debug on"){
-            gPrintDebugInfo = true;
-        }else if(str == "areyouthepico?"){
-            println("yes");
-        }else{
-            println("Unrecognised command. Type `help` for more info.");
+Binary frames (starting with a zero byte) are the control protocol, see src/ctl_protocol.hpp.)"));
+    }
+
+    // Process a console command.
+    inline void processline(sv str){
+        auto [result, c] = cmd::dispatch(cCommands, str);
+        if(result == cmd::Result::Unknown){
+            println(FMT("Unrecognised command. Type `help` for more info."));
+        }else if(result == cmd::Result::BadArgs){
+            println(FMT("Invalid arguments. Usage: %.*s%s%.*s: %.*s"), (int)c->name.size(), c->name.data(), c->args.empty() ? "" : " ",
+                (int)c->args.size(), c->args.data(), (int)c->help.size(), c->help.data());
         }
     }
+
+    // Reads what the host has sent: lines are commands, binary frames go to ctl (see ctl.hpp).
+    inline void poll(){ ctl::poll(processline); }
 }
\ No newline at end of file
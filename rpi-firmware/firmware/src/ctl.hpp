@@ -0,0 +1,187 @@
+#pragma once
+#include "common.hpp"
+#include "ctl_protocol.hpp"
+#include "ring_queue.hpp"
+#include "log_ring.hpp"
+#include "mixer.hpp"
+#include "dev/servo_pwm.hpp"
+#include "dev/i2s_dac.hpp"
+#include "dev/mic_adc.hpp"
+#include "tusb.h"
+#include <cmath>
+
+// The device's end of the binary control protocol (see ctl_protocol.hpp), sharing the CDC port with the console.
+// Bytes from the host are split as they arrive: lines go to the console, frames are handled here. Replies queue in
+// gTx as whole frames, and `tick` only hands one to TinyUSB when all of it fits, so console text never lands inside one.
+// When gTx can't take the replies to another read, the rest is left in TinyUSB's FIFO, which holds the host off.
+// Only used from core0.
+namespace ctl{
+    static_assert(cMaxWire <= CFG_TUD_CDC_TX_BUFSIZE, "A frame goes into the CDC FIFO in one go");
+
+    struct Queued{
+        u8 size;
+        Wire bytes;
+    };
+    inline RingQueue<Queued, 32> gTx;
+    inline Parser<128> gRx;
+    inline u8 gEvents = 0;    // Events bits the host subscribed to
+    inline u32 gBadFrames = 0; // Corrupt or too long. Dropped without a reply: their seq can't be trusted.
+
+    constexpr u32 cReadBytes = 64;
+    constexpr u32 cMinWire = 1 + cobs::max_encoded(4) + 1; // A frame with no payload
+    constexpr u32 cMaxRepliesPerRead = cReadBytes / cMinWire;
+    static_assert(cMaxRepliesPerRead <= decltype(gTx)::capacity());
+
+    // Sending
+    // -------------------
+    inline bool send(Msg msg, u8 seq, span<const u8> payload){
+        if(gTx.space() == 0){ // The host isn't reading them
+            gTx.note_overrun();
+            return false;
+        }
+        Queued q;
+        q.size = (u8)pack(msg, seq, payload, q.bytes);
+        gTx.write_from(span{&q, 1});
+        return true;
+    }
+    inline bool send(Msg msg, u8 seq, auto ref payload){
+        static_assert(sizeof(payload) <= cMaxPayload);
+        return send(msg, seq, {(u8 const*)&payload, sizeof(payload)});
+    }
+    inline void ack(u8 seq, Status s){ send(Msg::Ack, seq, s); }
+
+    // Moves queued frames into the CDC FIFO. Call from the main loop.
+    inline void tick(){
+        while(!gTx.empty()){
+            auto& q = gTx.read_spans()[0][0];
+            if(tud_cdc_write_available() < q.size){ break; } // Whole frames only
+            tud_cdc_write(q.bytes.data(), q.size);
+            gTx.commit_read(1);
+        }
+        tud_cdc_write_flush();
+    }
+
+    // Events
+    // -------------------
+    inline void event_button(u8 id, bool pressed){
+        if(gEvents & cEventButton){ send(Msg::Button, 0, Button{.id = id, .pressed = pressed}); }
+    }
+    inline void event_speech(bool speaking){
+        if(gEvents & cEventSpeech){ send(Msg::Speech, 0, (u8)speaking); }
+    }
+
+    // Receiving
+    // -------------------
+    inline Audio audio_stats(){
+        using namespace dev::dac;
+        auto& mic = dev::mic::gAudioSendBuffer;
+        return {
+            .fill = (u16)gAudioRecvBuffer.length(), .capacity = (u16)gAudioRecvBuffer.capacity(),
+            .feedback = gAudioRecvFeedback.value,
+            .overruns = gAudioRecvBuffer.overruns.load(), .underruns = gAudioRecvBuffer.underruns.load(),
+            .micQueuedUs = mic.length() * audio::cfg::cBlockUs, .micOverruns = mic.overruns.load(),
+        };
+    }
+    inline Voice voice_state(){
+        auto& v = dev::mic::gVoice;
+        return {.speaking = v.speaking, .mute = dev::mic::gMuteSilence,
+                .levelDb = (s16)VoiceDetector::to_db(v.level), .floorDb = (s16)VoiceDetector::to_db(v.noise_floor())};
+    }
+
+    // Runs `fn` with the payload as a T, or replies BadLength.
+    template<typename T> inline void with_payload(Frame ref f, auto&& fn){
+        if(auto v = as<T>(f.payload)){
+            fn(*v);
+        }else{
+            ack(f.seq, Status::BadLength);
+        }
+    }
+    inline void without_payload(Frame ref f, auto&& fn){
+        if(f.payload.empty()){
+            fn();
+        }else{
+            ack(f.seq, Status::BadLength);
+        }
+    }
+
+    inline void handle(Frame ref f){
+        auto done = [&](bool ok){ ack(f.seq, ok ? Status::Ok : Status::Busy); };
+        switch(f.msg){
+            case Msg::Ping:
+                with_payload<Ping>(f, [&](Ping p){ send(Msg::Pong, f.seq, p); });
+                break;
+            case Msg::Servo:
+                with_payload<Servo>(f, [&](Servo s){
+                    if(!(std::abs(s.degrees) <= 90.f)){ return ack(f.seq, Status::BadArg); } // NaN too
+                    dev::servo::set_rotation_angle(s.degrees);
+                    ack(f.seq, Status::Ok);
+                });
+                break;
+            case Msg::Play:
+                with_payload<Play>(f, [&](Play p){
+                    if(p.clip >= mixer::clips().count()){ return ack(f.seq, Status::BadArg); }
+                    done(mixer::play(p.clip, p.gain ? p.gain : mixer::cDefaultGain));
+                });
+                break;
+            case Msg::Tone:
+                with_payload<Tone>(f, [&](Tone t){
+                    if(t.hz == 0 || t.hz >= mixer::cRate / 2 || t.ms == 0 || t.ms > 10'000){ return ack(f.seq, Status::BadArg); }
+                    done(mixer::tone(t.hz, t.ms, t.gain ? t.gain : mixer::cDefaultGain));
+                });
+                break;
+            case Msg::Stop:
+                without_payload(f, [&]{ done(mixer::stop()); });
+                break;
+            case Msg::VadMute:
+                with_payload<u8>(f, [&](u8 on){
+                    dev::mic::gMuteSilence = on;
+                    ack(f.seq, Status::Ok);
+                });
+                break;
+            case Msg::GetAudio:
+                without_payload(f, [&]{ send(Msg::Audio, f.seq, audio_stats()); });
+                break;
+            case Msg::GetVoice:
+                without_payload(f, [&]{ send(Msg::Voice, f.seq, voice_state()); });
+                break;
+            case Msg::Subscribe:
+                with_payload<u8>(f, [&](u8 events){
+                    gEvents = events;
+                    ack(f.seq, Status::Ok);
+                });
+                break;
+            default:
+                ack(f.seq, Status::UnknownMsg);
+                break;
+        }
+    }
+
+    inline void line_too_long(){ logring::write<true>(FMT("Message too long. Ignored")); } // Out of `poll`, a template, so it's interned
+
+    // Reads what the host has sent, handing each line to `on_line`. From tud_cdc_rx_cb, and the main loop for what
+    // was held back.
+    inline void poll(auto&& on_line){
+        using Event = decltype(gRx)::Event;
+        array<u8, cReadBytes> buf;
+        while(tud_cdc_connected() && gTx.space() >= cMaxRepliesPerRead){
+            u32 n = tud_cdc_read(buf.data(), buf.size());
+            if(n == 0){ break; }
+            for(u8 b: span{buf}.first(n)){
+                switch(gRx.push(b)){
+                    case Event::Line: on_line(gRx.text()); break;
+                    case Event::Frame: handle(gRx.decoded()); break;
+                    case Event::LineTooLong: line_too_long(); break;
+                    case Event::BadFrame: gBadFrames += 1; break;
+                    case Event::None: break;
+                }
+            }
+        }
+    }
+
+    // Forgets a half received line or frame and unsent replies. On unplugging.
+    inline void reset(){
+        gRx = {};
+        gTx.commit_read(gTx.length());
+        gEvents = 0;
+    }
+}
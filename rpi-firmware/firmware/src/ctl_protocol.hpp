@@ -0,0 +1,167 @@
+#pragma once
+#include "common.hpp"
+#include "cobs.hpp"
+#include <cstring>
+
+// The binary control protocol, spoken over the CDC serial port alongside the text console. Shared with the host
+// client (tools/ctl_client.hpp), so both ends agree on the layout.
+// A frame is a zero byte, then COBS (see cobs.hpp) of {Msg, seq, payload, CRC-16 of those, little endian}, then a
+// zero byte. Console text never has zeros in it, so a zero is how either end tells a frame from a line. Any number
+// of frames can go in one write, so a host can send many commands in one USB packet without waiting for replies.
+// Each request gets a reply with its seq: Ack, or the data asked for. Events (sent once subscribed) have seq 0.
+// Payloads are packed little endian structs, like everything else on the wire here.
+namespace ctl{
+    enum class Msg: u8{
+        // Requests
+        Ping = 0x01,      // Ping -> Pong
+        Servo = 0x10,     // Servo -> Ack
+        Play = 0x11,      // Play -> Ack
+        Tone = 0x12,      // Tone -> Ack
+        Stop = 0x13,      // -> Ack
+        VadMute = 0x14,   // u8 on -> Ack
+        GetAudio = 0x20,  // -> Audio
+        GetVoice = 0x21,  // -> Voice
+        Subscribe = 0x30, // u8 Events bits -> Ack
+        // Replies
+        Ack = 0x80,       // Status
+        Pong = 0x81,      // Ping
+        Audio = 0xa0,     // Audio
+        Voice = 0xa1,     // Voice
+        // Events
+        Button = 0xc0,    // Button
+        Speech = 0xc1,    // u8 speaking
+        Log = 0xc2,       // Part of a console message, from a LOG_INTERNED build (see log_ring.hpp). Always sent.
+                          // seq is how many more parts follow.
+    };
+    enum class Status: u8{ Ok, UnknownMsg, BadLength, BadArg, Busy };
+    enum Events: u8{ cEventButton = 1 << 0, cEventSpeech = 1 << 1 };
+
+    struct PACKED Ping{ u32 token; };
+    struct PACKED Servo{ f32 degrees; }; // -90..90
+    struct PACKED Play{ u16 clip; u16 gain; }; // Its place in the pack (see mixer.hpp). Gain is Q15, 0 for the default.
+    struct PACKED Tone{ u16 hz; u16 ms; u16 gain; };
+    struct PACKED Audio{
+        u16 fill;            // Speaker ring, samples
+        u16 capacity;
+        u32 feedback;        // 16.16 samples/ms
+        u32 overruns;
+        u32 underruns;
+        u32 micQueuedUs;
+        u32 micOverruns;
+    };
+    struct PACKED Voice{ u8 speaking; u8 mute; s16 levelDb; s16 floorDb; };
+    struct PACKED Button{ u8 id; u8 pressed; };
+
+    constexpr size_t cMaxPayload = 48;
+    constexpr size_t cMaxRaw = 2 + cMaxPayload + 2;
+    constexpr size_t cMaxEncoded = cobs::max_encoded(cMaxRaw);
+    constexpr size_t cMaxWire = 1 + cMaxEncoded + 1; // With its zeros. Fits the CDC endpoint's FIFO (64).
+    using Wire = array<u8, cMaxWire>;
+
+    // Frames one message into `out`. Returns its size on the wire.
+    constexpr size_t pack(Msg msg, u8 seq, span<const u8> payload, Wire& out){
+        array<u8, cMaxRaw> raw;
+        raw[0] = (u8)msg;
+        raw[1] = seq;
+        std::copy(payload.begin(), payload.end(), raw.begin() + 2);
+        size_t n = 2 + payload.size();
+        u16 crc = cobs::crc16(span{raw}.first(n));
+        raw[n++] = (u8)crc;
+        raw[n++] = (u8)(crc >> 8);
+        out[0] = 0;
+        size_t len = 1 + cobs::encode(span{raw}.first(n), span{out}.subspan(1));
+        out[len++] = 0;
+        return len;
+    }
+    inline size_t pack(Msg msg, u8 seq, auto ref payload, Wire& out){
+        static_assert(sizeof(payload) <= cMaxPayload);
+        return pack(msg, seq, {(u8 const*)&payload, sizeof(payload)}, out);
+    }
+
+    // Reads `payload` as a T, if it's the right size.
+    template<typename T> inline opt<T> as(span<const u8> payload){
+        if(payload.size() != sizeof(T)){ return {}; }
+        T v;
+        std::memcpy(&v, payload.data(), sizeof(T));
+        return v;
+    }
+
+    struct Frame{
+        Msg msg;
+        u8 seq;
+        span<const u8> payload;
+    };
+
+    // Splits a byte stream into console lines and frames, a byte at a time, for either end.
+    // A frame may come in the middle of a line: the line carries on after it.
+    template<size_t cLineMax>
+    struct Parser{
+        enum class Event: u8{ None, Line, Frame, LineTooLong, BadFrame };
+        enum class Mode: u8{ Line, SkipLine, Frame, SkipFrame };
+        Mode mode = Mode::Line;
+        Mode lineMode = Mode::Line; // To go back to after a frame
+        u32 lineFill = 0;
+        u32 frameFill = 0;
+        bool lineTaken = false;
+        array<char, cLineMax> line;
+        array<u8, cMaxEncoded> frame;
+
+        // What the last Line event was. Good until the next `push`. Without the newline.
+        sv text(SelfRef){ return {self.line.data(), self.lineFill}; }
+        // What the last Frame event was. Good until the next frame starts.
+        Frame decoded(SelfRef){
+            return {.msg = (Msg)self.frame[0], .seq = self.frame[1], .payload = span{self.frame}.subspan(2, self.frameFill - 4)};
+        }
+
+        constexpr Event push(SelfMut, u8 b){
+            if(self.lineTaken){
+                self.lineFill = 0;
+                self.lineTaken = false;
+            }
+            switch(self.mode){
+                case Mode::Line:
+                case Mode::SkipLine:
+                    if(b == 0){
+                        self.lineMode = self.mode;
+                        self.mode = Mode::Frame;
+                        self.frameFill = 0;
+                        return Event::None;
+                    }
+                    if(b == '\n'){
+                        bool skipped = self.mode == Mode::SkipLine;
+                        self.mode = Mode::Line;
+                        self.lineTaken = true;
+                        return skipped ? Event::None : Event::Line;
+                    }
+                    if(self.mode == Mode::SkipLine){ return Event::None; }
+                    if(self.lineFill == cLineMax){
+                        self.mode = Mode::SkipLine;
+                        return Event::LineTooLong;
+                    }
+                    self.line[self.lineFill++] = (char)b;
+                    return Event::None;
+                case Mode::Frame:
+                case Mode::SkipFrame:{
+                    if(b != 0){
+                        if(self.mode == Mode::SkipFrame){ return Event::None; }
+                        if(self.frameFill == self.frame.size()){
+                            self.mode = Mode::SkipFrame;
+                            return Event::BadFrame;
+                        }
+                        self.frame[self.frameFill++] = b;
+                        return Event::None;
+                    }
+                    bool skipped = self.mode == Mode::SkipFrame;
+                    self.mode = self.lineMode;
+                    if(skipped || self.frameFill == 0){ return Event::None; } // Nothing between the zeros
+                    auto n = cobs::decode(span{self.frame}.first(self.frameFill), span{self.frame});
+                    if(!n || *n < 4){ return Event::BadFrame; }
+                    self.frameFill = *n;
+                    u16 crc = (u16)(self.frame[*n - 2] | self.frame[*n - 1] << 8);
+                    return cobs::crc16(span{self.frame}.first(*n - 2)) == crc ? Event::Frame : Event::BadFrame;
+                }
+            }
+            return Event::None;
+        }
+    };
+}
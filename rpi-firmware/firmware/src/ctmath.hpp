@@ -0,0 +1,30 @@
+#pragma once
+#include "common.hpp"
+
+// Compile time maths for building tables (std::exp/sin aren't constexpr).
+// Plain Taylor series, exact to f64 precision over the small ranges the tables use. Not for runtime use.
+namespace ctmath{
+    constexpr f64 cPi = 3.14159265358979323846;
+
+    constexpr f64 exp(f64 x){
+        f64 sum = 1, term = 1;
+        for(u32 i = 1; i < 64; i++){
+            term *= x / i;
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr f64 sin(f64 x){
+        // Bring into [-pi, pi] first so the series converges quickly
+        while(x > cPi){ x -= 2 * cPi; }
+        while(x < -cPi){ x += 2 * cPi; }
+        f64 sum = x, term = x;
+        for(u32 i = 1; i < 24; i++){
+            term *= -x * x / ((2 * i) * (2 * i + 1));
+            sum += term;
+        }
+        return sum;
+    }
+    constexpr f64 cos(f64 x){ return sin(x + cPi / 2); }
+}
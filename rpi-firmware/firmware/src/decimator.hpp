@@ -0,0 +1,110 @@
+#pragma once
+#include "common.hpp"
+#include "ctmath.hpp"
+
+// Mic decimator for the native 16 kHz capture mode: raw ADC counts at 192 kHz in, signed 16 kHz samples out.
+// A 4th order CIC does the first 6x with adds only, then a 96 tap FIR does the last 2x. The FIR also flattens
+// the CIC's passband droop and cuts at 0.45 of the output rate, so nothing aliases below that.
+// Averaging 12 ADC samples into each output lowers the noise floor, so the output keeps 3 more bits than the
+// ADC gives: it comes out 8x (18 dB) hotter than the raw samples, which still fits 16 bits around the level shift.
+struct Decimator{
+    static constexpr u32 cInRate = 192'000;
+    static constexpr u32 cCicFactor = 6;
+    static constexpr u32 cCicOrder = 4;
+    static constexpr u32 cFirFactor = 2;
+    static constexpr u32 cTaps = 96;
+    static constexpr u32 cOutRate = cInRate / (cCicFactor * cFirFactor);
+    static constexpr u32 cExtraBits = 3;
+    static constexpr u32 cCicGain = cCicFactor * cCicFactor * cCicFactor * cCicFactor; // cCicFactor ^ cCicOrder
+    static constexpr u32 cCicShift = 7;   // Brings the CIC's output (x1296) back to 16 bits for the FIR
+    static constexpr u32 cCoeffBits = 14; // Q14
+
+    // The first half of the (symmetric) FIR, in Q14. Windowed-sinc designed by integrating the ideal response,
+    // lowpass with the inverse of the CIC's droop, and scaled so DC comes out at 2^cExtraBits.
+    static constexpr auto cFir = []{
+        constexpr f64 cRate = (f64)cInRate / cCicFactor; // The FIR's input rate
+        constexpr f64 cCutoff = 0.45 * cOutRate;
+        constexpr u32 cSteps = 256;
+        // The CIC's magnitude at `f`, 1 at DC
+        auto cic = [](f64 f){
+            f64 x = ctmath::cPi * f / cInRate;
+            f64 r = x == 0 ? 1.0 : ctmath::sin(x * cCicFactor) / (cCicFactor * ctmath::sin(x));
+            return r * r * r * r;
+        };
+        array<f64, cTaps / 2> h;
+        f64 sum = 0;
+        for(u32 n = 0; n < h.size(); n++){
+            f64 t = (n - (cTaps - 1) / 2.0) / cRate;
+            f64 acc = 0;
+            for(u32 k = 0; k < cSteps; k++){
+                f64 f = (k + 0.5) * cCutoff / cSteps;
+                acc += ctmath::cos(2 * ctmath::cPi * f * t) / cic(f);
+            }
+            f64 w = (f64)n / (cTaps - 1);
+            f64 blackman = 0.42 - 0.5 * ctmath::cos(2 * ctmath::cPi * w) + 0.08 * ctmath::cos(4 * ctmath::cPi * w);
+            h[n] = 2 * acc * cCutoff / cSteps / cRate * blackman;
+            sum += 2 * h[n];
+        }
+        constexpr f64 cGain = (f64)(1 << cExtraBits) * (1 << cCicShift) / cCicGain * (1 << cCoeffBits);
+        array<s16, cTaps / 2> q;
+        s32 total = 0;
+        for(u32 n = 0; n < q.size(); n++){
+            f64 v = h[n] / sum * cGain;
+            q[n] = (s16)(v < 0 ? v - 0.5 : v + 0.5);
+            total += 2 * q[n];
+        }
+        q.back() += ((s32)(cGain + 0.5) - total) / 2; // The centre pair takes the rounding, so DC is exact
+        return q;
+    }();
+
+    s32 dc = 0; // Subtracted from every input
+    array<u32, cCicOrder> integ = {}; // Wrapping arithmetic, as CICs want
+    array<u32, cCicOrder> comb = {};  // Each comb stage's previous input
+    u32 cicPhase = 0;
+    u32 firPhase = 0;
+    u32 head = 0;
+    array<s16, 2 * cTaps> hist = {}; // The FIR's window, stored twice so it's always contiguous (as in Resampler)
+
+    static constexpr Decimator make(u16 dc){
+        Decimator d;
+        d.dc = dc;
+        return d;
+    }
+
+    constexpr void push(SelfMut, s16 x){
+        self.hist[self.head] = x;
+        self.hist[self.head + cTaps] = x;
+        self.head = self.head + 1 == cTaps ? 0 : self.head + 1;
+    }
+
+    constexpr s16 filter(SelfRef){
+        auto x = &self.hist[self.head]; // Oldest first
+        s32 acc = 1 << (cCoeffBits - 1);
+        // Symmetric, so pairs of taps share a multiply
+        for(u32 i = 0; i < cTaps / 2; i++){ acc += ((s32)x[i] + x[cTaps - 1 - i]) * cFir[i]; }
+        return (s16)clamp<s32>(INT16_MIN, acc >> cCoeffBits, INT16_MAX);
+    }
+
+    // Consumes all of `in`, writing the outputs that become available into `out`. Returns the number written.
+    // Size `out` with `max_out(in.size())`.
+    constexpr size_t process(SelfMut, span<const u16> in, span<s16> out){
+        size_t n = 0;
+        for(auto x: in){
+            u32 v = (u32)((s32)x - self.dc);
+            for(auto& i: self.integ){ v = i += v; }
+            if(++self.cicPhase < cCicFactor){ continue; }
+            self.cicPhase = 0;
+            for(auto& c: self.comb){
+                u32 prev = c;
+                c = v;
+                v -= prev;
+            }
+            self.push((s16)clamp<s32>(INT16_MIN, ((s32)v + (1 << (cCicShift - 1))) >> cCicShift, INT16_MAX));
+            if(++self.firPhase < cFirFactor){ continue; }
+            self.firPhase = 0;
+            if(n < out.size()){ out[n++] = self.filter(); }
+        }
+        return n;
+    }
+    static constexpr size_t max_out(size_t in){ return in / (cCicFactor * cFirFactor) + 1; }
+};
@@ -0,0 +1,263 @@
+#pragma once
+#include "../common.hpp"
+#include "../audio_config.hpp"
+#include "../adpcm.hpp"
+#include "../mixer.hpp"
+#include "i2s_protocol.hpp"
+#include "hardware/flash.h"
+#include "pico/flash.h"
+#include "pico/platform.h"
+#include "pico/time.h"
+
+#if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+extern char __flash_binary_end; // From the linker script
+#endif
+
+// Clip cache: replies the host has already synthesized once, kept in flash so they play again without it.
+// The host uploads each as ADPCM blocks (see adpcm.hpp) under a 64 bit key of its choosing (a hash of the voice and
+// the text, say) over the vendor interface (see vendor.hpp), and after that asks for it by key. Clips play straight
+// out of flash (XIP) like the built in ones, so the cache takes no SRAM beyond its directory.
+// It lives in the top audio::cfg::cClipCacheBytes of flash. Each clip is a run of whole sectors: a header page, then
+// its blocks. The header is programmed last, so only finished uploads are found by the scan at boot.
+// When there's no room a clip goes where it evicts the least recently played (the run whose newest clip is oldest).
+// Play times are only kept in RAM, so after a reboot every clip counts as equally old.
+// Erasing or programming stalls core1 and XIP (about 45ms a sector, under a millisecond a page), so the speaker goes
+// quiet and the mic drops blocks while an upload is written. Upload while nothing's being said.
+// Only used from core0.
+namespace dev::cache{
+    constexpr u32 cSectorBytes = FLASH_SECTOR_SIZE;
+    constexpr u32 cPageBytes = FLASH_PAGE_SIZE;
+    constexpr u32 cSectors = audio::cfg::cClipCacheBytes / cSectorBytes;
+    constexpr u32 cStart = PICO_FLASH_SIZE_BYTES - audio::cfg::cClipCacheBytes; // Offset into flash
+    constexpr u32 cMagic = 0x4843'4C43; // "CLCH"
+    constexpr u32 cFlashTimeoutMs = 100; // For core1 to take the drop, and then to reach the lockout
+
+    struct Header{
+        u32 magic;
+        u32 frames;
+        u64 key;
+        u32 sectors;
+        u32 check;
+    };
+    constexpr u32 checksum(Header ref h){
+        return ~(h.magic + h.frames + (u32)h.key + (u32)(h.key >> 32) + h.sectors);
+    }
+
+    constexpr u32 sectors_for(u32 frames){
+        return (cPageBytes + adpcm::encoded_size(frames) + cSectorBytes - 1) / cSectorBytes;
+    }
+    constexpr u32 cMaxFrames = (cSectors * cSectorBytes - cPageBytes) / adpcm::cBlockBytes * adpcm::cBlockFrames;
+    static_assert(sectors_for(cMaxFrames) <= cSectors);
+
+    struct Entry{
+        u64 key;
+        u32 frames;
+        u16 first; // Sector
+        u16 sectors;
+        u32 used;  // gClock when last played or uploaded. 0 for ones found at boot.
+
+        uintptr_t at(SelfRef){ return XIP_BASE + cStart + self.first * cSectorBytes; }
+        u8 const* blocks(SelfRef){ return (u8 const*)(self.at() + cPageBytes); }
+        bool overlaps(SelfRef, u32 first, u32 sectors){ return self.first < first + sectors && first < self.first + self.sectors; }
+    };
+
+    inline array<Entry, cSectors> gEntries;
+    inline u32 gCount = 0;
+    inline u32 gClock = 0;
+    inline bool gReady = false; // False if the firmware has grown into the cache's flash
+
+    inline span<Entry> entries(){ return span{gEntries}.first(gCount); }
+    inline u32 used_sectors(){
+        u32 n = 0;
+        for(auto& e: entries()){ n += e.sectors; }
+        return n;
+    }
+    inline Entry* find(u64 key){
+        auto it = std::ranges::find(entries(), key, &Entry::key);
+        return it == entries().end() ? nullptr : &*it;
+    }
+
+    // Flash writes
+    // -------------------
+    struct FlashOp{
+        u32 offset;
+        u8 const* page; // Programs it, or erases the sector when null
+    };
+    // Runs with core1 parked and every IRQ off. The speaker blocks are silenced so the DMA loops nothing audible
+    // until core1 is back to refill them.
+    inline void flash_op_locked(void* param){
+        auto& op = *(FlashOp const*)param;
+        for(auto& block: dac::gI2SOutBufs){ block.fill(dac::I2SOutSample::from_mono(0)); }
+        if(op.page){
+            flash_range_program(op.offset, op.page, cPageBytes);
+        }else{
+            flash_range_erase(op.offset, cSectorBytes);
+        }
+    }
+    // First has core1 stop the voices about to read what's being rewritten, and waits until it has: it owns them.
+    inline bool flash_op(FlashOp op){
+        uintptr_t at = XIP_BASE + op.offset;
+        if(!mixer::drop(at, at + (op.page ? cPageBytes : cSectorBytes))){ return false; }
+        u64 until = time_us_64() + cFlashTimeoutMs * 1000;
+        while(!mixer::gMixer.commands.empty()){
+            if(time_us_64() >= until){ return false; }
+            tight_loop_contents();
+        }
+        return flash_safe_execute(flash_op_locked, &op, cFlashTimeoutMs) == PICO_OK;
+    }
+    inline bool erase_sector(u32 sector){ return flash_op({.offset = cStart + sector * cSectorBytes}); }
+
+    // Forgets entry `i`, erasing its header so the boot scan forgets it too. Kept if that fails: its header still is.
+    inline bool evict(u32 i){
+        if(!erase_sector(gEntries[i].first)){ return false; }
+        gEntries[i] = gEntries[--gCount];
+        return true;
+    }
+
+    // Looks for finished clips. Call once at boot, before any other use.
+    inline void init(){
+#if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+        if((uintptr_t)&__flash_binary_end - XIP_BASE > cStart){ return; } // Lower CLIP_CACHE_KB
+#endif
+        gCount = 0;
+        for(u32 s = 0; s < cSectors;){
+            auto& h = *(Header const*)(XIP_BASE + cStart + s * cSectorBytes);
+            if(h.magic != cMagic || h.check != checksum(h) || h.frames == 0 || h.sectors != sectors_for(h.frames) || s + h.sectors > cSectors){
+                s += 1;
+                continue;
+            }
+            gEntries[gCount++] = {.key = h.key, .frames = h.frames, .first = (u16)s, .sectors = (u16)h.sectors};
+            s += h.sectors;
+        }
+        gReady = true;
+    }
+
+    // Clip `key` over the speaker. False if it isn't cached (or the mixer's queue is full).
+    inline bool play(u64 key, gain::Q15 g = mixer::cDefaultGain){
+        auto e = find(key);
+        if(!e){ return false; }
+        e->used = ++gClock;
+        return mixer::play(e->blocks(), e->frames, g);
+    }
+
+    // Forgets `key`. False if it wasn't there.
+    inline bool drop(u64 key){
+        auto e = find(key);
+        return e && evict((u32)(e - gEntries.data()));
+    }
+    inline bool drop_all(){
+        bool ok = true;
+        for(u32 i = gCount; i-- > 0;){ ok &= evict(i); }
+        return ok;
+    }
+
+    // Where `sectors` more go: the run whose newest clip was played longest ago, counting free sectors as never
+    // played. Ties go to the run evicting fewest clips, then the lowest.
+    inline u32 place(u32 sectors){
+        u32 best = 0;
+        u64 bestCost = UINT64_MAX;
+        for(u32 s = 0; s + sectors <= cSectors; s++){
+            u32 newest = 0, hits = 0;
+            for(auto& e: entries()){
+                if(!e.overlaps(s, sectors)){ continue; }
+                newest = std::max(newest, e.used + 1);
+                hits += 1;
+            }
+            if(u64 cost = (u64)newest << 32 | hits; cost < bestCost){
+                bestCost = cost;
+                best = s;
+            }
+        }
+        return best;
+    }
+
+    // Uploads
+    // -------------------
+    // One at a time: `begin`, the blocks in pieces of any size through `write`, then `finish`. Another `begin` in
+    // between abandons it, which leaves nothing the boot scan would find: the clips it overlaps are evicted first.
+    struct Upload{
+        Entry entry;
+        u32 bytes;      // Of blocks, all told
+        u32 got;
+        u32 pages;      // Of blocks programmed so far
+        u32 fill;       // Into `page`
+        bool active;
+        bool failed;    // A flash write failed. Swallows the rest, then `finish` says so.
+        alignas(4) array<u8, cPageBytes> page;
+    };
+    inline Upload gUpload = {};
+
+    enum class Result: u8{ Ok, TooBig, Short, Flash, NotReady };
+
+    // Makes room for a `frames` long clip under `key`, replacing any already there.
+    inline Result begin(u64 key, u32 frames){
+        auto& u = gUpload;
+        u.active = false;
+        if(!gReady){ return Result::NotReady; }
+        if(frames == 0 || frames > cMaxFrames){ return Result::TooBig; }
+        if(auto e = find(key); e && !evict((u32)(e - gEntries.data()))){ return Result::Flash; }
+        u32 sectors = sectors_for(frames), first = place(sectors);
+        bool ok = true;
+        for(u32 i = 0; i < gCount;){
+            if(!gEntries[i].overlaps(first, sectors)){
+                i += 1;
+            }else if(!evict(i)){ // Even one whose header the upload would erase in passing: it may be abandoned first
+                ok = false;
+                i += 1;
+            }
+        }
+        u = {
+            .entry = {.key = key, .frames = frames, .first = (u16)first, .sectors = (u16)sectors, .used = ++gClock},
+            .bytes = (u32)adpcm::encoded_size(frames), .active = true, .failed = !ok,
+        };
+        u.page.fill(0xff);
+        return Result::Ok;
+    }
+
+    // Programs the page buffer as the next page of blocks, erasing each sector as it's reached.
+    inline void flush_page(){
+        auto& u = gUpload;
+        u32 offset = cStart + u.entry.first * cSectorBytes + cPageBytes * (1 + u.pages);
+        if(u.pages == 0 || offset % cSectorBytes == 0){ u.failed |= !flash_op({.offset = offset & ~(cSectorBytes - 1)}); }
+        if(!u.failed){ u.failed |= !flash_op({.offset = offset, .page = u.page.data()}); }
+        u.pages += 1;
+        u.fill = 0;
+        u.page.fill(0xff);
+    }
+
+    // Returns how much of `data` was taken: all of it, unless it runs past the clip's end.
+    inline u32 write(span<const u8> data){
+        auto& u = gUpload;
+        u32 taken = 0;
+        while(u.active && taken < data.size() && u.got < u.bytes){
+            u32 n = std::min({(u32)data.size() - taken, cPageBytes - u.fill, u.bytes - u.got});
+            std::copy_n(data.begin() + taken, n, u.page.begin() + u.fill);
+            u.fill += n;
+            u.got += n;
+            taken += n;
+            if(u.fill < cPageBytes){ continue; }
+            if(u.failed){
+                u.fill = 0; // Keep swallowing
+            }else{
+                flush_page();
+            }
+        }
+        return taken;
+    }
+
+    // Programs the header, which makes the clip playable, and now and after a reboot.
+    inline Result finish(){
+        auto& u = gUpload;
+        if(!u.active){ return Result::Short; }
+        u.active = false;
+        if(u.got < u.bytes){ return Result::Short; }
+        if(u.fill > 0 && !u.failed){ flush_page(); }
+        if(u.failed){ return Result::Flash; }
+        Header h = {.magic = cMagic, .frames = u.entry.frames, .key = u.entry.key, .sectors = u.entry.sectors};
+        h.check = checksum(h);
+        std::copy_n((u8 const*)&h, sizeof(h), u.page.begin());
+        if(!flash_op({.offset = cStart + u.entry.first * cSectorBytes, .page = u.page.data()})){ return Result::Flash; }
+        gEntries[gCount++] = u.entry;
+        return Result::Ok;
+    }
+}
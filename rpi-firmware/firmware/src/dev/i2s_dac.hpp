@@ -2,50 +2,88 @@
 #include "../common.hpp"
 #include "i2s_protocol.hpp"
 #include "usb_handlers.hpp"
+#include "../gain.hpp"
+#include "../profile.hpp"
+#include "../resampler.hpp"
+#include "interp.hpp"
+#include "../mixer.hpp"
 
 #include <hardware/dma.h>
 
 namespace dev::dac{
-    static inline volatile u16 isDMA = 0;
+    // Follows volumeFactor one block behind, ramping between blocks. Only touched by the DMA IRQ.
+    inline gain::Ramp gVolumeRamp;
+    // USB rate -> I2S rate, when the host picked something other than 48k. Also only touched by the DMA IRQ.
+    inline Resampler gResampler;
+    inline u32 gResamplerRate = cI2SSampleRate;
 
-    // TODO: Volume control? Non-essential
-
-    inline void load_samples(I2SOutBufHalf& into){
+    // Templated on the sample format so any output mode (see cI2SFormat) can be tested from the host.
+    template<typename Sample, size_t N>
+    inline void load_samples(array<Sample, N>& into){
         // The buffer needs to be completely filled with samples.
         // We take as much as we can from gAudioRecvBuffer till it's empty, then we spit out zeros
-        auto recvCurrLength = gAudioRecvBuffer.length();
         size_t w = 0;
-        while(w < into.size() && w < recvCurrLength){
-            auto word = gAudioRecvBuffer.read_one();
-            // s16 sword = word;
-            s32 sample = word;
-            s32 scaled = sample * volumeFactor;
-            into[w] = I2SAudioSample{.l = scaled, .r = scaled};
-            // Default volume was 1 << 12 (4096), max is 65535
-            w += 1;
+        gAudioRecvFill.note(gAudioRecvBuffer.length());
+        auto volume = gVolumeRamp.begin_block(volumeFactor.load(std::memory_order_relaxed), into.size());
+
+        u32 rate = usbSampleRate.load(std::memory_order_relaxed);
+        if(rate != gResamplerRate){
+            gResampler = Resampler::make(rate, cI2SSampleRate);
+            gResamplerRate = rate;
         }
+        auto& mix = mixer::gMixer;
+        mix.take_commands();
+        if(rate != cI2SSampleRate || mix.busy()){
+            // A sample at a time: the resampler pulls from the ring as it needs them, and the mixer's clips and
+            // tones go on top of the volume
+            bool dry = false;
+            auto pull = [&]() -> s16 {
+                if(gAudioRecvBuffer.empty()){ dry = true; return 0; }
+                return gAudioRecvBuffer.read_one();
+            };
+            bool resample = rate != cI2SSampleRate;
+            for(auto& out: into){
+                s16 x = resample ? gResampler.next(pull) : pull();
+                out = Sample::from_mono(mix.mix(volume.next(x)));
+            }
+            if(dry){ gAudioRecvBuffer.note_underrun(); }
+            return;
+        }
+
+        // On the device the ring wrap and the gain ramp run on the interpolators (see interp.hpp)
+        w = std::min<size_t>(gAudioRecvBuffer.length(), into.size());
+        u32 from = gAudioRecvBuffer.read.load(std::memory_order_relaxed);
+        if constexpr(interp::cUseInterp){
+            interp::scaled_from_ring(gAudioRecvBuffer.ring, from, volume, span{into}.first(w));
+        }else{
+            interp::scaled_from_ring_scalar(gAudioRecvBuffer.ring, from, volume, span{into}.first(w));
+        }
+        gAudioRecvBuffer.commit_read(w);
         // Run out of audio. This supresses garbage but indicates not enough data.
+        if(w < into.size()){ gAudioRecvBuffer.note_underrun(); }
         while(w < into.size()){
-            into[w] = I2SAudioSample{.l = 0, .r = 0};
+            into[w] = Sample::from_mono(0);
             w += 1;
         }
     }
 
-    inline void dma_handle_channel(DMAChannel ch, I2SOutBufHalf& buf){
-        bool needs_servicing = dma_channel_get_irq0_status(ch);
-        if(!needs_servicing){ return; }
-
-        load_samples(buf);
-
-        // Prime the DMA that finished. It'll be auto-triggered by the other one when ready.
-        dma_channel_set_read_addr(ch, buf.begin(), false);
-        dma_channel_acknowledge_irq0(ch);
+    // Refills every block the data DMA has finished playing since last time, going by where it's reading now,
+    // so a late IRQ catches up in one go. Only a whole lap late does a block play twice.
+    inline void refill_blocks(){
+        constexpr u32 cMask = gI2SOutBufs.size() - 1;
+        uintptr_t at = dma_channel_hw_addr(gDMAData)->read_addr - (uintptr_t)gI2SOutBufs.data();
+        u32 playing = (u32)(at / sizeof(I2SOutBufHalf)) & cMask; // Just past the end of a block counts as the next
+        for(; gNextRefill != playing; gNextRefill = (gNextRefill + 1) & cMask){
+            load_samples(gI2SOutBufs[gNextRefill]);
+        }
     }
 
     inline void dma_handler(){
-        isDMA += 1; // Debug counter
-        dma_handle_channel(gDMADataA, gI2SOutBufA);
-        dma_handle_channel(gDMADataB, gI2SOutBufB);
+        PROFILE_SCOPE(profile::Site::SpeakerDMA);
+        u32 start = time_us_32();
+        dma_channel_acknowledge_irq0(gDMAData); // First, so a block finishing meanwhile raises it again
+        refill_blocks();
+        gDMAServiceTime.note(time_us_32() - start);
     }
 
 }
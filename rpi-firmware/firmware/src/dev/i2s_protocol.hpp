@@ -2,6 +2,9 @@
 #include "../common.hpp"
 #include "../system.hpp"
 #include "../ring_queue.hpp"
+#include "../rate_feedback.hpp"
+#include "../audio_config.hpp"
+#include "../audio_stats.hpp"
 
 extern "C" {
     #include "i2s.pio.h"
@@ -14,14 +17,48 @@ extern "C" {
 // micropython/ports/rp2/machine_i2s.c
 
 namespace dev::dac{
-    // Sample as seen by the DAC
+    // Sample formats as seen by the DAC. Each knows how to build itself from a mono sample scaled to 32 bits,
+    // and how its PIO program runs (state machine cycles per bit clock, whether it autopulls).
+    // 32 bits per channel, two DMA words per frame.
     union I2SAudioSample{
         s32 c[2];
         struct{
             s32 l;
             s32 r;
         };
+        static constexpr u8 cBitDepth = 32;
+        static constexpr u8 cPIOCyclesPerBit = 2;
+        static constexpr bool cAutoPull = true;
+        static constexpr I2SAudioSample from_mono(s32 v){ return {.l = v, .r = v}; }
     };
+    // 16 bits per channel, the whole frame in one DMA word. Left is the high half since it's shifted out first.
+    // Halves the DMA and SRAM traffic, at the cost of the low bits (the source is 16 bit, but volume scales it down).
+    struct I2SAudioSamplePacked16{
+        u32 lr;
+        static constexpr u8 cBitDepth = 16;
+        static constexpr u8 cPIOCyclesPerBit = 2;
+        static constexpr bool cAutoPull = true;
+        static constexpr I2SAudioSamplePacked16 from_mono(s32 v){
+            u32 h = (u32)v >> 16;
+            return {.lr = (h << 16) | h};
+        }
+    };
+    // 32 bits, one DMA word per frame. The PIO plays the same word on both channels (the source is mono anyway).
+    // Same savings as Packed16 but keeps full depth.
+    struct I2SAudioSampleMono32{
+        s32 v;
+        static constexpr u8 cBitDepth = 32;
+        static constexpr u8 cPIOCyclesPerBit = 4;
+        static constexpr bool cAutoPull = false;
+        static constexpr I2SAudioSampleMono32 from_mono(s32 v){ return {.v = v}; }
+    };
+
+    // Select the output format here.
+    enum class I2SFormat{ Stereo32, Packed16, Mono32 };
+    constexpr I2SFormat cI2SFormat = I2SFormat::Stereo32;
+    using I2SOutSample = std::conditional_t<cI2SFormat == I2SFormat::Packed16, I2SAudioSamplePacked16,
+                         std::conditional_t<cI2SFormat == I2SFormat::Mono32, I2SAudioSampleMono32, I2SAudioSample>>;
+    static_assert(sizeof(I2SOutSample) % 4 == 0, "The DMA moves whole words into the PIO FIFO");
 
     constexpr u32 cI2SSampleRate = 48'000;
     constexpr u8  cI2S_GPIO_DOUT = 18;
@@ -29,39 +66,58 @@ namespace dev::dac{
     constexpr u8  cI2S_GPIO_LCK  = 17;
     static_assert(cI2S_GPIO_BCK + 1 == cI2S_GPIO_LCK, "Due to the PIO implementation, the BCK and LCK pins must be next to eachother.");
 
-    constexpr u8  cI2SBitDepth   = 8 * sizeof(I2SAudioSample::c[0]);
+    constexpr u8  cI2SBitDepth   = I2SOutSample::cBitDepth;
     constexpr u32 cI2S_BCK_RATE  = cI2SSampleRate * cI2SBitDepth * 2;
     constexpr u32 cI2S_DOUT_RATE = cI2S_BCK_RATE;
     constexpr u32 cI2S_LCK_RATE  = cI2SSampleRate; // 50% low (L), 50% hi (R)
-    static_assert(cI2SBitDepth == 32, "Only 32 bit output is supported for the project.");
-
-    using I2SOutBufHalf = array<I2SAudioSample, (size_t)(cI2SSampleRate * 0.001)>; // This is 1ms each. Should dma 1000 times a second
-    inline I2SOutBufHalf gI2SOutBufA;
-    inline I2SOutBufHalf gI2SOutBufB;
-
-    inline DMAChannel gDMADataA;
-    inline DMAChannel gDMADataB;
-
-    // FIXME: There is still an audio bug where the buffer sometimes over-runs and causes unusual skipping. Don't know what to do about it
-    // Because the buffer is small (512 of 48kHz), the skip is only 10ms and not the most noticable. With speech output, it should be fine?
+    static_assert(cI2SBitDepth == 32 || cI2SBitDepth == 16, "There are only PIO programs for 16 and 32 bit output.");
+
+    using I2SOutBufHalf = array<I2SOutSample, audio::cfg::block_frames(cI2SSampleRate)>; // 1ms each by default, so 1000 DMAs a second
+    // The data DMA plays round these in order. The IRQ refills each one after it has played.
+    inline array<I2SOutBufHalf, audio::cfg::cSpeakerDMABlocks> gI2SOutBufs;
+    // The control DMA's blocks: the address of each of the above. It reads them in a ring, so it's aligned to
+    // its own size.
+    using I2SBlockAddrs = array<uintptr_t, audio::cfg::cSpeakerDMABlocks>;
+    alignas(sizeof(I2SBlockAddrs)) inline I2SBlockAddrs gI2SBlockAddrs;
+    inline u32 gNextRefill = 0; // The block to refill once the DMA has moved past it. Only touched by the DMA IRQ.
+
+    inline DMAChannel gDMAData; // Block -> PIO
+    inline DMAChannel gDMACtrl; // Block address -> the data DMA's read address (and go)
+
+    // Written by the USB receive callback, drained by the DMA IRQ. It's a lock-free SPSC queue, so the two
+    // contexts never tear each other's indices. Over/underruns are counted on the queue itself.
+    // The USB feedback endpoint keeps it hovering around half full, so clock drift doesn't cause skips.
     using MonoAudioSampleBE = s16;
-    inline RingQueue<MonoAudioSampleBE, (1<<9)> gAudioRecvBuffer; // USB / Bluetooth writes to this
+    inline RingQueue<MonoAudioSampleBE, audio::cfg::cSpeakerRingSamples> gAudioRecvBuffer; // USB / Bluetooth writes to this
+    inline RateFeedback gAudioRecvFeedback = RateFeedback::make(cI2SSampleRate, gAudioRecvBuffer.capacity() / 2);
+    inline audio::stats::FillRange gAudioRecvFill;       // As seen by the DMA IRQ before each block
+    inline audio::stats::ServiceTimes gDMAServiceTime;
 
     // ----------------------------
 
     inline u8 init_pio(PIO pio){
         auto sm = pio_claim_unused_sm(pio, true);
-        auto startAddr = pio_add_program(pio, &i2s_data_write_program);
+        u32 startAddr;
+        pio_sm_config sm_config;
+        if constexpr(cI2SFormat == I2SFormat::Packed16){
+            startAddr = pio_add_program(pio, &i2s_data_write_16_program);
+            sm_config = i2s_data_write_16_program_get_default_config(startAddr);
+        }else if constexpr(cI2SFormat == I2SFormat::Mono32){
+            startAddr = pio_add_program(pio, &i2s_data_write_mono_program);
+            sm_config = i2s_data_write_mono_program_get_default_config(startAddr);
+        }else{
+            startAddr = pio_add_program(pio, &i2s_data_write_program);
+            sm_config = i2s_data_write_program_get_default_config(startAddr);
+        }
 
         // PIO Block
-        pio_sm_config sm_config = i2s_data_write_program_get_default_config(startAddr);
         sm_config_set_sideset_pins(&sm_config, cI2S_GPIO_BCK); // The BCK and LRCK pins must be next to eachother. They need no data.
         sm_config_set_out_pins(&sm_config, cI2S_GPIO_DOUT, 1);
-        sm_config_set_out_shift(&sm_config, false, true, 32); // shift register is 4 bytes
+        sm_config_set_out_shift(&sm_config, false, I2SOutSample::cAutoPull, 32); // shift register is 4 bytes
         sm_config_set_fifo_join(&sm_config, PIO_FIFO_JOIN_TX); // fifo to the shift register is 8 bytes (this is the memory location we dma write to)
         pio_sm_init(pio, sm, startAddr, &sm_config);
 
-        constexpr f32 target_rate = cI2S_BCK_RATE * 2;
+        constexpr f32 target_rate = cI2S_BCK_RATE * I2SOutSample::cPIOCyclesPerBit;
         constexpr f32 clock_div = sys::cClockRate / target_rate;
         pio_sm_set_clkdiv(pio, sm, clock_div);
 
@@ -78,37 +134,41 @@ namespace dev::dac{
 
     inline void dma_handler();
     inline void init_dma(PIO pio, u8 sm){
-        gDMADataA = dma_claim_unused_channel(true);
-        gDMADataB = dma_claim_unused_channel(true);
-
-        // The DMA channels are chained together.
-        // The first DMA channel is used to access the top half of the DMA buffer.
-        // The second DMA channel accesses the bottom half of the DMA buffer.
-        // With chaining, when one DMA channel has completed a data transfer, the other DMA channel automatically starts a new data transfer.
-        auto configure = [&](DMAChannel ch, I2SOutBufHalf& buffer){
-            auto cfg = dma_channel_get_default_config(ch);
-            channel_config_set_transfer_data_size(&cfg, DMA_SIZE_32); // matches the tx shift register
-            channel_config_set_chain_to(&cfg, ch == gDMADataA ? gDMADataB : gDMADataA); // the key
-            channel_config_set_read_increment(&cfg, true);   // reading from the buffer
-            channel_config_set_write_increment(&cfg, false); // writing to the PIO block
-            channel_config_set_dreq(&cfg, pio_get_dreq(pio, sm, true)); // this ensures the dma doesn't overflow the PIO
-            dma_channel_configure(ch, &cfg, &pio->txf[sm], buffer.begin(), sizeof(buffer) / 4, false);
-        };
-        configure(gDMADataA, gI2SOutBufA);
-        configure(gDMADataB, gI2SOutBufB);
-
-        auto prime_interrupts = [](DMAChannel ch){
-            dma_channel_acknowledge_irq0(ch);
-            dma_channel_set_irq0_enabled(ch, true);
-        };
-        prime_interrupts(gDMADataA);
-        prime_interrupts(gDMADataB);
+        gDMAData = dma_claim_unused_channel(true);
+        gDMACtrl = dma_claim_unused_channel(true);
+        for(u32 i = 0; i < gI2SOutBufs.size(); i++){ gI2SBlockAddrs[i] = (uintptr_t)gI2SOutBufs[i].begin(); }
+        gNextRefill = 0;
+
+        // The data DMA plays a block into the PIO, then chains to the control DMA. That writes the next block's
+        // address to the data DMA's read-address trigger alias, which starts it again (the transfer count reloads
+        // by itself). So the blocks play round in a loop with no help from the CPU, and the IRQ can be as late as
+        // all but one of them.
+        auto data = dma_channel_get_default_config(gDMAData);
+        channel_config_set_transfer_data_size(&data, DMA_SIZE_32); // matches the tx shift register
+        channel_config_set_chain_to(&data, gDMACtrl); // the key
+        channel_config_set_read_increment(&data, true);   // reading from the buffer
+        channel_config_set_write_increment(&data, false); // writing to the PIO block
+        channel_config_set_dreq(&data, pio_get_dreq(pio, sm, true)); // this ensures the dma doesn't overflow the PIO
+        dma_channel_configure(gDMAData, &data, &pio->txf[sm], gI2SOutBufs[0].begin(), sizeof(I2SOutBufHalf) / 4, false);
+
+        auto ctrl = dma_channel_get_default_config(gDMACtrl);
+        channel_config_set_transfer_data_size(&ctrl, DMA_SIZE_32);
+        channel_config_set_read_increment(&ctrl, true);
+        channel_config_set_write_increment(&ctrl, false);
+        channel_config_set_ring(&ctrl, false, std::countr_zero(sizeof(I2SBlockAddrs))); // wrap round the block list
+        dma_channel_configure(gDMACtrl, &ctrl, &dma_channel_hw_addr(gDMAData)->al3_read_addr_trig,
+            &gI2SBlockAddrs[1], 1, false);
+
+        // Only the data DMA interrupts, once per block
+        dma_channel_acknowledge_irq0(gDMAData);
+        dma_channel_set_irq0_enabled(gDMAData, true);
     }
 
     inline void init(){
         auto const& pio = pio0;
         auto sm = init_pio(pio);
         gAudioRecvBuffer.ring.fill(0); // Clean the buffer so it doesn't spit out noise
+        for(auto& block: gI2SOutBufs){ block.fill(I2SOutSample::from_mono(0)); } // The first lap plays these
         init_dma(pio, sm); // set up dma to feed the state machine
         pio_sm_set_enabled(pio, sm, true); // Start the pio block. Empty I2S should be produced.
 
@@ -118,7 +178,7 @@ namespace dev::dac{
     }
 
     inline void start(){
-        dma_channel_start(gDMADataA); // Start the alternating DMAs. I2S sound should be produced.
+        dma_channel_start(gDMAData); // Start the loop. I2S sound should be produced.
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+#include "../common.hpp"
+#include "../gain.hpp"
+#include <bit>
+#include <hardware/interp.h>
+
+// The speaker fill's inner loop (ring samples -> gain ramp -> DAC frames) on the calling core's two interpolators.
+// interp0 walks the ring: lane 0 holds the byte offset of the next sample, its mask wraps it at the end of the ring,
+// and each pop adds 2. interp1 runs the gain ramp: lane 0 holds the 16.16 gain, each pop adds the step, and its
+// shift hands back the whole part. A sample then costs two register reads, a load and a multiply, with no index
+// or ramp arithmetic of its own.
+// Both interpolators are set up afresh on each call and not restored, so nothing else on the calling core may use
+// them. The speaker DMA IRQ is their only user on the audio core.
+// The host build has only the mock's model of them, which is slow, so the fill uses the plain loop there instead.
+namespace dev::interp{
+#if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+    constexpr bool cUseInterp = true;
+#else
+    constexpr bool cUseInterp = false;
+#endif
+
+    // Sends `out.size()` samples of `ring`, from free-running index `from`, through `volume` into `out`.
+    template<typename Sample, size_t N, size_t M>
+    inline void scaled_from_ring(array<s16, N> const& ring, u32 from, gain::Ramp::Stepper& volume, span<Sample, M> out){
+        static_assert(std::has_single_bit(N), "The interpolator wraps with a mask");
+        auto unused = interp_default_config(); // Lane 1 adds 0 to the full result
+
+        auto walk = interp_default_config();
+        interp_config_set_add_raw(&walk, true);
+        interp_config_set_mask(&walk, 1, std::countr_zero(N)); // Byte offsets of samples in the ring
+        interp_set_config(interp0, 0, &walk);
+        interp_set_config(interp0, 1, &unused);
+        interp_set_accumulator(interp0, 0, from * sizeof(s16));
+        interp_set_accumulator(interp0, 1, 0);
+        interp_set_base(interp0, 0, sizeof(s16));
+        interp_set_base(interp0, 1, 0);
+        interp_set_base(interp0, 2, 0); // Not the ring's address, which doesn't fit a register in the host build
+
+        auto ramp = interp_default_config();
+        interp_config_set_add_raw(&ramp, true);
+        interp_config_set_shift(&ramp, 16);
+        interp_config_set_mask(&ramp, 0, 15);
+        interp_set_config(interp1, 0, &ramp);
+        interp_set_config(interp1, 1, &unused);
+        interp_set_accumulator(interp1, 0, volume.acc + volume.step); // A pop reads before it steps, `next` after
+        interp_set_accumulator(interp1, 1, 0);
+        interp_set_base(interp1, 0, volume.step);
+        interp_set_base(interp1, 1, 0);
+        interp_set_base(interp1, 2, 0);
+
+        auto bytes = (u8 const*)ring.data();
+        for(auto& o: out){
+            auto sample = *(s16 const*)(bytes + interp_pop_full_result(interp0));
+            o = Sample::from_mono(gain::apply(sample, (gain::Q15)interp_pop_full_result(interp1)));
+        }
+        volume.acc += volume.step * out.size();
+    }
+
+    // The same, one sample at a time in plain code. The reference for the above, and the host build's fill.
+    template<typename Sample, size_t N, size_t M>
+    inline void scaled_from_ring_scalar(array<s16, N> const& ring, u32 from, gain::Ramp::Stepper& volume, span<Sample, M> out){
+        for(auto& o: out){ o = Sample::from_mono(volume.next(ring[from++ & (N - 1)])); }
+    }
+}
@@ -1,13 +1,26 @@
 #pragma once
 #include "../common.hpp"
 #include "../system.hpp"
+#include "../ring_queue.hpp"
+#include "../audio_config.hpp"
+#include "../audio_stats.hpp"
+#include "../profile.hpp"
+#include "../resampler.hpp"
+#include "../decimator.hpp"
+#include "../vad.hpp"
+#include "../preroll.hpp"
+#include "usb_handlers.hpp"
 #include <hardware/adc.h>
 #include <hardware/dma.h>
 #include <tusb.h>
 
 // For reading from a mono-channel microphone.
-// Uses 2 DMAs in an alternating "ping pong" formation to collect samples (same as speaker),
-// then flushes out completed buffers to the USB.
+// A data DMA writes ADC samples straight into the slots of a block queue. When it finishes a block it chains to a
+// control DMA, which points it at the next slot (from a ring of slot addresses) and retriggers it. The capture
+// runs forever without the CPU, and the IRQ only publishes finished blocks: however late it runs, nothing is lost
+// until the queue has been lapped.
+// The USB side later removes the DC offset while writing directly into TinyUSB's IN FIFO, so there's one copy total.
+// At a USB rate of 16k the ADC is oversampled at 192k and decimated instead (see Decimator), for a cleaner signal.
 // Uses DMA IRQ 1
 // NOTE: Remember to ground the mic and the RPI together on the same rail (else adc converts static).
 // -------------------------------------------
@@ -16,6 +29,7 @@ namespace dev::mic{
     namespace cfg{
         constexpr u32 ADC_PIN = 2;
         constexpr u32 SAMPLE_RATE = 48'000; // ehhh - rather be slower but its ok.
+        constexpr u32 OVERSAMPLED_RATE = Decimator::cInRate; // The native 16k mode
         constexpr f64 ADC_LEVEL_SHIFT = 2.0; // Volts
         // These are helper constants
         constexpr u32 ADC_PRECISION = 12; // bit depth
@@ -26,15 +40,68 @@ namespace dev::mic{
 
     using USBAudioSample16 = s16;
     using ADCAudioSampleRaw = u16; // Level shifted 12 bit adc output
-    using ADCInBufHalf = array<ADCAudioSampleRaw, (size_t)(cfg::SAMPLE_RATE * 0.001)>; // 5ms
-    inline DMAChannel gDMAadcA;
-    inline DMAChannel gDMAadcB;
-    inline ADCInBufHalf gSampleBufferA;
-    inline ADCInBufHalf gSampleBufferB;
-    inline bool gSampleBufferAFull = false;
-    inline bool gSampleBufferBFull = false;
+    using ADCInBufHalf = array<ADCAudioSampleRaw, audio::cfg::block_frames(cfg::SAMPLE_RATE)>; // 1ms by default
+    static_assert(sizeof(ADCInBufHalf) % 4 == 0, "Blocks are converted two samples per word");
+    static_assert(sizeof(ADCInBufHalf) <= CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ / 2, "A whole block must fit in the USB IN FIFO while the host drains the rest");
+    // A slot in the block queue. Holds a block at either ADC rate, tagged with the one it was captured at.
+    struct ADCBlock{
+        array<ADCAudioSampleRaw, audio::cfg::block_frames(cfg::OVERSAMPLED_RATE)> buf;
+        u32 rate;
+        constexpr span<const ADCAudioSampleRaw> samples(SelfRef){ return span{self.buf}.first(audio::cfg::block_frames(self.rate)); }
+    };
+    static_assert(offsetof(ADCBlock, buf) == 0, "The DMAs write to the start of a slot");
+    static_assert(audio::cfg::block_frames(cfg::OVERSAMPLED_RATE) % (Decimator::cCicFactor * Decimator::cFirFactor) == 0, "Blocks must decimate to a whole number of samples");
 
-    inline u32 gDMACount = 0;
+    // The ADC rate for a USB rate. 16k is decimated from 192k, the rest come from 48k (resampled if need be).
+    constexpr u32 adc_rate_for(u32 usbRate){ return usbRate == Decimator::cOutRate ? cfg::OVERSAMPLED_RATE : cfg::SAMPLE_RATE; }
+    inline DMAChannel gDMAadcData; // ADC FIFO -> slot
+    inline DMAChannel gDMAadcCtrl; // Slot address -> the data DMA's write address (and go)
+
+    // Completed blocks straight from the ADC (still level shifted). ~8ms deep by default.
+    // The data DMA cycles through the slots in place, the IRQ publishes them, and `pump_usb` on the USB core
+    // drains them. One slot is always being written, so up to `capacity() - 1` can be waiting.
+    // If the USB side falls further behind, the rest wait unpublished while the DMA writes over the oldest, and
+    // `pump_usb` skips what it's come round to (see `dma_slot`).
+    // Slots are word aligned so they can be read two samples at a time.
+    alignas(4) inline RingQueue<ADCBlock, audio::cfg::cMicQueueBlocks> gAudioSendBuffer;
+    // The control DMA's blocks: where each slot's samples go, in queue order. It reads them in a ring, so it's
+    // aligned to its own size.
+    using SlotAddrs = array<uintptr_t, audio::cfg::cMicQueueBlocks>;
+    alignas(sizeof(SlotAddrs)) inline SlotAddrs gSlotAddrs;
+    // Free running index of the slot the data DMA was writing when the IRQ last ran. Written by the IRQ (and `init`).
+    inline std::atomic<u32> gNextSlot = 0;
+    // Only touched by the DMA IRQ (and `init`)
+    inline u32 gADCRate = cfg::SAMPLE_RATE;
+    inline u32 gPrevRate = cfg::SAMPLE_RATE; // What slots before `gRateFrom` were captured at
+    inline u32 gRateFrom = 0;               // Free running index of the first slot at `gADCRate`
+    inline audio::stats::FillRange gAudioSendFill;       // Blocks queued, as seen by `pump_usb`
+    inline audio::stats::ServiceTimes gDMAServiceTime;
+    // ADC rate -> USB rate, when the host picked something other than 48k. Only touched by `pump_usb`.
+    inline Resampler gResampler;
+    inline Decimator gDecimator;
+    inline u32 gResamplerRate = cfg::SAMPLE_RATE; // The USB rate the two above were set up for
+    // Whether someone is talking, updated by `pump_usb` as blocks go out. Reported over CDC by the console.
+    inline VoiceDetector gVoice = VoiceDetector::make(audio::cfg::cBlockUs, cfg::ADC_LEVEL_SHIFT_COUNT);
+    // Send silence instead of the mic while nobody is talking. Clips the first ~cOnsetUs of each utterance.
+    inline bool gMuteSilence = false;
+    // What was sent to the host lately (at the USB rate), so a push-to-talk press can rewind into it. Sized for 48k.
+    // Only touched by the USB core.
+    inline PreRoll<audio::cfg::cMicPreRollMs * (cfg::SAMPLE_RATE / 1000) + ADCInBufHalf{}.size() + 1> gPreRoll;
+    // A copy of the same, taken while the vendor interface is capturing it (see vendor.hpp). 85ms at 48k.
+    inline RingQueue<USBAudioSample16, 4096> gCapture;
+    inline bool gCapturing = false;
+
+    // Notes what is sent to the host, before any muting or delay.
+    inline void record(span<const USBAudioSample16> out){
+        gPreRoll.record(out);
+        if(gCapturing){ gCapture.write_from(out); }
+    }
+
+    // The ADC runs off its own 48MHz clock, taking (1 + div) cycles per sample.
+    inline void set_adc_rate(u32 rate){
+        adc_set_clkdiv((f32)(48'000'000 / rate - 1));
+        gADCRate = rate;
+    }
 
     inline void adc_dma_handler();
     inline void init(){
@@ -50,32 +117,40 @@ namespace dev::mic{
             false // false = 16 bit, true = 8 bit
         );
 
-        constexpr auto clock_div = (f32)48'000'000.0/cfg::SAMPLE_RATE; // the ADC runs on its own 48MHz clock independently
-        adc_set_clkdiv(clock_div);
+        set_adc_rate(adc_rate_for(usbSampleRate.load(std::memory_order_relaxed)));
         // adc_set_temp_sensor_enabled(false); // hmm
 
-        // Arm the DMAs (alternating)
-        gDMAadcA = dma_claim_unused_channel(true);
-        gDMAadcB = dma_claim_unused_channel(true);
-        auto configure = [&](DMAChannel ch, ADCInBufHalf& buffer){
-            auto cfg = dma_channel_get_default_config(ch);
-            channel_config_set_chain_to(&cfg, ch == gDMAadcA ? gDMAadcB : gDMAadcA); // the key
-            channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
-            channel_config_set_read_increment(&cfg, false); // the fifo is in a fixed location
-            channel_config_set_write_increment(&cfg, true); // write into the ring buffer
-            channel_config_set_dreq(&cfg, DREQ_ADC);        // the dma triggers based on the adc
-            dma_channel_configure(ch, &cfg, buffer.begin(), &adc_hw->fifo, sizeof(buffer) / sizeof(u16), false);
-        };
-        configure(gDMAadcA, gSampleBufferA);
-        configure(gDMAadcB, gSampleBufferB);
-
-        // Interrupts
-        auto prime_interrupts = [](DMAChannel ch){
-            dma_channel_acknowledge_irq1(ch);
-            dma_channel_set_irq1_enabled(ch, true);
-        };
-        prime_interrupts(gDMAadcA);
-        prime_interrupts(gDMAadcB);
+        // Arm the DMAs. Capture starts at the queue's write index and carries on round the ring from there.
+        auto& q = gAudioSendBuffer;
+        for(u32 i = 0; i < q.capacity(); i++){ gSlotAddrs[i] = (uintptr_t)q.ring[i].buf.begin(); }
+        gRateFrom = q.write.load();
+        gNextSlot = gRateFrom;
+        gPrevRate = gADCRate;
+        gDMAadcData = dma_claim_unused_channel(true);
+        gDMAadcCtrl = dma_claim_unused_channel(true);
+
+        auto data = dma_channel_get_default_config(gDMAadcData);
+        channel_config_set_chain_to(&data, gDMAadcCtrl); // the key
+        channel_config_set_transfer_data_size(&data, DMA_SIZE_16);
+        channel_config_set_read_increment(&data, false); // the fifo is in a fixed location
+        channel_config_set_write_increment(&data, true); // write into the slot
+        channel_config_set_dreq(&data, DREQ_ADC);        // the dma triggers based on the adc
+        dma_channel_configure(gDMAadcData, &data, q.ring[gRateFrom & q.cMask].buf.begin(), &adc_hw->fifo,
+            audio::cfg::block_frames(gADCRate), false);
+
+        // Writes one slot address to the data DMA's write-address trigger alias. The transfer count reloads by
+        // itself. Takes a few cycles, which the ADC's 4 sample FIFO covers.
+        auto ctrl = dma_channel_get_default_config(gDMAadcCtrl);
+        channel_config_set_transfer_data_size(&ctrl, DMA_SIZE_32);
+        channel_config_set_read_increment(&ctrl, true);
+        channel_config_set_write_increment(&ctrl, false);
+        channel_config_set_ring(&ctrl, false, std::countr_zero(sizeof(SlotAddrs))); // wrap round the slot list
+        dma_channel_configure(gDMAadcCtrl, &ctrl, &dma_channel_hw_addr(gDMAadcData)->al2_write_addr_trig,
+            &gSlotAddrs[(gRateFrom + 1) & q.cMask], 1, false);
+
+        // Interrupts. Only the data DMA, as a notification.
+        dma_channel_acknowledge_irq1(gDMAadcData);
+        dma_channel_set_irq1_enabled(gDMAadcData, true);
 
         irq_set_exclusive_handler(DMA_IRQ_1, adc_dma_handler);
         irq_set_enabled(DMA_IRQ_1, true);
@@ -83,33 +158,164 @@ namespace dev::mic{
     }
     inline void start(){
         adc_run(true);
-        dma_channel_start(gDMAadcA); // start the ping-pong
+        dma_channel_start(gDMAadcData);
+    }
+
+    // Removes the DC offset from two samples packed in one word.
+    // 0x8000 is or'd into each lane first so the subtraction can't borrow across lanes (samples are only 12 bit),
+    // then the xor takes the bias back off, leaving two's complement.
+    constexpr u32 remove_dc_pair(u32 pair){
+        constexpr u32 cBias = 0x8000'8000;
+        constexpr u32 cShift = cfg::ADC_LEVEL_SHIFT_COUNT * 0x1'0001u;
+        return ((pair | cBias) - cShift) ^ cBias;
+    }
+    constexpr USBAudioSample16 remove_dc(ADCAudioSampleRaw s){
+        return (s16)s - cfg::ADC_LEVEL_SHIFT_COUNT;
     }
 
-    // Add to the USB audio outgoing buffer
-    inline void offload_samples(ADCInBufHalf& from){
-        // Apply the reverse-dc offset
-        for(auto& s: from){
-            s = ((s16)s - cfg::ADC_LEVEL_SHIFT_COUNT); // will be reinterpreted as signed
+    // Converts ADC samples into signed USB samples at `to`. Both sides are (at least) 2 byte aligned.
+    // When they share word alignment, the bulk goes two samples per word.
+    inline void convert_into(span<const ADCAudioSampleRaw> from, u8* to){
+        auto out16 = ptr_cast<USBAudioSample16*>(to);
+        size_t i = 0;
+        bool sameAlignment = (((uintptr_t)from.data() ^ (uintptr_t)to) & 2) == 0;
+        if(sameAlignment){
+            if((uintptr_t)to & 2 && i < from.size()){ out16[i] = remove_dc(from[i]); i += 1; }
+            for(; i + 1 < from.size(); i += 2){
+                *ptr_cast<u32*>(&out16[i]) = remove_dc_pair(*ptr_cast<u32 const*>(&from[i]));
+            }
         }
-        auto bytesWritten = tud_audio_write((u8*)from.begin(), sizeof(from));
+        for(; i < from.size(); i++){ out16[i] = remove_dc(from[i]); }
     }
 
-    inline void dma_handle_channel(DMAChannel ch, ADCInBufHalf& buf, bool& full){
-        bool needs_servicing = dma_channel_get_irq1_status(ch);
-        if(!needs_servicing){ return; }
+    // Push-to-talk (the button). While held, the host hears the mic from up to AUDIO_MIC_PREROLL_MS before the press.
+    inline void push_to_talk(bool held){
+        if(held){
+            gPreRoll.hold(audio::cfg::cMicPreRollMs * usbSampleRate.load(std::memory_order_relaxed) / 1000);
+        }else{
+            gPreRoll.release();
+        }
+    }
 
-        offload_samples(buf);
-        full = true;
+    // Free running index of the slot the data DMA is writing now: the IRQ's, plus whatever it's finished since.
+    // Right unless the IRQ is a whole lap late.
+    inline u32 dma_slot(){
+        auto& q = gAudioSendBuffer;
+        u32 from = gNextSlot.load(std::memory_order_acquire);
+        uintptr_t at = dma_channel_hw_addr(gDMAadcData)->write_addr - (uintptr_t)q.ring.data();
+        return from + (((u32)(at / sizeof(ADCBlock)) - from) & q.cMask);
+    }
+
+    // Moves every complete block that fits into TinyUSB's IN FIFO. Call from the core running `tud_task`.
+    // At 48k the block is converted in place in the FIFO. At 16k it's decimated from 192k into it.
+    // At other USB rates it's converted, then resampled into it.
+    // Each block also goes through the voice detector, and comes out as zeros if it's silence and that's asked for.
+    // Everything is kept in the pre-roll history too, and after a push-to-talk press the host gets that instead.
+    inline void pump_usb(){
+        auto& q = gAudioSendBuffer;
+        gAudioSendFill.note(q.length());
+        if(q.empty()){ return; } // Most calls. Keep them out of the profile.
+        PROFILE_SCOPE(profile::Site::MicPump);
+
+        u32 rate = usbSampleRate.load(std::memory_order_relaxed);
+        if(rate != gResamplerRate){
+            gResampler = Resampler::make(cfg::SAMPLE_RATE, rate);
+            gDecimator = Decimator::make(cfg::ADC_LEVEL_SHIFT_COUNT);
+            gPreRoll.reset();
+            gResamplerRate = rate;
+        }
+        using Resampled = array<USBAudioSample16, ADCInBufHalf{}.size() + 1>; // Only ever downsampling
+        static_assert(Decimator::max_out(ADCBlock{}.buf.size()) <= Resampled{}.size());
+        u32 needs = rate == cfg::SAMPLE_RATE ? sizeof(ADCInBufHalf) : sizeof(Resampled);
+
+        auto ff = tud_audio_get_ep_in_ff();
+        while(!q.empty()){
+            tu_fifo_buffer_info_t info;
+            tu_fifo_get_write_info(ff, &info);
+            if(info.len_lin + info.len_wrap < needs){ break; } // FIFO full
+
+            // Skip what the DMA has come round to again. The oldest it hasn't is the one it fills next, a block away.
+            u32 oldest = dma_slot() - (q.capacity() - 1), from = q.read.load(std::memory_order_relaxed);
+            if((s32)(oldest - from) > 0){
+                q.commit_read(std::min(oldest - from, q.length()));
+                if(q.empty()){ break; }
+            }
+            auto& slot = q.ring[q.read.load(std::memory_order_relaxed) & q.cMask];
+            auto block = slot.samples();
+            gVoice.process(block, slot.rate);
+            bool mute = gMuteSilence && !gVoice.speaking && gPreRoll.live(); // Never while the button is down
+            auto send = [&](span<USBAudioSample16> out){
+                record(out);
+                if(!gPreRoll.live()){
+                    for(auto part: gPreRoll.delayed(out.size())){ tu_fifo_write_n(ff, part.data(), part.size_bytes()); }
+                    return;
+                }
+                if(mute){ std::ranges::fill(out, 0); }
+                tu_fifo_write_n(ff, out.data(), out.size_bytes());
+            };
+            if(slot.rate == cfg::OVERSAMPLED_RATE){
+                // Blocks captured at 192k just before the host moved off 16k are dropped
+                if(rate == Decimator::cOutRate){
+                    Resampled out;
+                    send(span{out}.first(gDecimator.process(block, out)));
+                }
+            }else if(rate == cfg::SAMPLE_RATE && gPreRoll.live() && !mute){
+                // The FIFO may wrap partway through the block. Its write offset always stays sample aligned.
+                auto first = std::min<size_t>(info.len_lin / sizeof(USBAudioSample16), block.size());
+                convert_into(block.first(first), (u8*)info.ptr_lin);
+                convert_into(block.subspan(first), (u8*)info.ptr_wrap);
+                tu_fifo_advance_write_pointer(ff, block.size_bytes());
+                record(span{(USBAudioSample16 const*)info.ptr_lin, first});
+                record(span{(USBAudioSample16 const*)info.ptr_wrap, block.size() - first});
+            }else{
+                alignas(4) array<USBAudioSample16, ADCInBufHalf{}.size()> converted;
+                convert_into(block, (u8*)converted.data());
+                if(rate == cfg::SAMPLE_RATE){
+                    send(converted);
+                }else{
+                    Resampled out;
+                    send(span{out}.first(gResampler.process(converted, out)));
+                }
+            }
+            q.commit_read(1);
+        }
+    }
+
+    // Publishes every block the data DMA has finished since last time, going by where it's writing now (so a late
+    // IRQ catches up in one go). A block only just finished may still look in flight if the control DMA hasn't
+    // moved it on yet, in which case it goes out with the next one.
+    // Never more than `capacity() - 1`: the rest wait until `pump_usb` makes room.
+    inline void publish_blocks(){
+        auto& q = gAudioSendBuffer;
+        u32 inFlight = dma_slot();
+        for(u32 i = gNextSlot.load(std::memory_order_relaxed); i != inFlight; i++){
+            q.ring[i & q.cMask].rate = (s32)(i - gRateFrom) >= 0 ? gADCRate : gPrevRate;
+        }
+        gNextSlot.store(inFlight, std::memory_order_release);
+        u32 unpublished = inFlight - q.write.load(std::memory_order_relaxed);
+        u32 n = std::min(unpublished, q.capacity() - 1 - q.length());
+        q.commit_write(n);
+        if(n < unpublished){
+            q.note_overrun(); // The DMA is writing over a block the USB side hasn't read. The host isn't reading.
+        }
 
-        // Prime the DMA that finished. It'll be auto-triggered by the other one when ready.
-        dma_channel_set_write_addr(ch, buf.begin(), false);
-        dma_channel_acknowledge_irq1(ch);
+        // Follow the host's rate. The block in flight was armed with the old length and straddles the change,
+        // so one block goes out at the wrong rate when the host switches. The DMA picks up the new length
+        // from the next block.
+        u32 rate = adc_rate_for(usbSampleRate.load(std::memory_order_relaxed));
+        if(rate != gADCRate){
+            gPrevRate = gADCRate;
+            gRateFrom = inFlight + 1;
+            set_adc_rate(rate);
+            dma_channel_set_trans_count(gDMAadcData, audio::cfg::block_frames(rate), false);
+        }
     }
 
     inline void adc_dma_handler(){
-        gDMACount += 1; // Debug counter
-        dma_handle_channel(gDMAadcA, gSampleBufferA, gSampleBufferAFull);
-        dma_handle_channel(gDMAadcB, gSampleBufferB, gSampleBufferBFull);
+        PROFILE_SCOPE(profile::Site::MicDMA);
+        u32 start = time_us_32();
+        dma_channel_acknowledge_irq1(gDMAadcData); // First, so a block finishing meanwhile raises it again
+        publish_blocks();
+        gDMAServiceTime.note(time_us_32() - start);
     }
 }
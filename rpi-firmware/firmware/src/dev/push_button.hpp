@@ -1,5 +1,6 @@
 #include "../common.hpp"
 #include "../console.hpp"
+#include "mic_adc.hpp"
 #include "pico/stdlib.h"
 
 // Simple GPIO button
@@ -47,14 +48,29 @@ namespace dev::btn{
         return current;
     }
 
-    // Prints a special message over serial when the button is pressed and released.
+    // Prints a special message over serial (and sends a ctl event) when the button is pressed and released, and drives
+    // the mic's push-to-talk.
+    // The host hears the mic behind live while the button is down (the pre-roll), so the release is only reported
+    // once the stream has caught up to it. Pressing again before then carries on the same utterance.
     inline void report_changes(){
         static bool gButtonPressed = false;
+        static bool releasing = false;
         auto active = poll_denoised();
         if(active && !gButtonPressed){
-            console::println("Button 0: pressed");
+            dev::mic::push_to_talk(true);
+            if(!releasing){
+                console::println(FMT("Button 0: pressed"));
+                ctl::event_button(0, true);
+            }
+            releasing = false;
         }else if(!active && gButtonPressed){
-            console::println("Button 0: released");
+            dev::mic::push_to_talk(false);
+            releasing = true;
+        }
+        if(releasing && dev::mic::gPreRoll.live()){
+            console::println(FMT("Button 0: released"));
+            ctl::event_button(0, false);
+            releasing = false;
         }
         gButtonPressed = active;
     }
@@ -1,5 +1,6 @@
 #pragma once
 #include "../common.hpp"
+#include "../system.hpp"
 #include <hardware/pwm.h>
 
 // For driving the servo that rotates the head/body of the doll.
@@ -0,0 +1,336 @@
+#pragma once
+#include "../common.hpp"
+#include "../ring_queue.hpp"
+#include "../ctl.hpp"
+#include "vendor_protocol.hpp"
+#include "clip_cache.hpp"
+#include "mic_adc.hpp"
+#include "tusb.h"
+
+// The vendor bulk interface ("Board Data"): binary requests from the host that don't belong on the console, such as
+// uploading clips to the cache (see clip_cache.hpp), and bulk reads of telemetry and mic captures. Reached with
+// libusb/pyusb (see tools/vendor_client.hpp and software/clip_cache.py). Messages are in vendor_protocol.hpp.
+// Requests are parsed as USB hands them over. Small payloads are gathered before the handler runs; the rest of an
+// upload streams into flash (or Sink's CRC) as it arrives. Replies queue in gTx, which `tick` drains into the endpoint.
+// A reply too long for gTx, or made over time, streams: its header is queued, then gStream makes the payload as gTx
+// drains. Requests after it are left in TinyUSB's FIFO until it's done, which holds the host off and keeps the
+// replies in order.
+// There's no resync: a host that gives up halfway through a request must finish sending it (or re-plug the device).
+// Only used from core0.
+namespace dev::vendor{
+    static_assert(cTransferBytes == CFG_TUD_VENDOR_EPSIZE && CFG_TUD_VENDOR_RX_BUFSIZE >= cTransferBytes);
+    inline RingQueue<u8, 8192> gTx; // Replies not yet in the endpoint. Room for the longest list.
+    static_assert(sizeof(Header) + sizeof(CacheInfo) + cache::cSectors * sizeof(CacheClip) <= decltype(gTx)::capacity());
+    inline u32 gRxBytes = 0; // Since plugging in
+    inline u32 gTxBytes = 0;
+
+    // Sending
+    // -------------------
+    // Queues a reply's header, if there's room for it and the first `queued` bytes of its `length` of payload. Those
+    // must follow.
+    inline bool queue_header(Header ref req, Status s, u32 length, u32 queued){
+        if(gTx.space() < sizeof(Header) + queued){ // The host isn't reading them
+            gTx.note_overrun();
+            return false;
+        }
+        Header h = {.op = (u8)(req.op | cReplyBit), .status = (u8)s, .tag = req.tag, .length = length};
+        gTx.write_from({(u8 const*)&h, sizeof(h)});
+        return true;
+    }
+    inline bool reply_header(Header ref req, Status s, u32 length = 0){ return queue_header(req, s, length, length); }
+    inline void put(auto ref v){ gTx.write_from({(u8 const*)&v, sizeof(v)}); }
+
+    // The payload of the reply being streamed, made as there's room for it.
+    struct Stream{
+        u32 left = 0;            // Still to come
+        u32 at = 0;              // Made so far
+        u32 periodUs = 0;
+        u64 dueUs = 0;           // Telemetry: when the next is taken. Capture: when the mic is given up on.
+        u32 (*fill)(u32 most) = nullptr; // Queues up to `most` bytes of it in gTx. Returns how many (0 if none are ready).
+    };
+    inline Stream gStream;
+    inline bool streaming(){ return gStream.left > 0; }
+
+    inline u32 fill_source(u32 most){
+        u32 n = 0;
+        for(auto s: gTx.write_spans()){
+            for(u8& b: s.first(std::min<u32>(s.size(), most - n))){ b = (u8)(gStream.at + n++); }
+        }
+        gTx.commit_write(n);
+        return n;
+    }
+
+    inline Telemetry telemetry(){
+        return {
+            .timeUs = time_us_32(), .audio = ctl::audio_stats(), .voice = ctl::voice_state(),
+            .micRate = usbSampleRate.load(std::memory_order_relaxed), .rxBytes = gRxBytes, .txBytes = gTxBytes,
+        };
+    }
+    inline u32 fill_telemetry(u32 most){
+        auto& s = gStream;
+        if(most < sizeof(Telemetry) || time_us_64() < s.dueUs){ return 0; }
+        put(telemetry());
+        s.dueUs += s.periodUs;
+        return sizeof(Telemetry);
+    }
+
+    // The mic has stopped (the host closed its input) if nothing comes for this long. The rest is sent as silence.
+    constexpr u32 cCaptureStallUs = 100'000;
+    inline u32 fill_capture(u32 most){
+        auto& q = mic::gCapture;
+        u32 samples = most / sizeof(s16);
+        u32 n = 0;
+        for(auto s: q.read_spans()){
+            auto part = s.first(std::min<u32>(s.size(), samples - n));
+            gTx.write_from({(u8 const*)part.data(), part.size_bytes()});
+            n += part.size();
+        }
+        q.commit_read(n);
+        if(n > 0){
+            gStream.dueUs = time_us_64() + cCaptureStallUs;
+        }else if(time_us_64() >= gStream.dueUs){
+            for(auto s: gTx.write_spans()){ std::ranges::fill(s, 0); }
+            n = samples;
+            gTx.commit_write(n * sizeof(s16));
+        }
+        return n * sizeof(s16);
+    }
+
+    // Queues the header of a reply streamed by `fill`, after the first `queued` bytes of it, which must follow.
+    inline bool start_stream(Header ref req, u32 length, u32 (*fill)(u32), u32 queued = 0){
+        if(!queue_header(req, Status::Ok, length, queued)){ return false; }
+        gStream = {.left = length - queued, .fill = fill};
+        return true;
+    }
+    inline void end_stream(){
+        gStream = {};
+        mic::gCapturing = false;
+    }
+
+    // Moves queued replies into the endpoint, and makes more of a streamed one. Call from the main loop, and when
+    // the endpoint has sent some.
+    inline void poll();
+    inline void tick(){
+        auto& s = gStream;
+        while(true){
+            if(s.left > 0){
+                u32 n = s.fill(std::min(s.left, gTx.space()));
+                s.left -= n;
+                s.at += n;
+                if(s.left == 0){ end_stream(); }
+            }
+            u32 sent = 0;
+            while(!gTx.empty()){
+                auto part = gTx.read_spans()[0];
+                u32 n = tud_vendor_write(part.data(), std::min<u32>(part.size(), tud_vendor_write_available()));
+                if(n == 0){ break; } // The endpoint's FIFO is full
+                gTx.commit_read(n);
+                sent += n;
+            }
+            gTxBytes += sent;
+            if(sent == 0){ break; }
+        }
+        tud_vendor_write_flush();
+        if(!streaming()){ poll(); } // Requests held back while it streamed
+    }
+
+    // Receiving
+    // -------------------
+    struct Receiver{
+        Header h;
+        u32 headerFill = 0;
+        u32 got = 0;                // Of the payload
+        u32 gather = 0;             // How much of the payload goes into `small`
+        Status status = Status::Ok; // Not Ok: swallow the payload, then reply with this
+        u16 crc = 0;                // Sink's, so far
+        alignas(8) array<u8, cSmallBytes> small;
+    };
+    inline Receiver gRx;
+
+    // How much of `op`'s payload is gathered before it's handled (the rest streams), or nothing if `length` is wrong.
+    constexpr opt<u32> gathered(Op op, u32 length){
+        auto exactly = [&](u32 n){ return length == n ? opt<u32>{n} : opt<u32>{}; };
+        switch(op){
+            case Op::Ping: return length <= cSmallBytes ? opt<u32>{length} : opt<u32>{};
+            case Op::CacheList: return exactly(0);
+            case Op::CachePlay: return exactly(sizeof(CachePlay));
+            case Op::CachePut: return length >= sizeof(CachePut) ? opt<u32>{sizeof(CachePut)} : opt<u32>{};
+            case Op::CacheDrop: return length == 0 ? exactly(0) : exactly(sizeof(u64));
+            case Op::Telemetry: return length == 0 ? exactly(0) : exactly(sizeof(TelemetryReq));
+            case Op::Capture: return exactly(sizeof(u32));
+            case Op::Source: return exactly(sizeof(u32));
+            case Op::Sink: return 0;
+        }
+        return {};
+    }
+
+    constexpr Status from_cache(cache::Result r){
+        switch(r){
+            case cache::Result::Ok: return Status::Ok;
+            case cache::Result::TooBig: return Status::TooBig;
+            case cache::Result::Short: return Status::BadLength;
+            case cache::Result::Flash: return Status::Flash;
+            case cache::Result::NotReady: return Status::NotReady;
+        }
+        return Status::Flash;
+    }
+    template<typename T> inline T gathered_as(){ return *(T const*)gRx.small.data(); }
+
+    // The gathered part is in. Uploads and Sink have more to come.
+    inline void on_gathered(){
+        auto& r = gRx;
+        if((Op)r.h.op == Op::CachePut){
+            auto put = gathered_as<CachePut>();
+            if(r.h.length - sizeof(CachePut) != adpcm::encoded_size(put.frames)){
+                r.status = Status::BadLength;
+            }else{
+                r.status = from_cache(cache::begin(put.key, put.frames));
+            }
+        }else if((Op)r.h.op == Op::Sink){
+            r.crc = 0xffff;
+        }
+    }
+
+    // The rest of the payload, as it arrives.
+    inline void on_streamed(span<const u8> bytes){
+        auto& r = gRx;
+        if((Op)r.h.op == Op::CachePut){
+            cache::write(bytes);
+        }else if((Op)r.h.op == Op::Sink){
+            r.crc = cobs::crc16(bytes, r.crc);
+        }
+    }
+
+    // The whole request is in.
+    inline void on_request(){
+        auto& r = gRx;
+        if(r.status != Status::Ok){
+            reply_header(r.h, r.status);
+            return;
+        }
+        switch((Op)r.h.op){
+            case Op::Ping:
+                if(reply_header(r.h, Status::Ok, r.h.length)){ gTx.write_from(span{r.small}.first(r.h.length)); }
+                break;
+            case Op::CacheList:{
+                auto all = cache::entries();
+                if(!reply_header(r.h, Status::Ok, sizeof(CacheInfo) + all.size() * sizeof(CacheClip))){ break; }
+                put(CacheInfo{.sectors = cache::cSectors, .free = cache::cSectors - cache::used_sectors(), .sectorBytes = cache::cSectorBytes, .count = (u32)all.size()});
+                for(auto& e: all){ put(CacheClip{.key = e.key, .frames = e.frames, .sectors = e.sectors}); }
+                break;
+            }
+            case Op::CachePlay:{
+                auto play = gathered_as<CachePlay>();
+                auto s = !cache::find(play.key) ? Status::NotFound
+                       : !cache::play(play.key, play.gain ? play.gain : mixer::cDefaultGain) ? Status::Busy
+                       : Status::Ok;
+                reply_header(r.h, s);
+                break;
+            }
+            case Op::CachePut:
+                reply_header(r.h, from_cache(cache::finish()));
+                break;
+            case Op::CacheDrop:
+                if(r.h.length == 0){
+                    reply_header(r.h, cache::drop_all() ? Status::Ok : Status::Flash);
+                }else{
+                    reply_header(r.h, cache::drop(gathered_as<u64>()) ? Status::Ok : Status::NotFound);
+                }
+                break;
+            case Op::Telemetry:{
+                auto req = r.h.length == 0 ? TelemetryReq{.count = 1} : gathered_as<TelemetryReq>();
+                if(u64 length = (u64)req.count * sizeof(Telemetry); length > UINT32_MAX){
+                    reply_header(r.h, Status::TooBig);
+                }else if(start_stream(r.h, (u32)length, fill_telemetry)){
+                    gStream.periodUs = req.periodUs;
+                    gStream.dueUs = time_us_64();
+                }
+                break;
+            }
+            case Op::Capture:{
+                u32 frames = gathered_as<u32>();
+                if(frames > (UINT32_MAX - sizeof(CaptureInfo)) / sizeof(s16)){
+                    reply_header(r.h, Status::TooBig);
+                    break;
+                }
+                if(!start_stream(r.h, sizeof(CaptureInfo) + frames * sizeof(s16), fill_capture, sizeof(CaptureInfo))){ break; }
+                put(CaptureInfo{.rate = usbSampleRate.load(std::memory_order_relaxed), .frames = frames});
+                mic::gCapture.commit_read(mic::gCapture.length()); // Only from now on
+                mic::gCapturing = streaming();
+                gStream.dueUs = time_us_64() + cCaptureStallUs;
+                break;
+            }
+            case Op::Source:
+                start_stream(r.h, gathered_as<u32>(), fill_source);
+                break;
+            case Op::Sink:
+                if(reply_header(r.h, Status::Ok, sizeof(r.crc))){ put(r.crc); }
+                break;
+        }
+    }
+
+    // Takes bytes from the OUT endpoint, in whatever pieces they come. Stops after a request whose reply streams,
+    // returning how many it took.
+    inline u32 receive(span<const u8> in){
+        auto& r = gRx;
+        u32 took = 0;
+        while(took < in.size() && !streaming()){
+            auto rest = in.subspan(took);
+            u32 n;
+            if(r.headerFill < sizeof(Header)){
+                n = std::min<u32>(rest.size(), sizeof(Header) - r.headerFill);
+                std::copy_n(rest.begin(), n, (u8*)&r.h + r.headerFill);
+                r.headerFill += n;
+                if(r.headerFill == sizeof(Header)){
+                    auto gather = gathered((Op)r.h.op, r.h.length);
+                    r.got = 0;
+                    r.gather = gather.value_or(0);
+                    r.status = std::ranges::find(cOps, (Op)r.h.op) == cOps.end() ? Status::UnknownOp : !gather ? Status::BadLength : Status::Ok;
+                    if(r.status == Status::Ok && r.gather == 0){ on_gathered(); }
+                }
+            }else if(r.got < r.gather){
+                n = std::min<u32>(rest.size(), r.gather - r.got);
+                std::copy_n(rest.begin(), n, r.small.begin() + r.got);
+                r.got += n;
+                if(r.got == r.gather && r.status == Status::Ok){ on_gathered(); }
+            }else{
+                n = std::min<u32>(rest.size(), r.h.length - r.got);
+                if(r.status == Status::Ok){ on_streamed(rest.first(n)); }
+                r.got += n;
+            }
+            took += n;
+            if(r.headerFill == sizeof(Header) && r.got == r.h.length){
+                on_request();
+                r.headerFill = 0;
+            }
+        }
+        gRxBytes += took;
+        return took;
+    }
+
+    // Read from the OUT endpoint's FIFO but not yet taken, because a streamed reply came first.
+    inline array<u8, cTransferBytes> gIn;
+    inline u32 gInAt = 0;
+    inline u32 gInEnd = 0;
+
+    // Reads whatever the OUT endpoint has. From tud_vendor_rx_cb, and `tick` once a streamed reply is done.
+    inline void poll(){
+        while(!streaming()){
+            if(gInAt == gInEnd){
+                gInAt = 0;
+                gInEnd = tud_vendor_read(gIn.data(), gIn.size());
+                if(gInEnd == 0){ break; }
+            }
+            gInAt += receive(span{gIn}.subspan(gInAt, gInEnd - gInAt));
+        }
+    }
+
+    // Forgets a half received request and unsent replies. On unplugging.
+    inline void reset(){
+        gRx.headerFill = 0;
+        gInAt = gInEnd = 0;
+        gTx.commit_read(gTx.length());
+        end_stream();
+        gRxBytes = gTxBytes = 0;
+    }
+}
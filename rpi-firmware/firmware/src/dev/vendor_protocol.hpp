@@ -0,0 +1,58 @@
+#pragma once
+#include "../common.hpp"
+#include "../ctl_protocol.hpp"
+
+// The vendor bulk interface's messages (see vendor.hpp). Shared with the host client (tools/vendor_client.hpp) and
+// software/clip_cache.py, so all ends agree on the layout.
+// Every message, either way, is a Header then `length` bytes of payload. Each request gets one reply carrying its op
+// with the top bit set and its tag, so the host can match them up. Payloads are packed little endian structs.
+// The device takes USB transfers of up to cTransferBytes, which end early on a short packet. So a host must end a
+// request whose size is a multiple of cPacketBytes with a zero length packet, or it sits in the device unread.
+namespace dev::vendor{
+    constexpr u32 cPacketBytes = 64;    // Full speed bulk
+    constexpr u32 cTransferBytes = 512; // CFG_TUD_VENDOR_EPSIZE
+    constexpr u16 cVid = 0x2E8A;
+    constexpr u16 cPid = 0x0010;
+
+    struct PACKED Header{
+        u8 op;
+        u8 status;  // Replies: a Status
+        u16 tag;    // Anything. Echoed.
+        u32 length; // Of the payload that follows
+    };
+    static_assert(sizeof(Header) == 8);
+
+    enum class Op: u8{
+        Ping = 0x01,      // Echoes the payload (up to cSmallBytes)
+        CacheList = 0x10, // -> CacheInfo, then a CacheClip per clip
+        CachePlay = 0x11, // CachePlay
+        CachePut = 0x12,  // CachePut, then adpcm::encoded_size(frames) bytes of blocks
+        CacheDrop = 0x13, // A u64 key, or nothing for all of them
+        Telemetry = 0x20, // TelemetryReq, or nothing for one -> that many Telemetry, as they're taken
+        Capture = 0x21,   // u32 frames -> CaptureInfo, then that many s16 mic samples as they're sent to the host
+        Source = 0x30,    // u32 n -> n bytes, byte i being (u8)i. For measuring throughput.
+        Sink = 0x31,      // Any number of bytes -> their u16 CRC (cobs::crc16)
+    };
+    constexpr auto cOps = std::to_array({Op::Ping, Op::CacheList, Op::CachePlay, Op::CachePut, Op::CacheDrop,
+                                         Op::Telemetry, Op::Capture, Op::Source, Op::Sink});
+    constexpr u8 cReplyBit = 0x80;
+    enum class Status: u8{ Ok, UnknownOp, BadLength, NotFound, TooBig, Flash, NotReady, Busy };
+
+    constexpr u32 cSmallBytes = 64; // The most of a request's payload gathered before it's handled
+
+    struct PACKED CacheInfo{ u32 sectors; u32 free; u32 sectorBytes; u32 count; };
+    struct PACKED CacheClip{ u64 key; u32 frames; u32 sectors; };
+    struct PACKED CachePlay{ u64 key; u16 gain; }; // gain::Q15. 0 for the default.
+    struct PACKED CachePut{ u64 key; u32 frames; };
+
+    struct PACKED TelemetryReq{ u32 count; u32 periodUs; };
+    struct PACKED Telemetry{
+        u32 timeUs;      // When it was taken, since boot
+        ctl::Audio audio;
+        ctl::Voice voice;
+        u32 micRate;     // What the host records at
+        u32 rxBytes;     // Through this interface since plugging in
+        u32 txBytes;
+    };
+    struct PACKED CaptureInfo{ u32 rate; u32 frames; };
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "common.hpp"
+#include "ctmath.hpp"
+
+// Fixed-point speaker volume.
+// Gains are Q15 (0x8000 is 0 dB). Applying one to a 16 bit sample gives a sample at the top of 32 bits,
+// so 0 dB passes the host's samples through untouched.
+// The UAC2 volume control arrives in 1/256 dB steps. It's mapped through two small tables (whole dB and the
+// 1/256 dB fraction) whose product covers the whole advertised range at full resolution.
+namespace gain{
+    using Q15 = u16;
+    constexpr Q15 cUnity = 1 << 15;
+    constexpr s16 cMinDb256 = -50 * 256; // The volume range advertised to the host
+    constexpr s16 cMaxDb256 = 0;
+
+    namespace detail{
+        constexpr f64 attenuation(f64 db){ return ctmath::exp(-db * 0.11512925464970229); } // 10^(-dB/20), ln(10)/20
+
+        constexpr u32 to_q31(f64 v){ return (u32)(v * (1u << 31) + 0.5); }
+    }
+
+    // 10^(-dB/20) in Q31, for whole dB 0..=50 and for 0..255/256 dB.
+    constexpr auto cWholeDb = []{
+        array<u32, -cMinDb256 / 256 + 1> t;
+        for(u32 i = 0; i < t.size(); i++){ t[i] = detail::to_q31(detail::attenuation(i)); }
+        return t;
+    }();
+    constexpr auto cFracDb = []{
+        array<u32, 256> t;
+        for(u32 i = 0; i < t.size(); i++){ t[i] = detail::to_q31(detail::attenuation(i / 256.0)); }
+        return t;
+    }();
+
+    // UAC2 volume (dB * 256) to a Q15 gain. Clamped to the advertised range.
+    constexpr Q15 from_db256(s16 db256){
+        u32 att = -clamp(cMinDb256, db256, cMaxDb256);
+        u64 q31 = ((u64)cWholeDb[att >> 8] * cFracDb[att & 0xff]) >> 31;
+        return (Q15)((q31 + (1 << 15)) >> 16);
+    }
+    static_assert(from_db256(0) == cUnity);
+    static_assert(from_db256(-6 * 256) == 16423); // 0.501187
+
+    // A 16 bit sample scaled by a Q15 gain, at the top of 32 bits.
+    constexpr s32 apply(s16 sample, Q15 g){ return (s32)sample * (s32)g * 2; }
+
+    // Ramps linearly from the gain of the last block to the new target across one block, so volume moves and
+    // mutes don't step mid-waveform (zipper noise). Once there, the step is 0 and it's a plain multiply.
+    struct Ramp{
+        Q15 current = 0; // Gain at the end of the last block. Starting at 0 fades the first block in.
+
+        // Per block state. The gain is kept with 16 extra fraction bits so small changes still ramp smoothly.
+        struct Stepper{
+            u32 acc;
+            s32 step;
+            constexpr s32 next(SelfMut, s16 sample){
+                self.acc += self.step;
+                return apply(sample, (Q15)(self.acc >> 16));
+            }
+        };
+
+        // Starts a block of `n` samples heading to `target`. The last sample of the block lands on it.
+        constexpr Stepper begin_block(SelfMut, Q15 target, u32 n){
+            Stepper s = {.acc = (u32)self.current << 16, .step = (s32)((((s64)target - self.current) << 16) / n)};
+            s.acc += ((u32)target << 16) - (s.acc + s.step * n); // Land exactly on the target despite the truncated step
+            self.current = target;
+            return s;
+        }
+    };
+}
@@ -0,0 +1,5 @@
+#include "../common.hpp"
+
+// The mixer's clips (see mixer.hpp), linked into flash. An ADPCM pack built by tools/adpcm_pack from res/clips/.
+// Found through the include path (res/incbin/). Only this file may define it.
+INCBIN(Clips, "clips.adpcm");
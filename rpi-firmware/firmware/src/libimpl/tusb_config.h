@@ -92,6 +92,16 @@
 #define CFG_TUD_CDC_RX_BUFSIZE                    64
 #define CFG_TUD_CDC_TX_BUFSIZE                    64
 
+//--------------------------------------------------------------------
+// VENDOR CLASS DRIVER CONFIGURATION
+//--------------------------------------------------------------------
+
+// The bulk data interface (see dev/vendor.hpp). Transfers are several packets each, so they run from the USB IRQ
+// rather than one per tud_task, and the FIFOs hold two of them. Replies queue up in the firmware, not here.
+#define CFG_TUD_VENDOR_EPSIZE                     512 // dev::vendor::cTransferBytes
+#define CFG_TUD_VENDOR_RX_BUFSIZE                 1024
+#define CFG_TUD_VENDOR_TX_BUFSIZE                 1024
+
 //--------------------------------------------------------------------
 // AUDIO DRIVER CONFIGURATION
 //--------------------------------------------------------------------
@@ -106,13 +116,13 @@
 #define AUD_MIC_BITS_PER_SAMPLE     16
 #define AUD_MIC_CHANNELS            1
 
-#define CFG_TUD_AUDIO_FUNC_1_DESC_LEN           227 // Coded in C++, hardcoded here. sizeof(UAC2_DESCRIPTORS)
+#define CFG_TUD_AUDIO_FUNC_1_DESC_LEN           234 // Coded in C++, hardcoded here. sizeof(UAC2_DESCRIPTORS)
 #define CFG_TUD_AUDIO_FUNC_1_N_AS_INT           2   // (NOTE: 1 or 2?) Number of Standard AS Interface Descriptors (4.9.1) defined per audio function - this is required to be able to remember the current alternate settings of these interfaces - We restrict us here to have a constant number for all audio functions (which means this has to be the maximum number of AS interfaces an audio function has and a second audio function with less AS interfaces just wastes a few bytes)
 #define CFG_TUD_AUDIO_FUNC_1_CTRL_BUF_SZ        64  // Size of control request buffer
 
 // Speaker stuff config
 #define CFG_TUD_AUDIO_ENABLE_EP_OUT             1
-#define CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP        1 // TODO: We don't use this yet, but this could be used to prevent buffer overruns?
+#define CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP        1 // Asynchronous speaker. The rate is steered from the ring fill level (see rate_feedback.hpp)
 #define CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX      TUD_AUDIO_EP_SIZE(AUD_SPK_SAMPLE_RATE, AUD_SPK_BYTES_PER_SAMPLE, AUD_SPK_CHANNELS)
 #define CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ   (TUD_OPT_HIGH_SPEED ? 32 : 4) * CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX // 1.1 (FS) reads once per ms, 2.0 (HS) is 8x faster (hence 32)
 
@@ -20,6 +20,7 @@ enum StringDescriptors{
     SD_UAC_UAC2,
     SD_UAC_SPEAKER,
     SD_UAC_MICROPHONE,
+    SD_VENDOR,
 };
 
 //--------------------------------------------------------------------
@@ -29,6 +30,7 @@ enum StringDescriptors{
 enum EndpointsOut{
     EPO_CDC = 0x01,
     EPO_AUD = 0x04,
+    EPO_VENDOR = 0x06,
 };
 enum EndpointsIn{
     EPI_CDC = 0x81,
@@ -36,16 +38,7 @@ enum EndpointsIn{
     EPI_AUD_INT = 0x83,
     EPI_AUD = 0x84,
     EPI_AUD_FB = 0x85,
-};
-
-enum InterfaceIDs{
-    ITF_CDC = 0,
-    ITF_CDC_DATA, // Implicit (keep directly after CDC)
-    ITF_RPI_RESET,
-    ITF_AUDIO_CONTROL,
-    ITF_AUDIO_SPEAKER,
-    ITF_AUDIO_MICROPHONE,
-    ITF_COUNTOF
+    EPI_VENDOR = 0x86,
 };
 
 //--------------------------------------------------------------------
@@ -93,7 +86,7 @@ static constexpr tusb_desc_device_t usbd_desc_device = {
     /* Output Terminal Descriptor(4.7.2.5) */\
     TUD_AUDIO_DESC_OUTPUT_TERM(TERMID_MIC_OUT, AUDIO_TERM_TYPE_USB_STREAMING, /*_assocTerm*/ 0x00, TERMID_MIC_IN, TERMID_CLK, /*_ctrl*/ 0, NO_STR)\
 
-#define UAC2_DESCRIPTORS(_stridx, _epout, _epin, _epint) \
+#define UAC2_DESCRIPTORS(_stridx, _epout, _epfb, _epin, _epint) \
     /* Standard Interface Association Descriptor (IAD): Tells the host to strongly group UAC, Speaker, & Mic interfaces*/\
     TUD_AUDIO_DESC_IAD(ITF_AUDIO_CONTROL, 3, NO_STR),\
     /* Standard AC Interface Descriptor(4.7.1) */\
@@ -109,15 +102,18 @@ static constexpr tusb_desc_device_t usbd_desc_device = {
     TUD_AUDIO_DESC_STD_AS_INT(ITF_AUDIO_SPEAKER, /*_altset*/ 0, /*_nEPs*/ 0, SD_UAC_SPEAKER),\
     /* Standard AS Interface Descriptor(4.9.1) */\
     /* Interface 1, Alternate 1 - alternate interface for data streaming */\
-    TUD_AUDIO_DESC_STD_AS_INT(ITF_AUDIO_SPEAKER, /*_altset*/ 1, /*_nEPs*/ 1, SD_UAC_SPEAKER),\
+    TUD_AUDIO_DESC_STD_AS_INT(ITF_AUDIO_SPEAKER, /*_altset*/ 1, /*_nEPs*/ 2, SD_UAC_SPEAKER),\
         /* Class-Specific AS Interface Descriptor(4.9.2) */\
         TUD_AUDIO_DESC_CS_AS_INT(TERMID_SPK_IN, AUDIO_CTRL_NONE, AUDIO_FORMAT_TYPE_I, AUDIO_DATA_FORMAT_TYPE_I_PCM, AUD_SPK_CHANNELS, AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, NO_STR),\
         /* Type I Format Type Descriptor(2.3.1.6 - Audio Formats) */\
         TUD_AUDIO_DESC_TYPE_I_FORMAT(AUD_SPK_BYTES_PER_SAMPLE, AUD_SPK_BITS_PER_SAMPLE),\
         /* Standard AS Isochronous Audio Data Endpoint Descriptor(4.10.1.1) */\
-        TUD_AUDIO_DESC_STD_AS_ISO_EP(_epout, ((u8)TUSB_XFER_ISOCHRONOUS | (u8)TUSB_ISO_EP_ATT_ADAPTIVE | (u8)TUSB_ISO_EP_ATT_DATA), CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, /*_interval*/ 0x01),\
+        /* Asynchronous: the DAC runs off our clock, and the feedback endpoint tells the host how fast to send */\
+        TUD_AUDIO_DESC_STD_AS_ISO_EP(_epout, ((u8)TUSB_XFER_ISOCHRONOUS | (u8)TUSB_ISO_EP_ATT_ASYNCHRONOUS | (u8)TUSB_ISO_EP_ATT_DATA), CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, /*_interval*/ 0x01),\
         /* Class-Specific AS Isochronous Audio Data Endpoint Descriptor(4.10.1.2) */\
         TUD_AUDIO_DESC_CS_AS_ISO_EP(AUDIO_CS_AS_ISO_DATA_EP_ATT_NON_MAX_PACKETS_OK, AUDIO_CTRL_NONE, AUDIO_CS_AS_ISO_DATA_EP_LOCK_DELAY_UNIT_MILLISEC, /*_lockdelay*/ 1),\
+        /* Standard AS Isochronous Feedback Endpoint Descriptor(4.10.2.1) */\
+        TUD_AUDIO_DESC_STD_AS_ISO_FB_EP(_epfb, /*_epsize*/ 4, /*_interval*/ 0x01),\
     /* Standard AS Interface Descriptor(4.9.1) */\
     /* Interface 2, Alternate 0 - default alternate setting with 0 bandwidth */\
     TUD_AUDIO_DESC_STD_AS_INT(ITF_AUDIO_MICROPHONE, /*_altset*/ 0, /*_nEPs*/ 0, SD_UAC_MICROPHONE),\
@@ -137,7 +133,7 @@ static constexpr tusb_desc_device_t usbd_desc_device = {
 constexpr bool attribBusPowered = true;
 constexpr bool attribSelfPowered = false;
 constexpr u8 configAttribs = (attribBusPowered << 7) | (attribSelfPowered << 6);
-static_assert(sizeof(std::to_array<u8>({UAC2_DESCRIPTORS(SD_UAC_UAC2, EPO_AUD, EPI_AUD, EPI_AUD_INT)})) == CFG_TUD_AUDIO_FUNC_1_DESC_LEN, "These must match (update tusb_config)");
+static_assert(sizeof(std::to_array<u8>({UAC2_DESCRIPTORS(SD_UAC_UAC2, EPO_AUD, EPI_AUD_FB, EPI_AUD, EPI_AUD_INT)})) == CFG_TUD_AUDIO_FUNC_1_DESC_LEN, "These must match (update tusb_config)");
 
 static constexpr auto usbd_desc_cfg = []()consteval{
     constexpr u16 USBD_MAX_POWER_MA = 250;
@@ -145,7 +141,8 @@ static constexpr auto usbd_desc_cfg = []()consteval{
         TUD_CONFIG_DESCRIPTOR(1, ITF_COUNTOF, 0, /*len*/0, configAttribs, USBD_MAX_POWER_MA),
         TUD_CDC_DESCRIPTOR(ITF_CDC, SD_CDC, EPI_CDC_CMD, 8, EPO_CDC, EPI_CDC, 64),
         TUD_RPI_RESET_DESCRIPTOR(ITF_RPI_RESET, SD_RPI_RESET),
-        UAC2_DESCRIPTORS(SD_UAC_UAC2, EPO_AUD, EPI_AUD, EPI_AUD_INT),
+        UAC2_DESCRIPTORS(SD_UAC_UAC2, EPO_AUD, EPI_AUD_FB, EPI_AUD, EPI_AUD_INT),
+        TUD_VENDOR_DESCRIPTOR(ITF_VENDOR, SD_VENDOR, EPO_VENDOR, EPI_VENDOR, 64),
     });
     temp[2] = sizeof(temp) & 0xff; // Patch in the correct length
     temp[3] = sizeof(temp) >> 8;
@@ -200,6 +197,7 @@ extern "C" u16 const* tud_descriptor_string_cb(u8 index, u16 langid) {
         X(SD_UAC_UAC2, "UAC Compliant Device");
         X(SD_UAC_SPEAKER, "UAC Speaker");
         X(SD_UAC_MICROPHONE, "UAC Microphone");
+        X(SD_VENDOR, "Board Data");
     }
     return nullptr;
 }
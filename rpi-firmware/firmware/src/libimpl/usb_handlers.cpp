@@ -3,7 +3,10 @@
 #include "../dev/i2s_protocol.hpp"
 #include "../dev/i2s_dac.hpp"
 #include "../dev/mic_adc.hpp"
+#include "../dev/vendor.hpp"
 #include "../console.hpp"
+#include "../gain.hpp"
+#include "../profile.hpp"
 
 #include <stdio.h>
 #include "pico/stdlib.h"
@@ -18,7 +21,10 @@
 // --------------------------------------
 
 void tud_mount_cb(){}
-void tud_umount_cb(){}
+void tud_umount_cb(){
+    dev::vendor::reset();
+    ctl::reset();
+}
 void tud_suspend_cb(bool remote_wakeup_en){}
 void tud_resume_cb(){}
 
@@ -28,35 +34,19 @@ void tud_resume_cb(){}
 
 void tud_cdc_rx_cb(uint8_t itf){
     // Only one CDC interface exists on the device, so `itf` is ignored.
-    static array<u8, 128> buf;
-    static u32 buf_write_head = 0;
-
-    if(tud_cdc_connected() && tud_cdc_available() > 0) {
-        // Add the text into the buffer
-        buf_write_head += tud_cdc_read(&buf[buf_write_head], sizeof(buf) - buf_write_head);
-        // Look for the newlines and process the strings
-        {
-            u32 front = 0;
-            for(size_t i = 0; i < buf_write_head; i++){
-                if(buf[i] != '\n') continue;
-                auto s = sv{(char*)&buf[front], i - front};
-                front = i + 1; // skip \n
-                console::processline(s);
-            }
-            if(front == 0 && buf_write_head == sizeof(buf)){ // Traversed the whole buffer without finding a newline
-                sv msg = "Message too long. Ignored";
-                tud_cdc_write(msg.begin(), msg.size());
-                tud_cdc_write_flush();
-            }
-            // Move the remaining characters into the front of the buf in prep for the next recv.
-            bool buf_full = front >= sizeof(buf);
-            auto buf_remainder = buf_write_head - front;
-            if(buf_full){
-                std::copy_n(buf.begin() + front, buf_remainder, buf.begin());
-            }
-            buf_write_head = buf_full ? 0 : buf_remainder;
-        }
-    }
+    console::poll();
+}
+
+// --------------------------------------
+// The bulk data backend (see dev/vendor.hpp)
+// --------------------------------------
+
+void tud_vendor_rx_cb(uint8_t itf, uint8_t const* buffer, uint16_t bufsize){
+    // With CFG_TUD_VENDOR_RX_BUFSIZE set, TinyUSB hands the data over through its FIFO rather than `buffer`.
+    dev::vendor::poll();
+}
+void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes){
+    dev::vendor::tick(); // Keep the IN FIFO topped up between main loop passes
 }
 
 // --------------------------------------
@@ -77,6 +67,7 @@ enum VOLUME_CTRL {
     VOLUME_CTRL_100_DB = 25600,
     VOLUME_CTRL_SILENCE = 0x8000,
 };
+static_assert(-VOLUME_CTRL_50_DB == gain::cMinDb256, "The advertised range must match the gain table");
 
 static array<bool, 1+AUD_SPK_CHANNELS + 1> muteCtrls = {}; // 0: Master, 1: First channel (mono), 2: Second apparently. It shouldn't exist but windows is writing to it.
 static array<s16, 1+AUD_SPK_CHANNELS + 1> volumeCtrls = {};
@@ -84,21 +75,18 @@ static array<s16, 1+AUD_SPK_CHANNELS + 1> volumeCtrls = {};
 inline void updateVolume(){
     bool muted = std::ranges::any_of(muteCtrls, [](auto v){return v;});
     if(muted){
-        volumeFactor = 0; // shift out to null
-        console::dbg("Muted: ");
+        volumeFactor = 0; // The DAC ramps down to this, so muting doesn't click
+        console::dbg(FMT("Muted: "));
     }else{
-        //
-        auto mvol = *std::ranges::min_element(volumeCtrls); // VOLUME_CTRL_50_DB
-        u16 reduction_factor = std::abs(mvol);
-        reduction_factor = std::min(reduction_factor, (u16)VOLUME_CTRL_50_DB) * 5;
-        volumeFactor = (UINT16_MAX - reduction_factor) >> 2;
+        auto mvol = *std::ranges::min_element(volumeCtrls); // Down to -VOLUME_CTRL_50_DB
+        volumeFactor = gain::from_db256(mvol);
     }
-    console::dbgln("Vol fact: %d", (int)volumeFactor);
+    console::dbgln(FMT("Vol fact: %d"), (int)volumeFactor);
 }
 
-// List of supported sample rates
-constexpr auto sample_rates = std::to_array<u32>({48000});
-uint32_t current_sample_rate = sample_rates[0];
+// List of supported sample rates. The I2S and ADC clocks stay at 48k, the audio paths resample to/from these.
+constexpr auto sample_rates = std::to_array<u32>({16000, 24000, 32000, 44100, 48000});
+static_assert(sample_rates.back() == AUD_SPK_SAMPLE_RATE && sample_rates.back() == AUD_MIC_SAMPLE_RATE, "The endpoints are sized for the highest rate");
 
 // Helper for feature unit set requests
 static bool audio_feature_unit_set_request(uint8_t rhport, audio_control_request_t const *request, uint8_t const *buf) {
@@ -108,17 +96,17 @@ static bool audio_feature_unit_set_request(uint8_t rhport, audio_control_request
     if (request->bControlSelector == AUDIO_FU_CTRL_MUTE) {
         TU_VERIFY(request->wLength == sizeof(audio_control_cur_1_t));
         muteCtrls[request->bChannelNumber] = ((audio_control_cur_1_t const *) buf)->bCur;
-        console::dbgln("USB %d Mute: %d", request->bChannelNumber, muteCtrls[request->bChannelNumber]);
+        console::dbgln(FMT("USB %d Mute: %d"), request->bChannelNumber, muteCtrls[request->bChannelNumber]);
         updateVolume();
         return true;
     } else if (request->bControlSelector == AUDIO_FU_CTRL_VOLUME) {
         TU_VERIFY(request->wLength == sizeof(audio_control_cur_2_t));
         volumeCtrls[request->bChannelNumber] = ((audio_control_cur_2_t const *) buf)->bCur;
-        console::dbgln("USB %d volume: %d dB", request->bChannelNumber, volumeCtrls[request->bChannelNumber] / 256);
+        console::dbgln(FMT("USB %d volume: %d dB"), request->bChannelNumber, volumeCtrls[request->bChannelNumber] / 256);
         updateVolume();
         return true;
     } else {
-        console::dbgln("USB Feature SET not supported, entity = %u, selector = %u, request = %u",
+        console::dbgln(FMT("USB Feature SET not supported, entity = %u, selector = %u, request = %u"),
                 request->bEntityID, request->bControlSelector, request->bRequest);
         return false;
     }
@@ -132,11 +120,17 @@ static bool audio_clock_set_request(uint8_t rhport, audio_control_request_t cons
 
     if (request->bControlSelector == AUDIO_CS_CTRL_SAM_FREQ) {
         TU_VERIFY(request->wLength == sizeof(audio_control_cur_4_t));
-        current_sample_rate = (uint32_t) ((audio_control_cur_4_t const *) buf)->bCur;
-        console::dbgln("USB: Clock set current freq: %" PRIu32 "", current_sample_rate);
+        auto rate = (uint32_t) ((audio_control_cur_4_t const *) buf)->bCur;
+        TU_VERIFY(std::ranges::find(sample_rates, rate) != sample_rates.end());
+        usbSampleRate = rate; // The audio paths pick this up at their next block
+        // The host now sends at the new rate, so steer around that instead.
+        using namespace dev::dac;
+        gAudioRecvFeedback = RateFeedback::make(rate, gAudioRecvBuffer.capacity() / 2);
+        tud_audio_fb_set(gAudioRecvFeedback.value);
+        console::dbgln(FMT("USB: Clock set current freq: %" PRIu32 ""), rate);
         return true;
     } else {
-        console::dbgln("USB: Clock set not supported, entity = %u, selector = %u, request = %u",
+        console::dbgln(FMT("USB: Clock set not supported, entity = %u, selector = %u, request = %u"),
                 request->bEntityID, request->bControlSelector, request->bRequest);
         return false;
     }
@@ -148,28 +142,29 @@ static bool audio_clock_get_request(uint8_t rhport, audio_control_request_t cons
 
     if (request->bControlSelector == AUDIO_CS_CTRL_SAM_FREQ) {
         if (request->bRequest == AUDIO_CS_REQ_CUR) {
-            console::dbgln("USB: Clock GET current freq %" PRIu32 "", current_sample_rate);
+            u32 rate = usbSampleRate;
+            console::dbgln(FMT("USB: Clock GET current freq %" PRIu32 ""), rate);
 
-            audio_control_cur_4_t curf = {(int32_t) tu_htole32(current_sample_rate)};
+            audio_control_cur_4_t curf = {(int32_t) tu_htole32(rate)};
             return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *) request, &curf, sizeof(curf));
         } else if (request->bRequest == AUDIO_CS_REQ_RANGE) {
             audio_control_range_4_n_t(sample_rates.size()) rangef = {.wNumSubRanges = tu_htole16(sample_rates.size())};
-            console::dbgln("USB: Clock GET %d freq ranges", sample_rates.size());
+            console::dbgln(FMT("USB: Clock GET %d freq ranges"), sample_rates.size());
             for (uint8_t i = 0; i < sample_rates.size(); i++) {
                 rangef.subrange[i].bMin = (int32_t) sample_rates[i];
                 rangef.subrange[i].bMax = (int32_t) sample_rates[i];
                 rangef.subrange[i].bRes = 0;
-                console::dbgln("USB: Range %d (%d, %d, %d)", i, (int) rangef.subrange[i].bMin, (int) rangef.subrange[i].bMax, (int) rangef.subrange[i].bRes);
+                console::dbgln(FMT("USB: Range %d (%d, %d, %d)"), i, (int) rangef.subrange[i].bMin, (int) rangef.subrange[i].bMax, (int) rangef.subrange[i].bRes);
             }
 
             return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *) request, &rangef, sizeof(rangef));
         }
     } else if (request->bControlSelector == AUDIO_CS_CTRL_CLK_VALID && request->bRequest == AUDIO_CS_REQ_CUR) {
         audio_control_cur_1_t cur_valid = {.bCur = 1};
-        console::dbgln("USB: Clock get is valid %u", cur_valid.bCur);
+        console::dbgln(FMT("USB: Clock get is valid %u"), cur_valid.bCur);
         return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *) request, &cur_valid, sizeof(cur_valid));
     }
-    console::dbgln("USB: Clock GET not supported, entity = %u, selector = %u, request = %u",
+    console::dbgln(FMT("USB: Clock GET not supported, entity = %u, selector = %u, request = %u"),
             request->bEntityID, request->bControlSelector, request->bRequest);
     return false;
 }
@@ -180,23 +175,23 @@ static bool audio_feature_unit_get_request(uint8_t rhport, audio_control_request
 
     if (request->bControlSelector == AUDIO_FU_CTRL_MUTE && request->bRequest == AUDIO_CS_REQ_CUR) {
         audio_control_cur_1_t mute1 = {.bCur = muteCtrls[request->bChannelNumber]};
-        console::dbgln("USB: Get channel %u mute %d", request->bChannelNumber, mute1.bCur);
+        console::dbgln(FMT("USB: Get channel %u mute %d"), request->bChannelNumber, mute1.bCur);
         return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *) request, &mute1, sizeof(mute1));
     } else if (request->bControlSelector == AUDIO_FU_CTRL_VOLUME) {
         if (request->bRequest == AUDIO_CS_REQ_RANGE) {
             audio_control_range_2_n_t(1) range_vol = {
                 .wNumSubRanges = tu_htole16(1),
                 .subrange = {{.bMin = tu_htole16(-VOLUME_CTRL_50_DB), .bMax = tu_htole16(VOLUME_CTRL_0_DB), .bRes = tu_htole16(256)}}};
-            console::dbgln("USB: Get channel %u volume range (%d, %d, %u) dB", request->bChannelNumber,
+            console::dbgln(FMT("USB: Get channel %u volume range (%d, %d, %u) dB"), request->bChannelNumber,
                     range_vol.subrange[0].bMin / 256, range_vol.subrange[0].bMax / 256, range_vol.subrange[0].bRes / 256);
             return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *) request, &range_vol, sizeof(range_vol));
         } else if (request->bRequest == AUDIO_CS_REQ_CUR) {
             audio_control_cur_2_t cur_vol = {.bCur = tu_htole16(volumeCtrls[request->bChannelNumber])};
-            console::dbgln("USB: Get channel %u volume %d dB", request->bChannelNumber, cur_vol.bCur / 256);
+            console::dbgln(FMT("USB: Get channel %u volume %d dB"), request->bChannelNumber, cur_vol.bCur / 256);
             return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *) request, &cur_vol, sizeof(cur_vol));
         }
     }
-    console::dbgln("USB: Feature GET not supported, entity = %u, selector = %u, request = %u",
+    console::dbgln(FMT("USB: Feature GET not supported, entity = %u, selector = %u, request = %u"),
             request->bEntityID, request->bControlSelector, request->bRequest);
 
     return false;
@@ -215,7 +210,7 @@ bool tud_audio_set_req_entity_cb(uint8_t rhport, tusb_control_request_t const *p
     if (request->bEntityID == TERMID_CLK)
         return audio_clock_set_request(rhport, request, buf);
 
-    console::dbgln("USB: Set not handled, entity = %d, selector = %d, request = %d",
+    console::dbgln(FMT("USB: Set not handled, entity = %d, selector = %d, request = %d"),
           request->bEntityID, request->bControlSelector, request->bRequest);
     return false;
 }
@@ -229,7 +224,7 @@ bool tud_audio_get_req_entity_cb(uint8_t rhport, tusb_control_request_t const *p
     if (request->bEntityID == TERMID_SPK_FEAT)
         return audio_feature_unit_get_request(rhport, request);
 
-    console::dbgln("USB: Get not handled, entity = %d, selector = %d, request = %d",
+    console::dbgln(FMT("USB: Get not handled, entity = %d, selector = %d, request = %d"),
             request->bEntityID, request->bControlSelector, request->bRequest);
     return false;
 }
@@ -238,25 +233,43 @@ bool tud_audio_get_req_entity_cb(uint8_t rhport, tusb_control_request_t const *p
 bool tud_audio_rx_done_pre_read_cb(uint8_t rhport, uint16_t n_bytes_received, uint8_t func_id, uint8_t ep_out, uint8_t cur_alt_setting) {
     using namespace dev::dac;
     if (n_bytes_received == 0) return true; // Defensive: if nothing to read, return quickly
+    PROFILE_SCOPE(profile::Site::SpeakerRx);
+
+    // Read straight into the free regions of the ring (up to two when it wraps).
+    u32 bytesRead = 0;
+    for(auto region: gAudioRecvBuffer.write_spans()){
+        if(bytesRead >= n_bytes_received){ break; }
+        auto want = std::min<u32>(region.size_bytes(), n_bytes_received - bytesRead);
+        bytesRead += tud_audio_read(region.data(), want);
+    }
+    gAudioRecvBuffer.commit_write(bytesRead / sizeof(MonoAudioSampleBE));
 
-    // First chunk: up to end-of-ring
-    u32 bytesTillWrap = gAudioRecvBuffer.dist_till_writer_wrap() * sizeof(MonoAudioSampleBE);
-    auto bytesToReadFirst = std::min<u32>(bytesTillWrap, n_bytes_received);
-    auto bytesPreWrap = tud_audio_read(gAudioRecvBuffer.write_head(), bytesToReadFirst);
-    gAudioRecvBuffer.write_reserve_n(bytesPreWrap / sizeof(MonoAudioSampleBE));
-
-    // If there is more remaining (wrap happened), read the rest at ring.begin()
-    u16 remaining = n_bytes_received - bytesPreWrap;
-    if(remaining){
-        auto bytesPostWrap = tud_audio_read(gAudioRecvBuffer.ring.begin(), remaining);
-        gAudioRecvBuffer.write_reserve_n(bytesPostWrap / sizeof(MonoAudioSampleBE));
+    // Whatever didn't fit is dropped, else it would stay in the TinyUSB FIFO and back up further.
+    if(bytesRead < n_bytes_received){
+        static array<u8, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX> discard;
+        tud_audio_read(discard.begin(), std::min<u32>(sizeof(discard), n_bytes_received - bytesRead));
+        gAudioRecvBuffer.note_overrun();
     }
 
+    // Once per frame, steer the host's send rate towards keeping the ring half full.
+    tud_audio_fb_set(gAudioRecvFeedback.update(gAudioRecvBuffer.length()));
     return true;
 }
 
-// Stubbed set interface and interface close. We just pump all the time to one.
+// The feedback value is computed by us from the ring fill level (see RateFeedback), so TinyUSB's estimators stay off.
+void tud_audio_feedback_params_cb(uint8_t func_id, uint8_t alt_itf, audio_feedback_params_t* feedback_param) {
+    feedback_param->method = AUDIO_FEEDBACK_METHOD_DISABLED;
+    feedback_param->sample_freq = usbSampleRate;
+}
+
+// Set interface. Both streams pump all the time, the speaker just restarts its rate feedback.
 bool tud_audio_set_itf_cb(uint8_t rhport, tusb_control_request_t const *p_request) {
+    auto itf = tu_u16_low(p_request->wIndex);
+    auto alt = tu_u16_low(p_request->wValue);
+    if(itf == ITF_AUDIO_SPEAKER && alt != 0){
+        dev::dac::gAudioRecvFeedback.reset();
+        tud_audio_fb_set(dev::dac::gAudioRecvFeedback.value);
+    }
     return true;
 }
 bool tud_audio_set_itf_close_EP_cb(uint8_t rhport, tusb_control_request_t const* p_request) {
@@ -1,5 +1,6 @@
 #pragma once
 #include "tusb_config.h"
+#include <atomic>
 // Terminal IDs of importance to the descriptors and handlers
 // Unit numbers are arbitrary selected
 #define TERMID_CLK          0x04
@@ -9,4 +10,16 @@
 #define TERMID_MIC_IN       0x11
 #define TERMID_MIC_OUT      0x13
 
-inline u16 volumeFactor = 0;
+enum InterfaceIDs{
+    ITF_CDC = 0,
+    ITF_CDC_DATA, // Implicit (keep directly after CDC)
+    ITF_RPI_RESET,
+    ITF_AUDIO_CONTROL,
+    ITF_AUDIO_SPEAKER,
+    ITF_AUDIO_MICROPHONE,
+    ITF_VENDOR,
+    ITF_COUNTOF
+};
+
+inline std::atomic<u32> usbSampleRate = AUD_SPK_SAMPLE_RATE; // Set by the host through the clock source. Both streams run at it over USB.
+inline std::atomic<u16> volumeFactor = 0; // Target speaker gain (gain::Q15). Written by USB control requests (core0), read by the audio core
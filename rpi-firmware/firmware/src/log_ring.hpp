@@ -0,0 +1,270 @@
+#pragma once
+#include "common.hpp"
+#include "ring_queue.hpp"
+#include "ctl_protocol.hpp"
+#include "pico/platform.h"
+#include "hardware/sync.h"
+#include "tusb.h"
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+// Deferred console output. Printing only stores the format string's address and the raw arguments, a few words
+// into a ring, which is cheap and never blocks, so it's fine from USB callbacks and IRQs. `tick` formats them and
+// writes them to the CDC port from the main loop, only as fast as the port takes them.
+// One ring per core, each a single producer queue: within a core, interrupts are held off for the few cycles a
+// record takes to copy in. When a ring is full the message is dropped, and `tick` reports how many were.
+// Strings passed as arguments are read when the message is printed, so they must outlive it (literals, flash).
+// Built with LOG_INTERNED, the format strings aren't in flash at all, and messages go to the host as Msg::Log frames
+// of the format's ID and the arguments packed (see `encode`), as many frames as that takes. tools/logdump turns them
+// back into text with the ELF.
+#ifndef LOG_INTERNED
+#define LOG_INTERNED 0
+#endif
+
+// A format string, written FMT("...") wherever something is printed.
+// Interned, each goes in its own .logfmt.N section (GCC won't put inline functions' statics in one section with
+// other statics), which the linker gathers into .logfmt: not loaded, at address 0, so a string's address is its ID
+// (see src/libimpl/logfmt.ld). Not inside templates: GCC leaves their statics in .rodata, whatever section is asked for.
+#define LOGRING_STR_(x) #x
+#define LOGRING_STR(x) LOGRING_STR_(x)
+#if LOG_INTERNED
+#define FMT(s) (::logring::Fmt{[]{ [[gnu::section(".logfmt." LOGRING_STR(__COUNTER__))]] static constexpr char cS[] = s; return cS; }()})
+#else
+#define FMT(s) (::logring::Fmt{s})
+#endif
+
+namespace logring{
+    struct Fmt{ char const* at; }; // Interned, only an ID: there's nothing there to read
+    using Word = uintptr_t;
+    constexpr u32 cWords = 512;     // Per core
+    constexpr u32 cLineChars = 192; // Longer messages are cut short. Ones without arguments are printed as they are.
+    constexpr u32 cMaxArgWords = 16;
+
+    // What an argument is stored as: what printf would have been passed.
+    template<typename T> using Stored = std::conditional_t<std::is_floating_point_v<decltype(+std::declval<T>())>, f64, decltype(+std::declval<T>())>;
+    template<typename T> constexpr u32 cWordsOf = (sizeof(T) + sizeof(Word) - 1) / sizeof(Word);
+
+    template<typename... P> inline std::tuple<P...> unpack(Word const* args){
+        std::tuple<P...> values;
+        u32 at = 0;
+        std::apply([&](auto&... v){ ((std::memcpy(&v, args + at, sizeof(v)), at += cWordsOf<std::remove_reference_t<decltype(v)>>), ...); }, values);
+        return values;
+    }
+
+#if LOG_INTERNED
+    // Interned arguments, in order: integers (and pointers other than strings) as zigzag varints of their value as
+    // an s64, floats as a little endian f64, strings as a varint length and their bytes. A string is cut short to fit
+    // the message (cLineChars, like the text build's), and arguments that don't fit at all are left off. The host
+    // knows which is which from the format.
+    inline u32 put_varint(u64 v, span<u8> out){
+        u32 n = 0;
+        do{
+            if(n == out.size()){ return 0; }
+            out[n++] = (u8)(v & 0x7f) | (v >= 0x80 ? 0x80 : 0);
+            v >>= 7;
+        }while(v);
+        return n;
+    }
+    template<typename T> inline u32 put(T v, span<u8> out){
+        if constexpr(std::is_same_v<std::remove_cv_t<std::remove_pointer_t<T>>, char> && std::is_pointer_v<T>){
+            static_assert(cLineChars < 1 << 14, "Lengths take at most 2 bytes");
+            if(out.size() < 2){ return 0; }
+            size_t len = v ? strnlen(v, out.size() - 2) : 0;
+            u32 n = put_varint(len, out);
+            std::memcpy(&out[n], v, len);
+            return n + len;
+        }else if constexpr(std::is_floating_point_v<T>){
+            if(out.size() < sizeof(f64)){ return 0; }
+            std::memcpy(out.data(), &v, sizeof(f64));
+            return sizeof(f64);
+        }else{
+            s64 x;
+            if constexpr(std::is_pointer_v<T>){ x = (s64)(uintptr_t)v; }else{ x = (s64)v; }
+            return put_varint(((u64)x << 1) ^ (u64)(x >> 63), out);
+        }
+    }
+    using Encoder = u32 (*)(Word const* args, span<u8> out);
+    template<typename... P> inline u32 encode(Word const* args, span<u8> out){
+        u32 at = 0;
+        std::apply([&](auto... v){
+            (void)(... && [&](u32 n){ at += n; return n > 0; }(put(v, out.subspan(at))));
+        }, unpack<P...>(args));
+        return at;
+    }
+#else
+    using Formatter = int (*)(char const* fmt, Word const* args, span<char> out);
+    template<typename... P> inline int format(char const* fmt, Word const* args, span<char> out){
+        return std::apply([&](auto... v){ return snprintf(out.data(), out.size(), fmt, v...); }, unpack<P...>(args));
+    }
+#endif
+
+    // How to print a record: how many argument words follow its header, and how to format (or encode) their types.
+    struct Shape{
+        u32 words;
+        bool newline;
+#if LOG_INTERNED
+        Encoder encode;
+#else
+        Formatter format; // Null without arguments
+#endif
+    };
+    template<bool cNewline, typename... P> constexpr Shape cShape = {
+        .words = (cWordsOf<P> + ... + 0), .newline = cNewline,
+#if LOG_INTERNED
+        .encode = &encode<P...>,
+#else
+        .format = []{ if constexpr(sizeof...(P) > 0){ return Formatter{&format<P...>}; }else{ return Formatter{}; } }(),
+#endif
+    };
+
+    // A record is the format, its Shape, then the arguments.
+    inline array<RingQueue<Word, cWords>, NUM_CORES> gRings;
+
+    // Producer side, either core
+    // -------------------
+    template<bool cNewline> inline void write(Fmt fmt, auto ref... params){
+        constexpr Shape const& shape = cShape<cNewline, Stored<decltype(params)>...>;
+        static_assert(shape.words <= cMaxArgWords, "Too many arguments to log");
+        static_assert(((std::is_arithmetic_v<Stored<decltype(params)>> || std::is_pointer_v<Stored<decltype(params)>>) && ...), "Only numbers and strings can be logged");
+        array<Word, 2 + shape.words> record;
+        record[0] = (Word)fmt.at;
+        record[1] = (Word)&shape;
+        u32 at = 2;
+        ([&](Stored<decltype(params)> v){
+            std::memcpy(&record[at], &v, sizeof(v));
+            at += cWordsOf<decltype(v)>;
+        }(params), ...);
+
+        auto& q = gRings[get_core_num()];
+        u32 irq = save_and_disable_interrupts();
+        if(q.space() >= record.size()){
+            q.write_from(record);
+        }else{
+            q.note_overrun();
+        }
+        restore_interrupts(irq);
+    }
+
+    // Consumer side, core0's main loop
+    // -------------------
+    inline array<u32, NUM_CORES> gDropsReported = {};
+    inline u32 gNext = 0; // The ring to look in first, so one core can't hold the other off
+#if LOG_INTERNED
+    // A message taken from a record goes out a frame at a time, each frame's seq being how many more follow
+    inline array<u8, cLineChars> gMessage;
+    inline span<const u8> gUnframed; // What of gMessage isn't in a frame yet
+    inline ctl::Wire gFrame;         // Not yet written
+    inline u32 gFrameSize = 0;
+
+    // Frames the next piece of the message. Its size on the wire, 0 once it's all gone.
+    inline u32 next_frame(){
+        if(gUnframed.empty()){ return 0; }
+        u32 n = (u32)std::min(gUnframed.size(), ctl::cMaxPayload);
+        u8 more = (u8)((gUnframed.size() - n + ctl::cMaxPayload - 1) / ctl::cMaxPayload);
+        u32 size = (u32)ctl::pack(ctl::Msg::Log, more, gUnframed.first(n), gFrame);
+        gUnframed = gUnframed.subspan(n);
+        return size;
+    }
+
+    inline void emit(char const* fmt, Shape ref shape, Word const* args){
+        // The ID, then whether it's verbatim (no arguments: not a format, as in the text build) and the newline
+        u32 n = put_varint((u64)(uintptr_t)fmt << 2 | (shape.words == 0) << 1 | shape.newline, gMessage);
+        n += shape.encode(args, span{gMessage}.subspan(n));
+        gUnframed = span{gMessage}.first(n);
+        gFrameSize = next_frame();
+    }
+#else
+    inline array<char, cLineChars> gLine;
+    inline array<sv, 2> gPending; // Taken from a record but not yet written: its text, then its newline
+
+    inline void emit(char const* fmt, Shape ref shape, Word const* args){
+        if(shape.format){
+            int n = shape.format(fmt, args, gLine);
+            gPending[0] = {gLine.data(), (size_t)std::clamp<int>(n, 0, gLine.size() - 1)};
+        }else{
+            gPending[0] = fmt;
+        }
+        gPending[1] = shape.newline ? "\n" : "";
+    }
+
+    // Writes as much of `text` as the CDC FIFO has room for, with "\r\n" line ends like stdio. Returns the rest.
+    inline sv write_some(sv text){
+        while(!text.empty()){
+            u32 room = tud_cdc_write_available();
+            if(text[0] == '\n'){
+                if(room < 2){ break; }
+                tud_cdc_write("\r\n", 2);
+                text.remove_prefix(1);
+                continue;
+            }
+            u32 n = (u32)std::min({text.find('\n'), text.size(), (size_t)room});
+            if(n == 0){ break; }
+            tud_cdc_write(text.data(), n);
+            text.remove_prefix(n);
+        }
+        return text;
+    }
+#endif
+
+    // Takes the next message from the rings, ready to write. False if there are none.
+    inline bool take(){
+        for(u32 i = 0; i < gRings.size(); i++){
+            u32 core = (gNext + i) % gRings.size();
+            auto& q = gRings[core];
+            if(u32 drops = q.overruns.load(std::memory_order_relaxed); drops != gDropsReported[core]){
+                array<Word, 2> args = {drops - gDropsReported[core], core};
+                gDropsReported[core] = drops;
+                emit(FMT("Log: %u messages dropped on core %u").at, cShape<true, unsigned, unsigned>, args.data());
+                return true;
+            }
+            if(q.empty()){ continue; }
+            array<Word, 2> header;
+            q.read_into(header);
+            array<Word, cMaxArgWords> args;
+            auto& shape = *(Shape const*)header[1];
+            q.read_into(span{args}.first(shape.words));
+            emit((char const*)header[0], shape, args.data());
+            gNext = core + 1;
+            return true;
+        }
+        return false;
+    }
+
+    // Prints what's been logged, as far as the CDC FIFO takes it. Call from the main loop, after tud_task.
+    inline void tick(){
+        bool listening = tud_cdc_connected();
+        while(true){
+#if LOG_INTERNED
+            if(gFrameSize > 0){
+                if(listening){ // Nobody listening: dropped, like stdio does
+                    if(tud_cdc_write_available() < gFrameSize){ break; } // Whole frames only, like ctl::tick
+                    tud_cdc_write(gFrame.data(), gFrameSize);
+                }
+                gFrameSize = next_frame();
+                continue;
+            }
+#else
+            for(auto& p: gPending){
+                p = listening ? write_some(p) : sv{}; // Nobody listening: dropped, like stdio does
+                if(!p.empty()){ break; }
+            }
+            if(!gPending[0].empty() || !gPending[1].empty()){ break; } // The FIFO is full
+#endif
+            if(!take()){ break; }
+        }
+        if(listening){ tud_cdc_write_flush(); }
+    }
+
+    // Forgets whatever's logged but not yet written.
+    inline void reset(){
+        for(auto& q: gRings){ q.commit_read(q.length()); }
+#if LOG_INTERNED
+        gUnframed = {};
+        gFrameSize = 0;
+#else
+        gPending = {};
+#endif
+        gNext = 0;
+    }
+}
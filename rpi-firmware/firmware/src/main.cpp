@@ -12,7 +12,11 @@
 #include "dev/usb.hpp"
 #include "dev/i2s_dac.hpp"
 #include "dev/push_button.hpp"
+#include "dev/vendor.hpp"
 #include "console.hpp"
+#include "audio_engine.hpp"
+#include "profile.hpp"
+#include "mixer.hpp"
 
 void set_obled(bool on){
     cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, on);
@@ -20,6 +24,7 @@ void set_obled(bool on){
 
 void init(){
     set_sys_clock_khz(sys::cClockRate / 1000, true);
+    profile::init_this_core(); // Times the USB side. Core1 starts its own.
 
     dev::usb::init();
     while(to_ms_since_boot(get_absolute_time()) < 3000){ // Wait to connect device to PC - debugging.
@@ -28,11 +33,10 @@ void init(){
 
     dev::btn::init();
     dev::servo::init();
-    dev::mic::init();
-    dev::dac::init();
+    dev::cache::init();
 
     if(cyw43_arch_init()){ // Initialise the Wi-Fi chip
-        console::println("Wi-Fi init failed");
+        console::println(FMT("Wi-Fi init failed"));
     }
     set_obled(true); // Turn on the Pico W LED as proof of life.
 }
@@ -41,10 +45,9 @@ int main(){
     bool light_toggle = true;
     init();
 
-    // printf("Hello, world! Playing %d samples.\n", gTestAudioSize / sizeof(u16));
-    console::println("WARNING! Use the headphone jack at your own risk. It can destroy your ears!");
-    dev::dac::start();
-    dev::mic::start();
+    console::println(FMT("WARNING! Use the headphone jack at your own risk. It can destroy your ears!"));
+    audio::launch(); // Speaker and mic run on core1 from here on
+    if(auto chime = mixer::clips().find("chime")){ mixer::play(*chime); }
 
     auto once_per_second = make_timeout_time_ms(1000); // not strictly, but its ok.
     auto cook = make_timeout_time_ms(5000); // not strictly, but its ok.
@@ -52,17 +55,17 @@ int main(){
     while(true){
         auto now = get_absolute_time();
         dev::usb::tick();
+        dev::vendor::tick();
+        ctl::tick();
+        console::poll(); // Anything held back while ctl's replies were backed up
+        logring::tick();
+        dev::mic::pump_usb();
         dev::btn::report_changes();
+        console::report_voice_changes();
 
         if(absolute_time_diff_us(now, once_per_second) <= 0){
             set_obled(light_toggle);
             light_toggle = !light_toggle;
-
-            // if(console::gPrintDebugInfo){
-            //     console::println("DMAcnt: spk %d, mic %d", dev::dac::isDMA, dev::mic::gDMACount);
-            // }
-            dev::dac::isDMA = 0;
-            dev::mic::gDMACount = 0;
             once_per_second = delayed_by_ms(now, 1000);
         }
     }
@@ -0,0 +1,145 @@
+#pragma once
+#include "common.hpp"
+#include "ctmath.hpp"
+#include "gain.hpp"
+#include "ring_queue.hpp"
+#include "adpcm.hpp"
+
+// The clips, linked in from res/incbin by libimpl/clips.cpp. An ADPCM pack (see adpcm.hpp).
+INCBIN_EXTERN(Clips);
+
+// Speaker mixer: a few voices summed over the host's stream, each a clip or a tone.
+// Clips are decoded a sample at a time straight out of flash (XIP), so they take no SRAM however long they are,
+// and a voice costs the same each millisecond whatever it's playing.
+// Tones come from a sine table. Voices go on after the host's volume, at their own gain, so the device can still
+// be heard when the host has it muted (or hasn't opened the stream at all yet). Sums saturate rather than wrap.
+// Core0 asks for sounds through a command queue; the speaker IRQ on core1 owns the voices.
+namespace mixer{
+    constexpr u32 cRate = 48'000;
+    static_assert(cRate == adpcm::cRate);
+    constexpr u32 cVoices = 4;
+    constexpr u32 cFadeFrames = cRate / 500; // Tones ramp in and out over 2ms so they don't click
+    constexpr gain::Q15 cDefaultGain = gain::from_db256(-12 * 256);
+
+    inline adpcm::Pack clips(){ return {span{ClipsData, ClipsSize}}; }
+
+    // One period of a sine, plus the first sample again so interpolating off the end needs no wrap.
+    constexpr auto cSine = []{
+        array<s16, 257> t;
+        for(u32 i = 0; i < t.size(); i++){
+            f64 v = ctmath::sin(2 * ctmath::cPi * i / 256) * INT16_MAX;
+            t[i] = (s16)(v < 0 ? v - 0.5 : v + 0.5);
+        }
+        return t;
+    }();
+
+    struct Command{
+        enum class Op: u8{ Clip, Tone, Stop, Drop } op;
+        gain::Q15 gain = cDefaultGain;
+        u32 hz = 0;
+        u32 frames = 0;
+        u8 const* blocks = nullptr; // Clips: the ADPCM, in flash
+        uintptr_t from = 0, to = 0; // Drop: the flash about to be rewritten
+    };
+
+    struct Voice{
+        adpcm::Reader clip;      // Clips: where it's got to, in flash
+        u32 left = 0;            // Frames still to play. 0 when free.
+        u32 frames = 0;          // Tones: how long it is, for the fades
+        u32 phase = 0;           // Tones: a whole cycle is 2^32
+        u32 inc = 0;             // 0 for clips
+        gain::Q15 gain = 0;
+
+        // The next sample, still at 16 bits.
+        constexpr s16 next(SelfMut){
+            self.left -= 1;
+            if(self.inc == 0){ return self.clip.next(); }
+            u32 i = self.phase >> 24, frac = (self.phase >> 8) & 0xffff;
+            s32 s = cSine[i] + (((s32)cSine[i + 1] - cSine[i]) * (s32)frac >> 16);
+            self.phase += self.inc;
+            u32 edge = std::min({self.frames - self.left, self.left, cFadeFrames});
+            return (s16)(s * (s32)edge / (s32)cFadeFrames);
+        }
+    };
+
+    struct Mixer{
+        array<Voice, cVoices> voices;
+        RingQueue<Command, 8> commands; // core0 -> speaker IRQ
+
+        constexpr bool busy(SelfRef){
+            return std::ranges::any_of(self.voices, [](Voice ref v){ return v.left > 0; });
+        }
+
+        // A free voice, or the one closest to its end when they're all playing.
+        constexpr Voice& claim(SelfMut){
+            return *std::ranges::min_element(self.voices, {}, [](Voice ref v){ return v.left; });
+        }
+
+        constexpr void apply(SelfMut, Command ref c){
+            switch(c.op){
+                case Command::Op::Clip:
+                    if(!c.blocks || c.frames == 0){ return; }
+                    self.claim() = {.clip = adpcm::Reader::make(c.blocks), .left = c.frames, .gain = c.gain};
+                    break;
+                case Command::Op::Tone:
+                    if(c.frames == 0 || c.hz == 0 || c.hz >= cRate / 2){ return; }
+                    self.claim() = {.left = c.frames, .frames = c.frames, .inc = (u32)(((u64)c.hz << 32) / cRate), .gain = c.gain};
+                    break;
+                case Command::Op::Stop:
+                    for(auto& v: self.voices){ v.left = 0; }
+                    break;
+                case Command::Op::Drop:
+                    self.drop(c.from, c.to);
+                    break;
+            }
+        }
+
+        // Stops any voice still to read flash in [from, to), which is about to be rewritten. Speaker side only, as
+        // a Drop command: core1 may be halfway through updating a voice whenever it's stopped.
+        constexpr void drop(SelfMut, uintptr_t from, uintptr_t to){
+            for(auto& v: self.voices){
+                if(v.left == 0 || v.inc != 0){ continue; }
+                uintptr_t at = (uintptr_t)v.clip.at, end = at + adpcm::encoded_size(v.left) + adpcm::cBlockBytes; // Generous
+                if(at < to && end > from){ v.left = 0; }
+            }
+        }
+
+        // Speaker side: picks up what core0 asked for. Once per block.
+        // Each is taken off the queue only once it's applied, so core0 seeing it empty knows they've all happened.
+        void take_commands(SelfMut){
+            while(!self.commands.empty()){
+                self.apply(self.commands.read_spans()[0][0]);
+                self.commands.commit_read(1);
+            }
+        }
+
+        // Adds one sample of every playing voice to `stream` (a sample at the top of 32 bits, as gain::apply gives).
+        constexpr s32 mix(SelfMut, s32 stream){
+            s64 sum = stream;
+            for(auto& v: self.voices){
+                if(v.left > 0){ sum += gain::apply(v.next(), v.gain); }
+            }
+            return (s32)clamp<s64>(INT32_MIN, sum, INT32_MAX);
+        }
+    };
+    inline Mixer gMixer;
+
+    // Core0 side. Each returns false if the queue is full (the speaker core isn't keeping up).
+    inline bool send(Command ref c){ return gMixer.commands.write_from(span{&c, 1}) == 1; }
+    // Clips: `frames` of ADPCM blocks at `blocks`, which must stay put while they play.
+    inline bool play(u8 const* blocks, u32 frames, gain::Q15 g = cDefaultGain){
+        return send({.op = Command::Op::Clip, .gain = g, .frames = frames, .blocks = blocks});
+    }
+    // The built in clip `i` (its place in the pack).
+    inline bool play(u16 i, gain::Q15 g = cDefaultGain){
+        auto pack = clips();
+        if(i >= pack.count()){ return false; }
+        return play(pack.reader(i).at, pack.entries()[i].frames, g);
+    }
+    inline bool tone(u32 hz, u32 ms, gain::Q15 g = cDefaultGain){
+        return send({.op = Command::Op::Tone, .gain = g, .hz = hz, .frames = ms * (cRate / 1000)});
+    }
+    inline bool stop(){ return send({.op = Command::Op::Stop}); }
+    // Stops the voices reading flash in [from, to) (see Mixer::drop). Done once the queue is empty.
+    inline bool drop(uintptr_t from, uintptr_t to){ return send({.op = Command::Op::Drop, .from = from, .to = to}); }
+}
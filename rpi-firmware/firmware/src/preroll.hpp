@@ -0,0 +1,61 @@
+#pragma once
+#include "common.hpp"
+
+// Push-to-talk pre-roll: a rolling history of the mic as sent to the host, so a press can start from before it.
+// Pressing (`hold`) rewinds the stream by up to a set amount of that history, and the host hears the mic that far
+// behind live from then on. Releasing lets it play on until it reaches the release, then jumps back to live,
+// skipping what was captured after the release. Nothing the user said while holding is lost, and nothing
+// before the press is sent twice. Single threaded: only touched by the USB core.
+template<size_t N>
+struct PreRoll{
+    static_assert(N > 0);
+    array<s16, N> history;
+    u32 head = 0;      // Where the next sample goes
+    u32 filled = 0;    // Valid samples in `history`, up to N
+    u32 lag = 0;       // How far behind live the stream is (samples). 0 when live.
+    u32 remaining = 0; // Once released: samples still to send before the stream reaches the release
+    bool held = false;
+
+    constexpr bool live(SelfRef){ return self.lag == 0; }
+
+    // Appends what was just captured.
+    constexpr void record(SelfMut, span<const s16> in){
+        if(in.size() > N){ in = in.last(N); }
+        auto first = std::min<size_t>(in.size(), N - self.head);
+        std::copy_n(in.begin(), first, &self.history[self.head]);
+        std::copy(in.begin() + first, in.end(), self.history.begin());
+        self.head = (self.head + in.size()) % N;
+        self.filled = std::min<u32>(self.filled + in.size(), N);
+    }
+
+    // The `n` samples to send now, `lag` behind the end of the history. Up to two (the second when it wraps).
+    // Advances the release, if there is one, and goes live once it's reached.
+    constexpr array<span<const s16>, 2> delayed(SelfMut, u32 n){
+        u32 start = (self.head + 2 * N - self.lag - n) % N;
+        u32 first = std::min<u32>(n, N - start);
+        array<span<const s16>, 2> out = {span{&self.history[start], first}, span{self.history.data(), n - first}};
+        if(!self.held && self.remaining > 0){
+            self.remaining -= std::min(self.remaining, n);
+            if(self.remaining == 0){ self.lag = 0; }
+        }
+        return out;
+    }
+
+    // The button went down. Rewinds by up to `maxLag` samples, unless still catching up from the last press.
+    constexpr void hold(SelfMut, u32 maxLag){
+        self.held = true;
+        self.remaining = 0;
+        if(self.live()){ self.lag = std::min({self.filled, maxLag, (u32)N}); }
+    }
+    constexpr void release(SelfMut){
+        if(!self.held){ return; }
+        self.held = false;
+        self.remaining = self.lag;
+        if(self.remaining == 0){ self.lag = 0; }
+    }
+
+    // The history no longer matches what the host is receiving (the rate changed).
+    constexpr void reset(SelfMut){
+        self.head = self.filled = self.lag = self.remaining = 0;
+    }
+};
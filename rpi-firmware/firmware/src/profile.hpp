@@ -0,0 +1,79 @@
+#pragma once
+#include "common.hpp"
+#include <atomic>
+#include <bit>
+#include <hardware/structs/systick.h>
+
+// Cycle counts for the hot paths (mostly IRQ handlers), dumped over the console with `profile`.
+// Each core's SysTick free-runs at the processor clock, so readings are exact to the cycle. It's 24 bits,
+// wrapping every ~116ms at 144MHz, which is far longer than anything timed here.
+// Results go into a fixed table with one entry per Site. Each site only ever runs in one context, so an entry has
+// a single writer and relaxed atomics are enough for the console to read it from the other core.
+// Compiled out unless PROFILE_ENABLED (CMake: -DFIRMWARE_PROFILE=ON), in which case `PROFILE_SCOPE` is nothing.
+// Usage: `PROFILE_SCOPE(profile::Site::SpeakerDMA);` at the top of the scope to time.
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 0
+#endif
+
+namespace profile{
+    enum class Site: u8{
+        SpeakerDMA, // dev::dac::dma_handler
+        MicDMA,     // dev::mic::adc_dma_handler
+        SpeakerRx,  // The USB receive callback
+        MicPump,    // dev::mic::pump_usb
+        COUNT
+    };
+    constexpr array<char const*, (size_t)Site::COUNT> cSiteNames = {"speaker dma irq", "mic dma irq", "speaker usb rx", "mic usb pump"};
+
+    constexpr u32 cCounterMask = 0x00ff'ffff; // SysTick is 24 bits
+
+    struct Entry{
+        static constexpr u32 cBuckets = 25; // By bit width: [0], [1], [2, 3], [4, 7] ... [2^23, 2^24)
+        std::atomic<u32> count = 0;
+        std::atomic<u32> min = UINT32_MAX;
+        std::atomic<u32> max = 0;
+        std::atomic<u32> avg16 = 0; // Moving average over ~16 calls, in 1/16ths of a cycle
+        array<std::atomic<u32>, cBuckets> histogram = {};
+
+        void note(SelfMut, u32 cycles){
+            constexpr auto r = std::memory_order_relaxed;
+            u32 n = self.count.load(r);
+            u32 avg16 = self.avg16.load(r);
+            self.avg16.store(n == 0 ? cycles * 16 : avg16 - avg16 / 16 + cycles, r);
+            self.count.store(n + 1, r);
+            if(cycles < self.min.load(r)){ self.min.store(cycles, r); }
+            if(cycles > self.max.load(r)){ self.max.store(cycles, r); }
+            auto& h = self.histogram[std::min<u32>(std::bit_width(cycles), cBuckets - 1)];
+            h.store(h.load(r) + 1, r);
+        }
+        void reset(SelfMut){
+            self.count = 0;
+            self.min = UINT32_MAX;
+            self.max = 0;
+            self.avg16 = 0;
+            for(auto& h: self.histogram){ h = 0; }
+        }
+    };
+
+#if PROFILE_ENABLED
+    inline array<Entry, (size_t)Site::COUNT> gTable;
+
+    // Starts this core's SysTick free-running. Call once on each core that runs a profiled site.
+    inline void init_this_core(){
+        systick_hw->rvr = cCounterMask;
+        systick_hw->cvr = 0;
+        systick_hw->csr = 0b101; // Enabled, processor clock, no interrupt
+    }
+    inline u32 now(){ return systick_hw->cvr; }
+    inline void record(Site site, u32 start){
+        gTable[(size_t)site].note((start - now()) & cCounterMask); // Counts down
+    }
+
+    #define PROFILE_SCOPE(site) \
+        u32 CONCAT(profileStart_, __LINE__) = ::profile::now(); \
+        defer{ ::profile::record(site, CONCAT(profileStart_, __LINE__)); }
+#else
+    inline void init_this_core(){}
+    #define PROFILE_SCOPE(site)
+#endif
+}
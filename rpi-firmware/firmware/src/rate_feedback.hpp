@@ -0,0 +1,43 @@
+#pragma once
+#include "common.hpp"
+
+// Rate feedback for an asynchronous USB isochronous OUT endpoint.
+// The host sends as many samples per 1ms frame as the feedback value asks for (16.16 fixed point),
+// so by steering it we stop the receive ring slowly over/under filling when the host and DAC clocks drift.
+// A PI controller holds the ring fill level around a target (half full is the most tolerant).
+struct RateFeedback{
+    static constexpr u32 cFracBits = 16;
+    static constexpr s32 cKpShift = 10; // P: 1/64 sample/frame per sample of fill error
+    static constexpr s32 cKiShift = 4;  // I: 1/4096 sample/frame per sample-frame of accumulated error
+    static constexpr s32 cMaxDeviation = 1 << cFracBits; // Never ask for more than +-1 sample/frame off nominal
+    static constexpr s32 cIntegralLimit = cMaxDeviation >> cKiShift; // Anti-windup
+
+    u32 nominal; // 16.16 samples/frame with no drift
+    s32 target;  // Fill level to hold (samples)
+    s32 integral = 0;
+    u32 value = 0; // Last feedback sent (16.16)
+    u32 updates = 0;
+
+    static constexpr RateFeedback make(u32 sampleRate, u32 targetFill){
+        u32 nominal = (u32)(((u64)sampleRate << cFracBits) / 1000);
+        return RateFeedback{.nominal = nominal, .target = (s32)targetFill, .value = nominal};
+    }
+
+    // Starts over from the nominal rate, e.g. when the host (re)opens the stream.
+    constexpr void reset(SelfMut){
+        self.integral = 0;
+        self.value = self.nominal;
+    }
+
+    // Feeds in the current fill level (once per frame) and returns the new 16.16 feedback value.
+    constexpr u32 update(SelfMut, u32 fill){
+        // Too full means the host is outpacing the DAC, so ask for less.
+        s32 err = (s32)fill - self.target;
+        self.integral = clamp(-cIntegralLimit, self.integral + err, cIntegralLimit);
+        s32 correction = (err << cKpShift) + (self.integral << cKiShift);
+        correction = clamp(-cMaxDeviation, correction, cMaxDeviation);
+        self.value = (u32)((s32)self.nominal - correction);
+        self.updates += 1;
+        return self.value;
+    }
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include "common.hpp"
+#include "ctmath.hpp"
+
+// Fixed-point sample rate converter for any ratio between 16 kHz and 48 kHz, either direction.
+// It's a polyphase windowed-sinc filter: the kernel is tabulated at cPhases points per input sample, so each
+// output picks its taps from the table row nearest its fractional position (128 phases: under 1/256 sample of timing error).
+// Upsampling uses the kernel as is. Downsampling stretches it by the ratio (more taps) so it also cuts below
+// the output's Nyquist. Either way the passband is 0.45 of the lower rate.
+struct Resampler{
+    static constexpr u32 cHalfTaps = 8;   // Zero crossings either side of centre at the input rate
+    static constexpr u32 cPhases = 128;
+    static constexpr u32 cMaxTaps = 48;   // 48k -> 16k stretches the kernel 3x
+    static constexpr u32 cKernelOne = 1 << 14; // Q14. h(0) = 0.9 doesn't quite need it, but the sum of products has headroom
+
+    // h(i / cPhases) for i in 0..=cHalfTaps*cPhases: sinc at 0.45 of the input rate, Blackman windowed.
+    static constexpr auto cKernel = []{
+        constexpr f64 cCutoff = 0.9; // 2 * 0.45
+        array<s16, cHalfTaps * cPhases + 1> k;
+        for(u32 i = 0; i < k.size(); i++){
+            f64 t = (f64)i / cPhases;
+            f64 x = ctmath::cPi * cCutoff * t;
+            f64 sinc = i == 0 ? 1.0 : ctmath::sin(x) / x;
+            f64 w = t / cHalfTaps; // 0..1 from the centre out
+            f64 blackman = 0.42 + 0.5 * ctmath::cos(ctmath::cPi * w) + 0.08 * ctmath::cos(2 * ctmath::cPi * w);
+            f64 h = cCutoff * sinc * blackman * cKernelOne;
+            k[i] = (s16)(h < 0 ? h - 0.5 : h + 0.5);
+        }
+        return k;
+    }();
+
+    // The next output's position is tracked exactly as a fraction of `outRate`, so the ratio never drifts.
+    u32 inRate = 48'000;
+    u32 outRate = 48'000;
+    u32 scale = 1 << 16; // How much the kernel is squeezed: min(1, out/in) (16.16)
+    u32 taps = 2 * cHalfTaps;
+    u32 pos = 0;         // Where the next output lands past the window centre, in 1/outRate input samples. >= outRate needs inputs.
+    u32 head = 0;
+    array<s16, 2 * cMaxTaps> hist = {}; // Window of the last `taps` inputs, stored twice so it's always contiguous
+
+    static constexpr Resampler make(u32 inRate, u32 outRate){
+        Resampler r;
+        r.inRate = inRate;
+        r.outRate = outRate;
+        r.scale = inRate > outRate ? (u32)(((u64)outRate << 16) / inRate) : 1 << 16;
+        u32 halfTaps = (u32)((((u64)cHalfTaps << 16) + r.scale - 1) / r.scale); // ceil(cHalfTaps / scale)
+        r.taps = std::min(2 * halfTaps, cMaxTaps);
+        return r;
+    }
+
+    constexpr void push(SelfMut, s16 x){
+        self.hist[self.head] = x;
+        self.hist[self.head + self.taps] = x;
+        self.head = self.head + 1 == self.taps ? 0 : self.head + 1;
+    }
+
+    // Filters the window for the output at `pos` (< outRate) past its centre.
+    constexpr s16 filter(SelfRef){
+        auto x = &self.hist[self.head]; // Oldest first
+        u32 frac = (self.pos << 16) / self.outRate; // Hardware divider on the RP2040
+        // Kernel positions in table units (16.16). The taps sit at 0..taps-1, the output at taps/2 - 1 + frac.
+        s32 centre = (s32)(((self.taps / 2 - 1) << 16) + frac);
+        s32 kstep = (s32)(self.scale * cPhases);
+        s32 kpos = (s32)(-((s64)centre * self.scale * cPhases >> 16));
+        s64 acc = 0;
+        for(u32 i = 0; i < self.taps; i++){
+            u32 idx = ((u32)(kpos < 0 ? -kpos : kpos) + 0x8000) >> 16;
+            if(idx < cKernel.size()){ acc += (s32)x[i] * cKernel[idx]; }
+            kpos += kstep;
+        }
+        s64 y = (acc * self.scale) >> (16 + 14);
+        return (s16)clamp<s64>(INT16_MIN, y, INT16_MAX);
+    }
+
+    // Produces one output, calling `pull()` for each input sample it needs. For a consumer running at the output rate.
+    constexpr s16 next(SelfMut, auto&& pull){
+        while(self.pos >= self.outRate){
+            self.push(pull());
+            self.pos -= self.outRate;
+        }
+        s16 y = self.filter();
+        self.pos += self.inRate;
+        return y;
+    }
+
+    // Consumes all of `in`, writing what outputs become available into `out`. For a producer running at the input rate.
+    // Size `out` with `max_out(in.size())`. Returns the number written.
+    constexpr size_t process(SelfMut, span<const s16> in, span<s16> out){
+        size_t n = 0;
+        auto drain = [&]{
+            while(self.pos < self.outRate && n < out.size()){
+                out[n++] = self.filter();
+                self.pos += self.inRate;
+            }
+        };
+        for(auto x: in){
+            drain();
+            self.push(x);
+            self.pos -= std::min(self.pos, self.outRate);
+        }
+        drain();
+        return n;
+    }
+    constexpr size_t max_out(SelfRef, size_t in){ return ((u64)in * self.outRate + self.inRate - 1) / self.inRate + 1; }
+};
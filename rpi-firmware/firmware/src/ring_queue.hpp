@@ -1,45 +1,105 @@
 #pragma once
 #include "common.hpp"
+#include <atomic>
+#include <bit>
 
+// Single-producer/single-consumer ring queue.
+// The producer owns `write`, the consumer owns `read`. Each side publishes its index with release
+// semantics and observes the other's with acquire semantics, so the queue is safe between an IRQ and
+// thread context, or between the two cores, without locks.
+// Indices free-run and are masked on access, so N must be a power of two.
+// NOTE: Only atomic loads/stores are used (no read-modify-write), as the Cortex-M0+ has no LDREX/STREX.
 template<typename T, size_t N>
 struct RingQueue{
+    static_assert(std::has_single_bit(N), "RingQueue capacity must be a power of two");
+    static constexpr u32 cMask = N - 1;
+
     array<T, N> ring;
-    u16 write = 0;
-    u16 read = 0;
+    std::atomic<u32> write = 0; // Free running. Written by the producer only.
+    std::atomic<u32> read = 0;  // Free running. Written by the consumer only.
+    std::atomic<u32> overruns = 0;  // Producer had more data than space. Written by the producer only.
+    std::atomic<u32> underruns = 0; // Consumer wanted more data than available. Written by the consumer only.
 
-    constexpr auto write_head(SelfMut){
-        return self.ring.begin() + self.write;
-    }
-    constexpr auto read_head(SelfRef){
-        return self.ring.begin() + self.read;
+    // The maximum number of elements the buffer can hold.
+    static constexpr u32 capacity(){ return N; }
+    // Number of elements currently in the buffer. Safe to call from either side.
+    u32 length(SelfRef){
+        return self.write.load(std::memory_order_acquire) - self.read.load(std::memory_order_acquire);
     }
+    u32 space(SelfRef){ return capacity() - self.length(); }
+    bool empty(SelfRef){ return self.length() == 0; }
 
-    constexpr auto dist_till_writer_wrap(SelfRef){
-        return self.ring.size() - self.write;
+    // Producer side
+    // -------------------
+    // The free regions that may be written to before `commit_write`.
+    // Up to two contiguous regions (the second is non-empty only when the region wraps).
+    array<span<T>, 2> write_spans(SelfMut){
+        auto w = self.write.load(std::memory_order_relaxed);
+        auto r = self.read.load(std::memory_order_acquire);
+        return split_at(self, w, capacity() - (w - r));
     }
-
-
-    // The maximum number of elements the buffer can hold.
-    constexpr u32 capacity(SelfRef){ return self.ring.size(); }
-    // Does the ring buffer currently hold wrapped data?
-    constexpr bool is_wrapping(SelfRef){ return self.write < self.read; }
-    // Number of elements icurrently in the buffer
-    constexpr u32 length(SelfRef){
-        u32 base = self.is_wrapping() ? self.capacity() : 0;
-        return base + self.write - self.read;
+    // Publishes `n` elements previously written via `write_spans`.
+    void commit_write(SelfMut, u32 n){
+        self.write.store(self.write.load(std::memory_order_relaxed) + n, std::memory_order_release);
     }
-    constexpr bool empty(SelfRef){
-        return self.read == self.write;
+    // Copies in as much as fits. Anything that doesn't is dropped and counted as an overrun.
+    u32 write_from(SelfMut, span<const T> from){
+        auto spans = self.write_spans();
+        u32 n = 0;
+        for(auto s: spans){
+            auto c = std::min<size_t>(s.size(), from.size() - n);
+            std::copy_n(from.begin() + n, c, s.begin());
+            n += c;
+        }
+        self.commit_write(n);
+        if(n < from.size()){ self.note_overrun(); }
+        return n;
     }
+    void note_overrun(SelfMut){ bump(self.overruns); }
 
-    constexpr T read_one(SelfMut){
-        auto r = self.ring[self.read];
-        self.read += 1;
-        if(self.read >= self.capacity()){ self.read = 0; } // Wrap
-        return r;
+    // Consumer side
+    // -------------------
+    // The filled regions that may be read from before `commit_read`.
+    array<span<const T>, 2> read_spans(SelfRef){
+        auto r = self.read.load(std::memory_order_relaxed);
+        auto w = self.write.load(std::memory_order_acquire);
+        return split_at(self, r, w - r);
+    }
+    // Releases `n` elements back to the producer.
+    void commit_read(SelfMut, u32 n){
+        self.read.store(self.read.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+    // Copies out as much as is available. A short read is counted as an underrun.
+    u32 read_into(SelfMut, span<T> into){
+        auto spans = self.read_spans();
+        u32 n = 0;
+        for(auto s: spans){
+            auto c = std::min<size_t>(s.size(), into.size() - n);
+            std::copy_n(s.begin(), c, into.begin() + n);
+            n += c;
+        }
+        self.commit_read(n);
+        if(n < into.size()){ self.note_underrun(); }
+        return n;
     }
-    constexpr void write_reserve_n(SelfMut, size_t nelems){
-        self.write += nelems;
-        self.write %= self.capacity();
+    T read_one(SelfMut){
+        auto r = self.read.load(std::memory_order_relaxed);
+        T v = self.ring[r & cMask];
+        self.commit_read(1);
+        return v;
+    }
+    void note_underrun(SelfMut){ bump(self.underruns); }
+
+    // Splits `count` elements starting at free-running index `from` into the pre and post wrap regions.
+    static auto split_at(auto& q, u32 from, u32 count){
+        using E = std::remove_reference_t<decltype(q.ring[0])>;
+        auto start = from & cMask;
+        auto first = std::min<u32>(count, N - start);
+        return array<span<E>, 2>{
+            span<E>{q.ring.data() + start, first},
+            span<E>{q.ring.data(), count - first},
+        };
     }
-};
\ No newline at end of file
+    // Single writer increment. Not an atomic RMW, but each counter only has one writer.
+    static void bump(std::atomic<u32>& c){ c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include "common.hpp"
+#include <bit>
+
+// Voice activity detector for the mic. Fed each raw ADC block, it decides whether someone is talking.
+// A block's power (in log2 steps, so ~3 dB each) is smoothed over a few blocks and compared to a noise floor
+// that falls quickly and rises slowly. Speech starts once the level has stood well over the floor for cOnsetUs,
+// and ends after cHangoverUs below it. The zero crossing rate only gates the start: steady hiss crosses
+// far more often than voiced speech so it can't open it, but the s in the middle of a word doesn't close it.
+// All fixed point, and blocks faster than 48k are strided down to it, so it costs ~48 multiplies per ms.
+struct VoiceDetector{
+    static constexpr u32 cAnalysisRate = 48'000;
+    static constexpr s32 cOne = 256;                 // Levels are log2(power) in 1/256ths
+    static constexpr s32 cOnThreshold = 3 * cOne;    // ~9 dB over the floor to start
+    static constexpr s32 cOffThreshold = 2 * cOne;   // ~6 dB to keep going
+    static constexpr s32 cMinFloor = 4 * cOne;       // 4 counts RMS. The floor never drops below the ADC's own noise.
+    static constexpr s32 cFloorRisePerSec = cOne / 2; // ~1.5 dB/s
+    static constexpr u32 cMaxCrossingsPerMs = 12;    // Voiced speech crosses a few times a ms, white noise 24 at 48k
+    static constexpr u32 cOnsetUs = 10'000;
+    static constexpr u32 cHangoverUs = 300'000;
+    static constexpr u32 cSmoothShift = 3;           // Level and crossings are averaged over ~8 blocks
+
+    u32 blockUs = 1000;
+    s32 dc = 0;         // Tracked ADC offset, in 1/256 counts
+    s32 level = 0;      // Smoothed block power
+    s32 floor = -1;     // Noise floor, in 1/65536ths so the slow rise doesn't round away. Negative until the first block.
+    u32 crossings = 0;  // Smoothed zero crossings per ms, in 1/16ths
+    u32 run = 0;        // Blocks in a row over the threshold
+    u32 quiet = 0;      // Blocks in a row under it
+    bool speaking = false;
+    bool lastNegative = false;
+
+    static constexpr VoiceDetector make(u32 blockUs, u16 dc){
+        VoiceDetector v;
+        v.blockUs = blockUs;
+        v.dc = dc * cOne;
+        return v;
+    }
+
+    // log2(x) in 1/256ths, with a linear mantissa (within 0.09, ~0.3 dB).
+    static constexpr s32 log2(u32 x){
+        if(x == 0){ return 0; }
+        u32 b = std::bit_width(x) - 1;
+        return (s32)(b * cOne + (((x << (31 - b)) >> 23) & 0xff));
+    }
+
+    constexpr s32 noise_floor(SelfRef){ return self.floor >> 8; }
+    // A level (or the floor) in whole dB, relative to 1 count RMS.
+    static constexpr s32 to_db(s32 log2){ return log2 * 301 / (cOne * 100); }
+
+    // Analyses one block of raw ADC counts captured at `rate`. Returns true when `speaking` changes.
+    constexpr bool process(SelfMut, span<const u16> block, u32 rate){
+        u32 stride = std::max(rate / cAnalysisRate, 1u);
+        s32 dc = self.dc / cOne;
+        u64 power = 0;
+        u32 crossings = 0, n = 0;
+        s32 sum = 0;
+        for(size_t i = 0; i < block.size(); i += stride){
+            s32 v = (s32)block[i] - dc;
+            bool negative = v < 0;
+            crossings += negative != self.lastNegative;
+            self.lastNegative = negative;
+            power += (u32)(v * v);
+            sum += v;
+            n += 1;
+        }
+        if(n == 0){ return false; }
+        self.dc += sum * cOne / (s32)n >> 6; // Follows bias drift over ~64 blocks
+
+        s32 blockLevel = log2((u32)(power / n));
+        u32 perMs = crossings * 16 * 1000 / self.blockUs;
+        if(self.floor < 0){ // First block: start from here
+            self.level = blockLevel;
+            self.floor = std::max(blockLevel, cMinFloor) << 8;
+            self.crossings = perMs;
+        }
+        self.level += (blockLevel - self.level) >> cSmoothShift;
+        self.crossings += ((s32)perMs - (s32)self.crossings) >> cSmoothShift;
+
+        // Falls within a few blocks, rises slowly (so a long utterance barely moves it)
+        s32 target = self.level << 8;
+        if(target < self.floor){
+            self.floor += (target - self.floor) >> 4;
+        }else{
+            self.floor = std::min(target, self.floor + (s32)(((s64)cFloorRisePerSec << 8) * self.blockUs / 1'000'000));
+        }
+        self.floor = std::max(self.floor, cMinFloor << 8);
+
+        s32 over = self.level - self.noise_floor();
+        bool loud = over > (self.speaking ? cOffThreshold : cOnThreshold);
+        bool voiced = self.crossings <= cMaxCrossingsPerMs * 16;
+        if(loud && (self.speaking || voiced)){
+            self.run += 1;
+            self.quiet = 0;
+        }else{
+            self.quiet += 1;
+            self.run = 0;
+        }
+
+        bool was = self.speaking;
+        if(!self.speaking && self.run * self.blockUs >= cOnsetUs){ self.speaking = true; }
+        if(self.speaking && self.quiet * self.blockUs >= cHangoverUs){ self.speaking = false; }
+        return was != self.speaking;
+    }
+};
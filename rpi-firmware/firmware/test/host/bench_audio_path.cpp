@@ -0,0 +1,109 @@
+// Host throughput of the per-millisecond audio work: the speaker DMA refill, its gain stage and mixer, and the mic offload.
+// Absolute numbers mean little for a Cortex-M0+, but relative changes between builds do.
+#include "pico/stdlib.h"
+#include "dev/i2s_dac.hpp"
+#include "dev/mic_adc.hpp"
+#include <chrono>
+
+// Runs `body` `iters` times and reports the mean cost per audio sample.
+static void bench(char const* name, u32 iters, u32 samplesPerIter, auto&& body){
+    auto start = std::chrono::steady_clock::now();
+    for(u32 i = 0; i < iters; i++){ body(); }
+    std::chrono::duration<f64, std::nano> took = std::chrono::steady_clock::now() - start;
+    std::printf("%-28s %8.2f ns/sample  (%u iterations)\n", name, took.count() / ((f64)iters * samplesPerIter), iters);
+}
+
+int main(){
+    constexpr u32 cIters = 200'000;
+    mock::reset();
+    volumeFactor = gain::from_db256(-12 * 256);
+
+    using namespace dev;
+    array<s16, dac::I2SOutBufHalf{}.size()> packet;
+    for(size_t i = 0; i < packet.size(); i++){ packet[i] = (s16)(i * 331); }
+
+    bench("usb rx -> ring", cIters, packet.size(), [&]{
+        auto bytes = std::as_bytes(span{packet});
+        mock::gUSBAudioOut.insert(mock::gUSBAudioOut.end(), (u8 const*)bytes.data(), (u8 const*)bytes.data() + bytes.size());
+        tud_audio_rx_done_pre_read_cb(0, bytes.size(), 0, 0, 0);
+        dac::gAudioRecvBuffer.commit_read(dac::gAudioRecvBuffer.length());
+    });
+    bench("ring -> i2s buffer", cIters, packet.size(), [&]{
+        dac::gAudioRecvBuffer.write_from(packet);
+        dac::load_samples(dac::gI2SOutBufs[0]);
+    });
+    // The fill's inner loop on its own, both ways. The interpolator one runs on the mock's model of it here, so only
+    // `profile kernels` on the device says which is faster.
+    dac::I2SOutBufHalf frames;
+    gain::Ramp::Stepper steady = {.acc = (u32)gain::cUnity << 16, .step = 0};
+    bench("fill loop: scalar", cIters, frames.size(), [&]{
+        auto v = steady;
+        interp::scaled_from_ring_scalar(dac::gAudioRecvBuffer.ring, 500, v, span{frames});
+        asm volatile("" :: "r"(frames.data()) : "memory");
+    });
+    bench("fill loop: interp (model)", cIters, frames.size(), [&]{
+        auto v = steady;
+        interp::scaled_from_ring(dac::gAudioRecvBuffer.ring, 500, v, span{frames});
+        asm volatile("" :: "r"(frames.data()) : "memory");
+    });
+    // The gain stage on its own: the old flat u16 multiply, then the Q15 ramp holding and moving.
+    array<s32, packet.size()> scaled;
+    bench("gain: flat multiply (old)", cIters, packet.size(), [&]{
+        s32 volume = volumeFactor.load(std::memory_order_relaxed);
+        for(size_t i = 0; i < packet.size(); i++){ scaled[i] = packet[i] * volume; }
+        asm volatile("" :: "r"(scaled.data()) : "memory");
+    });
+    gain::Ramp ramp = {.current = volumeFactor};
+    bench("gain: q15 steady", cIters, packet.size(), [&]{
+        auto s = ramp.begin_block(volumeFactor, packet.size());
+        for(size_t i = 0; i < packet.size(); i++){ scaled[i] = s.next(packet[i]); }
+        asm volatile("" :: "r"(scaled.data()) : "memory");
+    });
+    u32 flip = 0;
+    bench("gain: q15 ramping", cIters, packet.size(), [&]{
+        auto s = ramp.begin_block(flip++ & 1 ? gain::cUnity : 0, packet.size());
+        for(size_t i = 0; i < packet.size(); i++){ scaled[i] = s.next(packet[i]); }
+        asm volatile("" :: "r"(scaled.data()) : "memory");
+    });
+    // The mixer with every voice decoding a clip, the most it adds to a block
+    auto pack = mixer::clips();
+    bench("mixer: all voices on clips", cIters, packet.size(), [&]{
+        for(auto& v: mixer::gMixer.voices){
+            if(v.left < packet.size()){ v = {.clip = pack.reader(0), .left = pack.entries()[0].frames, .gain = mixer::cDefaultGain}; }
+        }
+        for(auto& y: scaled){ y = mixer::gMixer.mix(0); }
+        asm volatile("" :: "r"(scaled.data()) : "memory");
+    });
+    // Resampling, per 48k sample (the I2S/ADC side)
+    auto up = Resampler::make(16'000, 48'000);
+    bench("resample 16k -> 48k", cIters, packet.size(), [&]{
+        u32 i = 0;
+        for(auto& y: scaled){ y = up.next([&]{ return packet[i++ % packet.size()]; }); }
+        asm volatile("" :: "r"(scaled.data()) : "memory");
+    });
+    auto down = Resampler::make(48'000, 16'000);
+    array<s16, packet.size() + 1> downOut;
+    bench("resample 48k -> 16k", cIters, packet.size(), [&]{
+        down.process(packet, downOut);
+        asm volatile("" :: "r"(downOut.data()) : "memory");
+    });
+    // The native 16k mic mode, per 192k ADC sample
+    auto decimator = Decimator::make(mic::cfg::ADC_LEVEL_SHIFT_COUNT);
+    array<u16, mic::ADCBlock{}.buf.size()> adc;
+    for(size_t i = 0; i < adc.size(); i++){ adc[i] = (u16)(mic::cfg::ADC_LEVEL_SHIFT_COUNT + (s16)(i * 331) / 32); }
+    bench("decimate 192k -> 16k", cIters, adc.size(), [&]{
+        decimator.process(adc, downOut);
+        asm volatile("" :: "r"(downOut.data()) : "memory");
+    });
+    bench("adc block -> usb fifo", cIters, mic::ADCInBufHalf{}.size(), [&]{
+        auto& q = mic::gAudioSendBuffer;
+        auto& slot = q.ring[q.write & q.cMask];
+        slot.buf.fill(mic::cfg::ADC_LEVEL_SHIFT_COUNT);
+        slot.rate = mic::cfg::SAMPLE_RATE;
+        q.commit_write(1);
+        mic::pump_usb();
+        auto& ff = mock::gUSBAudioInFifo;
+        ff.rd = ff.wr; // The host took it
+        ff.count = 0;
+    });
+}
@@ -0,0 +1,38 @@
+// Host throughput of console command dispatch (command_table.hpp): finding a command by its perfect hash against a
+// linear search of the same table, and whole lines through `processline`, parsing included.
+#include "pico/stdlib.h"
+#include "console.hpp"
+#include <chrono>
+
+static void bench(char const* name, u32 iters, u32 perIter, auto&& body){
+    auto start = std::chrono::steady_clock::now();
+    for(u32 i = 0; i < iters; i++){ body(); }
+    std::chrono::duration<f64, std::nano> took = std::chrono::steady_clock::now() - start;
+    std::printf("%-28s %8.2f ns/command  (%u iterations)\n", name, took.count() / ((f64)iters * perIter), iters);
+}
+
+int main(){
+    constexpr u32 cIters = 200'000;
+    mock::reset();
+    dev::servo::init();
+    auto& table = console::cCommands;
+    // Quiet ones, so the log ring isn't what's measured
+    constexpr auto cLines = std::to_array<sv>({"servo 12.5", "debug off", "vad mute off", "stats reset", "profile reset", "tone 0 0"});
+
+    bench("find: perfect hash", cIters, table.commands.size(), [&]{
+        for(auto& c: table.commands){
+            auto* found = table.find(c.name);
+            asm volatile("" :: "r"(found));
+        }
+    });
+    bench("find: linear", cIters, table.commands.size(), [&]{
+        for(auto& c: table.commands){
+            auto* found = &*std::ranges::find(table.commands, c.name, &cmd::Command::name);
+            asm volatile("" :: "r"(found));
+        }
+    });
+    bench("processline", cIters, cLines.size(), [&]{
+        for(sv line: cLines){ console::processline(line); }
+        logring::reset();
+    });
+}
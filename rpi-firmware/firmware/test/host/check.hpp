@@ -0,0 +1,20 @@
+#pragma once
+// Minimal assertion helpers for the host tests. A failed check reports and exits non-zero.
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#define CHECK(cond) do{ \
+    if(!(cond)){ std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); std::exit(1); } \
+}while(0)
+#define CHECK_EQ(a, b) do{ \
+    auto _a = (a); auto _b = (b); \
+    if(!(_a == _b)){ std::fprintf(stderr, "%s:%d: CHECK_EQ failed: %s (%lld) != %s (%lld)\n", __FILE__, __LINE__, \
+        #a, (long long)_a, #b, (long long)_b); std::exit(1); } \
+}while(0)
+
+// For CHECK(same(got, expect)) on text: shows both when they differ.
+inline bool same(std::string const& got, std::string const& expect){
+    if(got != expect){ std::fprintf(stderr, "got:\n%s\nexpected:\n%s\n", got.c_str(), expect.c_str()); }
+    return got == expect;
+}
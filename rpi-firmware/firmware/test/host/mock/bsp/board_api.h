@@ -0,0 +1,3 @@
+#pragma once
+// Mock of the TinyUSB `bsp/board_api.h`
+inline void board_init(){}
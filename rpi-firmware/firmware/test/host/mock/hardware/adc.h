@@ -0,0 +1,21 @@
+#pragma once
+// Mock of the Pico SDK `hardware/adc.h` (see mock_hal.hpp)
+#include "../mock_hal.hpp"
+
+struct adc_hw_t{
+    volatile uint32_t cs;
+    volatile uint32_t result;
+    volatile uint32_t fcs;
+    volatile uint32_t fifo;
+    volatile uint32_t div;
+};
+inline adc_hw_t gMockADCHw = {};
+#define adc_hw (&gMockADCHw)
+#define DREQ_ADC 36
+
+inline void adc_init(){}
+inline void adc_gpio_init(unsigned gpio){}
+inline void adc_select_input(unsigned input){ mock::gADCInput = input; }
+inline void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift){}
+inline void adc_set_clkdiv(float clkdiv){ mock::gADCClkDiv = clkdiv; }
+inline void adc_run(bool run){ mock::gADCRunning = run; }
@@ -0,0 +1,5 @@
+#pragma once
+// Mock of the Pico SDK `hardware/clocks.h` (see mock_hal.hpp)
+#include "../mock_hal.hpp"
+
+inline bool set_sys_clock_khz(uint32_t freq_khz, bool required){ return true; }
@@ -0,0 +1,78 @@
+#pragma once
+// Mock of the Pico SDK `hardware/dma.h` (see mock_hal.hpp)
+#include "../mock_hal.hpp"
+#include "irq.h"
+
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+using dma_channel_config = mock::DMAConfig;
+using dma_channel_hw_t = mock::DMAChannelHw;
+
+inline int dma_claim_unused_channel(bool required){
+    for(unsigned ch = 0; ch < mock::cDMAChannels; ch++){
+        if(!mock::gDMA[ch].claimed){
+            mock::gDMA[ch].claimed = true;
+            return ch;
+        }
+    }
+    return -1;
+}
+inline void dma_channel_unclaim(unsigned ch){ mock::gDMA[ch].claimed = false; }
+
+inline dma_channel_config dma_channel_get_default_config(unsigned ch){
+    dma_channel_config c;
+    c.chain_to = ch;
+    return c;
+}
+inline void channel_config_set_transfer_data_size(dma_channel_config* c, dma_channel_transfer_size size){ c->size = size; }
+inline void channel_config_set_read_increment(dma_channel_config* c, bool incr){ c->read_incr = incr; }
+inline void channel_config_set_write_increment(dma_channel_config* c, bool incr){ c->write_incr = incr; }
+inline void channel_config_set_chain_to(dma_channel_config* c, unsigned ch){ c->chain_to = ch; }
+inline void channel_config_set_dreq(dma_channel_config* c, unsigned dreq){ c->dreq = dreq; }
+inline void channel_config_set_ring(dma_channel_config* c, bool write, unsigned size_bits){
+    c->ring_write = write;
+    c->ring_bits = size_bits;
+}
+
+inline void dma_channel_start(unsigned ch){ mock::dma_trigger(ch); }
+inline void dma_channel_set_config(unsigned ch, const dma_channel_config* c, bool trigger){
+    mock::gDMA[ch].cfg = *c;
+    if(trigger){ dma_channel_start(ch); }
+}
+inline void dma_channel_set_read_addr(unsigned ch, const volatile void* read_addr, bool trigger){
+    mock::gDMA[ch].read_addr = read_addr;
+    if(trigger){ dma_channel_start(ch); }
+}
+inline void dma_channel_set_write_addr(unsigned ch, volatile void* write_addr, bool trigger){
+    mock::gDMA[ch].write_addr = write_addr;
+    if(trigger){ dma_channel_start(ch); }
+}
+inline void dma_channel_set_trans_count(unsigned ch, uint32_t count, bool trigger){
+    mock::gDMA[ch].count = count;
+    if(trigger){ dma_channel_start(ch); }
+}
+inline void dma_channel_configure(unsigned ch, const dma_channel_config* c, volatile void* write_addr,
+        const volatile void* read_addr, uint32_t count, bool trigger){
+    auto& s = mock::gDMA[ch];
+    s.cfg = *c;
+    s.write_addr = write_addr;
+    s.read_addr = read_addr;
+    s.count = count;
+    if(trigger){ dma_channel_start(ch); }
+}
+// Reads back what the channel is doing now (its registers are only kept up to date when asked for).
+inline dma_channel_hw_t* dma_channel_hw_addr(unsigned ch){
+    auto& r = mock::gDMAHw[ch];
+    auto& c = mock::gDMA[ch];
+    r.read_addr = (uintptr_t)c.read_addr;
+    r.write_addr = (uintptr_t)c.write_addr;
+    r.transfer_count = c.count;
+    return &r;
+}
+inline bool dma_channel_is_busy(unsigned ch){ return mock::gDMA[ch].busy; }
+
+inline void dma_channel_set_irq0_enabled(unsigned ch, bool enabled){ mock::gDMA[ch].irq0_enabled = enabled; }
+inline void dma_channel_set_irq1_enabled(unsigned ch, bool enabled){ mock::gDMA[ch].irq1_enabled = enabled; }
+inline bool dma_channel_get_irq0_status(unsigned ch){ return mock::gDMAIntStatus0 & (1u << ch); }
+inline bool dma_channel_get_irq1_status(unsigned ch){ return mock::gDMAIntStatus1 & (1u << ch); }
+inline void dma_channel_acknowledge_irq0(unsigned ch){ mock::gDMAIntStatus0 &= ~(1u << ch); }
+inline void dma_channel_acknowledge_irq1(unsigned ch){ mock::gDMAIntStatus1 &= ~(1u << ch); }
@@ -0,0 +1,22 @@
+#pragma once
+// Mock of the Pico SDK `hardware/flash.h` (see mock_hal.hpp). Offsets and sizes are checked like the ROM would need them.
+#include <cassert>
+#include "../mock_hal.hpp"
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES mock::cFlashBytes
+#endif
+#define XIP_BASE ((uintptr_t)mock::gFlash.data())
+
+inline void flash_range_erase(uint32_t offset, size_t count){
+    assert(offset % FLASH_SECTOR_SIZE == 0 && count % FLASH_SECTOR_SIZE == 0 && offset + count <= mock::gFlash.size());
+    std::memset(&mock::gFlash[offset], 0xff, count);
+    mock::gFlashErases += count / FLASH_SECTOR_SIZE;
+}
+inline void flash_range_program(uint32_t offset, const uint8_t* data, size_t count){
+    assert(offset % FLASH_PAGE_SIZE == 0 && count % FLASH_PAGE_SIZE == 0 && offset + count <= mock::gFlash.size());
+    for(size_t i = 0; i < count; i++){ mock::gFlash[offset + i] &= data[i]; }
+    mock::gFlashPrograms += count / FLASH_PAGE_SIZE;
+}
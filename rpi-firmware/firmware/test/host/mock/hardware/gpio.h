@@ -0,0 +1,11 @@
+#pragma once
+// Mock of the Pico SDK `hardware/gpio.h` (see mock_hal.hpp)
+#include "../mock_hal.hpp"
+
+enum gpio_function { GPIO_FUNC_PWM = 4, GPIO_FUNC_PIO0 = 6, GPIO_FUNC_SIO = 5 };
+
+inline void gpio_init(unsigned gpio){}
+inline void gpio_set_dir(unsigned gpio, bool out){}
+inline void gpio_pull_up(unsigned gpio){}
+inline void gpio_set_function(unsigned gpio, gpio_function fn){}
+inline bool gpio_get(unsigned gpio){ return mock::gGPIOIn[gpio]; }
@@ -0,0 +1,37 @@
+#pragma once
+// Mock of the Pico SDK `hardware/interp.h` (see mock_hal.hpp)
+#include "../mock_hal.hpp"
+
+using interp_hw_t = mock::Interp;
+#define interp0 (&mock::gInterp[0])
+#define interp1 (&mock::gInterp[1])
+
+struct interp_config{ mock::InterpLaneConfig lane; };
+
+inline interp_config interp_default_config(){ return {}; }
+inline void interp_config_set_shift(interp_config* c, unsigned shift){ c->lane.shift = shift; }
+inline void interp_config_set_mask(interp_config* c, unsigned mask_lsb, unsigned mask_msb){
+    c->lane.mask_lsb = mask_lsb;
+    c->lane.mask_msb = mask_msb;
+}
+inline void interp_config_set_signed(interp_config* c, bool is_signed){ c->lane.is_signed = is_signed; }
+inline void interp_config_set_add_raw(interp_config* c, bool add_raw){ c->lane.add_raw = add_raw; }
+inline void interp_set_config(interp_hw_t* interp, unsigned lane, interp_config* config){ interp->lane[lane] = config->lane; }
+
+inline void interp_set_base(interp_hw_t* interp, unsigned lane, uint32_t val){ interp->base[lane] = val; }
+inline uint32_t interp_get_base(interp_hw_t* interp, unsigned lane){ return interp->base[lane]; }
+inline void interp_set_accumulator(interp_hw_t* interp, unsigned lane, uint32_t val){ interp->accum[lane] = val; }
+inline uint32_t interp_get_accumulator(interp_hw_t* interp, unsigned lane){ return interp->accum[lane]; }
+
+inline uint32_t interp_peek_lane_result(interp_hw_t* interp, unsigned lane){ return interp->result(lane); }
+inline uint32_t interp_peek_full_result(interp_hw_t* interp){ return interp->full(); }
+inline uint32_t interp_pop_lane_result(interp_hw_t* interp, unsigned lane){
+    uint32_t r = interp->result(lane);
+    interp->pop();
+    return r;
+}
+inline uint32_t interp_pop_full_result(interp_hw_t* interp){
+    uint32_t r = interp->full();
+    interp->pop();
+    return r;
+}
@@ -0,0 +1,9 @@
+#pragma once
+// Mock of the Pico SDK `hardware/irq.h` (see mock_hal.hpp)
+#include "../mock_hal.hpp"
+
+enum irq_num_rp2040 { DMA_IRQ_0 = 11, DMA_IRQ_1 = 12 };
+using irq_handler_t = mock::irq_handler_t;
+
+inline void irq_set_exclusive_handler(unsigned num, irq_handler_t handler){ mock::gIRQHandlers[num] = handler; }
+inline void irq_set_enabled(unsigned num, bool enabled){ mock::gIRQEnabled[num] = enabled; }
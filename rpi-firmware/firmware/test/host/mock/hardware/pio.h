@@ -0,0 +1,49 @@
+#pragma once
+// Mock of the Pico SDK `hardware/pio.h` (see mock_hal.hpp)
+#include "../mock_hal.hpp"
+
+struct pio_hw_t{
+    volatile uint32_t txf[4];
+    volatile uint32_t rxf[4];
+};
+using PIO = pio_hw_t*;
+inline pio_hw_t gMockPIO0 = {};
+#define pio0 (&gMockPIO0)
+
+struct pio_program{
+    const uint16_t* instructions;
+    uint8_t length;
+    int8_t origin;
+};
+struct pio_sm_config{
+    uint32_t clkdiv;
+    uint32_t execctrl;
+    uint32_t shiftctrl;
+    uint32_t pinctrl;
+};
+enum pio_fifo_join { PIO_FIFO_JOIN_NONE = 0, PIO_FIFO_JOIN_TX = 1, PIO_FIFO_JOIN_RX = 2 };
+
+inline unsigned pio_claim_unused_sm(PIO pio, bool required){
+    for(unsigned sm = 0; sm < 4; sm++){
+        if(!mock::gPIOSMClaimed[sm]){
+            mock::gPIOSMClaimed[sm] = true;
+            return sm;
+        }
+    }
+    return -1;
+}
+inline unsigned pio_add_program(PIO pio, const pio_program* program){ return 0; }
+inline pio_sm_config pio_get_default_sm_config(){ return {}; }
+inline void sm_config_set_sideset_pins(pio_sm_config* c, unsigned base){}
+inline void sm_config_set_sideset(pio_sm_config* c, unsigned bit_count, bool optional, bool pindirs){}
+inline void sm_config_set_out_pins(pio_sm_config* c, unsigned base, unsigned count){}
+inline void sm_config_set_out_shift(pio_sm_config* c, bool shift_right, bool autopull, unsigned pull_threshold){}
+inline void sm_config_set_fifo_join(pio_sm_config* c, pio_fifo_join join){}
+inline void sm_config_set_wrap(pio_sm_config* c, unsigned wrap_target, unsigned wrap){}
+inline int pio_sm_init(PIO pio, unsigned sm, unsigned initial_pc, const pio_sm_config* config){ return 0; }
+inline void pio_sm_set_clkdiv(PIO pio, unsigned sm, float div){ mock::gPIOSMClkDiv[sm] = div; }
+inline void pio_gpio_init(PIO pio, unsigned pin){}
+inline void pio_sm_set_pins_with_mask(PIO pio, unsigned sm, uint32_t values, uint32_t mask){}
+inline void pio_sm_set_pindirs_with_mask(PIO pio, unsigned sm, uint32_t dirs, uint32_t mask){}
+inline void pio_sm_set_enabled(PIO pio, unsigned sm, bool enabled){ mock::gPIOSMEnabled[sm] = enabled; }
+inline unsigned pio_get_dreq(PIO pio, unsigned sm, bool is_tx){ return sm + (is_tx ? 0 : 4); }
@@ -0,0 +1,13 @@
+#pragma once
+// Mock of the Pico SDK `hardware/pwm.h` (see mock_hal.hpp)
+#include "gpio.h"
+
+enum pwm_chan { PWM_CHAN_A = 0, PWM_CHAN_B = 1 };
+
+inline unsigned pwm_gpio_to_slice_num(unsigned gpio){ return (gpio >> 1) & 7; }
+inline void pwm_set_clkdiv(unsigned slice, float div){}
+inline void pwm_set_wrap(unsigned slice, uint16_t wrap){ mock::gPWMWrap[slice] = wrap; }
+inline void pwm_set_chan_level(unsigned slice, unsigned chan, uint16_t level){
+    if(chan == PWM_CHAN_A){ mock::gPWMLevelA[slice] = level; }
+}
+inline void pwm_set_enabled(unsigned slice, bool enabled){}
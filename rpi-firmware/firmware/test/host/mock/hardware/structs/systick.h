@@ -0,0 +1,6 @@
+#pragma once
+// Mock of the Pico SDK `hardware/structs/systick.h`. The counter only moves when a test writes `cvr`.
+#include "../../mock_hal.hpp"
+
+using systick_hw_t = mock::SysTick;
+inline systick_hw_t* const systick_hw = &mock::gSysTick;
@@ -0,0 +1,10 @@
+#pragma once
+// Mock of the Pico SDK `hardware/sync.h`
+#include "../mock_hal.hpp"
+
+inline void __wfi(){}
+inline void __wfe(){}
+inline void __sev(){}
+inline void __dmb(){}
+inline uint32_t save_and_disable_interrupts(){ return 0; }
+inline void restore_interrupts(uint32_t status){}
@@ -0,0 +1,37 @@
+#pragma once
+// Stand-in for the header `pico_generate_pio_header` creates from src/dev/i2s.pio.
+// The instructions are irrelevant on the host, only the symbols are needed.
+// The firmware includes this inside `extern "C"`, which the C++ mock state can't live in.
+extern "C++" {
+    #include "hardware/pio.h"
+}
+
+static const uint16_t i2s_data_write_program_instructions[] = { 0 };
+static const struct pio_program i2s_data_write_program = {
+    .instructions = i2s_data_write_program_instructions,
+    .length = 1,
+    .origin = -1,
+};
+static inline pio_sm_config i2s_data_write_program_get_default_config(unsigned offset){
+    return pio_get_default_sm_config();
+}
+
+static const uint16_t i2s_data_write_16_program_instructions[] = { 0 };
+static const struct pio_program i2s_data_write_16_program = {
+    .instructions = i2s_data_write_16_program_instructions,
+    .length = 1,
+    .origin = -1,
+};
+static inline pio_sm_config i2s_data_write_16_program_get_default_config(unsigned offset){
+    return pio_get_default_sm_config();
+}
+
+static const uint16_t i2s_data_write_mono_program_instructions[] = { 0 };
+static const struct pio_program i2s_data_write_mono_program = {
+    .instructions = i2s_data_write_mono_program_instructions,
+    .length = 1,
+    .origin = -1,
+};
+static inline pio_sm_config i2s_data_write_mono_program_get_default_config(unsigned offset){
+    return pio_get_default_sm_config();
+}
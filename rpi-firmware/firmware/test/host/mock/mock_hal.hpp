@@ -0,0 +1,278 @@
+#pragma once
+// A thin stand-in for the parts of the Pico SDK and TinyUSB the firmware touches.
+// The SDK-named headers next to this file (`hardware/dma.h`, `tusb.h`, ...) forward to the state kept here,
+// so the firmware headers compile unmodified and tests can poke at the "hardware" directly.
+// Nothing here tries to be cycle accurate. Paced DMA transfers (the audio ones) only happen when a test says so.
+// Unpaced ones, like control blocks reprogramming another channel, run to completion as soon as they're triggered.
+// NOTE: Stick to the std headers common.hpp pulls in before it defines `ref`, or libstdc++ stops compiling.
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <array>
+#include <vector>
+
+namespace mock{
+    using irq_handler_t = void(*)();
+
+    // DMA
+    // ---------------------
+    constexpr unsigned cDMAChannels = 12;
+    constexpr unsigned cDREQForce = 0x3f; // DREQ_FORCE: unpaced
+    struct DMAConfig{
+        unsigned size = 2; // log2 bytes, DMA_SIZE_32
+        bool read_incr = true;
+        bool write_incr = false;
+        unsigned chain_to = 0; // Itself means no chaining (same as the hardware)
+        unsigned dreq = cDREQForce;
+        unsigned ring_bits = 0;
+        bool ring_write = false;
+    };
+    struct DMAChannelState{
+        bool claimed = false;
+        DMAConfig cfg;
+        volatile void* write_addr = nullptr;
+        const volatile void* read_addr = nullptr;
+        uint32_t count = 0;
+        bool busy = false;
+        bool irq0_enabled = false;
+        bool irq1_enabled = false;
+    };
+    inline std::array<DMAChannelState, cDMAChannels> gDMA;
+    inline uint32_t gDMAIntStatus0 = 0; // INTS0, cleared by writing 1s
+    inline uint32_t gDMAIntStatus1 = 0; // INTS1
+
+    // A channel's registers, in the hardware's order (4 aliases of {read, write, count, ctrl}, each shuffled).
+    // Only there to be written by another channel, or read back through `dma_channel_hw_addr`.
+    // Registers are pointer sized on the host so addresses fit, and a 32 bit channel writing into them moves
+    // pointer sized words.
+    struct DMAChannelHw{
+        uintptr_t read_addr, write_addr, transfer_count, ctrl_trig;
+        uintptr_t al1_ctrl, al1_read_addr, al1_write_addr, al1_transfer_count_trig;
+        uintptr_t al2_ctrl, al2_transfer_count, al2_read_addr, al2_write_addr_trig;
+        uintptr_t al3_ctrl, al3_write_addr, al3_transfer_count, al3_read_addr_trig;
+    };
+    inline std::array<DMAChannelHw, cDMAChannels> gDMAHw = {};
+
+    inline void dma_trigger(unsigned ch);
+
+    // A write into `ch`'s register number `reg` (in DMAChannelHw). The last register of each alias triggers.
+    inline void dma_register_write(unsigned ch, unsigned reg, uintptr_t value){
+        enum : uint8_t { Read, Write, Count, Ctrl };
+        constexpr uint8_t cLayout[16] = {Read, Write, Count, Ctrl, Ctrl, Read, Write, Count,
+                                         Ctrl, Count, Read, Write, Ctrl, Write, Count, Read};
+        auto& c = gDMA[ch];
+        switch(cLayout[reg]){
+            case Read: c.read_addr = (const volatile void*)value; break;
+            case Write: c.write_addr = (volatile void*)value; break;
+            case Count: c.count = (uint32_t)value; break;
+            case Ctrl: break; // Not modelled
+        }
+        if(reg % 4 == 3){ dma_trigger(ch); }
+    }
+    inline bool is_dma_register(uintptr_t addr){
+        return addr >= (uintptr_t)gDMAHw.data() && addr < (uintptr_t)(gDMAHw.data() + gDMAHw.size());
+    }
+    inline uintptr_t dma_word_bytes(unsigned ch){
+        auto& c = gDMA[ch];
+        if(c.cfg.size == 2 && is_dma_register((uintptr_t)c.write_addr)){ return sizeof(uintptr_t); }
+        return 1u << c.cfg.size;
+    }
+    // Moves an address on by `bytes`, wrapping within its low `ring_bits` bits if there's a ring.
+    inline uintptr_t dma_step(uintptr_t addr, uintptr_t bytes, unsigned ring_bits){
+        if(ring_bits == 0){ return addr + bytes; }
+        uintptr_t mask = ((uintptr_t)1 << ring_bits) - 1;
+        return (addr & ~mask) | ((addr + bytes) & mask);
+    }
+
+    // Moves everything `ch` is set up for, at once. Addresses are left for `dma_complete` to advance.
+    inline void dma_transfer(unsigned ch){
+        auto& c = gDMA[ch];
+        auto bytes = dma_word_bytes(ch);
+        auto from = (uintptr_t)c.read_addr, to = (uintptr_t)c.write_addr;
+        for(uint32_t i = 0; i < c.count; i++){
+            if(is_dma_register(to)){
+                uintptr_t v;
+                std::memcpy(&v, (const void*)from, sizeof(v));
+                auto offset = to - (uintptr_t)gDMAHw.data();
+                dma_register_write(offset / sizeof(DMAChannelHw), offset % sizeof(DMAChannelHw) / sizeof(uintptr_t), v);
+            }else{
+                std::memcpy((void*)to, (const void*)from, bytes);
+            }
+            if(c.cfg.read_incr){ from = dma_step(from, bytes, c.cfg.ring_write ? 0 : c.cfg.ring_bits); }
+            if(c.cfg.write_incr){ to = dma_step(to, bytes, c.cfg.ring_write ? c.cfg.ring_bits : 0); }
+        }
+    }
+
+    // Finishes the transfer on `ch`, raises its IRQs and triggers the chained channel.
+    // No data moves (tests write what the peripheral would have themselves), but the addresses end up past the
+    // transfer, as they do on the hardware.
+    inline void dma_complete(unsigned ch){
+        auto& c = gDMA[ch];
+        auto bytes = c.count * dma_word_bytes(ch);
+        if(c.cfg.read_incr){
+            c.read_addr = (const volatile void*)dma_step((uintptr_t)c.read_addr, bytes, c.cfg.ring_write ? 0 : c.cfg.ring_bits);
+        }
+        if(c.cfg.write_incr){
+            c.write_addr = (volatile void*)dma_step((uintptr_t)c.write_addr, bytes, c.cfg.ring_write ? c.cfg.ring_bits : 0);
+        }
+        c.busy = false;
+        if(c.irq0_enabled){ gDMAIntStatus0 |= 1u << ch; }
+        if(c.irq1_enabled){ gDMAIntStatus1 |= 1u << ch; }
+        if(c.cfg.chain_to != ch){ dma_trigger(c.cfg.chain_to); }
+    }
+
+    inline void dma_trigger(unsigned ch){
+        gDMA[ch].busy = true;
+        if(gDMA[ch].cfg.dreq == cDREQForce){
+            dma_transfer(ch);
+            dma_complete(ch);
+        }
+    }
+
+    // IRQ
+    // ---------------------
+    inline std::array<irq_handler_t, 32> gIRQHandlers = {};
+    inline std::array<bool, 32> gIRQEnabled = {};
+    inline void irq_fire(unsigned num){
+        if(gIRQEnabled[num] && gIRQHandlers[num]){ gIRQHandlers[num](); }
+    }
+
+    // ADC
+    // ---------------------
+    inline float gADCClkDiv = 0;
+    inline bool gADCRunning = false;
+    inline unsigned gADCInput = 0;
+
+    // Interpolators (one pair, standing in for the calling core's)
+    // ---------------------
+    // Each lane shifts its accumulator right, masks it and optionally sign extends it. A lane's result adds that
+    // (or, with add_raw, the raw accumulator) to its base, and the full result adds both shifted values to BASE2.
+    // A pop writes each lane's result back to its accumulator. Cross, clamp, blend and force_msb aren't modelled.
+    struct InterpLaneConfig{
+        unsigned shift = 0;
+        unsigned mask_lsb = 0;
+        unsigned mask_msb = 31;
+        bool is_signed = false;
+        bool add_raw = false;
+    };
+    struct Interp{
+        std::array<uint32_t, 2> accum = {};
+        std::array<uint32_t, 3> base = {};
+        std::array<InterpLaneConfig, 2> lane = {};
+
+        uint32_t shifted(unsigned l) const{
+            auto& c = lane[l];
+            uint32_t mask = (uint32_t)(((uint64_t)2 << c.mask_msb) - (1u << c.mask_lsb));
+            uint32_t v = (accum[l] >> c.shift) & mask;
+            if(c.is_signed && (v >> c.mask_msb & 1) && c.mask_msb < 31){ v |= ~(uint32_t)0 << (c.mask_msb + 1); }
+            return v;
+        }
+        uint32_t result(unsigned l) const{ return base[l] + (lane[l].add_raw ? accum[l] : shifted(l)); }
+        uint32_t full() const{ return base[2] + shifted(0) + shifted(1); }
+        void pop(){ accum = {result(0), result(1)}; }
+    };
+    inline std::array<Interp, 2> gInterp = {};
+
+    // PIO
+    // ---------------------
+    inline std::array<bool, 4> gPIOSMClaimed = {};
+    inline std::array<bool, 4> gPIOSMEnabled = {};
+    inline std::array<float, 4> gPIOSMClkDiv = {};
+
+    // PWM / GPIO
+    // ---------------------
+    inline std::array<uint16_t, 8> gPWMLevelA = {};
+    inline std::array<uint16_t, 8> gPWMWrap = {};
+    inline std::array<bool, 30> gGPIOIn = {}; // What gpio_get returns
+
+    // Multicore. There's only ever one core, so core1 is never started.
+    inline irq_handler_t gCore1Entry = nullptr;
+    inline irq_handler_t gCore1Spin = nullptr; // What core1 gets done each time core0 spins (tight_loop_contents)
+    inline uint32_t gCoreNum = 0; // What get_core_num says. Tests running core1's code can set it.
+    inline std::vector<uint32_t> gSIOFifo; // Both directions share it
+
+    // Time, in microseconds since boot. Only moves when a test moves it.
+    inline uint64_t gTimeUs = 0;
+    // The (per core, but there's one) SysTick. Counts down, and likewise only moves when a test moves it.
+    struct SysTick{
+        volatile uint32_t csr, rvr, cvr, calib;
+    };
+    inline SysTick gSysTick = {};
+
+    // USB
+    // ---------------------
+    inline std::vector<uint8_t> gUSBAudioOut;  // Host -> device (speaker). Consumed by tud_audio_read.
+    inline std::vector<uint8_t> gUSBAudioIn;   // Device -> host (mic). What has left the IN FIFO (see tusb.h).
+    inline std::vector<uint8_t> gUSBCDCRx;     // Host -> device serial
+    inline std::vector<uint8_t> gUSBCDCTx;     // Device -> host serial (tud_cdc_write only, not printf)
+    inline uint32_t gUSBCDCTxRoom = UINT32_MAX; // How much more the host takes. Unlimited unless a test limits it.
+    inline std::vector<uint8_t> gUSBControlReply; // Last payload passed to tud_audio_buffer_and_schedule_control_xfer
+    inline uint32_t gUSBFeedback = 0;             // Last value passed to tud_audio_fb_set (16.16)
+
+    // A TinyUSB style byte FIFO (tusb.h calls it tu_fifo_t). The mic's IN FIFO is the only one modelled.
+    struct ByteFifo{
+        uint8_t* buffer;
+        uint16_t depth;
+        uint16_t rd = 0, wr = 0, count = 0;
+    };
+    inline std::array<uint8_t, 4 * 98> gUSBAudioInFifoBuf; // CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ (checked in tusb.h)
+    inline ByteFifo gUSBAudioInFifo = {gUSBAudioInFifoBuf.data(), (uint16_t)gUSBAudioInFifoBuf.size()};
+
+    inline std::vector<uint8_t> gUSBVendorRx;  // Host -> device bulk
+    inline std::vector<uint8_t> gUSBVendorTx;  // Device -> host bulk
+    inline uint32_t gUSBVendorTxRoom = UINT32_MAX; // Like gUSBCDCTxRoom
+
+    // Flash
+    // ---------------------
+    // The whole 2MB part, mapped at XIP_BASE (see hardware/flash.h). Like the real thing it survives `reset`, so
+    // tests can "reboot" over it, and starts erased. Programming can only clear bits.
+    constexpr uint32_t cFlashBytes = 2 * 1024 * 1024;
+    inline std::vector<uint8_t> gFlash(cFlashBytes, 0xff);
+    inline uint32_t gFlashErases = 0;   // Sectors erased
+    inline uint32_t gFlashPrograms = 0; // Pages programmed
+    inline uint32_t gFlashSafeCalls = 0; // flash_safe_execute calls, each of which would stall the other core
+
+    // Moves up to `n` bytes from the front of `from` into `to`.
+    template<typename T>
+    inline uint32_t take_front(std::vector<T>& from, void* to, uint32_t n){
+        n = n < from.size() ? n : from.size();
+        std::memcpy(to, from.data(), n * sizeof(T));
+        from.erase(from.begin(), from.begin() + n);
+        return n;
+    }
+
+    // Puts every peripheral back to its power-on state. Call at the start of each test.
+    inline void reset(){
+        gDMA = {};
+        gDMAIntStatus0 = gDMAIntStatus1 = 0;
+        gDMAHw = {};
+        gIRQHandlers = {};
+        gIRQEnabled = {};
+        gADCClkDiv = 0;
+        gADCRunning = false;
+        gInterp = {};
+        gPIOSMClaimed = {};
+        gPIOSMEnabled = {};
+        gPWMLevelA = {};
+        gPWMWrap = {};
+        gGPIOIn = {};
+        gCore1Entry = nullptr;
+        gCore1Spin = nullptr;
+        gCoreNum = 0;
+        gSIOFifo.clear();
+        gTimeUs = 0;
+        gSysTick = {};
+        gUSBAudioOut.clear();
+        gUSBAudioIn.clear();
+        gUSBAudioInFifo.rd = gUSBAudioInFifo.wr = gUSBAudioInFifo.count = 0;
+        gUSBCDCRx.clear();
+        gUSBCDCTx.clear();
+        gUSBCDCTxRoom = UINT32_MAX;
+        gUSBControlReply.clear();
+        gUSBFeedback = 0;
+        gUSBVendorRx.clear();
+        gUSBVendorTx.clear();
+        gUSBVendorTxRoom = UINT32_MAX;
+        gFlashErases = gFlashPrograms = gFlashSafeCalls = 0;
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+// Mock of the Pico SDK `pico/flash.h`. There's no other core to pause, so the function just runs.
+#include "../mock_hal.hpp"
+
+#define PICO_OK 0
+inline bool flash_safe_execute_core_init(){ return true; }
+inline int flash_safe_execute(void (*func)(void*), void* param, uint32_t enter_exit_timeout_ms){
+    mock::gFlashSafeCalls += 1;
+    func(param);
+    return PICO_OK;
+}
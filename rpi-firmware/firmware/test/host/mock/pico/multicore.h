@@ -0,0 +1,14 @@
+#pragma once
+// Mock of the Pico SDK `pico/multicore.h`. There is no second core: the entry point is recorded, not run,
+// and the SIO FIFO is a plain queue (see mock_hal.hpp).
+#include "../mock_hal.hpp"
+
+inline void multicore_launch_core1(void (*entry)()){ mock::gCore1Entry = entry; }
+inline void multicore_reset_core1(){ mock::gCore1Entry = nullptr; }
+inline void multicore_fifo_push_blocking(uint32_t data){ mock::gSIOFifo.push_back(data); }
+inline uint32_t multicore_fifo_pop_blocking(){
+    uint32_t v = 0;
+    mock::take_front(mock::gSIOFifo, &v, 1);
+    return v;
+}
+inline bool multicore_fifo_rvalid(){ return !mock::gSIOFifo.empty(); }
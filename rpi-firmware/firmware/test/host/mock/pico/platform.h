@@ -0,0 +1,11 @@
+#pragma once
+// Mock of the Pico SDK `pico/platform.h`
+#include "../mock_hal.hpp"
+
+#define NUM_CORES 2
+inline unsigned get_core_num(){ return mock::gCoreNum; }
+// Stands in for core1 getting on while core0 spins: runs mock::gCore1Spin, if a test set one, and moves time on.
+inline void tight_loop_contents(){
+    if(mock::gCore1Spin){ mock::gCore1Spin(); }
+    mock::gTimeUs += 1;
+}
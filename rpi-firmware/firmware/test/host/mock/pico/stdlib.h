@@ -0,0 +1,8 @@
+#pragma once
+// Mock of the Pico SDK `pico/stdlib.h` (see mock_hal.hpp)
+#include <stdio.h>
+#include "../mock_hal.hpp"
+#include "../hardware/gpio.h"
+#include "time.h"
+
+inline bool stdio_init_all(){ return true; }
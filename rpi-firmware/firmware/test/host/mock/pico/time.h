@@ -0,0 +1,15 @@
+#pragma once
+// Mock of the Pico SDK `pico/time.h`. Time is `mock::gTimeUs` and only advances when a test moves it.
+#include "../mock_hal.hpp"
+
+using absolute_time_t = uint64_t;
+
+inline absolute_time_t get_absolute_time(){ return mock::gTimeUs; }
+inline uint32_t to_ms_since_boot(absolute_time_t t){ return t / 1000; }
+inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us){ return t + us; }
+inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms){ return t + ms * 1000ull; }
+inline absolute_time_t make_timeout_time_us(uint64_t us){ return delayed_by_us(get_absolute_time(), us); }
+inline absolute_time_t make_timeout_time_ms(uint32_t ms){ return delayed_by_ms(get_absolute_time(), ms); }
+inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to){ return (int64_t)(to - from); }
+inline uint64_t time_us_64(){ return mock::gTimeUs; }
+inline uint32_t time_us_32(){ return (uint32_t)mock::gTimeUs; }
@@ -0,0 +1,211 @@
+#pragma once
+// Mock of the TinyUSB device API the firmware uses (see mock_hal.hpp).
+// Only the types, constants and calls that appear in src/ are provided. The layouts match TinyUSB's.
+#include <stdint.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <algorithm>
+#include "mock_hal.hpp"
+
+#define OPT_MCU_RP2040          2100
+#define OPT_OS_NONE             1
+#define OPT_MODE_DEVICE         0x0001
+#define OPT_MODE_FULL_SPEED     0x0000
+#define OPT_MODE_DEFAULT_SPEED  OPT_MODE_FULL_SPEED
+#define TUD_OPT_HIGH_SPEED      0
+#include "tusb_config.h"
+
+#define TU_ATTR_PACKED __attribute__ ((packed))
+#define TU_ASSERT(_cond, ...) do{ if(!(_cond)){ return false; } }while(0)
+#define TU_VERIFY(_cond, ...) do{ if(!(_cond)){ return false; } }while(0)
+#define tu_htole16(_x) (_x)
+#define tu_htole32(_x) (_x)
+inline uint8_t tu_u16_low(uint16_t v){ return v & 0xff; }
+inline uint8_t tu_u16_high(uint16_t v){ return v >> 8; }
+
+// Audio class
+// ---------------------
+#define TUD_AUDIO_EP_SIZE(_maxFrequency, _nBytesPerSample, _nChannels) \
+    ((((_maxFrequency + (TUD_OPT_HIGH_SPEED ? 7999 : 999)) / (TUD_OPT_HIGH_SPEED ? 8000 : 1000)) + 1) * _nBytesPerSample * _nChannels)
+
+enum { AUDIO_CS_REQ_CUR = 0x01, AUDIO_CS_REQ_RANGE = 0x02 };
+enum { AUDIO_CS_CTRL_SAM_FREQ = 0x01, AUDIO_CS_CTRL_CLK_VALID = 0x02 };
+enum { AUDIO_FU_CTRL_MUTE = 0x01, AUDIO_FU_CTRL_VOLUME = 0x02 };
+
+typedef struct TU_ATTR_PACKED {
+    uint8_t bmRequestType;
+    uint8_t bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+} tusb_control_request_t;
+
+typedef struct TU_ATTR_PACKED {
+    uint8_t bmRequestType;
+    uint8_t bRequest;
+    union {
+        struct TU_ATTR_PACKED {
+            uint8_t bChannelNumber;
+            uint8_t bControlSelector;
+        };
+        uint16_t wValue;
+    };
+    union {
+        struct TU_ATTR_PACKED {
+            uint8_t bInterface;
+            uint8_t bEntityID;
+        };
+        uint16_t wIndex;
+    };
+    uint16_t wLength;
+} audio_control_request_t;
+
+typedef struct TU_ATTR_PACKED { int8_t  bCur; } audio_control_cur_1_t;
+typedef struct TU_ATTR_PACKED { int16_t bCur; } audio_control_cur_2_t;
+typedef struct TU_ATTR_PACKED { int32_t bCur; } audio_control_cur_4_t;
+
+#define audio_control_range_2_n_t(numSubRanges) \
+    struct TU_ATTR_PACKED { \
+        uint16_t wNumSubRanges; \
+        struct TU_ATTR_PACKED { int16_t bMin; int16_t bMax; uint16_t bRes; } subrange[numSubRanges]; \
+    }
+#define audio_control_range_4_n_t(numSubRanges) \
+    struct TU_ATTR_PACKED { \
+        uint16_t wNumSubRanges; \
+        struct TU_ATTR_PACKED { int32_t bMin; int32_t bMax; uint32_t bRes; } subrange[numSubRanges]; \
+    }
+
+typedef enum {
+    AUDIO_FEEDBACK_METHOD_DISABLED,
+    AUDIO_FEEDBACK_METHOD_FREQUENCY_FIXED,
+    AUDIO_FEEDBACK_METHOD_FREQUENCY_FLOAT,
+    AUDIO_FEEDBACK_METHOD_FREQUENCY_POWER_OF_2,
+    AUDIO_FEEDBACK_METHOD_FIFO_COUNT,
+} audio_feedback_method_t;
+typedef struct {
+    uint8_t method;
+    uint32_t sample_freq;
+    union {
+        struct { uint32_t mclk_freq; } frequency;
+    };
+} audio_feedback_params_t;
+
+// FIFO (TinyUSB's tu_fifo, byte items, no overwrite)
+// ---------------------
+using tu_fifo_t = mock::ByteFifo;
+static_assert(sizeof(mock::gUSBAudioInFifoBuf) == CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ, "Keep the mock FIFO in step with tusb_config.h");
+typedef struct {
+    uint16_t len_lin;
+    uint16_t len_wrap;
+    void* ptr_lin;
+    void* ptr_wrap;
+} tu_fifo_buffer_info_t;
+
+inline void tu_fifo_get_write_info(tu_fifo_t* f, tu_fifo_buffer_info_t* info){
+    uint16_t free = f->depth - f->count;
+    uint16_t tillEnd = f->depth - f->wr;
+    info->len_lin = free < tillEnd ? free : tillEnd;
+    info->len_wrap = free - info->len_lin;
+    info->ptr_lin = f->buffer + f->wr;
+    info->ptr_wrap = f->buffer;
+}
+inline void tu_fifo_advance_write_pointer(tu_fifo_t* f, uint16_t n){
+    f->wr = (f->wr + n) % f->depth;
+    f->count += n;
+}
+inline uint16_t tu_fifo_write_n(tu_fifo_t* f, const void* data, uint16_t n){
+    auto in = (const uint8_t*)data;
+    uint16_t done = 0;
+    for(; done < n && f->count < f->depth; done++){
+        f->buffer[f->wr] = in[done];
+        tu_fifo_advance_write_pointer(f, 1);
+    }
+    return done;
+}
+inline uint16_t tu_fifo_read_n(tu_fifo_t* f, void* data, uint16_t n){
+    auto out = (uint8_t*)data;
+    uint16_t done = 0;
+    for(; done < n && f->count > 0; done++){
+        out[done] = f->buffer[f->rd];
+        f->rd = (f->rd + 1) % f->depth;
+        f->count -= 1;
+    }
+    return done;
+}
+
+namespace mock{
+    // Empties the mic IN FIFO into gUSBAudioIn, as if the host had polled the endpoint.
+    inline void usb_audio_in_send(){
+        uint8_t b;
+        while(tu_fifo_read_n(&gUSBAudioInFifo, &b, 1)){ gUSBAudioIn.push_back(b); }
+    }
+}
+
+inline tu_fifo_t* tud_audio_get_ep_in_ff(){ return &mock::gUSBAudioInFifo; }
+inline bool tud_audio_fb_set(uint32_t feedback){
+    mock::gUSBFeedback = feedback;
+    return true;
+}
+inline uint16_t tud_audio_read(void* buffer, uint16_t bufsize){
+    return mock::take_front(mock::gUSBAudioOut, buffer, bufsize);
+}
+inline uint16_t tud_audio_write(const void* data, uint16_t len){
+    return tu_fifo_write_n(&mock::gUSBAudioInFifo, data, len);
+}
+inline bool tud_audio_buffer_and_schedule_control_xfer(uint8_t rhport, const tusb_control_request_t* request,
+        const void* data, uint16_t len){
+    auto p = (const uint8_t*)data;
+    mock::gUSBControlReply.assign(p, p + len);
+    return true;
+}
+
+// CDC class
+// ---------------------
+inline bool tud_cdc_connected(){ return true; }
+inline uint32_t tud_cdc_available(){ return mock::gUSBCDCRx.size(); }
+inline uint32_t tud_cdc_read(void* buffer, uint32_t bufsize){
+    return mock::take_front(mock::gUSBCDCRx, buffer, bufsize);
+}
+inline uint32_t tud_cdc_write_available(){ return std::min<uint32_t>(CFG_TUD_CDC_TX_BUFSIZE, mock::gUSBCDCTxRoom); }
+inline uint32_t tud_cdc_write(const void* buffer, uint32_t bufsize){
+    auto in = (const uint8_t*)buffer;
+    bufsize = std::min(bufsize, tud_cdc_write_available());
+    mock::gUSBCDCTx.insert(mock::gUSBCDCTx.end(), in, in + bufsize);
+    mock::gUSBCDCTxRoom -= bufsize;
+    return bufsize;
+}
+inline uint32_t tud_cdc_write_flush(){ return 0; }
+
+// Vendor class
+// ---------------------
+inline bool tud_vendor_mounted(){ return true; }
+inline uint32_t tud_vendor_available(){ return mock::gUSBVendorRx.size(); }
+inline uint32_t tud_vendor_read(void* buffer, uint32_t bufsize){
+    return mock::take_front(mock::gUSBVendorRx, buffer, bufsize);
+}
+inline uint32_t tud_vendor_write_available(){ return std::min<uint32_t>(CFG_TUD_VENDOR_TX_BUFSIZE, mock::gUSBVendorTxRoom); }
+inline uint32_t tud_vendor_write(const void* buffer, uint32_t bufsize){
+    auto in = (const uint8_t*)buffer;
+    bufsize = std::min(bufsize, tud_vendor_write_available());
+    mock::gUSBVendorTx.insert(mock::gUSBVendorTx.end(), in, in + bufsize);
+    mock::gUSBVendorTxRoom -= bufsize;
+    return bufsize;
+}
+inline uint32_t tud_vendor_write_flush(){ return 0; }
+
+// Application callbacks (implemented in src/libimpl/usb_handlers.cpp)
+// ---------------------
+void tud_umount_cb();
+bool tud_audio_set_req_entity_cb(uint8_t rhport, const tusb_control_request_t* p_request, uint8_t* buf);
+bool tud_audio_get_req_entity_cb(uint8_t rhport, const tusb_control_request_t* p_request);
+bool tud_audio_set_itf_cb(uint8_t rhport, const tusb_control_request_t* p_request);
+void tud_audio_feedback_params_cb(uint8_t func_id, uint8_t alt_itf, audio_feedback_params_t* feedback_param);
+bool tud_audio_rx_done_pre_read_cb(uint8_t rhport, uint16_t n_bytes_received, uint8_t func_id, uint8_t ep_out, uint8_t cur_alt_setting);
+void tud_cdc_rx_cb(uint8_t itf);
+void tud_vendor_rx_cb(uint8_t itf, uint8_t const* buffer, uint16_t bufsize);
+void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes);
+
+// Device
+// ---------------------
+inline bool tusb_init(){ return true; }
+inline void tud_task(){}
@@ -0,0 +1,92 @@
+// IMA-ADPCM: encode/decode quality, streaming across block boundaries, and packs.
+#include "check.hpp"
+#include "adpcm.hpp"
+#include <cmath>
+
+static vec<s16> sine(f64 hz, f64 amp, size_t n){
+    vec<s16> x(n);
+    for(size_t i = 0; i < n; i++){ x[i] = (s16)std::lround(amp * std::sin(2 * M_PI * hz / adpcm::cRate * i + 1)); }
+    return x;
+}
+
+static vec<s16> decode_all(span<const u8> blocks, size_t frames){
+    auto r = adpcm::Reader::make(blocks.data());
+    vec<s16> out(frames);
+    for(auto& s: out){ s = r.next(); }
+    return out;
+}
+
+static f64 snr_db(span<const s16> want, span<const s16> got){
+    f64 signal = 0, noise = 0;
+    for(size_t i = 0; i < want.size(); i++){
+        signal += (f64)want[i] * want[i];
+        noise += ((f64)want[i] - got[i]) * ((f64)want[i] - got[i]);
+    }
+    return 10 * std::log10(signal / std::max(noise, 1.0));
+}
+
+// A quarter the size, and close enough for speech and chimes.
+static void test_round_trip(){
+    for(f64 hz: {200.0, 1000.0, 4000.0}){
+        auto x = sine(hz, 16'000, adpcm::cRate / 4);
+        auto blocks = adpcm::encode(x);
+        CHECK_EQ(blocks.size(), adpcm::encoded_size(x.size()));
+        CHECK(blocks.size() * 4 < x.size() * sizeof(s16) * 1.05);
+        CHECK(snr_db(x, decode_all(blocks, x.size())) > 25);
+    }
+}
+
+// Every length decodes to what was encoded around the block edges: each block starts exact, the last one short.
+static void test_block_edges(){
+    for(size_t n: {1u, 2u, 3u, 504u, 505u, 506u, 507u, 1010u, 1011u}){
+        auto x = sine(700, 20'000, n);
+        auto blocks = adpcm::encode(x);
+        CHECK_EQ(blocks.size(), adpcm::encoded_size(n));
+        auto y = decode_all(blocks, n);
+        for(size_t i = 0; i < n; i += adpcm::cBlockFrames){ CHECK_EQ(y[i], x[i]); }
+        CHECK(snr_db(x, y) > 20);
+    }
+}
+
+// Full scale square waves mustn't wrap round.
+static void test_clipping(){
+    vec<s16> x(2000);
+    for(size_t i = 0; i < x.size(); i++){ x[i] = (i / 50) % 2 ? INT16_MAX : INT16_MIN; }
+    auto y = decode_all(adpcm::encode(x), x.size());
+    for(size_t i = 0; i < x.size(); i++){
+        if(i % 50 > 25){ CHECK((x[i] > 0) == (y[i] > 0)); }
+    }
+}
+
+static void test_pack(){
+    vec<std::pair<string, vec<s16>>> clips = {{"one", sine(440, 8000, 1000)}, {"two", sine(880, 8000, 3)}, {"a_long_name_here", {}}};
+    auto bytes = adpcm::pack(clips);
+    adpcm::Pack p = {bytes};
+    CHECK(p.valid());
+    CHECK_EQ(p.count(), 3u);
+    CHECK_EQ(*p.find("two"), 1);
+    CHECK_EQ(*p.find("a_long_name_here"), 2);
+    CHECK(!p.find("tw").has_value());
+    CHECK(!p.find("three").has_value());
+    for(u16 i = 0; i < 2; i++){
+        CHECK_EQ(p.entries()[i].offset % 4, 0u);
+        CHECK_EQ(p.entries()[i].frames, (u32)clips[i].second.size());
+        auto r = p.reader(i);
+        auto y = vec<s16>(clips[i].second.size());
+        for(auto& s: y){ s = r.next(); }
+        CHECK(y == decode_all(adpcm::encode(clips[i].second), y.size()));
+    }
+    // Damaged ones play nothing
+    CHECK_EQ((adpcm::Pack{span{bytes}.first(bytes.size() - 100)}.count()), 0u);
+    bytes[0] ^= 1;
+    CHECK_EQ(p.count(), 0u);
+    CHECK_EQ((adpcm::Pack{}.count()), 0u);
+}
+
+int main(){
+    test_round_trip();
+    test_block_edges();
+    test_clipping();
+    test_pack();
+    std::puts("test_adpcm: ok");
+}
@@ -0,0 +1,600 @@
+// The audio and console paths end to end against the mocked HAL:
+// USB OUT -> RingQueue -> DAC DMA buffers, ADC DMA buffers -> USB IN, UAC2 volume/mute, and console commands.
+#include "check.hpp"
+#include "pico/stdlib.h"
+#include "dev/i2s_dac.hpp"
+#include "dev/mic_adc.hpp"
+#include "console.hpp"
+#include "audio_engine.hpp"
+
+// Helpers
+// ---------------------
+
+// Queues `samples` as if the host sent them in one isochronous packet, and runs the receive callback.
+static void usb_send_audio(span<const s16> samples){
+    auto bytes = std::as_bytes(samples);
+    for(auto b: bytes){ mock::gUSBAudioOut.push_back((u8)b); }
+    tud_audio_rx_done_pre_read_cb(0, bytes.size(), 0, 0, 0);
+}
+
+static bool usb_set_feature(u8 selector, u8 channel, s16 value){
+    audio_control_request_t req = {};
+    req.bRequest = AUDIO_CS_REQ_CUR;
+    req.bControlSelector = selector;
+    req.bChannelNumber = channel;
+    req.bEntityID = TERMID_SPK_FEAT;
+    req.wLength = selector == AUDIO_FU_CTRL_MUTE ? sizeof(audio_control_cur_1_t) : sizeof(audio_control_cur_2_t);
+    audio_control_cur_2_t cur = {.bCur = value}; // The 1 byte mute control just reads the low byte
+    return tud_audio_set_req_entity_cb(0, (tusb_control_request_t const*)&req, (u8*)&cur);
+}
+
+static bool usb_set_clock(u32 rate){
+    audio_control_request_t req = {};
+    req.bRequest = AUDIO_CS_REQ_CUR;
+    req.bControlSelector = AUDIO_CS_CTRL_SAM_FREQ;
+    req.bEntityID = TERMID_CLK;
+    req.wLength = sizeof(audio_control_cur_4_t);
+    audio_control_cur_4_t cur = {.bCur = (s32)rate};
+    return tud_audio_set_req_entity_cb(0, (tusb_control_request_t const*)&req, (u8*)&cur);
+}
+
+// Finishes DMA `ch` and runs whatever handler sits on `irq`, like the hardware would.
+static void dma_finish(DMAChannel ch, unsigned irq){
+    mock::dma_complete(ch);
+    mock::irq_fire(irq);
+}
+
+static void reset_audio(){
+    mock::reset();
+    usb_set_clock(48'000);
+    auto& q = dev::dac::gAudioRecvBuffer;
+    q.commit_read(q.length());
+    q.overruns = 0;
+    q.underruns = 0;
+    auto& mq = dev::mic::gAudioSendBuffer;
+    mq.commit_read(mq.length());
+    mq.overruns = 0;
+    dev::mic::gVoice = VoiceDetector::make(audio::cfg::cBlockUs, dev::mic::cfg::ADC_LEVEL_SHIFT_COUNT);
+    dev::mic::gMuteSilence = false;
+    dev::mic::gPreRoll.release();
+    dev::mic::gPreRoll.reset();
+    for(u8 ch = 0; ch < 3; ch++){
+        usb_set_feature(AUDIO_FU_CTRL_MUTE, ch, 0);
+        usb_set_feature(AUDIO_FU_CTRL_VOLUME, ch, 0);
+    }
+    dev::dac::gVolumeRamp.current = volumeFactor; // Skip the fade in
+}
+
+// Tests
+// ---------------------
+
+static void test_speaker_path(){
+    using namespace dev::dac;
+    reset_audio();
+    audio::init_on_this_core();
+    CHECK(mock::gDMA[gDMAData].busy);
+    CHECK_EQ(mock::gDMA[gDMAData].count, sizeof(I2SOutBufHalf) / 4); // One word per DMA transfer
+
+    // 1.5 buffers worth of a ramp
+    array<s16, I2SOutBufHalf{}.size() * 3 / 2> ramp;
+    for(size_t i = 0; i < ramp.size(); i++){ ramp[i] = (s16)(i * 100 - 3000); }
+    usb_send_audio(ramp);
+    CHECK_EQ(gAudioRecvBuffer.length(), ramp.size());
+
+    dma_finish(gDMAData, DMA_IRQ_0); // The block that just played is refilled
+    auto& first = gI2SOutBufs[0];
+    for(size_t i = 0; i < first.size(); i++){
+        s32 expect = gain::apply(ramp[i], volumeFactor);
+        CHECK_EQ(first[i].l, expect);
+        CHECK_EQ(first[i].r, expect);
+    }
+    CHECK(mock::gDMA[gDMAData].read_addr == gI2SOutBufs[1].begin()); // Moved itself on
+    CHECK(mock::gDMA[gDMAData].busy);
+    CHECK(!dma_channel_get_irq0_status(gDMAData)); // Acknowledged
+
+    // Only half a buffer is left, the rest must be silence and flagged as an underrun.
+    dma_finish(gDMAData, DMA_IRQ_0);
+    auto& second = gI2SOutBufs[1];
+    size_t half = second.size() / 2;
+    CHECK_EQ(second[half - 1].l, gain::apply(ramp.back(), volumeFactor));
+    CHECK_EQ(second[half].l, 0);
+    CHECK_EQ(second.back().r, 0);
+    CHECK_EQ(gAudioRecvBuffer.underruns.load(), 1u);
+    CHECK(gAudioRecvBuffer.empty());
+}
+
+// Every output format carries the same mono sample on each channel, and silence once the ring runs dry.
+static void test_speaker_formats(){
+    using namespace dev::dac;
+    reset_audio();
+    array<s16, 4> samples = {1000, -1000, 32767, -32768};
+    array<I2SAudioSample, 6> wide;
+    array<I2SAudioSamplePacked16, 6> packed;
+    array<I2SAudioSampleMono32, 6> mono;
+
+    gAudioRecvBuffer.write_from(samples);
+    load_samples(wide);
+    gAudioRecvBuffer.write_from(samples);
+    load_samples(packed);
+    gAudioRecvBuffer.write_from(samples);
+    load_samples(mono);
+    for(size_t i = 0; i < samples.size(); i++){
+        s32 scaled = gain::apply(samples[i], volumeFactor);
+        CHECK_EQ(wide[i].l, scaled);
+        CHECK_EQ(wide[i].r, scaled);
+        u16 top = (u32)scaled >> 16;
+        CHECK_EQ(packed[i].lr >> 16, top); // Left goes out first
+        CHECK_EQ(packed[i].lr & 0xffff, top);
+        CHECK_EQ(mono[i].v, scaled); // The PIO does the duplicating
+    }
+    CHECK_EQ(wide.back().l, 0);
+    CHECK_EQ(packed.back().lr, 0u);
+    CHECK_EQ(mono.back().v, 0);
+    CHECK_EQ(gAudioRecvBuffer.underruns.load(), 3u);
+    static_assert(sizeof(I2SAudioSamplePacked16) == 4 && sizeof(I2SAudioSampleMono32) == 4, "One DMA word per frame");
+}
+
+static void test_speaker_overrun(){
+    using namespace dev::dac;
+    reset_audio();
+
+    // Flood the ring. What doesn't fit is dropped and the TinyUSB FIFO is left drained.
+    array<s16, 48> packet = {};
+    for(u32 i = 0; i < gAudioRecvBuffer.capacity() / packet.size() + 2; i++){
+        usb_send_audio(packet);
+    }
+    CHECK_EQ(gAudioRecvBuffer.length(), gAudioRecvBuffer.capacity());
+    CHECK(gAudioRecvBuffer.overruns.load() >= 1u);
+    CHECK(mock::gUSBAudioOut.empty());
+}
+
+// The IRQ is held off for up to all but one block at a time: the DMAs keep playing round the blocks, a single
+// late IRQ refills everything that has played, and the DAC hears the stream unbroken.
+static void test_speaker_irq_latency(){
+    using namespace dev::dac;
+    reset_audio();
+    audio::init_on_this_core();
+    constexpr u32 cBlock = I2SOutBufHalf{}.size();
+    std::vector<s32> played;
+    auto play = [&](u32 blocks){
+        for(u32 b = 0; b < blocks; b++){
+            auto from = (I2SOutSample const*)mock::gDMA[gDMAData].read_addr;
+            for(u32 i = 0; i < cBlock; i++){ played.push_back(from[i].l); }
+            mock::dma_complete(gDMAData);
+        }
+    };
+    std::vector<s16> ramp;
+    for(u32 late = 1; late < gI2SOutBufs.size(); late++){
+        std::vector<s16> more;
+        for(u32 i = 0; i < late * cBlock; i++){ more.push_back((s16)(ramp.size() + more.size()) * 5 - 10'000); }
+        usb_send_audio(more);
+        ramp.insert(ramp.end(), more.begin(), more.end());
+        play(late);
+        CHECK(mock::gDMA[gDMAData].busy); // Never stalled
+        mock::irq_fire(DMA_IRQ_0);
+    }
+    CHECK_EQ(gAudioRecvBuffer.underruns.load(), 0u);
+    play(gI2SOutBufs.size());
+
+    // A lap of the silence the blocks started with, then the whole stream
+    CHECK(std::all_of(played.begin(), played.begin() + gI2SOutBufs.size() * cBlock, [](s32 v){ return v == 0; }));
+    for(size_t i = 0; i < ramp.size(); i++){
+        s32 expect = gain::apply(ramp[i], volumeFactor);
+        if(played[gI2SOutBufs.size() * cBlock + i] != expect){
+            CHECK_EQ(played[gI2SOutBufs.size() * cBlock + i], expect);
+            break;
+        }
+    }
+}
+
+static void test_volume_controls(){
+    reset_audio();
+    u16 full = volumeFactor;
+    CHECK_EQ(full, gain::cUnity);
+
+    CHECK(usb_set_feature(AUDIO_FU_CTRL_VOLUME, 0, -20 * 256));
+    u16 quieter = volumeFactor;
+    CHECK_EQ(quieter, 3277); // 0.1
+    CHECK(usb_set_feature(AUDIO_FU_CTRL_VOLUME, 0, -90 * 256)); // Out of range, held at the bottom
+    CHECK_EQ(volumeFactor.load(), gain::from_db256(gain::cMinDb256));
+    CHECK(usb_set_feature(AUDIO_FU_CTRL_VOLUME, 0, -20 * 256));
+
+    CHECK(usb_set_feature(AUDIO_FU_CTRL_MUTE, 1, 1));
+    CHECK_EQ(volumeFactor.load(), 0);
+    CHECK(usb_set_feature(AUDIO_FU_CTRL_MUTE, 1, 0));
+    CHECK_EQ(volumeFactor.load(), quieter);
+}
+
+// A volume change ramps across the next DMA block instead of stepping.
+static void test_volume_ramp(){
+    using namespace dev::dac;
+    reset_audio();
+    audio::init_on_this_core();
+    usb_set_feature(AUDIO_FU_CTRL_MUTE, 0, 1);
+
+    array<s16, I2SOutBufHalf{}.size() * 2> dc;
+    dc.fill(10'000);
+    usb_send_audio(dc);
+    dma_finish(gDMAData, DMA_IRQ_0);
+    auto& first = gI2SOutBufs[0];
+    for(size_t i = 1; i < first.size(); i++){
+        CHECK(first[i].l < first[i - 1].l);
+    }
+    CHECK(first[0].l > gain::apply(10'000, gain::cUnity) * 0.9);
+    CHECK_EQ(first.back().l, 0);
+
+    dma_finish(gDMAData, DMA_IRQ_0); // Settled
+    CHECK_EQ(gI2SOutBufs[1].front().l, 0);
+    CHECK_EQ(gI2SOutBufs[1].back().l, 0);
+}
+
+// Fills the block the ADC's DMA is pointed at, as the ADC would, with DC shifted `first, first + 1, ...`.
+// Then finishes it, without running the IRQ (the control DMA moves it on to the next slot by itself).
+static void adc_fill(s16 first){
+    auto ch = dev::mic::gDMAadcData;
+    auto to = (dev::mic::ADCAudioSampleRaw*)mock::gDMA[ch].write_addr;
+    for(u32 i = 0; i < mock::gDMA[ch].count; i++){
+        to[i] = dev::mic::cfg::ADC_LEVEL_SHIFT_COUNT + first + (s16)i;
+    }
+    mock::dma_complete(ch);
+}
+
+static void test_mic_path(){
+    using namespace dev::mic;
+    reset_audio();
+    audio::init_on_this_core();
+    CHECK(mock::gADCRunning);
+    CHECK(mock::gDMA[gDMAadcData].busy);
+
+    // The DMA writes straight into the queue, and moves itself on to the next slot. The IRQ just publishes.
+    CHECK((u8*)mock::gDMA[gDMAadcData].write_addr == (u8*)&gAudioSendBuffer.ring[0]);
+    adc_fill(-10);
+    CHECK((u8*)mock::gDMA[gDMAadcData].write_addr == (u8*)&gAudioSendBuffer.ring[1]);
+    CHECK(mock::gDMA[gDMAadcData].busy);
+    CHECK(gAudioSendBuffer.empty());
+    mock::irq_fire(DMA_IRQ_1);
+    CHECK_EQ(gAudioSendBuffer.length(), 1u);
+    adc_fill(-10 + (s16)ADCInBufHalf{}.size());
+    mock::irq_fire(DMA_IRQ_1);
+
+    pump_usb();
+    CHECK(gAudioSendBuffer.empty());
+    mock::usb_audio_in_send();
+    u32 n = 2 * ADCInBufHalf{}.size();
+    CHECK_EQ(mock::gUSBAudioIn.size(), n * sizeof(s16));
+    auto sent = span{(s16 const*)mock::gUSBAudioIn.data(), n};
+    for(size_t i = 0; i < sent.size(); i++){
+        CHECK_EQ(sent[i], (s16)i - 10);
+    }
+}
+
+// The IN FIFO wraps at odd sample offsets, and the host stops reading.
+static void test_mic_fifo_wrap_and_overrun(){
+    using namespace dev::mic;
+    reset_audio();
+    audio::init_on_this_core();
+
+    // Knock the FIFO's write offset onto an odd sample so blocks split across the wrap out of word phase.
+    array<s16, 3> pad = {};
+    tud_audio_write(pad.data(), sizeof(pad));
+    mock::usb_audio_in_send();
+    mock::gUSBAudioIn.clear();
+
+    s16 next = -2000;
+    s16 expect = next;
+    auto complete = [&]{
+        adc_fill(next);
+        next += ADCInBufHalf{}.size();
+        mock::irq_fire(DMA_IRQ_1);
+    };
+    for(u32 i = 0; i < 40; i++){ // 40ms with the host polling every ms
+        complete();
+        pump_usb();
+        mock::usb_audio_in_send();
+    }
+    CHECK_EQ(mock::gUSBAudioIn.size(), 40 * sizeof(ADCInBufHalf));
+    for(auto s: span{(s16 const*)mock::gUSBAudioIn.data(), mock::gUSBAudioIn.size() / 2}){
+        CHECK_EQ(s, expect);
+        expect += 1;
+    }
+    CHECK_EQ(gAudioSendBuffer.overruns.load(), 0u);
+
+    // Nobody is pumping: the queue fills, never past what the DMA isn't writing, and the DMA carries on over the
+    // oldest blocks.
+    for(u32 i = 0; i < gAudioSendBuffer.capacity() + 4; i++){ complete(); }
+    CHECK_EQ(gAudioSendBuffer.length(), gAudioSendBuffer.capacity() - 1);
+    CHECK(gAudioSendBuffer.overruns.load() >= 1u);
+    // The host comes back and gets the newest blocks, all but the one being written over. The IRQ publishes the
+    // rest as room is made.
+    mock::gUSBAudioIn.clear();
+    for(u32 i = 0; i < 4; i++){
+        pump_usb();
+        mock::usb_audio_in_send();
+        mock::irq_fire(DMA_IRQ_1);
+    }
+    pump_usb();
+    mock::usb_audio_in_send();
+    CHECK(gAudioSendBuffer.empty());
+    u32 kept = gAudioSendBuffer.capacity() - 1;
+    CHECK_EQ(mock::gUSBAudioIn.size(), kept * sizeof(ADCInBufHalf));
+    expect = next - kept * ADCInBufHalf{}.size();
+    for(auto s: span{(s16 const*)mock::gUSBAudioIn.data(), mock::gUSBAudioIn.size() / 2}){
+        CHECK_EQ(s, expect);
+        expect += 1;
+    }
+}
+
+// The IRQ is held off for several blocks at a time: the DMAs keep capturing on their own, and a single late IRQ
+// publishes everything, in order, with nothing lost.
+static void test_mic_irq_latency(){
+    using namespace dev::mic;
+    reset_audio();
+    audio::init_on_this_core();
+    s16 next = -2000;
+    s16 expect = next;
+    u32 total = 0;
+    for(u32 late = 1; late < gAudioSendBuffer.capacity(); late++){
+        for(u32 i = 0; i < late; i++){
+            adc_fill(next);
+            next += ADCInBufHalf{}.size();
+        }
+        total += late;
+        CHECK(mock::gDMA[gDMAadcData].busy); // Never stalled
+        mock::irq_fire(DMA_IRQ_1);
+        CHECK_EQ(gAudioSendBuffer.length(), late);
+        for(u32 i = 0; i < late; i++){
+            pump_usb();
+            mock::usb_audio_in_send();
+        }
+    }
+    CHECK(gAudioSendBuffer.empty());
+    CHECK_EQ(gAudioSendBuffer.overruns.load(), 0u);
+    CHECK_EQ(mock::gUSBAudioIn.size(), total * sizeof(ADCInBufHalf));
+    for(auto s: span{(s16 const*)mock::gUSBAudioIn.data(), mock::gUSBAudioIn.size() / 2}){
+        if(s != expect){
+            CHECK_EQ(s, expect);
+            break;
+        }
+        expect += 1;
+    }
+}
+
+static void test_mic_remove_dc(){
+    using namespace dev::mic;
+    for(u32 a = 0; a < (1 << cfg::ADC_PRECISION); a++){
+        for(u32 b: {0u, 1u, (u32)cfg::ADC_LEVEL_SHIFT_COUNT, 4094u, 4095u, a}){
+            u32 pair = remove_dc_pair(a | b << 16);
+            CHECK_EQ((s16)(pair & 0xffff), remove_dc(a));
+            CHECK_EQ((s16)(pair >> 16), remove_dc(b));
+            CHECK_EQ(remove_dc(a), (s16)a - cfg::ADC_LEVEL_SHIFT_COUNT);
+        }
+    }
+}
+
+// The host picks 16k: the speaker upsamples to the I2S rate and the mic downsamples to USB.
+static void test_usb_rates(){
+    using namespace dev;
+    reset_audio();
+    CHECK(!usb_set_clock(22'050)); // Not advertised
+    CHECK_EQ(usbSampleRate.load(), 48'000u);
+    CHECK(usb_set_clock(16'000));
+    CHECK_EQ(mock::gUSBFeedback, 16u << 16); // Now asks for 16 samples a frame
+    audio::init_on_this_core();
+
+    // Speaker: 1/3 as many samples per block. DC comes out at the same level once the filter has filled.
+    constexpr u32 cBlock = dac::I2SOutBufHalf{}.size();
+    array<s16, cBlock / 3 * 4> dc;
+    dc.fill(1000);
+    usb_send_audio(dc);
+    dma_finish(dac::gDMAData, DMA_IRQ_0);
+    dma_finish(dac::gDMAData, DMA_IRQ_0);
+    CHECK(std::abs((s32)dc.size() - 2 * (s32)cBlock / 3 - (s32)dac::gAudioRecvBuffer.length()) <= 1);
+    s32 expect = gain::apply(1000, volumeFactor);
+    CHECK(std::abs(dac::gI2SOutBufs[1][cBlock / 2].l - expect) < expect / 100);
+    CHECK_EQ(dac::gAudioRecvBuffer.underruns.load(), 0u);
+
+    // Mic: 48k from the ADC, 24k to the host (16k has its own mode, see below).
+    reset_audio();
+    CHECK(usb_set_clock(24'000));
+    audio::init_on_this_core();
+    for(u32 i = 0; i < 6; i++){
+        auto ch = mic::gDMAadcData;
+        auto to = (mic::ADCAudioSampleRaw*)mock::gDMA[ch].write_addr;
+        std::fill_n(to, mock::gDMA[ch].count, mic::cfg::ADC_LEVEL_SHIFT_COUNT - 500);
+        dma_finish(ch, DMA_IRQ_1);
+        mic::pump_usb();
+        mock::usb_audio_in_send();
+    }
+    auto sent = span{(s16 const*)mock::gUSBAudioIn.data(), mock::gUSBAudioIn.size() / 2};
+    CHECK(std::abs((s32)sent.size() - 6 * (s32)mic::ADCInBufHalf{}.size() / 2) <= 2);
+    CHECK(std::abs(sent.back() + 500) <= 5);
+    usb_set_clock(48'000);
+}
+
+// Captures `blocks` blocks and passes them to the host. Block `i` is DC at `level(i)`.
+static void mic_capture(u32 blocks, auto&& level){
+    using namespace dev::mic;
+    for(u32 i = 0; i < blocks; i++){
+        auto ch = gDMAadcData;
+        auto to = (ADCAudioSampleRaw*)mock::gDMA[ch].write_addr;
+        std::fill_n(to, mock::gDMA[ch].count, cfg::ADC_LEVEL_SHIFT_COUNT + level(i));
+        dma_finish(ch, DMA_IRQ_1);
+        pump_usb();
+        mock::usb_audio_in_send();
+    }
+}
+static void mic_capture_dc(u32 blocks, s16 level){ mic_capture(blocks, [&](u32){ return level; }); }
+
+// At 16k the mic oversamples at 192k and decimates, instead of resampling from 48k.
+static void test_mic_native_16k(){
+    using namespace dev::mic;
+    reset_audio();
+    CHECK(usb_set_clock(16'000));
+    audio::init_on_this_core();
+    CHECK_EQ(mock::gADCClkDiv, 249.f);
+    CHECK_EQ(mock::gDMA[gDMAadcData].count, audio::cfg::block_frames(192'000));
+
+    // 16 samples a ms, 3 bits hotter than the ADC
+    mic_capture_dc(8, -500);
+    u32 n = 8 * audio::cfg::block_frames(16'000);
+    CHECK_EQ(mock::gUSBAudioIn.size(), n * sizeof(s16));
+    auto sent = span{(s16 const*)mock::gUSBAudioIn.data(), n};
+    CHECK(std::abs(sent.back() + (500 << Decimator::cExtraBits)) <= 2);
+
+    // Back to 48k. The block in flight and the one after it were armed at 192k (dropped), then it follows.
+    usb_set_clock(48'000);
+    mock::gUSBAudioIn.clear();
+    mic_capture_dc(4, 7);
+    CHECK_EQ(mock::gADCClkDiv, 999.f); // 48M / (1 + 999)
+    CHECK_EQ(mock::gDMA[gDMAadcData].count, ADCInBufHalf{}.size());
+    CHECK_EQ(mock::gUSBAudioIn.size(), 2 * sizeof(ADCInBufHalf));
+    for(auto s: span{(s16 const*)mock::gUSBAudioIn.data(), mock::gUSBAudioIn.size() / 2}){ CHECK_EQ(s, 7); }
+}
+
+// With `vad mute on` the host gets zeros until someone talks.
+static void test_mic_vad_mute(){
+    using namespace dev::mic;
+    reset_audio();
+    audio::init_on_this_core();
+    console::processline("vad mute on");
+    CHECK(gMuteSilence);
+
+    // A quiet room
+    mic_capture_dc(100, 1);
+    CHECK(!gVoice.speaking);
+    CHECK_EQ(mock::gUSBAudioIn.size(), 100 * sizeof(ADCInBufHalf));
+    CHECK(std::ranges::all_of(mock::gUSBAudioIn, [](u8 b){ return b == 0; }));
+
+    // Someone talks (a low square wave). It's muted until the detector is sure.
+    mock::gUSBAudioIn.clear();
+    mic_capture(100, [](u32 i){ return i / 4 % 2 ? 300 : -300; });
+    CHECK(gVoice.speaking);
+    auto sent = span{(s16 const*)mock::gUSBAudioIn.data(), mock::gUSBAudioIn.size() / 2};
+    CHECK_EQ(sent.front(), 0);
+    CHECK(std::abs(sent.back()) >= 290);
+
+    console::processline("vad mute off");
+    CHECK(!gMuteSilence);
+}
+
+// Push-to-talk: the press rewinds into the history, the release plays on up to it, then the stream goes live again.
+static void test_mic_preroll(){
+    using namespace dev::mic;
+    reset_audio();
+    audio::init_on_this_core();
+    constexpr u32 cLag = audio::cfg::cMicPreRollMs * 1000 / audio::cfg::cBlockUs; // In blocks
+    constexpr u32 cBefore = cLag + 100;
+    // Block i is DC at i, so what the host got can be read back as a list of blocks
+    u32 next = 0;
+    auto capture = [&](u32 blocks){ mic_capture(blocks, [&](u32){ return (s16)(next++ - 1000); }); };
+    std::vector<s16> expect;
+    auto expect_blocks = [&](u32 from, u32 n){ for(u32 i = 0; i < n; i++){ expect.push_back((s16)(from + i - 1000)); } };
+
+    capture(cBefore);
+    expect_blocks(0, cBefore);
+    push_to_talk(true);
+    capture(100);
+    expect_blocks(cBefore - cLag, 100); // From before the press
+    CHECK(!gPreRoll.live());
+    push_to_talk(false);
+    capture(cLag);
+    expect_blocks(cBefore - cLag + 100, cLag); // Up to the release
+    CHECK(gPreRoll.live());
+    capture(2);
+    expect_blocks(cBefore + 100 + cLag, 2); // Live again
+
+    auto sent = span{(s16 const*)mock::gUSBAudioIn.data(), mock::gUSBAudioIn.size() / 2};
+    CHECK_EQ(sent.size(), expect.size() * ADCInBufHalf{}.size());
+    for(size_t i = 0; i < sent.size(); i++){
+        if(sent[i] != expect[i / ADCInBufHalf{}.size()]){
+            CHECK_EQ(sent[i], expect[i / ADCInBufHalf{}.size()]);
+            break;
+        }
+    }
+}
+
+static void test_engine_launch(){
+    reset_audio();
+    multicore_fifo_push_blocking((u32)audio::CoreMsg::Ready); // The mock never runs core1, so answer for it
+    audio::launch();
+    CHECK(mock::gCore1Entry == audio::core1_main);
+    CHECK(mock::gSIOFifo.empty());
+}
+
+static void test_stats(){
+    using namespace dev;
+    reset_audio();
+    console::processline("stats reset");
+    audio::init_on_this_core();
+
+    array<s16, dac::I2SOutBufHalf{}.size() * 3> burst = {};
+    usb_send_audio(burst);
+    dma_finish(dac::gDMAData, DMA_IRQ_0);
+    dma_finish(dac::gDMAData, DMA_IRQ_0);
+    CHECK_EQ(dac::gAudioRecvFill.max.load(), burst.size());
+    CHECK_EQ(dac::gAudioRecvFill.min.load(), burst.size() - dac::I2SOutBufHalf{}.size());
+    CHECK_EQ(dac::gDMAServiceTime.total(), 2u);
+
+    dma_finish(mic::gDMAadcData, DMA_IRQ_1);
+    mic::pump_usb();
+    CHECK_EQ(mic::gAudioSendFill.max.load(), 1u);
+    CHECK_EQ(mic::gDMAServiceTime.total(), 1u);
+    console::processline("stats");
+
+    console::processline("stats reset");
+    CHECK_EQ(dac::gDMAServiceTime.total(), 0u);
+    CHECK(dac::gAudioRecvFill.min.load() > dac::gAudioRecvFill.max.load());
+
+    // Percentiles off the histogram: 90 calls at 3us, 9 at 10us, 1 way over the last bucket.
+    audio::stats::ServiceTimes t;
+    for(u32 i = 0; i < 90; i++){ t.note(3); }
+    for(u32 i = 0; i < 9; i++){ t.note(10); }
+    t.note(500);
+    CHECK_EQ(t.percentile(50), 3u);
+    CHECK_EQ(t.percentile(90), 3u);
+    CHECK_EQ(t.percentile(99), 10u);
+    CHECK_EQ(t.percentile(100), t.cBuckets - 1);
+    CHECK_EQ(t.worst.load(), 500u);
+}
+
+static void test_console(){
+    mock::reset();
+    dev::servo::init();
+    auto level = [](){ return mock::gPWMLevelA[dev::servo::gPWMSlice]; };
+    u16 centre = level();
+
+    console::processline("servo 45");
+    CHECK(level() > centre);
+    u16 at45 = level();
+    console::processline("servo 200"); // Clamped to 90
+    CHECK(level() > at45);
+    u16 at90 = level();
+    console::processline("servo nonsense");
+    CHECK_EQ(level(), at90);
+
+    console::processline("debug on");
+    CHECK(console::gPrintDebugInfo);
+    console::processline("debug off");
+    CHECK(!console::gPrintDebugInfo);
+}
+
+int main(){
+    test_speaker_path();
+    test_speaker_formats();
+    test_speaker_overrun();
+    test_speaker_irq_latency();
+    test_volume_controls();
+    test_volume_ramp();
+    test_mic_path();
+    test_mic_fifo_wrap_and_overrun();
+    test_mic_irq_latency();
+    test_mic_remove_dc();
+    test_usb_rates();
+    test_mic_native_16k();
+    test_mic_vad_mute();
+    test_mic_preroll();
+    test_engine_launch();
+    test_stats();
+    test_console();
+    std::puts("test_audio_path: ok");
+}
@@ -0,0 +1,263 @@
+// Clip cache: uploads over the vendor interface into (mock) flash, playing by key, LRU eviction, surviving a reboot.
+// Built with a 64KB cache (16 sectors) so filling it is quick.
+#include "check.hpp"
+#include "pico/stdlib.h"
+#include "dev/vendor.hpp"
+#include "dev/i2s_dac.hpp"
+#include "console.hpp"
+#include <cmath>
+
+using namespace dev;
+using vendor::Op;
+using vendor::Status;
+using Block = array<dac::I2SAudioSample, 48>;
+static_assert(cache::cSectors == 16);
+
+struct Reply{
+    vendor::Header h;
+    vec<u8> payload;
+};
+
+// Sends a request in pieces of `chunk` bytes, like USB would, and collects the replies.
+static vec<Reply> request(Op op, span<const u8> payload, u16 tag = 7, size_t chunk = 64){
+    vendor::Header h = {.op = (u8)op, .tag = tag, .length = (u32)payload.size()};
+    vec<u8> msg{(u8 const*)&h, (u8 const*)&h + sizeof(h)};
+    msg.insert(msg.end(), payload.begin(), payload.end());
+    for(size_t at = 0; at < msg.size(); at += chunk){
+        mock::gUSBVendorRx.assign(msg.begin() + at, msg.begin() + std::min(msg.size(), at + chunk));
+        tud_vendor_rx_cb(0, nullptr, 0);
+        vendor::tick();
+    }
+    vec<Reply> out;
+    auto& tx = mock::gUSBVendorTx;
+    for(size_t at = 0; at + sizeof(vendor::Header) <= tx.size();){
+        Reply r;
+        std::copy_n(tx.begin() + at, sizeof(r.h), (u8*)&r.h);
+        at += sizeof(r.h);
+        CHECK(at + r.h.length <= tx.size());
+        r.payload.assign(tx.begin() + at, tx.begin() + at + r.h.length);
+        at += r.h.length;
+        out.push_back(r);
+    }
+    tx.clear();
+    return out;
+}
+template<typename T> static span<const u8> bytes_of(T ref v){ return {(u8 const*)&v, sizeof(v)}; }
+
+static Status status_of(vec<Reply> ref replies, Op op){
+    CHECK_EQ(replies.size(), 1u);
+    CHECK_EQ(replies[0].h.op, (u8)op | vendor::cReplyBit);
+    CHECK_EQ(replies[0].h.tag, 7);
+    return (Status)replies[0].h.status;
+}
+
+// `frames` of ADPCM. Any bytes decode, so only clips that get played need to be real audio.
+static vec<u8> blocks(u32 frames, u8 fill){
+    vec<u8> b(adpcm::encoded_size(frames), fill);
+    for(size_t i = 0; i < b.size(); i += adpcm::cBlockBytes){ b[i + 2] = 0; } // A valid step index
+    return b;
+}
+// As many frames as fill `sectors`, header page and all.
+constexpr u32 frames_for(u32 sectors){ return (sectors * cache::cSectorBytes - cache::cPageBytes) / adpcm::cBlockBytes * adpcm::cBlockFrames; }
+
+static Status put(u64 key, span<const u8> data, u32 frames, size_t chunk = 64){
+    vendor::CachePut p = {.key = key, .frames = frames};
+    vec<u8> payload{bytes_of(p).begin(), bytes_of(p).end()};
+    payload.insert(payload.end(), data.begin(), data.end());
+    return status_of(request(Op::CachePut, payload, 7, chunk), Op::CachePut);
+}
+static Status put(u64 key, u32 sectors){ return put(key, blocks(frames_for(sectors), (u8)key), frames_for(sectors)); }
+
+static vec<u64> listed(){
+    auto r = request(Op::CacheList, {});
+    CHECK(status_of(r, Op::CacheList) == Status::Ok);
+    auto& p = r[0].payload;
+    vendor::CacheInfo info;
+    std::copy_n(p.begin(), sizeof(info), (u8*)&info);
+    CHECK_EQ(info.sectors, cache::cSectors);
+    CHECK_EQ(info.count, cache::gCount);
+    CHECK_EQ(p.size(), sizeof(info) + info.count * sizeof(vendor::CacheClip));
+    vec<u64> keys;
+    u32 used = 0;
+    for(u32 i = 0; i < info.count; i++){
+        vendor::CacheClip c;
+        std::copy_n(p.begin() + sizeof(info) + i * sizeof(c), sizeof(c), (u8*)&c);
+        keys.push_back(c.key);
+        used += c.sectors;
+    }
+    CHECK_EQ(info.free, cache::cSectors - used);
+    std::ranges::sort(keys);
+    return keys;
+}
+
+// Power cycles the board: RAM forgotten, flash kept.
+static void reboot(){
+    mock::reset();
+    cache::gEntries = {};
+    cache::gCount = 0;
+    cache::gUpload = {};
+    vendor::reset();
+    mixer::gMixer.voices = {};
+    mixer::gMixer.commands.commit_read(mixer::gMixer.commands.length());
+    mock::gCore1Spin = []{ mixer::gMixer.take_commands(); };
+    dac::gVolumeRamp = {};
+    volumeFactor = 0;
+    usbSampleRate = 48'000;
+    cache::init();
+}
+static void wipe(){
+    std::ranges::fill(mock::gFlash, 0xff);
+    reboot();
+}
+
+static void test_ping_and_errors(){
+    wipe();
+    array<u8, 5> hello = {'h', 'e', 'l', 'l', 'o'};
+    auto r = request(Op::Ping, hello, 7, 3);
+    CHECK(status_of(r, Op::Ping) == Status::Ok);
+    CHECK(std::ranges::equal(r[0].payload, hello));
+    // Bad requests have their payload swallowed, so the next one still parses
+    array<u8, 100> junk = {};
+    CHECK(status_of(request((Op)0x7f, junk), (Op)0x7f) == Status::UnknownOp);
+    CHECK(status_of(request(Op::CachePlay, junk), Op::CachePlay) == Status::BadLength);
+    CHECK(status_of(request(Op::Ping, junk), Op::Ping) == Status::BadLength);
+    CHECK(status_of(request(Op::Ping, hello), Op::Ping) == Status::Ok);
+}
+
+// Uploaded in any size pieces it's byte for byte in flash, and plays like any other clip.
+static void test_put_and_play(){
+    wipe();
+    vec<s16> pcm(3000);
+    for(size_t i = 0; i < pcm.size(); i++){ pcm[i] = (s16)(8000 * std::sin(i * 0.05)); }
+    auto data = adpcm::encode(pcm);
+    CHECK(put(0xabcd, data, pcm.size(), 7) == Status::Ok);
+    CHECK(put(0xbeef, data, pcm.size(), 4096) == Status::Ok);
+    CHECK(listed() == (vec<u64>{0xabcd, 0xbeef}));
+    for(u64 key: {0xabcd, 0xbeef}){ CHECK(std::equal(data.begin(), data.end(), cache::find(key)->blocks())); }
+    CHECK(mock::gFlashSafeCalls > 0);
+
+    vendor::CachePlay play = {.key = 0xabcd, .gain = gain::cUnity};
+    CHECK(status_of(request(Op::CachePlay, bytes_of(play)), Op::CachePlay) == Status::Ok);
+    auto r = adpcm::Reader::make(data.data());
+    Block b;
+    for(size_t i = 0; i < pcm.size(); i += b.size()){
+        dac::load_samples(b);
+        for(size_t j = 0; j < b.size() && i + j < pcm.size(); j++){ CHECK_EQ(b[j].l, gain::apply(r.next(), gain::cUnity)); }
+    }
+    play.key = 0x1234;
+    CHECK(status_of(request(Op::CachePlay, bytes_of(play)), Op::CachePlay) == Status::NotFound);
+}
+
+// Uploads that are too long, short or of the wrong length leave nothing behind.
+static void test_rejected_uploads(){
+    wipe();
+    CHECK(put(1, blocks(cache::cMaxFrames + 1, 0), cache::cMaxFrames + 1) == Status::TooBig);
+    auto data = blocks(2000, 0x55);
+    CHECK(put(2, span{data}.first(data.size() - 1), 2000) == Status::BadLength);
+    CHECK(put(3, span{data}, 1000) == Status::BadLength);
+    CHECK(listed().empty());
+    reboot();
+    CHECK(listed().empty());
+    CHECK(put(4, cache::cSectors) == Status::Ok); // The biggest there is
+    CHECK(listed() == (vec<u64>{4}));
+}
+
+// Only finished uploads come back after a reboot, however far the others got.
+static void test_reboot(){
+    wipe();
+    CHECK(put(1, 3) == Status::Ok);
+    CHECK(put(2, 5) == Status::Ok);
+    // Half an upload: the header and some blocks, then the host goes away
+    vendor::CachePut p = {.key = 3, .frames = frames_for(4)};
+    vendor::Header h = {.op = (u8)Op::CachePut, .length = (u32)(sizeof(p) + adpcm::encoded_size(p.frames))};
+    mock::gUSBVendorRx.assign((u8 const*)&h, (u8 const*)&h + sizeof(h));
+    mock::gUSBVendorRx.insert(mock::gUSBVendorRx.end(), (u8 const*)&p, (u8 const*)&p + sizeof(p));
+    mock::gUSBVendorRx.resize(mock::gUSBVendorRx.size() + 3 * cache::cSectorBytes, 0x33);
+    tud_vendor_rx_cb(0, nullptr, 0);
+    CHECK(mock::gUSBVendorTx.empty());
+    reboot();
+    CHECK(listed() == (vec<u64>{1, 2}));
+    CHECK_EQ(cache::find(1)->frames, frames_for(3));
+    CHECK(std::ranges::all_of(span{cache::find(2)->blocks(), adpcm::encoded_size(frames_for(5))}, [](u8 b){ return b == 2 || b == 0; }));
+}
+
+// Full, a new clip takes the place of the ones played longest ago. Replacing a key keeps one copy.
+static void test_eviction(){
+    wipe();
+    for(u64 key: {1, 2, 3, 4}){ CHECK(put(key, 4) == Status::Ok); }
+    CHECK_EQ(cache::used_sectors(), cache::cSectors);
+    for(u64 key: {1, 3}){
+        vendor::CachePlay play = {.key = key};
+        CHECK(status_of(request(Op::CachePlay, bytes_of(play)), Op::CachePlay) == Status::Ok);
+    }
+    CHECK(put(5, 4) == Status::Ok); // 2 was only ever uploaded, and before 4
+    CHECK(listed() == (vec<u64>{1, 3, 4, 5}));
+    CHECK(put(6, 2) == Status::Ok); // 4 now
+    CHECK(listed() == (vec<u64>{1, 3, 5, 6}));
+    CHECK(put(5, 2) == Status::Ok); // Replaced, not duplicated
+    CHECK(listed() == (vec<u64>{1, 3, 5, 6}));
+    CHECK_EQ(cache::find(5)->frames, frames_for(2));
+    reboot();
+    CHECK(listed() == (vec<u64>{1, 3, 5, 6}));
+}
+
+// Dropping one or all, which sticks across a reboot. A voice still playing a dropped clip stops.
+static void test_drop(){
+    wipe();
+    for(u64 key: {1, 2, 3}){ CHECK(put(key, 2) == Status::Ok); }
+    CHECK(cache::play(2));
+    Block b;
+    dac::load_samples(b);
+    CHECK(mixer::gMixer.busy());
+    u64 key = 2;
+    CHECK(status_of(request(Op::CacheDrop, bytes_of(key)), Op::CacheDrop) == Status::Ok);
+    CHECK(!mixer::gMixer.busy());
+    CHECK(status_of(request(Op::CacheDrop, bytes_of(key)), Op::CacheDrop) == Status::NotFound);
+    mock::gCore1Spin = nullptr; // The speaker core never takes the drop, so nothing's rewritten
+    u32 erases = mock::gFlashErases;
+    CHECK(put(4, 2) == Status::Flash);
+    CHECK_EQ(mock::gFlashErases, erases);
+    reboot();
+    CHECK(listed() == (vec<u64>{1, 3}));
+    CHECK(status_of(request(Op::CacheDrop, {}), Op::CacheDrop) == Status::Ok);
+    reboot();
+    CHECK(listed().empty());
+    console::processline("cache");
+}
+
+// An upload evicts what it overlaps before writing anything, so once it's abandoned the boot scan finds what's listed.
+// A clip whose header can't be erased stays listed.
+static void test_abandoned(){
+    wipe();
+    CHECK(put(1, 2) == Status::Ok);
+    CHECK(put(2, 4) == Status::Ok);
+    CHECK(put(3, 10) == Status::Ok);
+    CHECK(cache::drop(1));
+    // 2's header is partway into the run, and the host goes away having sent only the run's first sector
+    CHECK(cache::begin(4, frames_for(4)) == cache::Result::Ok);
+    CHECK_EQ(cache::gUpload.entry.first, 0);
+    auto data = blocks(frames_for(1), 4);
+    CHECK_EQ(cache::write(data), data.size());
+    CHECK(put(5, 2) == Status::Ok); // Where the abandoned one was
+    CHECK(listed() == (vec<u64>{3, 5}));
+    cache::init();
+    CHECK(listed() == (vec<u64>{3, 5}));
+
+    mock::gCore1Spin = nullptr; // Every flash write fails from here
+    CHECK(put(6, cache::cSectors) == Status::Flash);
+    CHECK(status_of(request(Op::CacheDrop, {}), Op::CacheDrop) == Status::Flash);
+    CHECK(listed() == (vec<u64>{3, 5}));
+    reboot();
+    CHECK(listed() == (vec<u64>{3, 5}));
+}
+
+int main(){
+    test_ping_and_errors();
+    test_put_and_play();
+    test_rejected_uploads();
+    test_reboot();
+    test_eviction();
+    test_drop();
+    test_abandoned();
+    std::puts("test_clip_cache: ok");
+}
@@ -0,0 +1,118 @@
+// The compile-time command table (command_table.hpp): typed arguments, two word names, the perfect hash, and the
+// console's own table and generated help.
+#include "check.hpp"
+#include "console.hpp"
+#include <string>
+
+enum class Mode: u8{ slow, fast };
+
+static struct{
+    u32 calls = 0;
+    f32 f = 0;
+    u32 u = 0;
+    sv word;
+    Mode mode = Mode::slow;
+    opt<s32> maybe;
+} gGot;
+
+static void with_numbers(f32 f, u32 u){ gGot = {.calls = gGot.calls + 1, .f = f, .u = u}; }
+static void with_word(sv w, Mode m){ gGot = {.calls = gGot.calls + 1, .word = w, .mode = m}; }
+static void with_optional(opt<s32> v){ gGot = {.calls = gGot.calls + 1, .maybe = v}; }
+static bool even_only(u32 u){ gGot.calls += 1; return u % 2 == 0; }
+static void none(){ gGot.calls += 1; }
+
+constexpr cmd::Table cTable{std::to_array<cmd::Command>({
+    cmd::command<&with_numbers>("numbers", "<f> <u>", ""),
+    cmd::command<&with_word>("word", "<w> <slow/fast>", ""),
+    cmd::command<&with_optional>("opt", "[n]", ""),
+    cmd::command<&even_only>("even", "<u>", ""),
+    cmd::command<&none>("none", "", ""),
+    cmd::command<&none>("none more", "", ""),
+})};
+
+static cmd::Result run(sv line){ return cmd::dispatch(cTable, line).result; }
+
+static void test_arguments(){
+    using cmd::Result;
+    CHECK(run("numbers -1.5 7") == Result::Ok);
+    CHECK(gGot.f == -1.5f && gGot.u == 7);
+    CHECK(run("  numbers   2   3  ") == Result::Ok); // Spacing doesn't matter
+    CHECK(gGot.f == 2.f && gGot.u == 3);
+    u32 calls = gGot.calls;
+    CHECK(run("numbers 1") == Result::BadArgs);     // Missing
+    CHECK(run("numbers 1 -3") == Result::BadArgs);  // Not a u32
+    CHECK(run("numbers 1 3x") == Result::BadArgs);  // Not all of it
+    CHECK(run("numbers 1 3 4") == Result::BadArgs); // One too many
+    CHECK_EQ(gGot.calls, calls);                    // None of them ran
+
+    CHECK(run("word hello fast") == Result::Ok);
+    CHECK(gGot.word == "hello" && gGot.mode == Mode::fast);
+    CHECK(run("word hello medium") == Result::BadArgs);
+
+    CHECK(run("opt") == Result::Ok);
+    CHECK(!gGot.maybe);
+    CHECK(run("opt -12") == Result::Ok);
+    CHECK(gGot.maybe == -12);
+    CHECK(run("opt x") == Result::BadArgs);
+
+    CHECK(run("even 4") == Result::Ok);
+    CHECK(run("even 5") == Result::BadArgs); // Rejected by the handler
+}
+
+// Every name is found, two word names before one word ones, and nothing else is.
+static void test_lookup(){
+    for(auto& c: cTable.commands){ CHECK(cTable.find(c.name) == &c); }
+    CHECK(!cTable.find("non"));
+    CHECK(!cTable.find("numbersx"));
+    CHECK(!cTable.find(""));
+    auto d = cmd::dispatch(cTable, "none more");
+    CHECK(d.result == cmd::Result::Ok && d.command->name == "none more");
+    d = cmd::dispatch(cTable, "  none    more ");
+    CHECK(d.result == cmd::Result::Ok && d.command->name == "none more");
+    d = cmd::dispatch(cTable, "none less");
+    CHECK(d.result == cmd::Result::BadArgs && d.command->name == "none");
+    CHECK(run("nothing") == cmd::Result::Unknown);
+    CHECK(run("") == cmd::Result::Unknown);
+}
+
+static std::string sent(){
+    logring::tick();
+    std::string s{mock::gUSBCDCTx.begin(), mock::gUSBCDCTx.end()};
+    mock::gUSBCDCTx.clear();
+    return s;
+}
+
+// `help` lists every command, and a wrong one gets its usage.
+static void test_console(){
+    mock::reset();
+    for(auto& c: console::cCommands.commands){ CHECK(console::cCommands.find(c.name) == &c); }
+    console::processline("help");
+    std::string help = sent();
+    for(auto& c: console::cCommands.commands){
+        CHECK(help.find("\r\n    " + std::string(c.name) + " ") != std::string::npos);
+    }
+    CHECK(help.find("    servo <angle>   : Adjust the servo angle") != std::string::npos);
+
+    console::processline("tone 440");
+    CHECK(sent().starts_with("Invalid arguments. Usage: tone <hz> <ms>: "));
+    console::processline("stats now");
+    CHECK(sent().starts_with("Invalid arguments. Usage: stats: "));
+    console::processline("bogus");
+    CHECK(sent() == "Unrecognised command. Type `help` for more info.\r\n");
+    console::processline("areyouthepico?");
+    CHECK(sent() == "yes\r\n");
+    console::processline("vad mute on");
+    CHECK(dev::mic::gMuteSilence);
+    console::processline("vad mute off");
+    CHECK(!dev::mic::gMuteSilence);
+    console::processline("vad   mute   on");
+    CHECK(dev::mic::gMuteSilence);
+    CHECK(sent().empty());
+}
+
+int main(){
+    test_arguments();
+    test_lookup();
+    test_console();
+    std::puts("test_commands: ok");
+}
@@ -0,0 +1,225 @@
+// The binary control protocol: COBS and the CRC, splitting frames from console lines, and the device answering the
+// host client (tools/ctl_client.hpp) through the mocked CDC port.
+#include "check.hpp"
+#include "pico/stdlib.h"
+#include "console.hpp"
+#include "../../tools/ctl_client.hpp"
+#include <cmath>
+
+using namespace ctl;
+
+static vec<u8> encoded(vec<u8> ref in){
+    vec<u8> out(cobs::max_encoded(in.size()));
+    out.resize(cobs::encode(in, out));
+    return out;
+}
+
+// Published examples, and a round trip around the 254 byte runs.
+static void test_cobs(){
+    CHECK(encoded({}) == (vec<u8>{0x01}));
+    CHECK(encoded({0x00}) == (vec<u8>{0x01, 0x01}));
+    CHECK(encoded({0x00, 0x00}) == (vec<u8>{0x01, 0x01, 0x01}));
+    CHECK(encoded({0x11, 0x22, 0x00, 0x33}) == (vec<u8>{0x03, 0x11, 0x22, 0x02, 0x33}));
+    CHECK(encoded({0x11, 0x00, 0x00, 0x00}) == (vec<u8>{0x02, 0x11, 0x01, 0x01, 0x01}));
+    vec<u8> run(254);
+    for(size_t i = 0; i < run.size(); i++){ run[i] = (u8)(i + 1); }
+    vec<u8> expect = {0xff};
+    expect.insert(expect.end(), run.begin(), run.end());
+    CHECK(encoded(run) == expect);
+
+    for(size_t n: {0, 1, 253, 254, 255, 300, 508, 509}){
+        for(u32 zeroEvery: {0, 1, 7, 254}){
+            vec<u8> in(n);
+            for(size_t i = 0; i < n; i++){ in[i] = zeroEvery && i % zeroEvery == 0 ? 0 : (u8)(i * 37 + 1) | 1; }
+            auto e = encoded(in);
+            CHECK(e.size() <= cobs::max_encoded(n));
+            CHECK(std::ranges::find(e, 0) == e.end());
+            auto d = cobs::decode(e, e); // In place
+            CHECK(d && *d == n);
+            CHECK(std::equal(in.begin(), in.end(), e.begin()));
+        }
+    }
+    vec<u8> bad = {0x05, 0x11, 0x22}; // Runs past the end
+    CHECK(!cobs::decode(bad, bad));
+    bad = {0x02, 0x11, 0x00, 0x33};
+    CHECK(!cobs::decode(bad, bad));
+    CHECK_EQ(cobs::crc16({}), 0xffff);
+}
+
+// Lines and frames in one stream, split anywhere, even a line by a frame. Corrupt frames and overlong lines cost only themselves.
+static void test_parser(){
+    Wire w;
+    vec<u8> stream;
+    auto text = [&](sv s){ stream.insert(stream.end(), s.begin(), s.end()); };
+    auto frame = [&](Msg m, u8 seq, span<const u8> payload){
+        size_t n = pack(m, seq, payload, w);
+        stream.insert(stream.end(), w.begin(), w.begin() + n);
+    };
+    text("servo 10\n");
+    Ping ping = {.token = 0xdeadbeef};
+    Tone tone = {.hz = 0x100, .ms = 0x0000, .gain = 0x0001}; // Zeros in the payload
+    frame(Msg::Ping, 1, {(u8 const*)&ping, sizeof(ping)});
+    frame(Msg::Tone, 2, {(u8 const*)&tone, sizeof(tone)});
+    text("v");
+    frame(Msg::Ping, 5, {(u8 const*)&ping, sizeof(ping)}); // In the middle of a line
+    text("ad\n");
+    frame(Msg::Ping, 3, {(u8 const*)&ping, sizeof(ping)});
+    stream[stream.size() - 4] ^= 0x40; // Its CRC no longer matches
+    text(string(100, 'x') + "\n");
+    frame(Msg::Stop, 4, {});
+    text("audio\n");
+
+    for(size_t chunk: {1, 3, 64, 1000}){
+        Parser<32> p;
+        vec<string> lines;
+        vec<std::pair<Msg, u8>> frames;
+        u32 bad = 0, tooLong = 0;
+        for(size_t at = 0; at < stream.size(); at += chunk){
+            for(u8 b: span{stream}.subspan(at, std::min(chunk, stream.size() - at))){
+                switch(p.push(b)){
+                    case decltype(p)::Event::Line: lines.emplace_back(p.text()); break;
+                    case decltype(p)::Event::Frame:{
+                        auto f = p.decoded();
+                        frames.emplace_back(f.msg, f.seq);
+                        if(f.seq == 1){ CHECK(as<Ping>(f.payload)->token == 0xdeadbeef); }
+                        if(f.seq == 2){ CHECK(as<Tone>(f.payload)->hz == 0x100 && as<Tone>(f.payload)->gain == 1); }
+                        if(f.seq == 4){ CHECK(f.payload.empty()); }
+                        break;
+                    }
+                    case decltype(p)::Event::BadFrame: bad++; break;
+                    case decltype(p)::Event::LineTooLong: tooLong++; break;
+                    case decltype(p)::Event::None: break;
+                }
+            }
+        }
+        CHECK(lines == (vec<string>{"servo 10", "vad", "audio"}));
+        CHECK((frames == vec<std::pair<Msg, u8>>{{Msg::Ping, 1}, {Msg::Tone, 2}, {Msg::Ping, 5}, {Msg::Stop, 4}}));
+        CHECK_EQ(bad, 1u);
+        CHECK_EQ(tooLong, 1u);
+    }
+}
+
+// The host's side of the mocked CDC port. Each read runs the device's main loop once.
+struct Loopback{
+    bool write(span<const u8> bytes){
+        for(size_t at = 0; at < bytes.size(); at += 64){ // A USB packet at a time
+            auto packet = bytes.subspan(at, std::min<size_t>(64, bytes.size() - at));
+            mock::gUSBCDCRx.insert(mock::gUSBCDCRx.end(), packet.begin(), packet.end());
+            tud_cdc_rx_cb(0);
+        }
+        return true;
+    }
+    size_t read(span<u8> into, u32 timeoutMs){
+        ctl::tick();
+        console::poll();
+        ctl::tick();
+        logring::tick();
+        return mock::take_front(mock::gUSBCDCTx, into.data(), into.size());
+    }
+};
+
+static Client<Loopback> connect(){
+    mock::reset();
+    ctl::reset();
+    logring::reset();
+    mixer::gMixer.commands.commit_read(mixer::gMixer.commands.length());
+    return {};
+}
+
+// Many requests in one write. More than the device's reply queue holds, so it has to hold the host off.
+static void test_batches(){
+    auto c = connect();
+    vec<u8> seqs;
+    for(u32 i = 0; i < 100; i++){ seqs.push_back(c.queue(Msg::Ping, Ping{.token = i * 3})); }
+    CHECK(c.flush());
+    CHECK(!mock::gUSBCDCRx.empty()); // Held back
+    for(u32 i = 100; i-- > 0;){ // Any order
+        auto r = c.wait(seqs[i]);
+        CHECK(r && r->msg == Msg::Pong);
+        CHECK_EQ(as<Ping>(r->payload)->token, i * 3);
+    }
+    CHECK(mock::gUSBCDCRx.empty());
+    CHECK(c.replies.empty());
+    CHECK_EQ(ctl::gTx.overruns.load(), 0u);
+    CHECK(c.ping(0x12345678)); // Seqs wrap past 255
+}
+
+static void test_commands(){
+    auto c = connect();
+    CHECK(c.servo(-45) == Status::Ok);
+    u16 low = mock::gPWMLevelA[dev::servo::gPWMSlice];
+    CHECK(c.servo(45) == Status::Ok);
+    CHECK(mock::gPWMLevelA[dev::servo::gPWMSlice] > low);
+    CHECK(c.servo(91) == Status::BadArg);
+    CHECK(c.servo(NAN) == Status::BadArg);
+
+    CHECK(c.play(0) == Status::Ok);
+    CHECK(c.play(mixer::clips().count()) == Status::BadArg);
+    CHECK(c.tone(1000, 50) == Status::Ok);
+    CHECK(c.tone(0, 50) == Status::BadArg);
+    CHECK(c.stop() == Status::Ok);
+    CHECK_EQ(mixer::gMixer.commands.length(), 3u);
+
+    CHECK(c.vad_mute(true) == Status::Ok);
+    CHECK(dev::mic::gMuteSilence);
+    auto v = c.voice();
+    CHECK(v && v->mute == 1 && v->speaking == 0);
+    CHECK(c.vad_mute(false) == Status::Ok);
+
+    auto a = c.audio();
+    CHECK(a);
+    CHECK_EQ(a->fill, dev::dac::gAudioRecvBuffer.length());
+    CHECK_EQ(a->capacity, dev::dac::gAudioRecvBuffer.capacity());
+    CHECK_EQ(a->feedback, dev::dac::gAudioRecvFeedback.value);
+
+    CHECK(c.command((Msg)0x55) == Status::UnknownMsg);
+    CHECK(c.command(Msg::Ping) == Status::BadLength);
+    CHECK(c.command(Msg::Stop, u8{1}) == Status::BadLength);
+}
+
+// A corrupt frame gets no reply, a long line gets the console's complaint, and neither upsets what follows.
+static void test_errors(){
+    auto c = connect();
+    u8 seq = c.queue(Msg::Ping, Ping{.token = 1});
+    c.batch[4] ^= 0x40;
+    CHECK(!c.wait(seq));
+    CHECK_EQ(ctl::gBadFrames, 1u);
+    string junk(300, 'x');
+    junk += '\n';
+    c.port.write({(u8 const*)junk.data(), junk.size()});
+    CHECK(c.ping(2));
+    CHECK(c.lines == (vec<string>{"Message too long. Ignored"}));
+}
+
+// Events only once asked for, with seq 0.
+static void test_events(){
+    auto c = connect();
+    auto& voice = dev::mic::gVoice;
+    voice.speaking = true;
+    console::report_voice_changes();
+    voice.speaking = false;
+    console::report_voice_changes();
+    CHECK(!c.next_event(0));
+
+    CHECK(c.subscribe(cEventSpeech) == Status::Ok);
+    voice.speaking = true;
+    console::report_voice_changes();
+    auto e = c.next_event(0);
+    CHECK(e && e->msg == Msg::Speech && e->seq == 0 && e->payload == vec<u8>{1});
+    voice.speaking = false;
+    console::report_voice_changes();
+    ctl::event_button(0, true); // Not subscribed to
+    e = c.next_event(0);
+    CHECK(e && e->msg == Msg::Speech && e->payload == vec<u8>{0});
+    CHECK(!c.next_event(0));
+}
+
+int main(){
+    test_cobs();
+    test_parser();
+    test_batches();
+    test_commands();
+    test_errors();
+    test_events();
+    std::puts("test_ctl: ok");
+}
@@ -0,0 +1,81 @@
+// Decimator: gain, passband flatness (the CIC droop is made up), noise, and rejection of what would alias.
+#include "check.hpp"
+#include "decimator.hpp"
+#include "tone_fit.hpp"
+#include <cmath>
+
+constexpr u16 cDC = 2481; // The mic's level shift
+constexpr f64 cGain = 1 << Decimator::cExtraBits;
+
+// A quarter second of a tone at `hz` through a fresh decimator, fed in 1ms blocks of ADC counts.
+// Returns the output once the filters have filled.
+static std::vector<s16> run_tone(f64 hz, f64 amp){
+    auto d = Decimator::make(cDC);
+    std::vector<s16> out;
+    array<u16, Decimator::cInRate / 1000> block;
+    array<s16, Decimator::max_out(block.size())> got;
+    u32 t = 0;
+    for(u32 ms = 0; ms < 250; ms++){
+        for(auto& x: block){ x = (u16)std::lround(cDC + amp * std::sin(2 * M_PI * hz / Decimator::cInRate * t++)); }
+        auto n = d.process(block, got);
+        CHECK_EQ(n, (size_t)Decimator::cOutRate / 1000);
+        out.insert(out.end(), got.begin(), got.begin() + n);
+    }
+    out.erase(out.begin(), out.begin() + 100);
+    return out;
+}
+
+static f64 rms(span<const s16> y){
+    f64 sum = 0;
+    for(auto v: y){ sum += (f64)v * v; }
+    return std::sqrt(sum / y.size());
+}
+
+static void test_coefficients(){
+    s32 sum = 0;
+    for(auto c: Decimator::cFir){ sum += 2 * c; }
+    f64 expect = cGain * (1 << Decimator::cCicShift) / Decimator::cCicGain * (1 << Decimator::cCoeffBits);
+    CHECK(std::abs(sum - expect) < expect / 1000); // Within the rounding of the taps
+    CHECK(std::abs(Decimator::cFir.front()) <= 1); // Windowed to nothing at the edge
+}
+
+static void test_dc(){
+    auto d = Decimator::make(cDC);
+    array<u16, 192> block;
+    array<s16, Decimator::max_out(block.size())> got;
+    block.fill(cDC - 300);
+    size_t n = 0;
+    for(u32 i = 0; i < 10; i++){ n = d.process(block, got); }
+    CHECK_EQ(n, 16u);
+    CHECK(std::abs(got[n - 1] + 300 * cGain) <= 2);
+    // The top and bottom of the ADC's range still fit
+    block.fill(0);
+    for(u32 i = 0; i < 10; i++){ n = d.process(block, got); }
+    CHECK(std::abs(got[n - 1] + cDC * cGain) <= 2);
+}
+
+// Flat across the passband, and quieter than the ADC's own quantisation would allow at 16k.
+static void test_passband(){
+    for(f64 hz: {200.0, 1000.0, 3000.0, 6000.0}){
+        auto y = run_tone(hz, 1000);
+        auto [amp, snr] = fit_tone(y, hz / Decimator::cOutRate);
+        CHECK(std::abs(20 * std::log10(amp / (1000 * cGain))) < 0.2);
+        CHECK(snr > 70);
+    }
+}
+
+// Tones that would fold into the output's band: above its Nyquist (the FIR), and near multiples of 32k (the CIC).
+static void test_alias_rejection(){
+    for(f64 hz: {9000.0, 12000.0, 26000.0, 38000.0, 60000.0}){
+        auto y = run_tone(hz, 1000);
+        CHECK(20 * std::log10(rms(y) / (1000 * cGain / std::sqrt(2))) < -40);
+    }
+}
+
+int main(){
+    test_coefficients();
+    test_dc();
+    test_passband();
+    test_alias_rejection();
+    std::puts("test_decimator: ok");
+}
@@ -0,0 +1,45 @@
+// gain: the dB table against libm, and the per-block ramps.
+#include "check.hpp"
+#include "gain.hpp"
+#include <cmath>
+
+static void test_table(){
+    gain::Q15 last = gain::cUnity + 1;
+    for(s32 db256 = gain::cMaxDb256; db256 >= gain::cMinDb256; db256--){
+        f64 expect = std::pow(10.0, db256 / 256.0 / 20.0) * gain::cUnity;
+        gain::Q15 got = gain::from_db256(db256);
+        CHECK(std::abs(got - expect) <= 0.5 + 1e-6); // Correctly rounded
+        CHECK(got <= last);
+        last = got;
+    }
+    CHECK_EQ(gain::from_db256(INT16_MIN), gain::from_db256(gain::cMinDb256));
+    CHECK_EQ(gain::from_db256(100), gain::cUnity);
+}
+
+static void test_ramp(){
+    constexpr u32 cBlock = 48;
+    gain::Ramp ramp;
+    for(gain::Q15 target: {gain::cUnity, (gain::Q15)0, (gain::Q15)1000, (gain::Q15)1001, (gain::Q15)1001, gain::cUnity}){
+        gain::Q15 from = ramp.current;
+        auto s = ramp.begin_block(target, cBlock);
+        s32 prev = gain::apply(1 << 14, from);
+        for(u32 i = 0; i < cBlock; i++){
+            s32 v = s.next(1 << 14);
+            CHECK(target >= from ? v >= prev : v <= prev); // Monotonic
+            // Never more than one straight-line step (plus rounding) from the previous sample
+            CHECK(std::abs((s64)v - prev) <= std::abs(((s64)target - from) << 15) / cBlock + (1 << 15));
+            prev = v;
+        }
+        CHECK_EQ(prev, gain::apply(1 << 14, target));
+        CHECK_EQ(ramp.current, target);
+    }
+    // Full scale at unity stays in range
+    CHECK_EQ(gain::apply(INT16_MIN, gain::cUnity), INT32_MIN);
+    CHECK_EQ(gain::apply(INT16_MAX, gain::cUnity), INT32_MAX - 0xffff);
+}
+
+int main(){
+    test_table();
+    test_ramp();
+    std::puts("test_gain: ok");
+}
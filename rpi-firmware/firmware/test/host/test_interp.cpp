@@ -0,0 +1,35 @@
+// The speaker fill on the interpolators matches the plain loop sample for sample: across the ring's wrap,
+// with the gain holding and ramping, in every output format.
+#include "check.hpp"
+#include "dev/interp.hpp"
+#include "dev/i2s_dac.hpp"
+
+template<typename Sample>
+static void check_matches(u32 from, gain::Q15 start, gain::Q15 target){
+    using namespace dev;
+    array<s16, 256> ring;
+    for(size_t i = 0; i < ring.size(); i++){ ring[i] = (s16)(i * 257 - 30'000); }
+    array<Sample, 100> fast, slow;
+    gain::Ramp a = {.current = start}, b = {.current = start};
+    auto va = a.begin_block(target, fast.size()), vb = b.begin_block(target, slow.size());
+    interp::scaled_from_ring(ring, from, va, span{fast});
+    interp::scaled_from_ring_scalar(ring, from, vb, span{slow});
+    CHECK(std::memcmp(fast.data(), slow.data(), sizeof(fast)) == 0);
+    CHECK_EQ(va.acc, vb.acc);
+}
+
+static void test_matches_scalar(){
+    using namespace dev::dac;
+    for(u32 from: {0u, 200u, 255u, 1000u}){ // 200 and 1000 wrap partway through
+        for(auto [start, target]: {std::pair<gain::Q15, gain::Q15>{gain::cUnity, gain::cUnity}, {0, gain::cUnity}, {gain::cUnity, 3277}, {12345, 12345}}){
+            check_matches<I2SAudioSample>(from, start, target);
+            check_matches<I2SAudioSamplePacked16>(from, start, target);
+            check_matches<I2SAudioSampleMono32>(from, start, target);
+        }
+    }
+}
+
+int main(){
+    test_matches_scalar();
+    std::puts("test_interp: ok");
+}
@@ -0,0 +1,160 @@
+// Interned console output (LOG_INTERNED): the formats only in the ELF's .logfmt section, messages sent as Msg::Log
+// frames, and tools/log_decoder.hpp turning them back into what the text build prints. Decodes its own executable.
+#include "check.hpp"
+#include "console.hpp"
+#include "../../tools/log_decoder.hpp"
+#include <string>
+
+static logring::Formats gFormats;
+
+static vec<u8> sent(){
+    vec<u8> b = std::move(mock::gUSBCDCTx);
+    mock::gUSBCDCTx.clear();
+    return b;
+}
+// The messages in `bytes`, as text. Everything in it must be a Log frame, and every message whole.
+static std::string decoded(vec<u8> ref bytes){
+    using Event = ctl::Parser<256>::Event;
+    ctl::Parser<256> p;
+    logring::Joiner joiner;
+    std::string out;
+    for(u8 b: bytes){
+        switch(p.push(b)){
+            case Event::Frame:{
+                auto f = p.decoded();
+                CHECK(f.msg == ctl::Msg::Log);
+                auto payload = joiner.push(f.seq, f.payload);
+                if(!payload){ break; }
+                auto m = logring::decode(gFormats, *payload);
+                CHECK(m);
+                if(m){ out += m->text + (m->newline ? "\n" : ""); }
+                break;
+            }
+            case Event::None: break;
+            default: CHECK(false); break;
+        }
+    }
+    CHECK(joiner.pending.empty());
+    return out;
+}
+static void fresh(){
+    mock::reset();
+    logring::reset();
+}
+
+// The formats are in the ELF but not in memory: the section sits at 0, and a string's address is its offset in it.
+static void test_section(){
+    CHECK_EQ(gFormats.addr, 0u);
+    auto fmt = FMT("Interned %u");
+    CHECK((uintptr_t)fmt.at < gFormats.bytes.size());
+    CHECK(gFormats.at((uintptr_t)fmt.at) == sv{"Interned %u"});
+    CHECK(std::ranges::search(gFormats.bytes, sv{"Log: %u messages dropped on core %u"}));
+    CHECK(!gFormats.at(gFormats.bytes.size()));
+}
+
+// What the text build prints (see test_log_ring.cpp), short messages a frame each.
+static void test_round_trip(){
+    fresh();
+    u8 small = 200;
+    s16 negative = -1234;
+    logring::write<true>(FMT("%u %d %s %.*s %llx %.2f %c %p"), small, negative, "str", 3, "abcdef", 0x123456789abcull, 1.5f, 'x', (void*)0x1234);
+    console::print(FMT("no newline, "));
+    console::println(FMT("%s"), "then one");
+    console::println(FMT("100% literal")); // Without arguments it's not a format
+    console::println(FMT("%-6s|%5d|%-4u|%03x"), "ab", -7, 12u, 10u);
+    CHECK(sent().empty());
+    logring::tick();
+    CHECK(same(decoded(sent()), "200 -1234 str abc 123456789abc 1.50 x 0x1234\nno newline, then one\n100% literal\nab    |   -7|12  |00a\n"));
+}
+
+// The point of it: a stats line is a fraction of its text on the wire.
+static void test_size(){
+    fresh();
+    console::println(FMT("Speaker: fill %u/%u, feedback %u.%04u samples/ms, overruns %u, underruns %u"), 256u, 512u, 48u, 12u, 0u, 3u);
+    logring::tick();
+    auto wire = sent();
+    std::string text = decoded(wire);
+    CHECK(same(text, "Speaker: fill 256/512, feedback 48.0012 samples/ms, overruns 0, underruns 3\n"));
+    CHECK(wire.size() * 4 < text.size());
+}
+
+// A message longer than a frame goes in several. One longer than a line is cut short like the text build's, and
+// arguments after a string that doesn't fit print as "?".
+static void test_long_messages(){
+    fresh();
+    std::string longer(100, 's');
+    console::println(FMT("%s then %u"), longer.c_str(), 7u);
+    logring::tick();
+    auto wire = sent();
+    CHECK(wire.size() > ctl::cMaxWire);
+    CHECK(same(decoded(wire), longer + " then 7\n"));
+
+    std::string longest(300, 'l');
+    console::println(FMT("%s then %u"), longest.c_str(), 7u);
+    logring::tick();
+    std::string text = decoded(sent());
+    CHECK(text.starts_with(longest.substr(0, 150)));
+    CHECK(text.size() < logring::cLineChars + sv{" then ?\n"}.size());
+    CHECK(text.ends_with("l then ?\n"));
+}
+
+// The console's own help, every line of it whole.
+static void test_help(){
+    fresh();
+    console::processline("help");
+    logring::tick();
+    std::string text = decoded(sent());
+    for(auto& c: console::cCommands.commands){
+        char line[256];
+        int pad = std::max<int>(0, 15 - (int)c.name.size());
+        std::snprintf(line, sizeof(line), "    %.*s %-*.*s: %.*s\n", (int)c.name.size(), c.name.data(), pad, (int)c.args.size(),
+            c.args.data(), (int)c.help.size(), c.help.data());
+        CHECK(text.find(line) != std::string::npos);
+    }
+    CHECK(text.ends_with("see src/ctl_protocol.hpp.\n"));
+}
+
+// Frames only go whole into the CDC FIFO, so the control protocol's can't land in the middle of one.
+static void test_slow_host(){
+    fresh();
+    console::println(FMT("first %u"), 1u);
+    console::println(FMT("second %u"), 2u);
+    mock::gUSBCDCTxRoom = 5;
+    logring::tick();
+    CHECK(sent().empty());
+    mock::gUSBCDCTxRoom = 16;
+    logring::tick();
+    auto one = sent();
+    mock::gUSBCDCTxRoom = UINT32_MAX;
+    logring::tick();
+    auto two = sent();
+    CHECK(same(decoded(one), "first 1\n"));
+    CHECK(same(decoded(two), "second 2\n"));
+}
+
+// Drops are reported through a format of their own.
+static void test_drops(){
+    fresh();
+    u32 before = logring::gRings[0].overruns.load();
+    for(u32 i = 0; i < 1000; i++){ console::println(FMT("message %u"), (unsigned)i); }
+    u32 dropped = logring::gRings[0].overruns.load() - before;
+    CHECK(dropped > 0);
+    logring::tick();
+    std::string text = decoded(sent());
+    CHECK(text.starts_with("Log: " + std::to_string(dropped) + " messages dropped on core 0\nmessage 0\n"));
+}
+
+int main(){
+    auto formats = logring::Formats::load("/proc/self/exe");
+    CHECK(formats);
+    if(!formats){ return 1; }
+    gFormats = std::move(*formats);
+    test_section();
+    test_round_trip();
+    test_size();
+    test_long_messages();
+    test_help();
+    test_slow_host();
+    test_drops();
+    std::puts("test_log_intern: ok");
+}
@@ -0,0 +1,98 @@
+// The deferred log: arguments stored raw and formatted later, lines written only as the CDC FIFO has room, and
+// messages dropped (and counted) rather than blocking when the ring is full.
+#include "check.hpp"
+#include "log_ring.hpp"
+#include "console.hpp"
+#include <string>
+
+static std::string sent(){
+    std::string s{mock::gUSBCDCTx.begin(), mock::gUSBCDCTx.end()};
+    mock::gUSBCDCTx.clear();
+    return s;
+}
+static void fresh(){
+    mock::reset();
+    logring::reset();
+}
+
+// Nothing is formatted until `tick`, and then it's what printf would have said.
+static void test_format(){
+    fresh();
+    u8 small = 200;
+    s16 negative = -1234;
+    logring::write<true>(FMT("%u %d %s %.*s %llx %.2f %c %p"), small, negative, "str", 3, "abcdef", 0x123456789abcull, 1.5f, 'x', (void*)0);
+    console::print(FMT("no newline, "));
+    console::println(FMT("%s"), "then one");
+    console::println(FMT("100% literal")); // Without arguments it's not a format
+    CHECK(sent().empty());
+    logring::tick();
+    char expect[64];
+    std::snprintf(expect, sizeof(expect), "%p", (void*)0);
+    CHECK(same(sent(), "200 -1234 str abc 123456789abc 1.50 x " + std::string(expect) + "\r\nno newline, then one\r\n100% literal\r\n"));
+    console::println(FMT("help text\nwith lines")); // No arguments: written straight from the literal
+    logring::tick();
+    CHECK(same(sent(), "help text\r\nwith lines\r\n"));
+}
+
+// A host that's slow to read gets everything in order, in pieces, and never half a line end.
+static void test_slow_host(){
+    fresh();
+    std::string text(300, 'a');
+    for(size_t i = 7; i < text.size(); i += 13){ text[i] = '\n'; }
+    logring::write<true>(FMT("%s"), text.c_str());
+    console::println(FMT("after")); // Queued behind it
+    std::string got;
+    for(u32 room: {0, 1, 5, 6, 7, 1, 1, 2, 64, 3, 200, 200, 200}){
+        mock::gUSBCDCTxRoom = room;
+        logring::tick();
+        got += sent();
+    }
+    std::string expect;
+    for(char c: text.substr(0, logring::cLineChars - 1)){ expect += c == '\n' ? "\r\n" : std::string(1, c); } // Cut short
+    expect += "\r\nafter\r\n";
+    CHECK(same(got, expect));
+    CHECK(logring::gRings[0].empty());
+}
+
+// A full ring drops what doesn't fit, and says so once there's room.
+static void test_drops(){
+    fresh();
+    u32 kept = 0;
+    for(u32 i = 0; i < 1000; i++){
+        console::println(FMT("message %u"), (unsigned)i);
+        kept += logring::gRings[0].overruns.load() == 0;
+    }
+    CHECK_EQ(kept, logring::cWords / 3);
+    logring::tick();
+    std::string out = sent();
+    char expect[64];
+    std::snprintf(expect, sizeof(expect), "Log: %u messages dropped on core 0\r\n", (unsigned)(1000 - kept));
+    CHECK(out.starts_with(expect));
+    CHECK(out.ends_with("message " + std::to_string(kept - 1) + "\r\n"));
+    console::println(FMT("later"));
+    logring::tick();
+    CHECK(same(sent(), "later\r\n")); // Reported once
+}
+
+// Each core has its own ring, and neither starves the other.
+static void test_cores(){
+    fresh();
+    for(u32 i = 0; i < 3; i++){
+        mock::gCoreNum = 0;
+        console::println(FMT("core0 %u"), (unsigned)i);
+        mock::gCoreNum = 1;
+        console::println(FMT("core1 %u"), (unsigned)i);
+    }
+    CHECK_EQ(logring::gRings[1].length(), 3u * 3);
+    mock::gCoreNum = 0;
+    logring::tick();
+    CHECK(same(sent(), "core0 0\r\ncore1 0\r\ncore0 1\r\ncore1 1\r\ncore0 2\r\ncore1 2\r\n"));
+}
+
+int main(){
+    test_format();
+    test_slow_host();
+    test_drops();
+    test_cores();
+    std::puts("test_log_ring: ok");
+}
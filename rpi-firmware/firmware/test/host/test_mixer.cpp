@@ -0,0 +1,155 @@
+// Mixer: ADPCM clips out of flash and tones over the speaker stream, through the speaker's block fill, and the console commands.
+#include "check.hpp"
+#include "pico/stdlib.h"
+#include "dev/i2s_dac.hpp"
+#include "console.hpp"
+#include <cmath>
+
+using namespace dev;
+using Block = array<dac::I2SAudioSample, 48>;
+
+static void reset_mixer(u16 volume){
+    mock::reset();
+    usbSampleRate = 48'000;
+    volumeFactor = volume;
+    dac::gVolumeRamp = {.current = volume};
+    auto& q = dac::gAudioRecvBuffer;
+    q.commit_read(q.length());
+    auto& m = mixer::gMixer;
+    m.commands.commit_read(m.commands.length());
+    m.voices = {};
+}
+
+// Fills `n` blocks like the speaker IRQ does and returns the left channel.
+static vec<s32> play_blocks(u32 n){
+    vec<s32> out;
+    Block b;
+    for(u32 i = 0; i < n; i++){
+        dac::load_samples(b);
+        for(auto& s: b){ out.push_back(s.l); }
+    }
+    return out;
+}
+
+// Clip `name` from the linked pack, decoded in one go.
+static vec<s16> decoded(sv name){
+    auto pack = mixer::clips();
+    auto i = pack.find(name);
+    CHECK(i.has_value());
+    auto r = pack.reader(*i);
+    vec<s16> out(pack.entries()[*i].frames);
+    for(auto& s: out){ s = r.next(); }
+    return out;
+}
+
+static void test_clips_linked(){
+    auto pack = mixer::clips();
+    CHECK(pack.valid());
+    CHECK_EQ(pack.count(), 3u);
+    for(sv name: {"chime", "thinking", "error"}){
+        auto c = decoded(name);
+        CHECK(c.size() > mixer::cRate / 10); // At least 100ms each
+        CHECK_EQ(c.front(), 0); // Faded at both ends
+        CHECK(std::abs(c.back()) < 64);
+        CHECK(std::ranges::any_of(c, [](s16 s){ return std::abs(s) > 1000; }));
+    }
+}
+
+// A clip comes out sample for sample at its gain, even with the host's volume at 0, and then the voice frees up.
+static void test_clip_over_silence(){
+    reset_mixer(0);
+    auto clip = decoded("error");
+    CHECK(mixer::play(*mixer::clips().find("error")));
+    auto out = play_blocks(clip.size() / Block{}.size() + 2);
+    for(size_t i = 0; i < clip.size(); i++){ CHECK_EQ(out[i], gain::apply(clip[i], mixer::cDefaultGain)); }
+    for(size_t i = clip.size(); i < out.size(); i++){ CHECK_EQ(out[i], 0); }
+    CHECK(!mixer::gMixer.busy());
+}
+
+// On top of the stream: summed after the stream's volume, saturating rather than wrapping.
+static void test_clip_over_stream(){
+    reset_mixer(gain::cUnity);
+    array<s16, 96> stream;
+    for(size_t i = 0; i < stream.size(); i++){ stream[i] = (s16)(i * 300 - 12'000); }
+    dac::gAudioRecvBuffer.write_from(stream);
+    mixer::play(*mixer::clips().find("chime"), gain::cUnity);
+    auto clip = decoded("chime");
+    auto out = play_blocks(2);
+    for(size_t i = 0; i < stream.size(); i++){ CHECK_EQ(out[i], gain::apply(stream[i], gain::cUnity) + gain::apply(clip[i], gain::cUnity)); }
+
+    reset_mixer(gain::cUnity);
+    stream.fill(INT16_MAX);
+    dac::gAudioRecvBuffer.write_from(stream);
+    mixer::tone(1000, 10, gain::cUnity);
+    out = play_blocks(2);
+    CHECK(std::ranges::all_of(out, [](s32 v){ return v > 0; })); // Never wrapped round
+    CHECK(std::ranges::count(out, INT32_MAX) > 0);
+}
+
+// A tone fades in and out, lasts as long as asked, and is at the right pitch and level.
+static void test_tone(){
+    reset_mixer(0);
+    mixer::tone(1000, 100, gain::cUnity);
+    auto out = play_blocks(110);
+    CHECK_EQ(out[0], 0);
+    CHECK(std::abs(out[4]) < std::abs(gain::apply(INT16_MAX, gain::cUnity)) / 10); // Still fading in
+    for(size_t i = mixer::cRate / 10; i < out.size(); i++){ CHECK_EQ(out[i], 0); }
+    u32 crossings = 0;
+    s32 peak = 0;
+    for(size_t i = 1; i < mixer::cRate / 10; i++){
+        crossings += (out[i - 1] < 0) != (out[i] < 0);
+        peak = std::max(peak, out[i]);
+    }
+    CHECK(crossings >= 199 && crossings <= 201); // 100 cycles
+    CHECK(std::abs(peak - gain::apply(INT16_MAX, gain::cUnity)) < (1 << 17));
+}
+
+// More sounds than voices take over the one nearest its end. Stop silences the lot from the next block.
+static void test_voices_and_stop(){
+    reset_mixer(0);
+    for(u32 ms: {50, 60, 70, 80}){ mixer::tone(500, ms); }
+    play_blocks(1);
+    mixer::tone(500, 200);
+    play_blocks(1);
+    u32 longest = 0;
+    for(auto& v: mixer::gMixer.voices){ longest = std::max(longest, v.left); }
+    CHECK_EQ(longest, 200u * 48 - 48);
+    CHECK(std::ranges::none_of(mixer::gMixer.voices, [](auto ref v){ return v.frames == 50u * 48; }));
+    mixer::stop();
+    auto out = play_blocks(1);
+    CHECK(std::ranges::all_of(out, [](s32 v){ return v == 0; }));
+    CHECK(!mixer::gMixer.busy());
+}
+
+static void test_console(){
+    reset_mixer(0);
+    auto queued = []{ return mixer::gMixer.commands.length(); };
+    console::processline("play chime");
+    console::processline("play 2");
+    console::processline("clips");
+    console::processline("tone 440 250");
+    CHECK_EQ(queued(), 3u);
+    console::processline("play nonsense");
+    console::processline("play 3");
+    console::processline("tone 440");
+    console::processline("tone 30000 100");
+    CHECK_EQ(queued(), 3u);
+    play_blocks(1);
+    auto pack = mixer::clips();
+    CHECK_EQ(mixer::gMixer.voices[0].left, pack.entries()[*pack.find("chime")].frames - 48);
+    CHECK_EQ(mixer::gMixer.voices[1].left, pack.entries()[2].frames - 48);
+    CHECK_EQ(mixer::gMixer.voices[2].frames, 250u * 48);
+    console::processline("play stop");
+    play_blocks(1);
+    CHECK(!mixer::gMixer.busy());
+}
+
+int main(){
+    test_clips_linked();
+    test_clip_over_silence();
+    test_clip_over_stream();
+    test_tone();
+    test_voices_and_stop();
+    test_console();
+    std::puts("test_mixer: ok");
+}
@@ -0,0 +1,67 @@
+// profile: the per-site table, the SysTick arithmetic behind PROFILE_SCOPE, and the console dump.
+#include "check.hpp"
+#include "pico/stdlib.h"
+#include "dev/i2s_dac.hpp"
+#include "console.hpp"
+
+static void test_entry(){
+    profile::Entry e;
+    for(u32 c: {100u, 300u, 200u}){ e.note(c); }
+    CHECK_EQ(e.count.load(), 3u);
+    CHECK_EQ(e.min.load(), 100u);
+    CHECK_EQ(e.max.load(), 300u);
+    CHECK(e.avg16 / 16 > 100 && e.avg16 / 16 < 300);
+    CHECK_EQ(e.histogram[7].load(), 1u); // 100 is 7 bits
+    CHECK_EQ(e.histogram[9].load(), 1u);
+    CHECK_EQ(e.histogram[8].load(), 1u);
+
+    // Settles on a steady cost
+    for(u32 i = 0; i < 200; i++){ e.note(1000); }
+    CHECK_EQ(e.avg16 / 16, 1000u);
+
+    e.note(0);
+    e.note(UINT32_MAX);
+    CHECK_EQ(e.histogram[0].load(), 1u);
+    CHECK_EQ(e.histogram[e.cBuckets - 1].load(), 1u);
+    e.reset();
+    CHECK_EQ(e.count.load(), 0u);
+    CHECK_EQ(e.histogram[10].load(), 0u);
+}
+
+static void test_scope(){
+    mock::reset();
+    console::processline("profile reset");
+    profile::init_this_core();
+    CHECK_EQ(systick_hw->rvr, profile::cCounterMask);
+
+    auto& e = profile::gTable[(size_t)profile::Site::SpeakerRx];
+    systick_hw->cvr = 1000;
+    {
+        PROFILE_SCOPE(profile::Site::SpeakerRx);
+        systick_hw->cvr = 400; // 600 cycles later (it counts down)
+    }
+    CHECK_EQ(e.max.load(), 600u);
+    systick_hw->cvr = 10;
+    {
+        PROFILE_SCOPE(profile::Site::SpeakerRx);
+        systick_hw->cvr = profile::cCounterMask - 5; // Wrapped
+    }
+    CHECK_EQ(e.min.load(), 16u);
+    CHECK_EQ(e.count.load(), 2u);
+
+    // The handlers are instrumented
+    dev::dac::init();
+    mock::dma_complete(dev::dac::gDMAData);
+    mock::irq_fire(DMA_IRQ_0);
+    CHECK_EQ(profile::gTable[(size_t)profile::Site::SpeakerDMA].count.load(), 1u);
+
+    console::processline("profile");
+    console::processline("profile reset");
+    CHECK_EQ(e.count.load(), 0u);
+}
+
+int main(){
+    test_entry();
+    test_scope();
+    std::puts("test_profile: ok");
+}
@@ -0,0 +1,80 @@
+// RateFeedback: a simulated host and DAC with drifting clocks, checking the ring never over or underruns.
+#include "check.hpp"
+#include "ring_queue.hpp"
+#include "rate_feedback.hpp"
+
+// Runs `seconds` of 1ms frames. The host sends what the feedback asks for, the DAC drains 48 sample blocks
+// at 48kHz * (1 + ppm/1e6) as measured in host frames. Returns the mean feedback over the last 100 seconds
+// (small drifts only slip a whole block every few seconds, so shorter windows alias).
+static f64 simulate(s32 ppm, u32 seconds){
+    RingQueue<s16, 512> ring;
+    auto fb = RateFeedback::make(48'000, ring.capacity() / 2);
+    constexpr u32 cBlock = 48;
+    constexpr u32 cMeanFrames = 100'000;
+    const u64 dacPerFrame = ((u64)cBlock << 16) * (1'000'000 + ppm) / 1'000'000; // 16.16
+
+    u64 hostAcc = 0;
+    u64 dacAcc = 0;
+    u32 sent = fb.nominal;
+    u32 settledOverruns = 0, settledUnderruns = 0;
+    u32 minFill = ring.capacity(), maxFill = 0;
+    u64 fbSum = 0;
+    array<s16, 64> packet = {};
+    array<s16, cBlock> block;
+    u32 frames = seconds * 1000;
+    for(u32 f = 0; f < frames; f++){
+        // Host: sends the fractional rate it was last told, one frame late like the real feedback pipe.
+        hostAcc += sent;
+        u32 n = hostAcc >> 16;
+        hostAcc &= 0xffff;
+        ring.write_from(span{packet}.first(n));
+        sent = fb.update(ring.length());
+
+        // DAC: whole blocks, whenever its (drifted) clock has played one.
+        dacAcc += dacPerFrame;
+        while(dacAcc >= ((u64)cBlock << 16)){
+            dacAcc -= (u64)cBlock << 16;
+            ring.read_into(block);
+        }
+
+        if(f == 2000){ // Give it two seconds to lock on
+            settledOverruns = ring.overruns;
+            settledUnderruns = ring.underruns;
+        }
+        if(f > 2000){
+            minFill = std::min(minFill, ring.length());
+            maxFill = std::max(maxFill, ring.length());
+        }
+        if(f >= frames - cMeanFrames){ fbSum += sent; }
+    }
+    CHECK_EQ(ring.overruns.load(), settledOverruns);
+    CHECK_EQ(ring.underruns.load(), settledUnderruns);
+    CHECK(minFill > cBlock);
+    CHECK(maxFill < ring.capacity() - cBlock);
+    return fbSum / (f64)cMeanFrames / 65536.0;
+}
+
+static void test_tracks_drift(){
+    for(s32 ppm: {0, 100, -100, 500, -500, 2000, -2000}){
+        f64 expect = 48.0 * (1'000'000 + ppm) / 1'000'000;
+        f64 got = simulate(ppm, 600); // 10 minutes
+        CHECK(std::abs(got - expect) < 0.001);
+    }
+}
+
+static void test_limits(){
+    auto fb = RateFeedback::make(48'000, 256);
+    CHECK_EQ(fb.value, 48u << 16);
+    for(int i = 0; i < 10'000; i++){ fb.update(512); } // Stuck full, e.g. the DAC stopped
+    CHECK_EQ(fb.value, 47u << 16);
+    fb.reset();
+    CHECK_EQ(fb.value, 48u << 16);
+    for(int i = 0; i < 10'000; i++){ fb.update(0); }
+    CHECK_EQ(fb.value, 49u << 16);
+}
+
+int main(){
+    test_tracks_drift();
+    test_limits();
+    std::puts("test_rate_feedback: ok");
+}
@@ -0,0 +1,81 @@
+// Resampler: tone fidelity both ways, alias rejection, and that it consumes exactly the right number of inputs.
+#include "check.hpp"
+#include "resampler.hpp"
+#include "tone_fit.hpp"
+#include <cmath>
+
+static s16 tone(f64 freq, u32 i, f64 amp = 16000){ return (s16)std::lround(amp * std::sin(2 * M_PI * freq * i)); }
+
+static void test_kernel(){
+    CHECK_EQ(Resampler::cKernel[0], (s16)std::lround(0.9 * Resampler::cKernelOne));
+    CHECK(std::abs(Resampler::cKernel.back()) <= 1); // Windowed to nothing at the edge
+    // DC gain of every phase is ~1
+    for(u32 p = 0; p < Resampler::cPhases; p++){
+        s32 sum = 0;
+        for(s32 k = -(s32)Resampler::cHalfTaps; k <= (s32)Resampler::cHalfTaps; k++){
+            s32 idx = std::abs(k * (s32)Resampler::cPhases + (s32)p);
+            if(idx < (s32)Resampler::cKernel.size()){ sum += Resampler::cKernel[idx]; }
+        }
+        CHECK(std::abs(sum - (s32)Resampler::cKernelOne) < 40);
+    }
+}
+
+// Up: the DAC side, pulling at the output rate.
+static void test_upsample(u32 inRate){
+    auto r = Resampler::make(inRate, 48'000);
+    f64 freq = 1000.0 / inRate;
+    u32 pulled = 0;
+    std::vector<s16> out(48'000 / 4);
+    for(auto& y: out){ y = r.next([&]{ return tone(freq, pulled++); }); }
+    auto settled = span{out}.subspan(100);
+    auto [amp, snr] = fit_tone(settled, 1000.0 / 48'000);
+    CHECK(std::abs(amp - 16000) < 16000 * 0.01);
+    CHECK(snr > 45);
+    // Input consumption tracks the ratio exactly (plus the window filling up)
+    CHECK(std::abs((f64)pulled - out.size() * (f64)inRate / 48'000) <= 2);
+}
+
+// Down: the mic side, pushing blocks at the input rate.
+static void test_downsample(u32 outRate){
+    auto r = Resampler::make(48'000, outRate);
+    std::vector<s16> out;
+    array<s16, 48> block;
+    array<s16, 50> got;
+    u32 t = 0;
+    for(u32 b = 0; b < 250; b++){
+        for(auto& x: block){ x = tone(1000.0 / 48'000, t++); }
+        CHECK(r.max_out(block.size()) <= got.size());
+        size_t n = r.process(block, got);
+        out.insert(out.end(), got.begin(), got.begin() + n);
+    }
+    CHECK(std::abs((f64)out.size() - 250 * 48 * (f64)outRate / 48'000) <= 2);
+    auto [amp, snr] = fit_tone(span{out}.subspan(100), 1000.0 / outRate);
+    CHECK(std::abs(amp - 16000) < 16000 * 0.01);
+    CHECK(snr > 45);
+}
+
+// Above the output's Nyquist gets filtered instead of folding back in.
+static void test_alias_rejection(){
+    auto r = Resampler::make(48'000, 16'000);
+    std::vector<s16> out;
+    array<s16, 48> block;
+    array<s16, 50> got;
+    u32 t = 0;
+    for(u32 b = 0; b < 250; b++){
+        for(auto& x: block){ x = tone(12'000.0 / 48'000, t++); } // Would alias to 4k
+        size_t n = r.process(block, got);
+        out.insert(out.end(), got.begin(), got.begin() + n);
+    }
+    auto [amp, snr] = fit_tone(span{out}.subspan(100), 4000.0 / 16'000);
+    CHECK(amp < 16000 * 0.01); // -40dB
+}
+
+int main(){
+    test_kernel();
+    for(u32 rate: {16'000u, 24'000u, 32'000u, 44'100u}){
+        test_upsample(rate);
+        test_downsample(rate);
+    }
+    test_alias_rejection();
+    std::puts("test_resampler: ok");
+}
@@ -0,0 +1,100 @@
+// RingQueue: span bookkeeping, counters, and a two thread stress test of the SPSC ordering.
+#include "check.hpp"
+#include "ring_queue.hpp"
+#include <thread>
+#include <random>
+
+static void test_spans_wrap(){
+    RingQueue<u16, 8> q;
+    CHECK(q.empty());
+    CHECK_EQ(q.space(), 8u);
+
+    // Fill 6, drain 5 so the next write region wraps.
+    auto w = q.write_spans();
+    CHECK_EQ(w[0].size(), 8u);
+    CHECK_EQ(w[1].size(), 0u);
+    for(u16 i = 0; i < 6; i++){ w[0][i] = i; }
+    q.commit_write(6);
+    array<u16, 5> out;
+    CHECK_EQ(q.read_into(out), 5u);
+    CHECK_EQ(out[4], 4);
+
+    w = q.write_spans();
+    CHECK_EQ(w[0].size(), 2u); // indices 6, 7
+    CHECK_EQ(w[1].size(), 5u); // indices 0..=4 (5 is still unread)
+    array<u16, 7> in = {6, 7, 8, 9, 10, 11, 12};
+    CHECK_EQ(q.write_from(in), 7u);
+    CHECK_EQ(q.length(), 8u);
+
+    auto r = q.read_spans();
+    CHECK_EQ(r[0].size(), 3u);
+    CHECK_EQ(r[1].size(), 5u);
+    CHECK_EQ(r[0][0], 5);
+    CHECK_EQ(r[1][4], 12);
+    CHECK_EQ(q.read_one(), 5);
+    CHECK_EQ(q.overruns.load(), 0u);
+    CHECK_EQ(q.underruns.load(), 0u);
+}
+
+static void test_counters(){
+    RingQueue<s16, 4> q;
+    array<s16, 6> in = {1, 2, 3, 4, 5, 6};
+    CHECK_EQ(q.write_from(in), 4u); // Newest two are dropped
+    CHECK_EQ(q.overruns.load(), 1u);
+
+    array<s16, 6> out = {};
+    CHECK_EQ(q.read_into(out), 4u);
+    CHECK_EQ(out[3], 4);
+    CHECK_EQ(q.underruns.load(), 1u);
+    CHECK(q.empty());
+}
+
+// Producer and consumer run flat out with random chunk sizes; the consumer checks the sequence is unbroken.
+static void test_two_thread_stress(){
+    static RingQueue<u32, 512> q;
+    constexpr u32 cTotal = 2'000'000;
+
+    std::thread producer([]{
+        std::minstd_rand rng(1);
+        u32 next = 0;
+        while(next < cTotal){
+            u32 want = rng() % 97 + 1;
+            u32 n = 0;
+            for(auto s: q.write_spans()){
+                for(auto& v: s){
+                    if(n == want || next == cTotal){ break; }
+                    v = next++;
+                    n += 1;
+                }
+            }
+            q.commit_write(n);
+            if(n == 0){ std::this_thread::yield(); } // Full. Matters on single core CI runners.
+        }
+    });
+
+    std::minstd_rand rng(2);
+    u32 expected = 0;
+    while(expected < cTotal){
+        u32 want = rng() % 89 + 1;
+        u32 n = 0;
+        for(auto s: q.read_spans()){
+            for(auto v: s){
+                if(n == want){ break; }
+                CHECK_EQ(v, expected);
+                expected += 1;
+                n += 1;
+            }
+        }
+        q.commit_read(n);
+        if(n == 0){ std::this_thread::yield(); } // Empty
+    }
+    producer.join();
+    CHECK(q.empty());
+}
+
+int main(){
+    test_spans_wrap();
+    test_counters();
+    test_two_thread_stress();
+    std::puts("test_ring_queue: ok");
+}
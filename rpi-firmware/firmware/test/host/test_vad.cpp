@@ -0,0 +1,93 @@
+// VoiceDetector: stays quiet on room noise and hiss, catches speech-like bursts quickly, and holds through pauses.
+#include "check.hpp"
+#include "vad.hpp"
+#include <cmath>
+
+constexpr u16 cDC = 2481;
+constexpr u32 cBlockUs = 1000;
+
+// Repeatable noise, uniform in [-amp, amp]
+struct Noise{
+    u32 state = 12345;
+    f64 next(f64 amp){
+        state = state * 1664525 + 1013904223;
+        return amp * ((f64)(state >> 8) / (1 << 23) - 1);
+    }
+};
+
+// Feeds `ms` milliseconds of `signal(t in seconds)` at `rate`. Returns the ms (from the start of this call)
+// the detector last changed its mind, or -1.
+struct Feed{
+    VoiceDetector v = VoiceDetector::make(cBlockUs, cDC);
+    Noise noise;
+    u32 rate = 48'000;
+    u64 t = 0;
+    s32 run(u32 ms, auto&& signal){
+        s32 changed = -1;
+        std::vector<u16> block(rate / 1000);
+        for(u32 m = 0; m < ms; m++){
+            for(auto& x: block){ x = (u16)std::lround(cDC + signal((f64)t++ / rate) + noise.next(3)); }
+            if(v.process(block, rate)){ changed = m; }
+        }
+        return changed;
+    }
+};
+
+// A 150 Hz voice with a few harmonics, and syllables at 4 Hz that dip most of the way but not to nothing.
+static f64 voice(f64 t){
+    f64 syllables = 0.6 + 0.4 * std::sin(2 * M_PI * 4 * t);
+    f64 v = 0;
+    for(u32 h = 1; h <= 4; h++){ v += std::sin(2 * M_PI * 150 * h * t) / h; }
+    return 300 * syllables * v;
+}
+static f64 silence(f64){ return 0; }
+
+static void test_log2(){
+    CHECK_EQ(VoiceDetector::log2(1), 0);
+    CHECK_EQ(VoiceDetector::log2(2), 256);
+    CHECK_EQ(VoiceDetector::log2(1024), 10 * 256);
+    CHECK_EQ(VoiceDetector::log2(3), 256 + 128); // Linear between powers of two
+}
+
+static void test_speech(u32 rate){
+    Feed f;
+    f.rate = rate;
+    CHECK_EQ(f.run(500, silence), -1);
+    CHECK(!f.v.speaking);
+    s32 start = f.run(1000, voice);
+    CHECK(f.v.speaking);
+    CHECK(start >= 0 && start <= 30); // Onset plus smoothing
+    s32 end = f.run(1000, silence);
+    CHECK(!f.v.speaking);
+    CHECK(end >= 300 && end <= 360); // The hangover
+}
+
+// Loud, but crossing zero every other sample: not a voice.
+static void test_hiss(){
+    Feed f;
+    f.run(500, silence);
+    Noise hiss = {777};
+    CHECK_EQ(f.run(1000, [&](f64){ return hiss.next(500); }), -1);
+    CHECK(!f.v.speaking);
+}
+
+// The floor follows the room up, so a steady louder background stops counting as speech.
+static void test_floor_follows(){
+    Feed f;
+    f.run(500, silence);
+    Noise fan = {99};
+    f64 lp = 0;
+    auto rumble = [&](f64){ lp += (fan.next(400) - lp) * 0.05; return lp; }; // Low frequency, so it crosses rarely
+    f.run(20'000, rumble);
+    CHECK(!f.v.speaking);
+    CHECK(f.v.noise_floor() > VoiceDetector::cMinFloor + 2 * VoiceDetector::cOne);
+}
+
+int main(){
+    test_log2();
+    test_speech(48'000);
+    test_speech(192'000);
+    test_hiss();
+    test_floor_follows();
+    std::puts("test_vad: ok");
+}
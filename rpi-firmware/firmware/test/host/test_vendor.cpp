@@ -0,0 +1,182 @@
+// The vendor bulk interface end to end: tools/vendor_client.hpp talking to dev/vendor.hpp through the mocked endpoints,
+// streamed uploads and replies, replies kept in order behind a stream, telemetry and mic captures.
+#include "check.hpp"
+#include "pico/stdlib.h"
+#include "dev/vendor.hpp"
+#include "../../tools/vendor_client.hpp"
+#include <functional>
+#include <random>
+
+using namespace dev;
+using vendor::Op;
+using vendor::Status;
+
+// The device, driven as TinyUSB would: writes land in the OUT FIFO a transfer at a time, and a read runs main loop
+// passes, a millisecond each, until the IN endpoint has something. Each pass the host takes `room` more bytes.
+struct Loopback{
+    u32 room = UINT32_MAX;
+    std::function<void()> each_pass = []{};
+
+    bool write(span<const u8> bytes){
+        for(size_t at = 0; at < bytes.size(); at += vendor::cTransferBytes){
+            auto part = bytes.subspan(at, std::min<size_t>(vendor::cTransferBytes, bytes.size() - at));
+            mock::gUSBVendorRx.insert(mock::gUSBVendorRx.end(), part.begin(), part.end());
+            tud_vendor_rx_cb(0, nullptr, 0);
+        }
+        return true;
+    }
+    size_t read(span<u8> into, u32 timeoutMs){
+        for(u32 i = 0; i < timeoutMs && mock::gUSBVendorTx.empty(); i++){
+            mock::gTimeUs += 1000;
+            mock::gUSBVendorTxRoom = room;
+            each_pass();
+            vendor::tick();
+        }
+        return mock::take_front(mock::gUSBVendorTx, into.data(), (u32)into.size());
+    }
+};
+using Client = vendor::Client<Loopback>;
+
+static Client fresh(){
+    mock::reset();
+    tud_umount_cb();
+    return Client{.timeoutMs = 500};
+}
+template<typename T> static span<const u8> bytes_of(T ref v){ return {(u8 const*)&v, sizeof(v)}; }
+static vec<u8> random_bytes(size_t n, u32 seed){
+    std::mt19937 rng{seed};
+    vec<u8> b(n);
+    for(u8& v: b){ v = (u8)rng(); }
+    return b;
+}
+
+// Payloads on and around packet boundaries, and requests the device turns down without losing its place.
+static void test_ping_and_errors(){
+    auto c = fresh();
+    for(size_t n: {0, 1, 56, 64}){ CHECK(c.ping(random_bytes(n, (u32)n))); }
+    auto r = c.request(Op::Ping, random_bytes(vendor::cSmallBytes + 1, 1));
+    CHECK(r && r->status() == Status::BadLength && r->payload.empty());
+    r = c.request((Op)0x7f, random_bytes(300, 2)); // Its payload is swallowed
+    CHECK(r && r->status() == Status::UnknownOp);
+    r = c.request(Op::Source, random_bytes(3, 3));
+    CHECK(r && r->status() == Status::BadLength);
+    CHECK(c.ping(random_bytes(8, 4)));
+}
+
+// An upload streams through Sink's CRC however it's cut up.
+static void test_sink(){
+    auto c = fresh();
+    auto bytes = random_bytes(100'000, 5);
+    CHECK_EQ(c.sink(bytes).value_or(0), cobs::crc16(bytes));
+    CHECK_EQ(c.sink({}).value_or(0), 0xffff);
+    CHECK_EQ(vendor::gRxBytes, 2 * sizeof(vendor::Header) + bytes.size());
+}
+
+// A reply longer than gTx, to a host taking a packet a pass, arrives whole and without dropping any.
+static void test_source(){
+    auto c = fresh();
+    c.port.room = vendor::cPacketBytes;
+    constexpr u32 cBytes = 100'003;
+    u32 at = 0;
+    bool pattern = true;
+    auto s = c.stream(Op::Source, bytes_of(cBytes), [&](span<const u8> bytes){
+        for(u8 b: bytes){ pattern = pattern && b == (u8)at++; }
+    });
+    CHECK(s == Status::Ok);
+    CHECK(pattern);
+    CHECK_EQ(at, cBytes);
+    CHECK_EQ(vendor::gTx.overruns.load(), 0u);
+    CHECK(!vendor::streaming());
+    CHECK_EQ(vendor::gTxBytes, sizeof(vendor::Header) + cBytes);
+}
+
+// Requests sent behind one whose reply streams wait in the FIFO, so their replies come after all of it.
+static void test_order(){
+    auto c = fresh();
+    constexpr u32 cBytes = 20'000;
+    c.port.room = 0; // The host isn't reading yet
+    auto source = c.send(Op::Source, cBytes);
+    auto ping = c.send(Op::Ping, span<const u8>{});
+    CHECK(source && ping);
+    CHECK(vendor::streaming());
+    c.port.room = UINT32_MAX;
+    auto h = c.reply_header(Op::Source, *source);
+    CHECK(h && h->length == cBytes);
+    CHECK(c.read_payload(cBytes, [](auto){}));
+    h = c.reply_header(Op::Ping, *ping);
+    CHECK(h && h->status == (u8)Status::Ok && h->length == 0);
+}
+
+// Records as they're taken, `periodUs` apart.
+static void test_telemetry(){
+    auto c = fresh();
+    dac::gAudioRecvBuffer.note_overrun();
+    vec<vendor::Telemetry> got;
+    auto s = c.telemetry(5, 10'000, [&](vendor::Telemetry ref t){ got.push_back(t); });
+    CHECK(s == Status::Ok);
+    CHECK_EQ(got.size(), 5u);
+    CHECK(got[1].timeUs - got[0].timeUs <= 10'000u); // The first is taken on the next pass
+    for(size_t i = 2; i < got.size(); i++){ CHECK_EQ(got[i].timeUs - got[i - 1].timeUs, 10'000u); }
+    CHECK_EQ(got[0].micRate, usbSampleRate.load());
+    CHECK_EQ(got[0].audio.overruns, dac::gAudioRecvBuffer.overruns.load());
+    CHECK_EQ(got[0].rxBytes, sizeof(vendor::Header) + sizeof(vendor::TelemetryReq));
+    auto one = c.request(Op::Telemetry);
+    CHECK(one && one->payload.size() == sizeof(vendor::Telemetry));
+}
+
+// What's sent to the host from the request on, a millisecond at a time. When the mic stops, silence.
+static void test_capture(){
+    auto c = fresh();
+    s16 next = 0;
+    c.port.each_pass = [&]{
+        array<s16, 48> block;
+        for(s16& s: block){ s = next++; }
+        mic::record(block);
+    };
+    c.port.room = 4 * vendor::cPacketBytes; // Keeps the request from being answered in one pass
+    for(u32 i = 0; i < 3; i++){ c.port.read({}, 1); } // Earlier audio isn't in it
+    s16 first = next;
+    opt<vendor::CaptureInfo> info;
+    vec<s16> samples;
+    auto s = c.capture(1000, [&](auto i){ info = i; }, [&](span<const s16> part){ samples.insert(samples.end(), part.begin(), part.end()); });
+    CHECK(s == Status::Ok);
+    CHECK(info && info->rate == usbSampleRate.load() && info->frames == 1000);
+    CHECK_EQ(samples.size(), 1000u);
+    CHECK(samples[0] >= first);
+    for(size_t i = 1; i < samples.size(); i++){ CHECK_EQ(samples[i], (s16)(samples[0] + i)); }
+    CHECK(!mic::gCapturing);
+
+    c.port.each_pass = []{};
+    u64 start = mock::gTimeUs;
+    samples.clear();
+    s = c.capture(500, [](auto){}, [&](span<const s16> part){ samples.insert(samples.end(), part.begin(), part.end()); });
+    CHECK(s == Status::Ok);
+    CHECK(std::ranges::all_of(samples, [](s16 v){ return v == 0; }));
+    CHECK(mock::gTimeUs - start >= vendor::cCaptureStallUs);
+}
+
+// Unplugging in the middle of a reply forgets it.
+static void test_unplug(){
+    auto c = fresh();
+    c.port.room = vendor::cPacketBytes;
+    auto tag = c.send(Op::Source, (u32)1'000'000);
+    CHECK(tag && c.reply_header(Op::Source, *tag));
+    CHECK(vendor::streaming());
+    tud_umount_cb();
+    CHECK(!vendor::streaming());
+    mock::gUSBVendorTx.clear();
+    c.rxAt = c.rxEnd = 0;
+    c.port.room = UINT32_MAX;
+    CHECK(c.ping(random_bytes(4, 6)));
+}
+
+int main(){
+    test_ping_and_errors();
+    test_sink();
+    test_source();
+    test_order();
+    test_telemetry();
+    test_capture();
+    test_unplug();
+    std::puts("test_vendor: ok");
+}
@@ -0,0 +1,24 @@
+#pragma once
+// Signal measurements shared by the audio filter tests.
+#include "common.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// Least squares fit of a sine at `freq` (cycles/sample) to `y`. Returns {amplitude, SNR in dB of the fit vs the rest}.
+inline std::pair<f64, f64> fit_tone(span<const s16> y, f64 freq){
+    f64 ss = 0, sc = 0, cc = 0, ys = 0, yc = 0;
+    for(size_t i = 0; i < y.size(); i++){
+        f64 s = std::sin(2 * M_PI * freq * i), c = std::cos(2 * M_PI * freq * i);
+        ss += s * s; sc += s * c; cc += c * c; ys += y[i] * s; yc += y[i] * c;
+    }
+    f64 det = ss * cc - sc * sc;
+    f64 a = (ys * cc - yc * sc) / det, b = (yc * ss - ys * sc) / det;
+    f64 signal = 0, noise = 0;
+    for(size_t i = 0; i < y.size(); i++){
+        f64 fit = a * std::sin(2 * M_PI * freq * i) + b * std::cos(2 * M_PI * freq * i);
+        signal += fit * fit;
+        noise += (y[i] - fit) * (y[i] - fit);
+    }
+    return {std::hypot(a, b), 10 * std::log10(signal / std::max(noise, 1e-9))};
+}
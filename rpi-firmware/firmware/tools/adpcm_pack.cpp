@@ -0,0 +1,85 @@
+// Packs WAVs into an IMA-ADPCM clip pack for the firmware (see src/adpcm.hpp and src/mixer.hpp):
+//   adpcm_pack <out.adpcm> <in.wav>...
+// Each clip is named after its file (without the extension, up to 19 characters), which is what `play <name>` takes.
+// Takes 16 bit PCM, mono or stereo (mixed down), at 16..48 kHz. Anything under 48k is resampled up with the
+// firmware's own resampler.
+#include "adpcm.hpp"
+#include "resampler.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+static opt<vec<s16>> read_wav(char const* path){
+    std::ifstream f(path, std::ios::binary);
+    vec<u8> b{std::istreambuf_iterator<char>(f), {}};
+    auto u16_at = [&](size_t i){ return (u32)(b[i] | b[i + 1] << 8); };
+    auto u32_at = [&](size_t i){ return u16_at(i) | u16_at(i + 2) << 16; };
+    if(b.size() < 12 || std::memcmp(&b[0], "RIFF", 4) || std::memcmp(&b[8], "WAVE", 4)){
+        std::fprintf(stderr, "%s: not a WAV\n", path);
+        return {};
+    }
+    u32 channels = 0, rate = 0, bits = 0;
+    for(size_t at = 12; at + 8 <= b.size();){
+        u32 size = u32_at(at + 4);
+        size_t body = at + 8;
+        if(size > b.size() - body){ break; }
+        if(!std::memcmp(&b[at], "fmt ", 4) && size >= 16){
+            u32 tag = u16_at(body);
+            channels = u16_at(body + 2);
+            rate = u32_at(body + 4);
+            bits = u16_at(body + 14);
+            if(tag != 1 && tag != 0xfffe){ bits = 0; } // PCM, or PCM in WAVE_FORMAT_EXTENSIBLE
+        }else if(!std::memcmp(&b[at], "data", 4)){
+            if(bits != 16 || channels < 1 || channels > 2 || rate < 16'000 || rate > 48'000){
+                std::fprintf(stderr, "%s: needs 16 bit PCM, mono or stereo, 16..48 kHz\n", path);
+                return {};
+            }
+            vec<s16> in;
+            for(size_t i = body; i + 2 * channels <= body + size; i += 2 * channels){
+                s32 sum = 0;
+                for(u32 c = 0; c < channels; c++){ sum += (s16)u16_at(i + 2 * c); }
+                in.push_back((s16)(sum / (s32)channels));
+            }
+            if(rate == adpcm::cRate){ return in; }
+            auto r = Resampler::make(rate, adpcm::cRate);
+            vec<s16> out(r.max_out(in.size()));
+            out.resize(r.process(in, out));
+            return out;
+        }
+        at = body + size + (size & 1); // Chunks are padded to even sizes
+    }
+    std::fprintf(stderr, "%s: no audio\n", path);
+    return {};
+}
+
+int main(int argc, char** argv){
+    if(argc < 3){
+        std::fprintf(stderr, "usage: %s <out.adpcm> <in.wav>...\n", argv[0]);
+        return 2;
+    }
+    vec<std::pair<string, vec<s16>>> clips;
+    size_t pcmBytes = 0;
+    for(int i = 2; i < argc; i++){
+        sv path = argv[i];
+        auto name = path.substr(path.find_last_of("/\\") + 1);
+        name = name.substr(0, name.rfind('.'));
+        if(name.empty() || name.size() >= adpcm::PackEntry{}.name.size()){
+            std::fprintf(stderr, "%s: the name must be 1..%zu characters\n", argv[i], adpcm::PackEntry{}.name.size() - 1);
+            return 1;
+        }
+        auto pcm = read_wav(argv[i]);
+        if(!pcm){ return 1; }
+        pcmBytes += pcm->size() * sizeof(s16);
+        std::printf("%-20.*s %6zu ms\n", (int)name.size(), name.data(), pcm->size() * 1000 / adpcm::cRate);
+        clips.emplace_back(string{name}, std::move(*pcm));
+    }
+    auto pack = adpcm::pack(clips);
+    std::ofstream out(argv[1], std::ios::binary);
+    out.write((char const*)pack.data(), pack.size());
+    if(!out){
+        std::fprintf(stderr, "%s: couldn't write\n", argv[1]);
+        return 1;
+    }
+    std::printf("%zu clips, %zu bytes (%zu as PCM)\n", clips.size(), pack.size(), pcmBytes);
+}
@@ -0,0 +1,158 @@
+// Talks to the firmware's vendor bulk interface, "Board Data" (see src/dev/vendor.hpp and vendor_client.hpp):
+//   board_data ping
+//   board_data list
+//   board_data telemetry [count] [period ms]
+//   board_data capture <seconds> <out.wav>
+//   board_data bench [MB]
+// `bench` times Source (device to host) and Sink (host to device), checking what arrived.
+#include "vendor_client.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+using namespace dev::vendor;
+using Clock = std::chrono::steady_clock;
+
+static char const* status_name(opt<Status> s){
+    if(!s){ return "no reply"; }
+    constexpr auto cNames = std::to_array({"ok", "unknown op", "bad length", "not found", "too big", "flash error", "not ready", "busy"});
+    return (u8)*s < cNames.size() ? cNames[(u8)*s] : "unknown status";
+}
+
+static f64 s_since(Clock::time_point start){
+    return std::chrono::duration<f64>(Clock::now() - start).count();
+}
+
+// 16 bit mono PCM. The sizes are filled in by `finish`.
+struct WavWriter{
+    std::ofstream f;
+    u32 rate = 0;
+    u32 samples = 0;
+
+    void header(SelfMut){
+        struct PACKED{
+            char riff[4] = {'R', 'I', 'F', 'F'};
+            u32 size;
+            char wave[8] = {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '};
+            u32 fmtSize = 16;
+            u16 format = 1, channels = 1;
+            u32 rate, byteRate;
+            u16 blockAlign = 2, bits = 16;
+            char data[4] = {'d', 'a', 't', 'a'};
+            u32 dataSize;
+        } h;
+        h.dataSize = self.samples * sizeof(s16);
+        h.size = sizeof(h) - 8 + h.dataSize;
+        h.rate = self.rate;
+        h.byteRate = self.rate * sizeof(s16);
+        self.f.seekp(0);
+        self.f.write((char const*)&h, sizeof(h));
+    }
+    void write(SelfMut, span<const s16> s){
+        self.f.write((char const*)s.data(), s.size_bytes());
+        self.samples += s.size();
+    }
+    void finish(SelfMut){ self.header(); }
+};
+
+static int bench(Client<UsbDevice>& c, u32 mb){
+    u32 bytes = mb << 20;
+    auto start = Clock::now();
+    u32 at = 0;
+    u32 wrong = 0;
+    auto s = c.stream(Op::Source, {(u8 const*)&bytes, sizeof(bytes)}, [&](span<const u8> got){
+        for(u8 b: got){ wrong += b != (u8)at++; }
+    });
+    f64 down = s_since(start);
+    if(s != Status::Ok || wrong > 0){
+        std::fprintf(stderr, "Source: %s, %u bytes wrong\n", status_name(s), (unsigned)wrong);
+        return 1;
+    }
+
+    vec<u8> data(bytes);
+    for(u32 i = 0; i < bytes; i++){ data[i] = (u8)(i * 7 + (i >> 8)); }
+    start = Clock::now();
+    auto crc = c.sink(data);
+    f64 up = s_since(start);
+    if(crc != cobs::crc16(data)){
+        std::fprintf(stderr, crc ? "Sink: CRC mismatch\n" : "Sink: no reply\n");
+        return 1;
+    }
+    std::printf("Device to host: %7.1f KB/s\n", bytes / down / 1024);
+    std::printf("Host to device: %7.1f KB/s\n", bytes / up / 1024);
+    return 0;
+}
+
+int main(int argc, char** argv){
+    if(argc < 2){
+        std::fprintf(stderr, "usage: %s ping|list|telemetry [count] [ms]|capture <seconds> <out.wav>|bench [MB]\n", argv[0]);
+        return 2;
+    }
+    auto dev = UsbDevice::open();
+    if(!dev){
+        std::fprintf(stderr, "Can't open the device's Board Data interface\n");
+        return 1;
+    }
+    Client<UsbDevice> c{.port = std::move(*dev)};
+    sv cmd = argv[1];
+    auto arg = [&](int i, f64 otherwise){ return argc > 2 + i ? std::atof(argv[2 + i]) : otherwise; };
+
+    if(cmd == "ping"){
+        auto start = Clock::now();
+        bool ok = c.ping(std::to_array<u8>({'p', 'i', 'n', 'g'}));
+        std::printf(ok ? "pong in %.0f us\n" : "no reply\n", s_since(start) * 1e6);
+        return ok ? 0 : 1;
+    }else if(cmd == "list"){
+        auto r = c.request(Op::CacheList);
+        if(!r || r->status() != Status::Ok || r->payload.size() < sizeof(CacheInfo)){
+            std::fprintf(stderr, "%s\n", status_name(r ? opt<Status>{r->status()} : opt<Status>{}));
+            return 1;
+        }
+        CacheInfo info;
+        std::memcpy(&info, r->payload.data(), sizeof(info));
+        std::printf("%u of %u sectors free\n", (unsigned)info.free, (unsigned)info.sectors);
+        for(size_t at = sizeof(info); at + sizeof(CacheClip) <= r->payload.size(); at += sizeof(CacheClip)){
+            CacheClip clip;
+            std::memcpy(&clip, r->payload.data() + at, sizeof(clip));
+            std::printf("%016llx %7u frames %3u sectors\n", (unsigned long long)clip.key, (unsigned)clip.frames, (unsigned)clip.sectors);
+        }
+        return 0;
+    }else if(cmd == "telemetry"){
+        auto count = (u32)arg(0, 1);
+        auto periodUs = (u32)(arg(1, 100) * 1000);
+        c.timeoutMs = std::max<u32>(c.timeoutMs, periodUs / 1000 * 2);
+        auto s = c.telemetry(count, periodUs, [](Telemetry ref t){
+            std::printf("%10.3f s  speaker %u/%u %.4f samples/ms, over %u under %u  mic %u us over %u  vad %s %d/%d dB  in %u out %u\n",
+                t.timeUs / 1e6, (unsigned)t.audio.fill, (unsigned)t.audio.capacity, t.audio.feedback / 65536.0,
+                (unsigned)t.audio.overruns, (unsigned)t.audio.underruns, (unsigned)t.audio.micQueuedUs,
+                (unsigned)t.audio.micOverruns, t.voice.speaking ? "speech" : "silence", t.voice.levelDb, t.voice.floorDb,
+                (unsigned)t.rxBytes, (unsigned)t.txBytes);
+            std::fflush(stdout);
+        });
+        if(s != Status::Ok){ std::fprintf(stderr, "%s\n", status_name(s)); }
+        return s == Status::Ok ? 0 : 1;
+    }else if(cmd == "capture" && argc > 3){
+        f64 seconds = arg(0, 0);
+        WavWriter wav{.f = std::ofstream(argv[3], std::ios::binary)};
+        if(!wav.f){
+            std::fprintf(stderr, "Can't write %s\n", argv[3]);
+            return 1;
+        }
+        wav.header();
+        u32 rate = 0;
+        c.telemetry(1, 0, [&](Telemetry ref t){ rate = t.micRate; });
+        if(rate == 0){
+            std::fprintf(stderr, "No reply\n");
+            return 1;
+        }
+        auto s = c.capture((u32)(seconds * rate), [&](CaptureInfo ref info){ wav.rate = info.rate; },
+                           [&](span<const s16> samples){ wav.write(samples); });
+        wav.finish();
+        std::printf("%s: %u samples at %u Hz\n", status_name(s), (unsigned)wav.samples, (unsigned)wav.rate);
+        return s == Status::Ok ? 0 : 1;
+    }else if(cmd == "bench"){
+        return bench(c, (u32)arg(0, 4));
+    }
+    std::fprintf(stderr, "Unknown command %s\n", argv[1]);
+    return 2;
+}
@@ -0,0 +1,123 @@
+// Talks to the firmware over its binary control protocol (see src/ctl_protocol.hpp and ctl_client.hpp):
+//   ctl <port> ping
+//   ctl <port> servo <degrees>
+//   ctl <port> play <clip> | tone <hz> <ms> | stop
+//   ctl <port> stats
+//   ctl <port> events
+//   ctl <port> bench [count]
+// `bench` times pings one at a time against the same pings sent in batches, which is what the protocol is for.
+#include "ctl_client.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace ctl;
+using Clock = std::chrono::steady_clock;
+
+static char const* status_name(opt<Status> s){
+    if(!s){ return "no reply"; }
+    constexpr auto cNames = std::to_array({"ok", "unknown message", "bad length", "bad argument", "busy"});
+    return (u8)*s < cNames.size() ? cNames[(u8)*s] : "unknown status";
+}
+
+static int report(opt<Status> s){
+    std::printf("%s\n", status_name(s));
+    return s == Status::Ok ? 0 : 1;
+}
+
+static f64 us_since(Clock::time_point start){
+    return std::chrono::duration<f64, std::micro>(Clock::now() - start).count();
+}
+
+// `count` pings waited for one by one, then in batches of `batch` sent together.
+static int bench(Client<SerialPort>& c, u32 count){
+    auto start = Clock::now();
+    for(u32 i = 0; i < count; i++){
+        if(!c.ping(i)){
+            std::fprintf(stderr, "Ping %u got no reply\n", (unsigned)i);
+            return 1;
+        }
+    }
+    f64 one = us_since(start) / count;
+
+    constexpr u32 cBatch = 16; // Under the device's reply queue, so it never holds us off
+    start = Clock::now();
+    for(u32 i = 0; i < count; i += cBatch){
+        array<u8, cBatch> seqs;
+        u32 n = std::min(cBatch, count - i);
+        for(u32 j = 0; j < n; j++){ seqs[j] = c.queue(Msg::Ping, Ping{.token = i + j}); }
+        for(u32 j = 0; j < n; j++){
+            auto r = c.wait(seqs[j]);
+            auto p = r ? as<Ping>(r->payload) : opt<Ping>{};
+            if(!p || p->token != i + j){
+                std::fprintf(stderr, "Ping %u got no reply\n", (unsigned)(i + j));
+                return 1;
+            }
+        }
+    }
+    f64 batched = us_since(start) / count;
+    std::printf("One at a time: %8.1f us per command\n", one);
+    std::printf("Batches of %2u: %8.1f us per command (%.1fx)\n", (unsigned)cBatch, batched, one / batched);
+    return 0;
+}
+
+int main(int argc, char** argv){
+    if(argc < 3){
+        std::fprintf(stderr, "usage: %s <port> ping|servo <deg>|play <clip>|tone <hz> <ms>|stop|stats|events|bench [count]\n", argv[0]);
+        return 2;
+    }
+    auto port = SerialPort::open(argv[1]);
+    if(!port){
+        std::fprintf(stderr, "Can't open %s\n", argv[1]);
+        return 1;
+    }
+    Client<SerialPort> c{.port = std::move(*port)};
+    sv cmd = argv[2];
+    auto arg = [&](int i){ return argc > 3 + i ? std::atof(argv[3 + i]) : 0.0; };
+
+    if(cmd == "ping"){
+        auto start = Clock::now();
+        bool ok = c.ping(0x1234);
+        std::printf(ok ? "pong in %.0f us\n" : "no reply\n", us_since(start));
+        return ok ? 0 : 1;
+    }else if(cmd == "servo"){
+        return report(c.servo((f32)arg(0)));
+    }else if(cmd == "play"){
+        return report(c.play((u16)arg(0)));
+    }else if(cmd == "tone"){
+        return report(c.tone((u16)arg(0), (u16)arg(1)));
+    }else if(cmd == "stop"){
+        return report(c.stop());
+    }else if(cmd == "stats"){
+        auto a = c.audio();
+        auto v = c.voice();
+        if(!a || !v){
+            std::fprintf(stderr, "No reply\n");
+            return 1;
+        }
+        std::printf("Speaker: fill %u/%u, feedback %.4f samples/ms, overruns %u, underruns %u\n", (unsigned)a->fill,
+            (unsigned)a->capacity, a->feedback / 65536.0, (unsigned)a->overruns, (unsigned)a->underruns);
+        std::printf("Mic: queued %u us, overruns %u\n", (unsigned)a->micQueuedUs, (unsigned)a->micOverruns);
+        std::printf("VAD: %s, level %d dB, floor %d dB, mute %s\n", v->speaking ? "speech" : "silence", v->levelDb,
+            v->floorDb, v->mute ? "on" : "off");
+        return 0;
+    }else if(cmd == "events"){
+        if(c.subscribe(cEventButton | cEventSpeech) != Status::Ok){
+            std::fprintf(stderr, "Couldn't subscribe\n");
+            return 1;
+        }
+        while(true){
+            auto e = c.next_event(1000);
+            if(!e){ continue; }
+            if(auto b = as<Button>(e->payload); e->msg == Msg::Button && b){
+                std::printf("Button %u: %s\n", (unsigned)b->id, b->pressed ? "pressed" : "released");
+            }else if(e->msg == Msg::Speech && e->payload.size() == 1){
+                std::printf("Speech %s\n", e->payload[0] ? "start" : "end");
+            }
+            std::fflush(stdout);
+        }
+    }else if(cmd == "bench"){
+        return bench(c, argc > 3 ? (u32)std::atoi(argv[3]) : 1000);
+    }
+    std::fprintf(stderr, "Unknown command %s\n", argv[2]);
+    return 2;
+}
@@ -0,0 +1,196 @@
+#pragma once
+// The host's end of the binary control protocol (see src/ctl_protocol.hpp). Header only: include it, and put the
+// firmware's src/ on the include path.
+// Requests are queued and go out together on `flush` (or the first `wait`), so a batch of commands costs one USB
+// transfer and one round trip rather than one each. Replies are matched up by seq, whatever order they come in.
+//   ctl::Client c{*ctl::SerialPort::open("/dev/ttyACM0")};
+//   auto a = c.queue(ctl::Msg::Servo, ctl::Servo{30.f});
+//   auto b = c.queue(ctl::Msg::GetAudio);
+//   c.wait(a); auto stats = c.wait(b);
+#include "ctl_protocol.hpp"
+#include <string>
+#include <chrono>
+#if __has_include(<termios.h>)
+#include <termios.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace ctl{
+    // A Transport has
+    //   bool write(span<const u8>)
+    //   size_t read(span<u8>, u32 timeoutMs): what it got, 0 on a timeout
+    template<typename Transport>
+    struct Client{
+        struct Reply{
+            Msg msg;
+            u8 seq;
+            vec<u8> payload;
+        };
+
+        Transport port;
+        u32 timeoutMs = 1000;
+        vec<u8> batch;            // Queued, not yet written
+        vec<Reply> replies;       // Arrived before anyone waited for them
+        vec<Reply> events;        // Arrived unasked (seq 0)
+        vec<vec<u8>> logs;        // Console messages from a LOG_INTERNED build, their frames joined (see log_decoder.hpp)
+        vec<u8> logPart;          // The frames so far of one that isn't all in
+        vec<std::string> lines;   // Console text from the device
+        u32 badFrames = 0;
+        u8 lastSeq = 0;
+        Parser<256> rx;
+
+        // Queues a request. Returns its seq, for `wait`.
+        u8 queue(SelfMut, Msg msg, span<const u8> payload = {}){
+            self.lastSeq = self.lastSeq == 0xff ? 1 : self.lastSeq + 1; // 0 is for events
+            Wire w;
+            size_t n = pack(msg, self.lastSeq, payload, w);
+            self.batch.insert(self.batch.end(), w.begin(), w.begin() + n);
+            return self.lastSeq;
+        }
+        u8 queue(SelfMut, Msg msg, auto ref payload){
+            static_assert(sizeof(payload) <= cMaxPayload);
+            return self.queue(msg, {(u8 const*)&payload, sizeof(payload)});
+        }
+
+        // Writes everything queued, in one go.
+        bool flush(SelfMut){
+            if(self.batch.empty()){ return true; }
+            bool ok = self.port.write(self.batch);
+            self.batch.clear();
+            return ok;
+        }
+
+        // Reads what the device has sent, for up to `ms`. Returns false on a timeout.
+        bool receive(SelfMut, u32 ms){
+            using Event = decltype(self.rx)::Event;
+            array<u8, 512> buf;
+            size_t n = self.port.read(buf, ms);
+            for(u8 b: span{buf}.first(n)){
+                switch(self.rx.push(b)){
+                    case Event::Line:{
+                        auto line = self.rx.text();
+                        if(line.ends_with('\r')){ line.remove_suffix(1); } // The device ends them "\r\n"
+                        self.lines.emplace_back(line);
+                        break;
+                    }
+                    case Event::Frame:{
+                        auto f = self.rx.decoded();
+                        if(f.msg == Msg::Log){ // seq is how many frames of it are still to come
+                            self.logPart.insert(self.logPart.end(), f.payload.begin(), f.payload.end());
+                            if(f.seq == 0){ self.logs.push_back(std::exchange(self.logPart, {})); }
+                            break;
+                        }
+                        Reply r = {.msg = f.msg, .seq = f.seq, .payload = {f.payload.begin(), f.payload.end()}};
+                        (f.seq == 0 ? self.events : self.replies).push_back(std::move(r));
+                        break;
+                    }
+                    case Event::BadFrame: self.badFrames += 1; break;
+                    default: break;
+                }
+            }
+            return n > 0;
+        }
+
+        // The reply to request `seq`, or nothing if it didn't come in time.
+        opt<Reply> wait(SelfMut, u8 seq){
+            if(!self.flush()){ return {}; }
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(self.timeoutMs);
+            while(true){
+                auto it = std::ranges::find(self.replies, seq, &Reply::seq);
+                if(it != self.replies.end()){
+                    Reply r = std::move(*it);
+                    self.replies.erase(it);
+                    return r;
+                }
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if(left.count() <= 0 || !self.receive((u32)left.count())){ return {}; }
+            }
+        }
+
+        // The next event, waiting up to `ms` for one.
+        opt<Reply> next_event(SelfMut, u32 ms){
+            if(self.events.empty()){ self.receive(ms); }
+            if(self.events.empty()){ return {}; }
+            Reply r = std::move(self.events.front());
+            self.events.erase(self.events.begin());
+            return r;
+        }
+
+        // One request and its reply
+        // -------------------
+        // Requests answered with an Ack: its status, or nothing if none came.
+        opt<Status> command(SelfMut, Msg msg, span<const u8> payload = {}){
+            auto r = self.wait(self.queue(msg, payload));
+            if(!r || r->msg != Msg::Ack || r->payload.size() != 1){ return {}; }
+            return (Status)r->payload[0];
+        }
+        opt<Status> command(SelfMut, Msg msg, auto ref payload){ return self.command(msg, {(u8 const*)&payload, sizeof(payload)}); }
+        // Requests answered with a T.
+        template<typename T> opt<T> get(SelfMut, Msg msg, Msg reply, span<const u8> payload = {}){
+            auto r = self.wait(self.queue(msg, payload));
+            if(!r || r->msg != reply){ return {}; }
+            return as<T>(r->payload);
+        }
+
+        bool ping(SelfMut, u32 token = 0){
+            Ping p = {.token = token};
+            auto r = self.template get<Ping>(Msg::Ping, Msg::Pong, {(u8 const*)&p, sizeof(p)});
+            return r && r->token == token;
+        }
+        opt<Status> servo(SelfMut, f32 degrees){ return self.command(Msg::Servo, Servo{.degrees = degrees}); }
+        opt<Status> play(SelfMut, u16 clip, u16 gain = 0){ return self.command(Msg::Play, Play{.clip = clip, .gain = gain}); }
+        opt<Status> tone(SelfMut, u16 hz, u16 ms, u16 gain = 0){ return self.command(Msg::Tone, Tone{.hz = hz, .ms = ms, .gain = gain}); }
+        opt<Status> stop(SelfMut){ return self.command(Msg::Stop); }
+        opt<Status> vad_mute(SelfMut, bool on){ return self.command(Msg::VadMute, (u8)on); }
+        opt<Status> subscribe(SelfMut, u8 events){ return self.command(Msg::Subscribe, events); }
+        opt<Audio> audio(SelfMut){ return self.template get<Audio>(Msg::GetAudio, Msg::Audio); }
+        opt<Voice> voice(SelfMut){ return self.template get<Voice>(Msg::GetVoice, Msg::Voice); }
+    };
+
+#if __has_include(<termios.h>)
+    // The device's CDC port on Linux/macOS (/dev/ttyACM0, /dev/cu.usbmodem...), raw.
+    struct SerialPort{
+        int fd = -1;
+
+        static opt<SerialPort> open(char const* path){
+            SerialPort p;
+            p.fd = ::open(path, O_RDWR | O_NOCTTY);
+            if(p.fd < 0){ return {}; }
+            termios t;
+            if(tcgetattr(p.fd, &t) != 0){ return {}; }
+            cfmakeraw(&t);
+            t.c_cc[VMIN] = 0;
+            t.c_cc[VTIME] = 0;
+            if(tcsetattr(p.fd, TCSANOW, &t) != 0){ return {}; }
+            tcflush(p.fd, TCIFLUSH); // Whatever the device said before we were listening
+            return p;
+        }
+        SerialPort() = default;
+        SerialPort(SerialPort&& o): fd(std::exchange(o.fd, -1)){}
+        SerialPort& operator=(SerialPort&& o){
+            std::swap(fd, o.fd);
+            return *this;
+        }
+        ~SerialPort(){
+            if(fd >= 0){ ::close(fd); }
+        }
+
+        bool write(SelfMut, span<const u8> bytes){
+            while(!bytes.empty()){
+                auto n = ::write(self.fd, bytes.data(), bytes.size());
+                if(n <= 0){ return false; }
+                bytes = bytes.subspan(n);
+            }
+            return true;
+        }
+        size_t read(SelfMut, span<u8> into, u32 timeoutMs){
+            pollfd p = {.fd = self.fd, .events = POLLIN};
+            if(::poll(&p, 1, (int)timeoutMs) <= 0){ return 0; }
+            auto n = ::read(self.fd, into.data(), into.size());
+            return n > 0 ? (size_t)n : 0;
+        }
+    };
+#endif
+}
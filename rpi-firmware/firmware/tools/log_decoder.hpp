@@ -0,0 +1,207 @@
+#pragma once
+// Turns the console messages of a LOG_INTERNED build (Msg::Log frames, see src/log_ring.hpp) back into text, with
+// the format strings from the firmware's ELF. Header only, like ctl_client.hpp.
+//   auto formats = logring::Formats::load("build/firmware.elf");
+//   if(auto payload = joiner.push(frame.seq, frame.payload)){
+//       auto m = logring::decode(*formats, *payload); // "Button 0: pressed", newline
+//   }
+#include "ctl_protocol.hpp"
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <cstring>
+
+namespace logring{
+    // The .logfmt section of an ELF file: every interned format, at its ID.
+    struct Formats{
+        u64 addr = 0;
+        vec<char> bytes;
+
+        static opt<Formats> load(char const* path){
+            std::ifstream f(path, std::ios::binary);
+            vec<u8> b{std::istreambuf_iterator<char>(f), {}};
+            if(b.size() < 0x34 || std::memcmp(b.data(), "\x7f" "ELF", 4) || b[5] != 1){ return {}; } // Little endian only
+            bool wide = b[4] == 2; // ELF64
+            auto field = [&](size_t at, u32 size) -> u64{
+                u64 v = 0;
+                for(u32 i = 0; i < size && at + i < b.size(); i++){ v |= (u64)b[at + i] << (8 * i); }
+                return v;
+            };
+            u32 word = wide ? 8 : 4;
+            u64 shoff = field(wide ? 0x28 : 0x20, word);
+            u64 shentsize = field(wide ? 0x3a : 0x2e, 2);
+            u64 shnum = field(wide ? 0x3c : 0x30, 2);
+            u64 shstrndx = field(wide ? 0x3e : 0x32, 2);
+            if(shoff + shnum * shentsize > b.size() || shstrndx >= shnum){ return {}; }
+            struct Section{ u64 name, addr, offset, size; };
+            auto section = [&](u64 i) -> Section{
+                size_t at = shoff + i * shentsize;
+                return {.name = field(at, 4), .addr = field(at + (wide ? 0x10 : 0x0c), word),
+                    .offset = field(at + (wide ? 0x18 : 0x10), word), .size = field(at + (wide ? 0x20 : 0x14), word)};
+            };
+            Section names = section(shstrndx);
+            for(u64 i = 0; i < shnum; i++){
+                Section s = section(i);
+                size_t name = names.offset + s.name;
+                if(name >= b.size() || std::strncmp((char const*)&b[name], ".logfmt", b.size() - name) != 0){ continue; }
+                if(s.offset + s.size > b.size()){ return {}; }
+                return Formats{.addr = s.addr, .bytes = {b.begin() + s.offset, b.begin() + s.offset + s.size}};
+            }
+            return {};
+        }
+
+        // The format with this ID, if it's one of them.
+        opt<sv> at(u64 id) const{
+            if(id < addr || id - addr >= bytes.size()){ return {}; }
+            char const* s = bytes.data() + (id - addr);
+            return sv{s, strnlen(s, bytes.size() - (id - addr))};
+        }
+    };
+
+    // Reads the arguments back in the order log_ring.hpp's `put` wrote them.
+    struct ArgReader{
+        span<const u8> in;
+
+        opt<u64> varint(){
+            u64 v = 0;
+            for(u32 shift = 0; shift < 64 && !in.empty(); shift += 7){
+                u8 b = in[0];
+                in = in.subspan(1);
+                v |= (u64)(b & 0x7f) << shift;
+                if(!(b & 0x80)){ return v; }
+            }
+            return {};
+        }
+        opt<s64> integer(){
+            auto v = varint();
+            if(!v){ return {}; }
+            return (s64)(*v >> 1) ^ -(s64)(*v & 1);
+        }
+        opt<f64> real(){
+            if(in.size() < sizeof(f64)){ return {}; }
+            f64 v;
+            std::memcpy(&v, in.data(), sizeof(v));
+            in = in.subspan(sizeof(v));
+            return v;
+        }
+        opt<std::string> text(){
+            auto n = varint();
+            if(!n || *n > in.size()){ return {}; }
+            std::string s{(char const*)in.data(), (size_t)*n};
+            in = in.subspan(*n);
+            return s;
+        }
+    };
+
+    // Puts a message sent in several Msg::Log frames back together. Each frame's seq is how many more follow it.
+    struct Joiner{
+        vec<u8> pending;
+        u8 left = 0; // Frames still to come for `pending`
+
+        // The message's payload, once its last frame is in. A message missing a frame is dropped.
+        opt<vec<u8>> push(u8 seq, span<const u8> payload){
+            if(!pending.empty() && seq + 1 != left){ pending.clear(); } // Lost the rest of it
+            pending.insert(pending.end(), payload.begin(), payload.end());
+            left = seq;
+            if(seq > 0){ return {}; }
+            return std::exchange(pending, {});
+        }
+    };
+
+    struct Message{
+        std::string text;
+        bool newline;
+    };
+
+    // One message (Msg::Log payloads, joined) as printf would have printed it. Arguments missing from it (it was
+    // full) print as "?". Nothing if the payload is broken; a placeholder message if the ID isn't one of the ELF's formats (a
+    // different build?).
+    inline opt<Message> decode(Formats ref formats, span<const u8> payload){
+        ArgReader args{payload};
+        auto id = args.varint();
+        if(!id){ return {}; }
+        Message m = {.newline = (*id & 1) != 0};
+        auto fmt = formats.at(*id >> 2);
+        if(!fmt){
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), "<unknown log format 0x%llx>", (unsigned long long)(*id >> 2));
+            return Message{.text = buf, .newline = true};
+        }
+        if(*id & 2){ // No arguments: printed as it is
+            m.text = *fmt;
+            return m;
+        }
+        char out[256];
+        auto hex = [&](s64 v){
+            std::snprintf(out, sizeof(out), "%llx", (unsigned long long)v);
+            return std::string{out};
+        };
+        auto emit = [&](std::string ref spec, auto... v){
+            int n = std::snprintf(out, sizeof(out), spec.c_str(), v...);
+            m.text.append(out, std::clamp<int>(n, 0, sizeof(out) - 1));
+        };
+        sv f = *fmt;
+        for(size_t i = 0; i < f.size();){
+            if(f[i] != '%'){
+                m.text += f[i++];
+                continue;
+            }
+            if(++i < f.size() && f[i] == '%'){
+                m.text += f[i++];
+                continue;
+            }
+            // %[flags][width][.precision][length]conversion, with * widths taken from the arguments
+            std::string spec = "%";
+            bool missing = false;
+            auto number = [&]{
+                if(i < f.size() && f[i] == '*'){
+                    i++;
+                    auto v = args.integer();
+                    missing |= !v;
+                    spec += std::to_string(v.value_or(0));
+                    return;
+                }
+                while(i < f.size() && f[i] >= '0' && f[i] <= '9'){ spec += f[i++]; }
+            };
+            while(i < f.size() && std::strchr("-+ #0", f[i])){ spec += f[i++]; }
+            number();
+            if(i < f.size() && f[i] == '.'){
+                spec += f[i++];
+                number();
+            }
+            while(i < f.size() && std::strchr("hljztL", f[i])){ i++; } // Everything's 64 bit here
+            if(i == f.size()){ break; }
+            char conv = f[i++];
+            if(missing){
+                m.text += '?';
+                continue;
+            }
+            switch(conv){
+                case 'd': case 'i':
+                    if(auto v = args.integer()){ emit(spec + "lld", (long long)*v); }else{ m.text += '?'; }
+                    break;
+                case 'u': case 'o': case 'x': case 'X':
+                    if(auto v = args.integer()){ emit(spec + "ll" + conv, (unsigned long long)*v); }else{ m.text += '?'; }
+                    break;
+                case 'c':
+                    if(auto v = args.integer()){ emit(spec + conv, (int)*v); }else{ m.text += '?'; }
+                    break;
+                case 'p':
+                    if(auto v = args.integer()){ emit(spec + "s", ("0x" + hex(*v)).c_str()); }else{ m.text += '?'; }
+                    break;
+                case 's':
+                    if(auto v = args.text()){ emit(spec + conv, v->c_str()); }else{ m.text += '?'; }
+                    break;
+                case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+                    if(auto v = args.real()){ emit(spec + conv, *v); }else{ m.text += '?'; }
+                    break;
+                default: // Not a conversion printf knows: as written
+                    m.text += spec;
+                    m.text += conv;
+                    break;
+            }
+        }
+        return m;
+    }
+}
@@ -0,0 +1,70 @@
+// Prints the console of a LOG_INTERNED build (see src/log_ring.hpp), its messages decoded with the firmware's ELF:
+//   logdump <firmware.elf> <port>
+//   logdump <firmware.elf> <capture file>
+// Plain console lines are passed through, and the control protocol's other frames skipped.
+#include "ctl_client.hpp"
+#include "log_decoder.hpp"
+
+using namespace ctl;
+
+static logring::Formats gFormats;
+static Parser<256> gRx;
+static logring::Joiner gJoiner;
+static u32 gBad = 0;
+
+static void feed(span<const u8> bytes){
+    using Event = decltype(gRx)::Event;
+    for(u8 b: bytes){
+        switch(gRx.push(b)){
+            case Event::Line:{
+                auto line = gRx.text();
+                if(line.ends_with('\r')){ line.remove_suffix(1); }
+                std::printf("%.*s\n", (int)line.size(), line.data());
+                break;
+            }
+            case Event::Frame:{
+                auto f = gRx.decoded();
+                if(f.msg != Msg::Log){ break; }
+                auto payload = gJoiner.push(f.seq, f.payload);
+                if(!payload){ break; }
+                auto m = logring::decode(gFormats, *payload);
+                if(!m){
+                    gBad += 1;
+                    break;
+                }
+                std::printf("%s%s", m->text.c_str(), m->newline ? "\n" : "");
+                break;
+            }
+            case Event::BadFrame: gBad += 1; break;
+            default: break;
+        }
+    }
+    std::fflush(stdout);
+}
+
+int main(int argc, char** argv){
+    if(argc < 3){
+        std::fprintf(stderr, "usage: %s <firmware.elf> <port|capture file>\n", argv[0]);
+        return 2;
+    }
+    auto formats = logring::Formats::load(argv[1]);
+    if(!formats){
+        std::fprintf(stderr, "%s: no .logfmt section. Is it a LOG_INTERNED build?\n", argv[1]);
+        return 1;
+    }
+    gFormats = std::move(*formats);
+
+    if(auto port = SerialPort::open(argv[2])){
+        array<u8, 512> buf;
+        while(true){ feed(span{buf}.first(port->read(buf, 1000))); }
+    }
+    std::ifstream f(argv[2], std::ios::binary); // Not a serial port: a capture of one
+    if(!f){
+        std::fprintf(stderr, "Can't open %s\n", argv[2]);
+        return 1;
+    }
+    vec<u8> bytes{std::istreambuf_iterator<char>(f), {}};
+    feed(bytes);
+    if(gBad > 0){ std::fprintf(stderr, "%u corrupt frames\n", (unsigned)gBad); }
+    return 0;
+}
@@ -0,0 +1,234 @@
+#pragma once
+// The host's end of the vendor bulk interface (see src/dev/vendor_protocol.hpp). Header only: include it, and put
+// the firmware's src/ on the include path. UsbDevice needs libusb-1.0.
+// One request at a time. Replies come back as they're made, so a long one (a capture, Source) is handed over in
+// pieces rather than gathered first.
+//   dev::vendor::Client c{*dev::vendor::UsbDevice::open()};
+//   c.capture(48000, [](auto info){ ... }, [](span<const s16> samples){ ... });
+#include "dev/vendor_protocol.hpp"
+#include "cobs.hpp"
+#include <chrono>
+#include <cstring>
+#if __has_include(<libusb.h>)
+#include <libusb.h>
+#endif
+
+namespace dev::vendor{
+    // A payload sent as it is in memory: a packed struct or number, not a container of them.
+    template<typename T> concept Plain = std::is_trivially_copyable_v<T> && !std::ranges::range<T>;
+
+    // A Transport has
+    //   bool write(span<const u8>): one whole message
+    //   size_t read(span<u8>, u32 timeoutMs): what it got, 0 on a timeout
+    template<typename Transport>
+    struct Client{
+        struct Reply{
+            Header h;
+            vec<u8> payload;
+            Status status() const{ return (Status)h.status; }
+        };
+
+        Transport port;
+        u32 timeoutMs = 2000; // Without a byte from the device
+        u16 lastTag = 0;
+        vec<u8> rx = vec<u8>(16384); // A multiple of cPacketBytes, so USB reads never overflow it
+        size_t rxAt = 0, rxEnd = 0;   // What's been read but not yet taken
+
+        // Sends a request. Returns its tag, or nothing if it couldn't be written.
+        opt<u16> send(SelfMut, Op op, span<const u8> payload = {}){
+            self.lastTag += 1;
+            Header h = {.op = (u8)op, .status = 0, .tag = self.lastTag, .length = (u32)payload.size()};
+            vec<u8> msg{(u8 const*)&h, (u8 const*)&h + sizeof(h)};
+            msg.insert(msg.end(), payload.begin(), payload.end());
+            if(!self.port.write(msg)){ return {}; }
+            return self.lastTag;
+        }
+        opt<u16> send(SelfMut, Op op, Plain auto ref payload){ return self.send(op, {(u8 const*)&payload, sizeof(payload)}); }
+
+        // Up to `most` of what the device sent, waiting for some if there's none. Empty on a timeout.
+        // Asks for no more than that, in whole packets: a reply ending on a packet boundary doesn't end a USB read.
+        span<const u8> take(SelfMut, size_t most){
+            if(self.rxAt == self.rxEnd){
+                size_t ask = std::min(self.rx.size(), (most + cPacketBytes - 1) / cPacketBytes * cPacketBytes);
+                self.rxAt = 0;
+                self.rxEnd = self.port.read(span{self.rx}.first(ask), self.timeoutMs);
+            }
+            size_t n = std::min(most, self.rxEnd - self.rxAt);
+            span<const u8> got{self.rx.data() + self.rxAt, n};
+            self.rxAt += n;
+            return got;
+        }
+        bool read_exact(SelfMut, span<u8> into){
+            for(size_t at = 0; at < into.size();){
+                auto got = self.take(into.size() - at);
+                if(got.empty()){ return false; }
+                std::ranges::copy(got, into.begin() + at);
+                at += got.size();
+            }
+            return true;
+        }
+        // Hands `length` bytes of payload to `on_data(span<const u8>)` as they arrive.
+        bool read_payload(SelfMut, u32 length, auto&& on_data){
+            for(u32 left = length; left > 0;){
+                auto got = self.take(left);
+                if(got.empty()){ return false; }
+                on_data(got);
+                left -= got.size();
+            }
+            return true;
+        }
+        // The header of the reply to request `tag`. Earlier replies, to requests given up on, are skipped.
+        opt<Header> reply_header(SelfMut, Op op, u16 tag){
+            while(true){
+                Header h;
+                if(!self.read_exact({(u8*)&h, sizeof(h)})){ return {}; }
+                if(h.op == ((u8)op | cReplyBit) && h.tag == tag){ return h; }
+                if(!self.read_payload(h.length, [](auto){})){ return {}; }
+            }
+        }
+
+        // One request and all of its reply, or nothing if it didn't come in time.
+        opt<Reply> request(SelfMut, Op op, span<const u8> payload = {}){
+            auto tag = self.send(op, payload);
+            auto h = tag ? self.reply_header(op, *tag) : opt<Header>{};
+            if(!h){ return {}; }
+            Reply r = {.h = *h, .payload = vec<u8>(h->length)};
+            if(!self.read_exact(r.payload)){ return {}; }
+            return r;
+        }
+        opt<Reply> request(SelfMut, Op op, Plain auto ref payload){ return self.request(op, {(u8 const*)&payload, sizeof(payload)}); }
+        // A request whose reply's payload goes to `on_data` as it arrives. Its status, or nothing if it didn't all come.
+        opt<Status> stream(SelfMut, Op op, span<const u8> payload, auto&& on_data){
+            auto tag = self.send(op, payload);
+            auto h = tag ? self.reply_header(op, *tag) : opt<Header>{};
+            if(!h || !self.read_payload(h->length, on_data)){ return {}; }
+            return (Status)h->status;
+        }
+
+        bool ping(SelfMut, span<const u8> data){
+            auto r = self.request(Op::Ping, data);
+            return r && r->status() == Status::Ok && std::ranges::equal(r->payload, data);
+        }
+        // `count` Telemetry records, one every `periodUs`, each to `on_record` as it comes.
+        opt<Status> telemetry(SelfMut, u32 count, u32 periodUs, auto&& on_record){
+            TelemetryReq req = {.count = count, .periodUs = periodUs};
+            Telemetry t;
+            size_t fill = 0;
+            return self.stream(Op::Telemetry, {(u8 const*)&req, sizeof(req)}, [&](span<const u8> bytes){
+                for(u8 b: bytes){
+                    ((u8*)&t)[fill++] = b;
+                    if(fill == sizeof(t)){
+                        on_record(t);
+                        fill = 0;
+                    }
+                }
+            });
+        }
+        // `frames` of the mic from now on: `on_info(CaptureInfo)` first, then `on_samples(span<const s16>)` as they come.
+        opt<Status> capture(SelfMut, u32 frames, auto&& on_info, auto&& on_samples){
+            array<u8, sizeof(CaptureInfo)> info;
+            size_t infoFill = 0;
+            opt<u8> odd; // Half a sample left over from the last piece
+            return self.stream(Op::Capture, {(u8 const*)&frames, sizeof(frames)}, [&](span<const u8> bytes){
+                while(infoFill < info.size() && !bytes.empty()){
+                    info[infoFill++] = bytes[0];
+                    bytes = bytes.subspan(1);
+                    if(infoFill == info.size()){ on_info(*(CaptureInfo const*)info.data()); }
+                }
+                if(odd && !bytes.empty()){
+                    s16 s = (s16)(*odd | bytes[0] << 8);
+                    on_samples(span<const s16>{&s, 1});
+                    bytes = bytes.subspan(1);
+                    odd.reset();
+                }
+                vec<s16> samples(bytes.size() / sizeof(s16));
+                std::memcpy(samples.data(), bytes.data(), samples.size() * sizeof(s16));
+                if(!samples.empty()){ on_samples(span<const s16>{samples}); }
+                if(bytes.size() % 2){ odd = bytes.back(); }
+            });
+        }
+        // The device's CRC of `bytes` (cobs::crc16), having sent them through Sink.
+        opt<u16> sink(SelfMut, span<const u8> bytes){
+            auto r = self.request(Op::Sink, bytes);
+            if(!r || r->status() != Status::Ok || r->payload.size() != sizeof(u16)){ return {}; }
+            return (u16)(r->payload[0] | r->payload[1] << 8);
+        }
+    };
+
+#if __has_include(<libusb.h>)
+    // The device's "Board Data" interface, through libusb. On Linux, the user needs access to the device (a udev
+    // rule); on Windows, the interface bound to WinUSB.
+    struct UsbDevice{
+        libusb_context* ctx = nullptr;
+        libusb_device_handle* handle = nullptr;
+        u8 itf = 0;
+        u8 epOut = 0;
+        u8 epIn = 0;
+
+        static opt<UsbDevice> open(u16 vid = cVid, u16 pid = cPid){
+            UsbDevice d;
+            if(libusb_init(&d.ctx) != 0){ return {}; }
+            d.handle = libusb_open_device_with_vid_pid(d.ctx, vid, pid);
+            if(!d.handle){ return {}; }
+            libusb_config_descriptor* config;
+            if(libusb_get_active_config_descriptor(libusb_get_device(d.handle), &config) != 0){ return {}; }
+            bool found = false;
+            for(u8 i = 0; i < config->bNumInterfaces && !found; i++){
+                auto& alt = config->interface[i].altsetting[0];
+                // The Pi reset interface is vendor class too, with no endpoints
+                if(alt.bInterfaceClass != LIBUSB_CLASS_VENDOR_SPEC || alt.bNumEndpoints != 2){ continue; }
+                d.itf = alt.bInterfaceNumber;
+                for(u8 e = 0; e < 2; e++){
+                    u8 addr = alt.endpoint[e].bEndpointAddress;
+                    (addr & LIBUSB_ENDPOINT_IN ? d.epIn : d.epOut) = addr;
+                }
+                found = true;
+            }
+            libusb_free_config_descriptor(config);
+            if(!found){ return {}; }
+            libusb_set_auto_detach_kernel_driver(d.handle, 1);
+            if(libusb_claim_interface(d.handle, d.itf) != 0){ return {}; }
+            return d;
+        }
+        UsbDevice() = default;
+        UsbDevice(UsbDevice&& o): ctx(std::exchange(o.ctx, nullptr)), handle(std::exchange(o.handle, nullptr)),
+                                  itf(o.itf), epOut(o.epOut), epIn(o.epIn){}
+        UsbDevice& operator=(UsbDevice&& o){
+            std::swap(ctx, o.ctx);
+            std::swap(handle, o.handle);
+            itf = o.itf;
+            epOut = o.epOut;
+            epIn = o.epIn;
+            return *this;
+        }
+        ~UsbDevice(){
+            if(handle){
+                libusb_release_interface(handle, itf);
+                libusb_close(handle);
+            }
+            if(ctx){ libusb_exit(ctx); }
+        }
+
+        // A message ending on a packet boundary gets a zero length packet after it, so the device's transfer ends.
+        bool write(SelfMut, span<const u8> bytes){
+            bool zlp = bytes.size() % cPacketBytes == 0;
+            while(!bytes.empty()){
+                int n = 0;
+                int len = (int)std::min<size_t>(bytes.size(), 1 << 20);
+                int e = libusb_bulk_transfer(self.handle, self.epOut, (u8*)bytes.data(), len, &n, 2000);
+                if(n == 0 && e != 0){ return false; }
+                bytes = bytes.subspan(n);
+            }
+            int n;
+            u8 none = 0;
+            return !zlp || libusb_bulk_transfer(self.handle, self.epOut, &none, 0, &n, 2000) == 0;
+        }
+        size_t read(SelfMut, span<u8> into, u32 timeoutMs){
+            int n = 0;
+            int len = (int)(into.size() / cPacketBytes * cPacketBytes);
+            libusb_bulk_transfer(self.handle, self.epIn, into.data(), len, &n, timeoutMs);
+            return (size_t)n;
+        }
+    };
+#endif
+}
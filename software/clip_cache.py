@@ -0,0 +1,226 @@
+# clip_cache.py
+# Replies the doll has already said, kept in its flash so they play again without Gemini/ElevenLabs.
+# Talks to the firmware's vendor bulk interface ("Board Data", see rpi-firmware/firmware/src/dev/vendor.hpp).
+# Needs pyusb and libusb (pip install pyusb). On Windows, bind the "Board Data" interface to WinUSB with Zadig first.
+import hashlib, struct, threading
+import numpy as np
+
+from config import VOICE_ID, EL_MODEL_ID, VERBOSE
+
+VID, PID = 0x2E8A, 0x0010
+RATE = 48000  # Every clip on the device
+
+OP_PING, OP_LIST, OP_PLAY, OP_PUT, OP_DROP = 0x01, 0x10, 0x11, 0x12, 0x13
+REPLY_BIT = 0x80
+STATUS = ["ok", "unknown op", "bad length", "not found", "too big", "flash error", "not ready", "busy"]
+HEADER = struct.Struct("<BBHI")  # op, status, tag, length
+
+
+# ===== IMA-ADPCM, as adpcm.hpp decodes it =====
+STEPS = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+    107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+    5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+    27086, 29794, 32767,
+]
+INDEX_STEPS = [-1, -1, -1, -1, 2, 4, 6, 8]
+BLOCK_BYTES = 256
+BLOCK_FRAMES = 505
+
+
+def adpcm_size(frames: int) -> int:
+    whole, rest = divmod(frames, BLOCK_FRAMES)
+    return whole * BLOCK_BYTES + (4 + rest // 2 if rest else 0)
+
+
+def adpcm_encode(pcm: np.ndarray) -> bytes:
+    """Blocks of 505 frames, each starting from its first sample and the step index the last one ended on.
+    (tools/adpcm_pack searches for the best start index instead; that's too slow in Python for a small gain.)"""
+    samples = pcm.astype(np.int32).tolist()
+    out = bytearray()
+    index = 0
+    for at in range(0, len(samples), BLOCK_FRAMES):
+        block = samples[at:at + BLOCK_FRAMES]
+        predictor = block[0]
+        out += struct.pack("<hBB", predictor, index, 0)
+
+        def code(x):
+            nonlocal predictor, index
+            step = STEPS[index]
+            diff = x - predictor
+            c = 8 if diff < 0 else 0
+            diff = abs(diff)
+            for bit in (4, 2, 1):
+                if diff >= step:
+                    c |= bit
+                    diff -= step
+                step >>= 1
+            # Decode it, so the state follows the device's exactly
+            step = STEPS[index]
+            d = step >> 3
+            if c & 4: d += step
+            if c & 2: d += step >> 1
+            if c & 1: d += step >> 2
+            predictor = max(-32768, min(predictor - d if c & 8 else predictor + d, 32767))
+            index = max(0, min(index + INDEX_STEPS[c & 7], len(STEPS) - 1))
+            return c
+
+        for i in range(1, len(block), 2):
+            lo = code(block[i])
+            hi = code(block[i + 1]) if i + 1 < len(block) else 0
+            out.append(lo | hi << 4)
+    return bytes(out)
+
+
+def upsample(pcm: np.ndarray, rate: int) -> np.ndarray:
+    """`rate` -> 48k for integer ratios (ElevenLabs' 16k, 24k): zero stuffing then a windowed-sinc low-pass."""
+    if rate == RATE:
+        return pcm
+    if RATE % rate:
+        raise ValueError(f"Can't resample {rate} Hz to {RATE} Hz")
+    factor = RATE // rate
+    taps = 24 * factor + 1
+    n = np.arange(taps) - taps // 2
+    fir = np.sinc(n / factor) * np.kaiser(taps, 8.0)  # Cut off at the source's Nyquist, unity gain after stuffing
+    stuffed = np.zeros(len(pcm) * factor)
+    stuffed[::factor] = pcm
+    y = np.convolve(stuffed, fir, mode="same")
+    return np.clip(np.round(y), -32768, 32767).astype(np.int16)
+
+
+def key_for(text: str) -> int:
+    """The cache key for a reply: the same words in the same voice are the same clip."""
+    h = hashlib.blake2b(f"{VOICE_ID}\0{EL_MODEL_ID}\0{text.strip()}".encode(), digest_size=8)
+    return int.from_bytes(h.digest(), "little")
+
+
+class CacheError(Exception):
+    pass
+
+
+class LinkError(CacheError):
+    """The device didn't answer (timed out or unplugged). It's no use carrying on with it."""
+    pass
+
+
+class ClipCache:
+    """The device's clip cache. Thread safe: one request at a time."""
+
+    def __init__(self, dev, ep_out, ep_in):
+        self.dev, self.ep_out, self.ep_in = dev, ep_out, ep_in
+        self.lock = threading.Lock()
+        self.tag = 0
+        self.rx = bytearray()
+        self.frames: dict[int, int] = {}  # What the device holds, as of the last `list`/`put`
+        self.list()
+
+    @staticmethod
+    def open() -> "ClipCache | None":
+        try:
+            import usb.core
+        except ImportError:
+            print("[cache] pyusb isn't installed (pip install pyusb). Not caching replies")
+            return None
+        try:
+            dev = usb.core.find(idVendor=VID, idProduct=PID)
+            if dev is None:
+                return None
+            for intf in dev.get_active_configuration():
+                eps = list(intf)
+                if intf.bInterfaceClass != 0xFF or len(eps) != 2:  # The Pi reset interface is vendor class too, with none
+                    continue
+                ep_out = next(e for e in eps if not e.bEndpointAddress & 0x80)
+                ep_in = next(e for e in eps if e.bEndpointAddress & 0x80)
+                cache = ClipCache(dev, ep_out, ep_in)
+                print(f"[cache] {len(cache.frames)} clips on the device")
+                return cache
+        except Exception as e:
+            print(f"[cache] Couldn't open the device's data interface: {e}")
+        return None
+
+    def _read(self, n: int, timeout: int) -> bytes:
+        mps = self.ep_in.wMaxPacketSize
+        while len(self.rx) < n:
+            # No more than is needed, in whole packets: a reply ending on a packet boundary doesn't end a read
+            want = -(-(n - len(self.rx)) // mps) * mps
+            self.rx += bytes(self.ep_in.read(min(want, mps * 16), timeout))
+        out, self.rx = bytes(self.rx[:n]), self.rx[n:]
+        return out
+
+    def request(self, op: int, payload: bytes = b"", timeout: int = 2000) -> bytes:
+        """Sends a request and waits for its reply's payload. Raises CacheError if the device says no, and LinkError
+        if it can't be reached."""
+        import usb.core
+        with self.lock:
+            self.tag = (self.tag + 1) & 0xFFFF
+            msg = HEADER.pack(op, 0, self.tag, len(payload)) + payload
+            try:
+                self.ep_out.write(msg, timeout)
+                if len(msg) % self.ep_out.wMaxPacketSize == 0:  # The device's transfers only end early on a short packet
+                    self.ep_out.write(b"", timeout)
+                while True:
+                    rop, status, tag, length = HEADER.unpack(self._read(HEADER.size, timeout))
+                    body = self._read(length, timeout)
+                    if rop == op | REPLY_BIT and tag == self.tag:
+                        break
+            except usb.core.USBError as e:  # USBTimeoutError too
+                self.rx.clear()  # Whatever's left of a reply can't be trusted
+                raise LinkError(str(e)) from e
+            if status != 0:
+                raise CacheError(STATUS[status] if status < len(STATUS) else f"status {status}")
+            return body
+
+    def ping(self, data: bytes = b"ping") -> bool:
+        return self.request(OP_PING, data) == data
+
+    def list(self) -> dict[int, int]:
+        """{key: frames} of every clip on the device."""
+        body = self.request(OP_LIST)
+        sectors, free, sector_bytes, count = struct.unpack_from("<IIII", body)
+        self.frames = {}
+        for i in range(count):
+            key, frames, _ = struct.unpack_from("<QII", body, 16 + 16 * i)
+            self.frames[key] = frames
+        if VERBOSE:
+            print(f"[cache] {count} clips, {free * sector_bytes // 1024} of {sectors * sector_bytes // 1024} KB free")
+        return self.frames
+
+    def play(self, key: int, gain: int = 0) -> float | None:
+        """Plays clip `key` on the device. Its length in seconds, or None if it isn't there. `gain` is Q15 (0: default).
+        Raises LinkError if the device can't be reached."""
+        if key not in self.frames:
+            return None
+        try:
+            self.request(OP_PLAY, struct.pack("<QH", key, gain))
+        except LinkError:
+            raise
+        except CacheError as e:
+            if str(e) == "not found":
+                self.frames.pop(key, None)
+            return None
+        return self.frames[key] / RATE
+
+    def put(self, key: int, pcm: bytes, rate: int) -> bool:
+        """Uploads 16 bit mono PCM at `rate` as clip `key`, evicting what was played longest ago if it's full.
+        The device's speaker and mic stall while its flash is written (about 50ms per 4KB), so upload when quiet.
+        Raises LinkError if the device can't be reached."""
+        samples = upsample(np.frombuffer(pcm, dtype=np.int16), rate)
+        if len(samples) == 0:
+            return False
+        blocks = adpcm_encode(samples)
+        assert len(blocks) == adpcm_size(len(samples))
+        try:
+            self.request(OP_PUT, struct.pack("<QI", key, len(samples)) + blocks, timeout=30_000)
+        except LinkError:
+            raise
+        except CacheError as e:
+            print(f"[cache] Upload failed: {e}")
+            return False
+        self.list()  # Others may have been evicted
+        return True
+
+    def drop(self, key: int | None = None):
+        """Forgets clip `key`, or every clip."""
+        self.request(OP_DROP, b"" if key is None else struct.pack("<Q", key))
+        self.list()
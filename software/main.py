@@ -4,6 +4,7 @@ import sounddevice as sd
 
 from config import (
     OUTPUT_FILE, OUTPUT_DIR, VERBOSE, CHUNK_MS, TARGET_SR, CHANNELS, DG_API_KEY,
+    CLIP_CACHE, CLIP_CACHE_MAX_CHARS,
 )
 from stt import (
     choose_device, Chunker, deepgram_url, ws_connect,
@@ -11,6 +12,7 @@ from stt import (
 )
 from llm import gemini_reply
 from tts import tts_streaming_ws
+import clip_cache
 
 
 # ============================================================
@@ -79,6 +81,8 @@ N_WORKERS = int(os.getenv("N_WORKERS", "1"))
 
 CTRL_Q: "asyncio.Queue[str]" = asyncio.Queue()   # values: "tts_done"
 
+CACHE: "clip_cache.ClipCache | None" = None      # The device's clip cache, when it's plugged in
+
 def _append(path: str, text: str):
     with open(path, "a", encoding="utf-8") as f:
         f.write(text)
@@ -173,6 +177,18 @@ async def keyloop():
 # =======================
 # Worker: LLM + TTS
 # =======================
+async def cache_call(method, *args):
+    """Runs a ClipCache method off the event loop. If the device stops answering, the cache is given up on for the
+    session (replies go through TTS), and None is returned."""
+    global CACHE
+    try:
+        return await asyncio.to_thread(method, *args)
+    except clip_cache.LinkError as e:
+        print(f"[cache] ❌ Lost the device ({e}). Not caching replies")
+        CACHE = None
+        return None
+
+
 async def process_job_worker(worker_id: int):
     while not SHOULD_STOP.is_set():
         try:
@@ -193,14 +209,32 @@ async def process_job_worker(worker_id: int):
             header_reply = f"--- Gemini reply @ {ts:%Y-%m-%d %H:%M:%S} ---\n{reply}\n"
             write_reply = asyncio.create_task(asyncio.to_thread(_append, OUTPUT_FILE, header_reply))
 
+            # Said before: the device plays it from flash, no ElevenLabs round trip
+            cache = CACHE
+            cacheable = cache is not None and len(reply) <= CLIP_CACHE_MAX_CHARS
+            key = clip_cache.key_for(reply)
+            seconds = await cache_call(cache.play, key) if cacheable else None
+            if seconds is not None:
+                print(f"[worker{worker_id}] 🤖 {len(reply)} chars — ✅ played from the device's cache")
+                await asyncio.sleep(seconds)
+                await write_reply
+                continue
+
+            pcm: list[bytes] = []
             try:
-                saved = await tts_streaming_ws(reply, save_wav=False)
+                saved = await tts_streaming_ws(reply, save_wav=False, collect=pcm if cacheable else None)
                 if saved:
                     print(f"[worker{worker_id}] 🤖 {len(reply)} chars — ✅ TTS saved: {os.path.abspath(saved)}")
                 else:
                     print(f"[worker{worker_id}] 🤖 {len(reply)} chars — ✅ TTS streamed")
             except Exception as e:
                 print(f"[worker{worker_id}] ❌ TTS (stream): {e}")
+                pcm.clear()
+
+            # Uploading stalls the device's audio for a moment, so it waits until the reply has been said
+            if pcm and CACHE is cache and await cache_call(cache.put, key, b"".join(pcm), 16000):
+                if VERBOSE:
+                    print(f"[cache] Cached {key:016x}")
 
             await write_reply
         finally:
@@ -260,7 +294,7 @@ async def stt_run_forever():
 # Main
 # =======================
 async def main():
-    global FLUSH_REQUEST
+    global FLUSH_REQUEST, CACHE
     di, info = choose_device()
     src = int(info.get("default_samplerate") or 48000)
     src = src if src >= 8000 else 16000
@@ -269,6 +303,9 @@ async def main():
     print(f"[file ] {os.path.abspath(OUTPUT_FILE)}")
     print(f"[tts  ] {os.path.abspath(OUTPUT_DIR)}")
     print("[keys ] HOLD SPACE to record; RELEASE to finalize & send. (Ctrl+C to quit)")
+    if CLIP_CACHE:
+        CACHE = clip_cache.ClipCache.open()
+        print(f"[cache] {'Replies are cached on the device' if CACHE else 'No device to cache replies on'}")
 
     chunker = Chunker(src, AUDIO_Q, sending_event=SENDING_AUDIO)
 
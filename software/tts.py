@@ -6,7 +6,8 @@ from config import (
     WS_PING_INTERVAL, WS_PING_TIMEOUT, WS_MAX_SIZE, VERBOSE
 )
 
-async def tts_streaming_ws(text: str, save_wav: bool = False) -> str | None:
+async def tts_streaming_ws(text: str, save_wav: bool = False, collect: list[bytes] | None = None) -> str | None:
+    """Speaks `text` on the PC. The 16 kHz PCM chunks are appended to `collect` as they play, if given."""
     if not text.strip():
         raise ValueError("No text to synthesize.")
     if not ELEVEN_API_KEY:
@@ -81,6 +82,8 @@ async def tts_streaming_ws(text: str, save_wav: bool = False) -> str | None:
                 await asyncio.to_thread(out_stream.write, np.frombuffer(pcm_bytes, dtype=np.int16))
                 if writer is not None:
                     writer.writeframes(pcm_bytes)
+                if collect is not None:
+                    collect.append(pcm_bytes)
 
     finally:
         try: